@@ -9,6 +9,8 @@ that the API is still in development and might change until the first stable rel
 # Core classes
 """
 
-__all__ = ['SovMap', 'ColumnWorker', 'SolarSystem', 'Region', 'Owner', 'MapOwnerLabel', 'OwnerImage', 'stream', 'table']
+__all__ = ['SovMap', 'ColumnWorker', 'SolarSystem', 'Region', 'Owner', 'MapOwnerLabel', 'OwnerImage', 'load_image',
+           'RenderFuture', 'Topology', 'OwnerHistory', 'TileMerger', 'create_tile_jobs', 'execute_tile_job', 'stream',
+           'table']
 
 from ._map import *
\ No newline at end of file
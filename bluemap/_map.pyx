@@ -1,7 +1,9 @@
 # distutils: language = c++
 # cython: linetrace=True
 import os
+import threading
 import weakref
+from concurrent.futures import Future
 from pathlib import Path
 from typing import Generator, TYPE_CHECKING, Union, Callable, Iterable, Literal
 
@@ -10,8 +12,10 @@ if TYPE_CHECKING:
     from PIL.ImageFont import FreeTypeFont, ImageFont
 
 from libc.math cimport sqrt
-from libc.stdlib cimport free, malloc
+from libc.stdlib cimport calloc, free, malloc
+from libc.string cimport memcpy
 from libcpp cimport bool as cbool
+from libcpp.map cimport map as cmap
 from libcpp.memory cimport make_shared, shared_ptr, unique_ptr
 from libcpp.string cimport string
 from libcpp.vector cimport vector
@@ -19,7 +23,8 @@ from libcpp.vector cimport vector
 from .stream import StreamReader, StreamWriter
 from .stream cimport StreamReader, StreamWriter
 
-__all__ = ['SovMap', 'ColumnWorker', 'SolarSystem', 'Region', 'Owner', 'MapOwnerLabel', 'OwnerImage']
+__all__ = ['SovMap', 'ColumnWorker', 'SolarSystem', 'Region', 'Owner', 'MapOwnerLabel', 'OwnerImage', 'load_image',
+           'RenderFuture', 'Topology', 'OwnerHistory', 'TileMerger', 'create_tile_jobs', 'execute_tile_job']
 
 cdef extern from "stdint.h":
     ctypedef unsigned char uint8_t
@@ -57,6 +62,56 @@ cdef extern from "<mutex>" namespace "std" nogil:
     cdef cppclass lock_guard[T]:
         lock_guard(mutex mm)
 
+cdef extern from "Image.h":
+    ctypedef enum ImageFormat "ImageFormat":
+        FORMAT_PNG "ImageFormat::PNG"
+        FORMAT_QOI "ImageFormat::QOI"
+        FORMAT_RAW "ImageFormat::RAW"
+
+    cdef struct CRGBAColor "Color":
+        uint8_t red
+        uint8_t green
+        uint8_t blue
+        uint8_t alpha
+
+    cdef cppclass CImage "Image":
+        CImage(unsigned int width, unsigned int height) except +
+        void read(const char *filename) except + nogil
+        # Transfers the ownership of the ptr
+        uint8_t *retrieve_data()
+        unsigned int get_width()
+        unsigned int get_height()
+
+cdef extern from "Stats.h" namespace "bluemap":
+    cdef cppclass CRenderStats "bluemap::RenderStats":
+        cbool enabled
+        cmap[string, double] phase_ms
+        vector[double] worker_busy_ms
+        unsigned long long pixels
+        unsigned long long systems_visited
+        unsigned long long owner_contributions
+        unsigned long long callback_calls
+        double gil_wait_ms
+        double image_mutex_wait_ms
+        double map_mutex_wait_ms
+
+cdef extern from "Topology.h" namespace "bluemap":
+    cdef cppclass CTopology "bluemap::Topology":
+        unsigned int get_width() const
+        unsigned int get_height() const
+        size_t size() const
+        size_t jump_count() const
+
+cdef extern from "Kernel.h" namespace "bluemap":
+    cdef cppclass CKernelConfig "bluemap::KernelConfig":
+        double parameter
+        double cutoff
+        double threshold
+
+        @staticmethod
+        CKernelConfig from_name(const string& name, double parameter, double cutoff, double threshold) except +
+        string get_name()
+
 cdef extern from "Map.h" namespace "bluemap":
     ctypedef unsigned long long id_t
 
@@ -71,6 +126,21 @@ cdef extern from "Map.h" namespace "bluemap":
         Color(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha)
         Color(uint8_t red, uint8_t green, uint8_t blue)
 
+    cdef struct CSystemStyle "bluemap::SystemStyle":
+        CRGBAColor jump_system
+        CRGBAColor jump_constellation
+        CRGBAColor jump_region
+        CRGBAColor no_sov
+        cbool antialias
+
+    cdef struct CViewport "bluemap::Viewport":
+        double x
+        double y
+        double width
+        double height
+        unsigned int output_width
+        unsigned int output_height
+
     # All listed methods are thread-safe and memory safe. All operations that will modify or retrieve data from the map
     # will be blocked as long as any worker is rendering.
     # noinspection PyPep8Naming,PyUnresolvedReferences
@@ -84,6 +154,42 @@ cdef extern from "Map.h" namespace "bluemap":
             CMapOwnerLabel()
             CMapOwnerLabel(id_t owner_id)
 
+        struct CPrecisionDifference "PrecisionDifference":
+            unsigned int x
+            unsigned int y
+            id_t double_owner
+            id_t float_owner
+            int double_alpha
+            int float_alpha
+
+        struct CPrecisionReport "PrecisionReport":
+            unsigned long long pixels
+            unsigned long long owner_differences
+            unsigned long long alpha_differences
+            int max_alpha_difference
+            vector[CMap.CPrecisionDifference] differences
+
+        struct CEngineDifference "EngineDifference":
+            unsigned int x
+            unsigned int y
+            id_t reference_owner
+            id_t engine_owner
+            double reference_influence
+            double engine_influence
+
+        struct CEngineReport "EngineReport":
+            unsigned long long pixels
+            unsigned long long owner_differences
+            double max_influence_error
+            double mean_influence_error
+            vector[CMap.CEngineDifference] differences
+
+        struct CTerritoryDiff "TerritoryDiff":
+            vector[id_t] owners
+            vector[unsigned long long] transfers
+            vector[unsigned long long] gained
+            vector[unsigned long long] lost
+
         # noinspection PyPep8Naming
         cppclass CColumnWorker "ColumnWorker":
             CColumnWorker(CMap *map, unsigned int start_x, unsigned int end_x) except +
@@ -97,25 +203,48 @@ cdef extern from "Map.h" namespace "bluemap":
         CMap.CColumnWorker * create_worker(unsigned int start_x, unsigned int end_x) except +
 
         void render_multithreaded() except +
-        void calculate_influence() except +
-        void load_data(const string& filename) except +
+        void reset_render_state() nogil
+        void cancel_render() nogil
+        cbool is_render_cancelled() nogil
+        unsigned long long get_rendered_pixels() nogil
+        CRenderStats get_stats() nogil
+        void reset_stats() nogil
+        void start_trace() nogil
+        void stop_trace() nogil
+        void save_trace(const string& filename) except + nogil
+        void composite(unsigned int thread_count) except + nogil
+        # The heavy functions are declared nogil, Python callbacks acquire the GIL on their own
+        void calculate_influence() except + nogil
+        void load_data(const string& filename) except + nogil
         # Old API, will be removed in the future
         void load_data(const vector[COwnerData]& owners,
                        const vector[CSolarSystemData]& solar_systems,
-                       const vector[CJumpData]& jumps) except +
+                       const vector[CJumpData]& jumps) except + nogil
         void set_data(const vector[shared_ptr[COwner]] & owners,
                       const vector[shared_ptr[CSolarSystem]] & solar_systems,
-                      const vector[CJumpData] & jumps)  except +
-        void update_size(unsigned int width, unsigned int height, unsigned int sample_rate) except +
-        void save(const string& path) except +
+                      const vector[CJumpData] & jumps)  except + nogil
+        void update_size(unsigned int width, unsigned int height, unsigned int sample_rate) except + nogil
+        void save(const string& path, ImageFormat format, int level, unsigned int thread_count) except + nogil
 
-        vector[CMap.CMapOwnerLabel] calculate_labels() except +
+        vector[CMap.CMapOwnerLabel] calculate_labels() except + nogil
 
         # All three functions will transfer the ownership of the ptr
-        uint8_t *retrieve_image() except +
-        id_t *create_owner_image() except +
+        uint8_t *retrieve_image() except + nogil
+        id_t *create_owner_image() except + nogil
+        float *retrieve_influence_image() except + nogil
+        void write_owner_image(id_t *target, Py_ssize_t row_stride, Py_ssize_t column_stride) except + nogil
+        # The target must stay valid until release_image_target is called
+        void set_image_target(uint8_t *target) except + nogil
+        void render_viewport(const CViewport& viewport, uint8_t *target, id_t *owner_target,
+                             Py_ssize_t owner_row_stride, Py_ssize_t owner_column_stride,
+                             unsigned int thread_count) except + nogil
+        void draw_systems(uint8_t *target, const CSystemStyle& style, unsigned int thread_count) except + nogil
+        vector[id_t] get_uncolored_system_owners() except + nogil
+        void release_image_target() except + nogil
+        void set_export_influence(cbool export_influence) except +
+        cbool is_export_influence()
         # Will raise exception if size does not match (ptr will still be deallocated)
-        void set_old_owner_image(id_t *old_owner_image, unsigned int width, unsigned int height) except +
+        void set_old_owner_image(id_t *old_owner_image, unsigned int width, unsigned int height) except + nogil
 
         ### The fancy shit ###
         # Takes a function (double, bool, id_t) -> double
@@ -124,9 +253,30 @@ cdef extern from "Map.h" namespace "bluemap":
         void set_influence_to_alpha_function(object pyfunc) except +
         void set_generate_owner_color_function(object pyfunc) except +
 
+        shared_ptr[const CTopology] create_topology() except + nogil
+        void set_topology(shared_ptr[const CTopology] topology) except + nogil
+        void load_snapshot(const vector[shared_ptr[COwner]] & owners,
+                           const vector[CSolarSystemData] & solar_systems) except + nogil
+        size_t shared_state_size() except + nogil
+        void export_shared_state(uint8_t *target, size_t size) except + nogil
+        void attach_shared_state(const uint8_t *data, size_t size) except + nogil
+        vector[shared_ptr[COwner]] get_owners() except +
+
         unsigned int get_width()
         unsigned int get_height()
         cbool has_old_owner_image()
+        int get_border_alpha()
+        void set_border_alpha(int border_alpha) except +
+        CKernelConfig get_kernel() except + nogil
+        void set_kernel(const CKernelConfig& kernel) except + nogil
+        cbool is_single_precision() except + nogil
+        void set_single_precision(cbool single_precision) except + nogil
+        CMap.CPrecisionReport compare_precision(unsigned int thread_count, size_t max_reported) except + nogil
+        string get_engine() except + nogil
+        void set_engine(const string& name) except + nogil
+        void render_engine(unsigned int thread_count) except + nogil
+        CMap.CEngineReport compare_engine(unsigned int thread_count, size_t max_reported) except + nogil
+        CMap.CTerritoryDiff diff_territory(id_t region_id, unsigned int thread_count) except + nogil
 
     cdef struct COwnerData "bluemap::OwnerData":
         id_t id
@@ -175,13 +325,51 @@ cdef extern from "Map.h" namespace "bluemap":
         unsigned int get_y() const
         vector[OwnerInfluenceTuple] get_influences()
 
+cdef extern from "History.h" namespace "bluemap":
+    cdef cppclass COwnerHistory "bluemap::OwnerHistory":
+        COwnerHistory(unsigned int width, unsigned int height, unsigned int keyframe_interval) except +
+        void append(long long date, const id_t *raster) except + nogil
+        size_t find(long long date) nogil
+        void reconstruct(size_t index, id_t *target, unsigned int thread_count) except + nogil
+        size_t size()
+        vector[long long] get_dates()
+        size_t run_count()
+        unsigned int get_width()
+        unsigned int get_height()
+        void save(const string& filename) except + nogil
+        void load(const string& filename) except + nogil
+
+cdef extern from "Tiles.h" namespace "bluemap":
+    cdef cppclass CTileJob "bluemap::TileJob":
+        pass
+
+    cdef cppclass CTileResult "bluemap::TileResult":
+        pass
+
+    string serialize_tile_job(const CTileJob& job) except +
+    CTileResult parse_tile_result(const string& data) except + nogil
+    vector[CTileJob] create_tile_jobs_c "bluemap::create_tile_jobs"(
+            const string& state_path, unsigned int width, unsigned int height, unsigned int tile_size,
+            unsigned int sample_rate, int border_alpha) except +
+    string execute_serialized_tile_job(const string& job) except + nogil
+
+    cdef cppclass CTileMerger "bluemap::TileMerger":
+        CTileMerger(unsigned int width, unsigned int height, unsigned int sample_rate) except +
+        void add(const CTileResult& tile) except + nogil
+        const vector[uint8_t]& get_image()
+        const vector[id_t]& get_owners()
+        vector[CMap.CMapOwnerLabel] get_labels() except + nogil
+        size_t get_covered_pixels()
+        unsigned int get_width()
+        unsigned int get_height()
+
 cdef class BufferWrapper:
     cdef void * data_ptr
     cdef Py_ssize_t width
     cdef Py_ssize_t height
     cdef Py_ssize_t channels
     cdef Py_ssize_t itemsize
-    # 1 = uint8_t, 2 = id_t
+    # 1 = uint8_t, 2 = id_t, 3 = float
     cdef int dtype
 
     cdef Py_ssize_t shape[3]
@@ -208,6 +396,8 @@ cdef class BufferWrapper:
             self.itemsize = 1
         elif dtype == 2:
             self.itemsize = 8
+        elif dtype == 3:
+            self.itemsize = 4
         else:
             self.itemsize = 1
 
@@ -230,6 +420,8 @@ cdef class BufferWrapper:
             buffer.format = 'B'
         elif self.dtype == 2:
             buffer.format = 'Q'
+        elif self.dtype == 3:
+            buffer.format = 'f'
         else:
             buffer.format = 'c'
         buffer.internal = NULL
@@ -273,6 +465,10 @@ cdef class BufferWrapper:
             return (
                 <id_t *> (<char *> self.data_ptr + x * self.strides[1] + y * self.strides[0] + c * self.strides[2])
             )[0]
+        elif self.dtype == 3:
+            return (
+                <float *> (<char *> self.data_ptr + x * self.strides[1] + y * self.strides[0] + c * self.strides[2])
+            )[0]
         else:
             return (<char *> self.data_ptr)[x * self.strides[1] + y * self.strides[0] + c * self.strides[2]]
 
@@ -281,6 +477,7 @@ cdef class BufferWrapper:
             raise ValueError("Buffer is not allocated")
         cdef uint8_t val_ui8
         cdef id_t val_id
+        cdef float val_float
         cdef char val_char
         if self.dtype == 1:
             val_ui8 = value
@@ -293,6 +490,11 @@ cdef class BufferWrapper:
             (
                 <id_t *> (<char *> self.data_ptr + x * self.strides[1] + y * self.strides[0] + c * self.strides[2])
             )[0] = val_id
+        elif self.dtype == 3:
+            val_float = value
+            (
+                <float *> (<char *> self.data_ptr + x * self.strides[1] + y * self.strides[0] + c * self.strides[2])
+            )[0] = val_float
         else:
             val_char = value
             (<char *> self.data_ptr)[x * self.strides[1] + y * self.strides[0] + c * self.strides[2]] = val_char
@@ -622,7 +824,7 @@ cdef class Owner:
             self.c_data = shared_ptr[COwner](new COwner(
                 id_, name.encode("utf-8"), color[0], color[1], color[2], npc))
         else:
-            self.c_data = shared_ptr[COwner](new COwner(id=id_, name=name.encode("utf-8"), is_npc=npc))
+            self.c_data = shared_ptr[COwner](new COwner(id_, name.encode("utf-8"), npc))
 
     @property
     def id(self):
@@ -660,6 +862,32 @@ cdef class Owner:
     def name(self, value: str):
         self.c_data.get().set_name(value.encode("utf-8"))
 
+cdef class Topology:
+    """
+    The static part of a map (the solar systems with their coordinates and the jumps), created with
+    SovMap.create_topology(). It is immutable and can be shared by any number of maps of the same size, which then only
+    store the ownership of the systems, see SovMap.load_snapshot().
+    """
+    cdef shared_ptr[const CTopology] c_data
+
+    def __init__(self):
+        raise TypeError("Topology objects are created with SovMap.create_topology()")
+
+    @property
+    def width(self) -> int:
+        return self.c_data.get().get_width()
+
+    @property
+    def height(self) -> int:
+        return self.c_data.get().get_height()
+
+    @property
+    def jump_count(self) -> int:
+        return self.c_data.get().jump_count()
+
+    def __len__(self) -> int:
+        return self.c_data.get().size()
+
 cdef class MapOwnerLabel:
     cdef CMap.CMapOwnerLabel c_data
 
@@ -791,6 +1019,220 @@ cdef class OwnerImage:
         return OwnerImage(buffer)
 
 
+cdef class OwnerHistory:
+    """
+    A series of owner images (e.g. one per day) for change highlighting and time-lapses. Instead of full images, only
+    keyframes and the changed pixels between consecutive images are stored, both run-length encoded. The image of any
+    date is reconstructed in parallel and can be passed to SovMap.load_old_owners:
+
+    >>> history = OwnerHistory(sov_map.width, sov_map.height)
+    >>> history.append(day.toordinal(), sov_map.get_owner_buffer())
+    >>> sov_map.load_old_owners(history.get(day.toordinal()))
+
+    All methods are thread-safe.
+    """
+    cdef unique_ptr[COwnerHistory] c_history
+
+    def __init__(self, width: int, height: int, keyframe_interval: int = 30):
+        """
+        :param width: the width of the owner images
+        :param height: the height of the owner images
+        :param keyframe_interval: a full image is stored every keyframe_interval images, which limits the number of
+        changes that have to be applied to reconstruct an image
+        """
+        self.c_history.reset(new COwnerHistory(width, height, keyframe_interval))
+
+    def append(self, date: int, owners) -> None:
+        """
+        Appends the owner image of the date. Only the pixels that changed since the last image are stored.
+
+        :param date: the date as integer (e.g. date.toordinal()), must be greater than the last date
+        :param owners: an OwnerImage, the buffer from SovMap.get_owner_buffer or a uint64 array of the shape (height, width)
+        :raises ValueError: if the owners have the wrong size or type
+        :raises RuntimeError: if the date is not greater than the last date
+        :return:
+        """
+        cdef unsigned int width = self.c_history.get().get_width()
+        cdef unsigned int height = self.c_history.get().get_height()
+        cdef long long c_date = date
+        cdef const id_t * data
+        cdef const id_t[:, ::1] view
+        cdef BufferWrapper buffer
+        if isinstance(owners, OwnerImage):
+            # noinspection PyProtectedMember
+            owners = (<OwnerImage> owners)._buffer
+        if isinstance(owners, BufferWrapper):
+            buffer = owners
+            if buffer.dtype != 2 or buffer.data_ptr is NULL:
+                raise ValueError("Invalid owner image data type")
+            if buffer.width != width or buffer.height != height:
+                raise ValueError(f"Invalid owner image size {buffer.width}x{buffer.height}, expected {width}x{height}")
+            data = <const id_t *> buffer.data_ptr
+        else:
+            try:
+                view = owners
+            except (BufferError, TypeError, ValueError) as e:
+                raise ValueError(f"Invalid owner image: {e}") from e
+            if view.shape[0] != height or view.shape[1] != width:
+                raise ValueError(
+                    f"Invalid owner image shape ({view.shape[0]}, {view.shape[1]}), expected ({height}, {width})")
+            data = &view[0, 0]
+        with nogil:
+            self.c_history.get().append(c_date, data)
+
+    def get(self, date: int, thread_count: int = 0) -> OwnerImage:
+        """
+        Reconstructs the owner image of the date. If there is no image for this exact date, the newest image before it
+        is returned.
+
+        :param date: the date
+        :param thread_count: the number of threads to decode with, 0 uses all cores
+        :raises KeyError: if the date is before the first image
+        :return: a new owner image
+        """
+        cdef long long c_date = date
+        cdef size_t index
+        cdef unsigned int c_thread_count = thread_count
+        cdef unsigned int width = self.c_history.get().get_width()
+        cdef unsigned int height = self.c_history.get().get_height()
+        with nogil:
+            index = self.c_history.get().find(c_date)
+        if index == self.c_history.get().size():
+            raise KeyError(date)
+        cdef id_t * data = <id_t *> malloc(<size_t> width * height * sizeof(id_t))
+        if data is NULL:
+            raise MemoryError("Failed to allocate memory")
+        try:
+            with nogil:
+                self.c_history.get().reconstruct(index, data, c_thread_count)
+        except:
+            free(data)
+            raise
+        cdef BufferWrapper buffer = BufferWrapper()
+        buffer.set_data(width, height, data, 1, 2)
+        return OwnerImage(buffer)
+
+    @property
+    def dates(self) -> list[int]:
+        return list(self.c_history.get().get_dates())
+
+    @property
+    def width(self) -> int:
+        return self.c_history.get().get_width()
+
+    @property
+    def height(self) -> int:
+        return self.c_history.get().get_height()
+
+    @property
+    def run_count(self) -> int:
+        """
+        The number of stored runs over all images, every run takes 16 bytes.
+        """
+        return self.c_history.get().run_count()
+
+    def __len__(self) -> int:
+        return self.c_history.get().size()
+
+    def __contains__(self, date: int) -> bool:
+        return date in self.dates
+
+    def save(self, path: Path | os.PathLike[str] | str) -> None:
+        cdef string c_path = str(path).encode('utf-8')
+        with nogil:
+            self.c_history.get().save(c_path)
+
+    @classmethod
+    def load(cls, path: Path | os.PathLike[str] | str) -> OwnerHistory:
+        if not Path(path).exists():
+            raise FileNotFoundError("File not found")
+        cdef OwnerHistory history = cls(1, 1)
+        cdef string c_path = str(path).encode('utf-8')
+        with nogil:
+            history.c_history.get().load(c_path)
+        return history
+
+cdef class TileMerger:
+    """
+    Assembles the results of tile jobs (see create_tile_jobs) into the full image, owner image and labels. The results
+    are identical to SovMap.render followed by SovMap.get_image, SovMap.get_owner_buffer and SovMap.get_owner_labels.
+
+    >>> merger = TileMerger(sov_map.width, sov_map.height)
+    >>> for result in pool.map(execute_tile_job, create_tile_jobs("state.bin", sov_map.width, sov_map.height)):
+    ...     merger.add(result)
+    >>> merger.get_image().as_pil_image().save("influence.png")
+    """
+    cdef unique_ptr[CTileMerger] c_merger
+
+    def __init__(self, width: int, height: int, sample_rate: int = 8):
+        """
+        :param width: the width of the map
+        :param height: the height of the map
+        :param sample_rate: the sample rate of the jobs
+        """
+        self.c_merger.reset(new CTileMerger(width, height, sample_rate))
+
+    def add(self, result: bytes) -> None:
+        """
+        Adds the result of a tile job.
+
+        :param result: the result returned by execute_tile_job or a tile worker
+        :raises RuntimeError: if the result is invalid or does not fit into the map
+        """
+        cdef string c_result = result
+        with nogil:
+            self.c_merger.get().add(parse_tile_result(c_result))
+
+    def get_image(self) -> BufferWrapper:
+        """
+        :return: a copy of the RGBA image, see SovMap.get_image
+        """
+        cdef const vector[uint8_t] *image = &self.c_merger.get().get_image()
+        cdef uint8_t * data = <uint8_t *> malloc(image.size())
+        if data is NULL:
+            raise MemoryError("Failed to allocate memory")
+        memcpy(data, image.data(), image.size())
+        cdef BufferWrapper buffer = BufferWrapper()
+        buffer.set_data(self.c_merger.get().get_width(), self.c_merger.get().get_height(), data, 4, 1)
+        return buffer
+
+    def get_owner_buffer(self) -> BufferWrapper:
+        """
+        :return: a copy of the owner image, see SovMap.get_owner_buffer
+        """
+        cdef const vector[id_t] *owners = &self.c_merger.get().get_owners()
+        cdef id_t * data = <id_t *> malloc(owners.size() * sizeof(id_t))
+        if data is NULL:
+            raise MemoryError("Failed to allocate memory")
+        memcpy(data, owners.data(), owners.size() * sizeof(id_t))
+        cdef BufferWrapper buffer = BufferWrapper()
+        buffer.set_data(self.c_merger.get().get_width(), self.c_merger.get().get_height(), data, 1, 2)
+        return buffer
+
+    def get_labels(self) -> list[MapOwnerLabel]:
+        """
+        :return: the owner labels, in the same order as SovMap.get_owner_labels
+        """
+        cdef vector[CMap.CMapOwnerLabel] labels
+        with nogil:
+            labels = self.c_merger.get().get_labels()
+        return [MapOwnerLabel.from_c_data(label) for label in labels]
+
+    @property
+    def covered_pixels(self) -> int:
+        """
+        The number of pixels added so far, it equals width * height once all tiles were added.
+        """
+        return self.c_merger.get().get_covered_pixels()
+
+    @property
+    def width(self) -> int:
+        return self.c_merger.get().get_width()
+
+    @property
+    def height(self) -> int:
+        return self.c_merger.get().get_height()
+
 cdef class ColorGenerator:
     cdef vector[Color] c_color_table
     cdef mutex c_color_table_mutex
@@ -858,6 +1300,55 @@ cdef class ColorGenerator:
         return color
 
 
+class RenderFuture(Future):
+    """
+    The future returned by SovMap.render_async. Besides the usual methods of concurrent.futures.Future, it reports the
+    progress of the rendering and can be awaited directly from asyncio code.
+
+    Cancelling the future stops all workers after their current row. The future is only marked as cancelled once the
+    workers have stopped, so waiting for it (result, wait or await) returns when the map is no longer rendered.
+    Afterward, the map contains a partial rendering and can be rendered again.
+    """
+
+    def __init__(self, sov_map: SovMap):
+        super().__init__()
+        self._map = sov_map
+        self._cancel_requested = False
+
+    @property
+    def progress(self) -> float:
+        """
+        The progress of the rendering between 0.0 and 1.0
+        """
+        return self._map.render_progress
+
+    def cancel(self) -> bool:
+        """
+        Signal the workers to stop. The future is cancelled by the rendering thread after the workers have stopped,
+        cancelled() may still return False right after this call.
+
+        :return: False if the rendering has already finished
+        """
+        if self.done():
+            return False
+        self._cancel_requested = True
+        self._map.cancel_render()
+        return True
+
+    def _finish(self, error: BaseException | None, cancelled: bool) -> None:
+        # Called by the rendering thread once the workers have stopped
+        if self._cancel_requested or cancelled:
+            super().cancel()
+        elif error is not None:
+            self.set_exception(error)
+        else:
+            self.set_result(None)
+
+    def __await__(self):
+        import asyncio
+        return asyncio.wrap_future(self).__await__()
+
+
 cdef class SovMap:
     # Ok, so these two attributes are important and need to be handled very carefully to avoid memory leaks or
     # segfaults. The way it works: On the C++ code, every worker has a reference to the map. However, only the map is
@@ -874,6 +1365,9 @@ cdef class SovMap:
     # without any restrictions. All cdef functions need to be handled with care and are not supposed to be used.
     cdef CMap * c_map
     cdef object workers  # type: list[CMap.CColumnWorker]
+    # Weak reference to the future of the last render_async (the future references the map), another rendering must
+    # not start before it is done
+    cdef object _async_render
 
     cdef object __weakref__
 
@@ -895,6 +1389,8 @@ cdef class SovMap:
 
     cdef vector[CMap.CMapOwnerLabel] owner_labels
     cdef ColorGenerator _color_generator
+    # Keeps an attached shared state alive, see attach_shared
+    cdef object _shared
 
     color_jump_s = (0, 0, 0xFF, 0x30)
     color_jump_c = (0xFF, 0, 0, 0x30)
@@ -933,6 +1429,7 @@ cdef class SovMap:
         self.c_map = new CMap()
         self._calculated = False
         self.workers = []
+        self._async_render = None
         # noinspection PyUnresolvedReferences
         self.owner_labels.clear()
         self._color_generator = ColorGenerator()
@@ -946,11 +1443,11 @@ cdef class SovMap:
         del self.c_map
 
     cdef void _sync_data(self):
-        self.c_map.update_size(
-            <unsigned int> self._width,
-            <unsigned int> self._height,
-            <unsigned int> self._sample_rate,
-        )
+        cdef unsigned int width = <unsigned int> self._width
+        cdef unsigned int height = <unsigned int> self._height
+        cdef unsigned int sample_rate = <unsigned int> self._sample_rate
+        with nogil:
+            self.c_map.update_size(width, height, sample_rate)
 
     cdef void remove_worker(self, worker):
         self.workers.remove(worker)
@@ -967,8 +1464,9 @@ cdef class SovMap:
         :param filename:
         :return:
         """
-        # noinspection PyTypeChecker
-        self.c_map.load_data(filename.encode('utf-8'))
+        cdef string c_filename = filename.encode('utf-8')
+        with nogil:
+            self.c_map.load_data(c_filename)
 
     def set_sov_power_function(self, func: Callable[[float, bool, int], float]):
         """
@@ -989,6 +1487,11 @@ cdef class SovMap:
         IMPORTANT: THIS FUNCTION MAY NOT CALL ANY FUNCTIONS THAT WILL MODIFY/READ FROM THE MAP. THIS WILL RESULT IN A
         DEADLOCK. This affects all functions marked with "This is a blocking operation on the underlying map object."
 
+        Instead of a Python function, a native function can be passed: a ctypes function pointer (e.g. a CFUNCTYPE
+        object or a function of a CDLL with restype and argtypes set) or a numba cfunc with the signature
+        double(double, bool, uint64). It is called directly from the worker threads without the GIL. The other setters
+        accept native functions as well.
+
         :param func: the function (double, bool, int) -> double
         :return:
         """
@@ -1011,6 +1514,8 @@ cdef class SovMap:
         IMPORTANT: THIS FUNCTION MAY NOT CALL ANY FUNCTIONS THAT WILL MODIFY/READ FROM THE MAP. THIS WILL RESULT IN A
         DEADLOCK. This affects all functions marked with "This is a blocking operation on the underlying map object."
 
+        Accepts a native function double(double, double, int) as well, see set_sov_power_function.
+
         :param func: the function (double, double, int) -> double
         :return:
         """
@@ -1034,6 +1539,13 @@ cdef class SovMap:
         IMPORTANT: THIS FUNCTION MAY NOT CALL ANY FUNCTIONS THAT WILL MODIFY/READ FROM THE MAP. THIS WILL RESULT IN A
         DEADLOCK. This affects all functions marked with "This is a blocking operation on the underlying map object."
 
+        A native function double(double) (see set_sov_power_function) avoids this overhead, e.g. a numba cfunc:
+
+        >>> @numba.cfunc("float64(float64)")
+        ... def to_alpha(influence):
+        ...     return min(190.0, math.log(math.log(influence + 1.0) + 1.0) * 700)
+        >>> sov_map.set_influence_to_alpha_function(to_alpha)
+
         :param func: the function (double) -> double
         :return:
         """
@@ -1047,6 +1559,9 @@ cdef class SovMap:
 
         It will be called for every owner that should get rendered, but doesn't have a color set.
 
+        A native function uint32(uint64) returning the color as 0xRRGGBB is accepted as well, see
+        set_sov_power_function.
+
         :param func:
         :return:
         """
@@ -1058,7 +1573,8 @@ cdef class SovMap:
         This is a blocking operation on the underlying map object.
         :return:
         """
-        self.c_map.calculate_influence()
+        with nogil:
+            self.c_map.calculate_influence()
         self._calculated = True
 
     def create_workers(self, count: int):
@@ -1183,21 +1699,512 @@ cdef class SovMap:
             jump_data.push_back(CJumpData(sys_from=connection[0], sys_to=connection[1]))
             self._connections.append(connection)
 
-        self.c_map.set_data(owner_data, system_data, jump_data)
+        with nogil:
+            self.c_map.set_data(owner_data, system_data, jump_data)
         #print("Skipped %d systems" % len(skipped))
 
-    def render(self, thread_count: int = 1) -> None:
+    def create_topology(self) -> Topology:
+        """
+        Creates a topology from the loaded systems and jumps. It can be passed to load_snapshot of other maps with the
+        same size, which then share the systems and jumps instead of storing their own copy.
+
+        This is a blocking operation on the underlying map object.
+        :return: the topology
+        """
+        cdef Topology topology = Topology.__new__(Topology)
+        with nogil:
+            topology.c_data = self.c_map.create_topology()
+        return topology
+
+    def load_snapshot(self, topology: Topology, owners: Iterable[dict], systems: Iterable[dict]):
+        """
+        Loads the ownership of the systems of a shared topology (see create_topology). This is much cheaper than
+        load_data, as the systems and jumps are not copied. It is meant for rendering many snapshots of the same universe,
+        e.g. one map per day of a history.
+
+        The systems and jumps of this map are removed, methods using them on the python side (like the jump and system
+        rendering) will not show anything. Calling load_data switches back to own data.
+
+        This is a blocking operation on the underlying map object.
+        :param topology: the topology, must have the same size as this map
+        :param owners: a list of owner data, see load_data
+        :param systems: a list of system data, each entry is a dict with the keys 'id', 'has_station', 'sov_power' and 'owner'. Systems not listed are unclaimed, unknown systems are ignored
+        :return:
+        """
+        cdef Topology c_topology = topology
+        if c_topology.c_data.get().get_width() != self._width or c_topology.c_data.get().get_height() != self._height:
+            raise ValueError("The topology has size %dx%d, but the map has size %dx%d" % (
+                c_topology.c_data.get().get_width(), c_topology.c_data.get().get_height(), self._width, self._height))
+        cdef vector[shared_ptr[COwner]] owner_data
+        cdef vector[CSolarSystemData] system_data
+        cdef CSolarSystemData c_system
+        self._connections.clear()
+        self._systems.clear()
+        self._owners.clear()
+        # noinspection PyUnresolvedReferences
+        self._color_generator.clear()
+
+        cdef Owner owner_obj
+        for owner in owners:
+            owner_obj = Owner(
+                id_=owner['id'],
+                name=owner.get('name', str(owner['id'])),
+                color=owner['color'],
+                npc=owner['npc'])
+            if owner_obj.c_data.get().has_color():
+                # noinspection PyUnresolvedReferences
+                self._color_generator.push_color(owner_obj.c_data.get().get_color())
+            # noinspection PyTypeChecker
+            self._owners[owner_obj.id] = owner_obj
+            # noinspection PyUnresolvedReferences
+            owner_data.push_back(owner_obj.c_data)
+        for system in systems:
+            c_system.id = system['id']
+            c_system.has_station = system['has_station']
+            c_system.sov_power = system['sov_power']
+            c_system.owner = system['owner'] or 0
+            system_data.push_back(c_system)
+
+        with nogil:
+            self.c_map.set_topology(c_topology.c_data)
+            self.c_map.load_snapshot(owner_data, system_data)
+        self._calculated = False
+
+    def export_shared(self, name: str | None = None):
+        """
+        Copies the state needed for rendering (systems, jumps, ownership, the calculated influence, the old owner data
+        and the kernel, precision and engine) into a new shared memory segment. Other processes can attach it with attach_shared in a few milliseconds
+        instead of loading the data and calculating the influence again:
+
+        >>> shm = sov_map.export_shared()
+        >>> # In another process, with a map of the same size
+        >>> other_map.attach_shared(shm.name)
+        >>> other_map.render(thread_count=4)
+
+        The caller owns the segment and has to close and unlink it once all processes are done.
+
+        This is a blocking operation on the underlying map object.
+        :param name: the name of the segment, a random name is used if None
+        :return: the multiprocessing.shared_memory.SharedMemory
+        """
+        from multiprocessing.shared_memory import SharedMemory
+        cdef size_t size
+        with nogil:
+            size = self.c_map.shared_state_size()
+        shm = SharedMemory(name=name, create=True, size=size)
+        try:
+            self._write_shared(shm.buf)
+        except:
+            shm.close()
+            shm.unlink()
+            raise
+        return shm
+
+    def save_shared(self, path: Path | os.PathLike[str] | str) -> None:
+        """
+        Writes the same state as export_shared into a file, which other processes can memory map with attach_shared.
+
+        This is a blocking operation on the underlying map object.
+        :param path: the file to write
+        :return:
+        """
+        import mmap
+        cdef size_t size
+        with nogil:
+            size = self.c_map.shared_state_size()
+        with open(path, "w+b") as f:
+            f.truncate(size)
+            with mmap.mmap(f.fileno(), size) as mapped:
+                self._write_shared(mapped)
+
+    cdef _write_shared(self, object target):
+        cdef uint8_t[::1] view = target
+        with nogil:
+            self.c_map.export_shared_state(&view[0], view.shape[0])
+
+    def attach_shared(self, source) -> None:
+        """
+        Uses a state created by export_shared or save_shared, the topology and old owner data are read directly from the
+        shared memory without copying. The map must have the same size as the exporting map. Afterward, the map can be
+        rendered right away with the kernel, precision and engine of the exporting map, the influence is already
+        calculated. The systems and jumps are not available on the python side (see load_snapshot).
+
+        The shared memory is kept open as long as this map exists.
+
+        This is a blocking operation on the underlying map object.
+        :param source: the path of a file written by save_shared (a Path or a str naming an existing file), the name of
+        a shared memory segment (any other str), a SharedMemory or any buffer (e.g. a mmap object)
+        :raises RuntimeError: if the state is invalid or has a different size than the map
+        :raises FileNotFoundError: if the str is neither an existing file nor the name of a segment
+        :return:
+        """
+        import mmap
+        from multiprocessing.shared_memory import SharedMemory
+        if isinstance(source, str) and os.path.isfile(source):
+            source = Path(source)
+        holder = source
+        if isinstance(source, str):
+            try:
+                # The segment belongs to the exporting process, it must not be unlinked when this process exits
+                holder = SharedMemory(name=source, track=False)
+            except TypeError:
+                # Before Python 3.13 the segment is always tracked. This is fine for child processes of the exporting
+                # process, as they share its resource tracker
+                holder = SharedMemory(name=source)
+            buffer = holder.buf
+        elif isinstance(source, os.PathLike):
+            with open(source, "rb") as f:
+                holder = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+            buffer = holder
+        elif isinstance(source, SharedMemory):
+            buffer = source.buf
+        else:
+            buffer = source
+        cdef const uint8_t[::1] view = buffer
+        try:
+            with nogil:
+                self.c_map.attach_shared_state(&view[0], view.shape[0])
+        except:
+            # Release the view first, a mapping can't be closed while it is exported
+            view = None
+            if holder is not source:
+                holder.close()
+            raise
+        # The view is released before the holder is closed, as a tuple releases its items in reverse order
+        self._shared = (holder, view)
+
+        self._connections.clear()
+        self._systems.clear()
+        self._owners.clear()
+        # noinspection PyUnresolvedReferences
+        self._color_generator.clear()
+        cdef Owner owner_obj
+        cdef shared_ptr[COwner] c_owner
+        for c_owner in self.c_map.get_owners():
+            owner_obj = Owner.__new__(Owner)
+            owner_obj.c_data = c_owner
+            if c_owner.get().has_color():
+                # noinspection PyUnresolvedReferences
+                self._color_generator.push_color(c_owner.get().get_color())
+            # noinspection PyTypeChecker
+            self._owners[owner_obj.id] = owner_obj
+        self._calculated = True
+
+    def render(self, thread_count: int = 1, out=None, owner_out=None) -> None:
         """
         Render the map. This method will calculate the influence of each owner and render the map. The rendering is done
         in parallel using the given number of threads.
 
-        Warning: Calling this method while a rendering is already in progress is not safe and is considered undefined
-        behavior.
+        Instead of the internal image, the rendering can write directly into existing memory, for example a numpy array,
+        a shared memory segment or a memory mapped file. Any writable object supporting the buffer protocol can be used:
+
+        >>> image = np.empty((sov_map.height, sov_map.width, 4), dtype=np.uint8)
+        >>> owners = np.empty((sov_map.height, sov_map.width), dtype=np.uint64)
+        >>> sov_map.render(thread_count=4, out=image, owner_out=owners)
+
+        The internal image is not touched in this case, get_image will not return this rendering.
+
+        Warning: Calling this method while another synchronous rendering is in progress is not safe and is considered
+        undefined behavior. A running render_async is detected and raises a RuntimeError.
         :param thread_count:
+        :param out: a writable, C-contiguous uint8 buffer of the shape (height, width, 4) which receives the RGBA image
+        :param owner_out: a writable uint64 buffer of the shape (height, width) which receives the owner ids (0 = None),
+                          it may have arbitrary strides
+        :raises ValueError: if a buffer has the wrong shape, type or layout, or is read-only
+        :raises RuntimeError: if a background rendering is still running
         :return:
         """
+        cdef uint8_t[:, :, ::1] image_target
+        cdef id_t[:, :] owner_target
+        self._check_no_async_render()
+        if out is not None:
+            image_target = self._image_target(out)
+        if owner_out is not None:
+            owner_target = self._owner_target(owner_out)
+        if not self._calculated:
+            self.calculate_influence()
+        if out is not None:
+            with nogil:
+                self.c_map.set_image_target(&image_target[0, 0, 0])
+        try:
+            self._render(thread_count)
+        finally:
+            if out is not None:
+                with nogil:
+                    self.c_map.release_image_target()
+        if owner_out is not None:
+            with nogil:
+                self.c_map.write_owner_image(&owner_target[0, 0], owner_target.strides[0], owner_target.strides[1])
+
+    def render_viewport(
+            self,
+            x: float, y: float, width: float, height: float,
+            output_width: int | None = None, output_height: int | None = None,
+            thread_count: int = 1, out=None, owner_out=None) -> BufferWrapper | None:
+        """
+        Render a rectangle of the map into an image of its own size, e.g. to zoom into a region. The rectangle is given
+        in map coordinates (the coordinates of the solar systems), only the systems whose influence reaches it are
+        evaluated. No buffers of the size of the map are used, so a region can be rendered at a high zoom without
+        raising the size of the whole map:
+
+        >>> image = sov_map.render_viewport(300, 400, 200, 150, output_width=1600, output_height=1200)
+        >>> image.as_pil_image().save("zoomed.png")
+
+        At the output size of the rectangle (zoom 1) and integer coordinates, the image matches the same area of
+        render(), including the edges of the map. Outside the map, the influence is rendered as if the map continued.
+        The internal image is not touched.
+        :param x: the left edge of the rectangle
+        :param y: the top edge of the rectangle
+        :param width: the width of the rectangle
+        :param height: the height of the rectangle
+        :param output_width: the width of the image, defaults to the width of the rectangle
+        :param output_height: the height of the image, defaults to the height of the rectangle
+        :param thread_count: the number of threads to render with
+        :param out: a writable, C-contiguous uint8 buffer of the shape (output_height, output_width, 4) which receives
+                    the image instead of a new buffer
+        :param owner_out: a writable uint64 buffer of the shape (output_height, output_width) which receives the owner
+                          ids (0 = None)
+        :raises ValueError: if the viewport is empty or a buffer has the wrong shape
+        :return: the RGBA image, or None if out is given
+        """
+        cdef CViewport viewport
+        viewport.x = x
+        viewport.y = y
+        viewport.width = width
+        viewport.height = height
+        if output_width is None:
+            output_width = max(1, round(width))
+        if output_height is None:
+            output_height = max(1, round(height))
+        if output_width <= 0 or output_height <= 0 or not width > 0 or not height > 0:
+            raise ValueError("The viewport must not be empty")
+        viewport.output_width = output_width
+        viewport.output_height = output_height
+        cdef unsigned int c_thread_count = thread_count
+        cdef uint8_t[:, :, ::1] image_target
+        cdef id_t[:, :] owner_target
+        cdef id_t * owner_ptr = NULL
+        cdef Py_ssize_t owner_row_stride = 0, owner_column_stride = 0
+        cdef BufferWrapper buffer = None
+        cdef uint8_t * data
+        if out is not None:
+            try:
+                image_target = out
+            except (BufferError, TypeError) as e:
+                raise ValueError(f"Invalid image target: {e}") from e
+            if (image_target.shape[0] != output_height or image_target.shape[1] != output_width or
+                    image_target.shape[2] != 4):
+                raise ValueError(
+                    f"Invalid image target shape ({image_target.shape[0]}, {image_target.shape[1]}, "
+                    f"{image_target.shape[2]}), expected ({output_height}, {output_width}, 4)")
+            data = &image_target[0, 0, 0]
+        else:
+            data = <uint8_t *> malloc(<size_t> viewport.output_width * viewport.output_height * 4)
+            if data is NULL:
+                raise MemoryError("Failed to allocate memory")
+            buffer = BufferWrapper()
+            buffer.set_data(output_width, output_height, data, 4, 1)
+        if owner_out is not None:
+            try:
+                owner_target = owner_out
+            except (BufferError, TypeError) as e:
+                raise ValueError(f"Invalid owner target: {e}") from e
+            if owner_target.shape[0] != output_height or owner_target.shape[1] != output_width:
+                raise ValueError(
+                    f"Invalid owner target shape ({owner_target.shape[0]}, {owner_target.shape[1]}), expected "
+                    f"({output_height}, {output_width})")
+            owner_ptr = &owner_target[0, 0]
+            owner_row_stride = owner_target.strides[0]
+            owner_column_stride = owner_target.strides[1]
         if not self._calculated:
             self.calculate_influence()
+        with nogil:
+            self.c_map.render_viewport(viewport, data, owner_ptr, owner_row_stride, owner_column_stride,
+                                       c_thread_count)
+        return buffer
+
+    cdef uint8_t[:, :, ::1] _image_target(self, object out):
+        cdef uint8_t[:, :, ::1] target
+        try:
+            target = out
+        except (BufferError, TypeError) as e:
+            raise ValueError(f"Invalid image target: {e}") from e
+        if target.shape[0] != self.c_map.get_height() or target.shape[1] != self.c_map.get_width() or target.shape[2] != 4:
+            raise ValueError(
+                f"Invalid image target shape ({target.shape[0]}, {target.shape[1]}, {target.shape[2]}), expected "
+                f"({self.c_map.get_height()}, {self.c_map.get_width()}, 4)")
+        return target
+
+    cdef CRGBAColor _style_color(self, object color):
+        cdef CRGBAColor c_color
+        c_color.red = color[0]
+        c_color.green = color[1]
+        c_color.blue = color[2]
+        c_color.alpha = color[3] if len(color) > 3 else 255
+        return c_color
+
+    cdef id_t[:, :] _owner_target(self, object owner_out):
+        cdef id_t[:, :] target
+        try:
+            target = owner_out
+        except (BufferError, TypeError) as e:
+            raise ValueError(f"Invalid owner target: {e}") from e
+        if target.shape[0] != self.c_map.get_height() or target.shape[1] != self.c_map.get_width():
+            raise ValueError(
+                f"Invalid owner target shape ({target.shape[0]}, {target.shape[1]}), expected "
+                f"({self.c_map.get_height()}, {self.c_map.get_width()})")
+        return target
+
+    def render_async(self, thread_count: int = 1) -> RenderFuture:
+        """
+        Start the rendering in the background and return immediately. The rendering runs on native threads without the
+        GIL, the returned future can be used to wait for it, to check the progress or to cancel it:
+
+        >>> future = sov_map.render_async(thread_count=4)
+        >>> print(future.progress)
+        >>> future.cancel()
+
+        Inside asyncio code, the future can be awaited directly:
+
+        >>> await sov_map.render_async(thread_count=4)
+
+        Only one background rendering can run at a time, wait for the previous future first (a cancelled future is done
+        once its workers have stopped).
+        :param thread_count: the number of threads to render with
+        :raises RuntimeError: if a background rendering is still running
+        :return: a future which completes when the rendering is done
+        """
+        self._check_no_async_render()
+        future = RenderFuture(self)
+        self._async_render = weakref.ref(future)
+        self.c_map.reset_render_state()
+
+        def run():
+            error = None
+            try:
+                if not self._calculated:
+                    self.calculate_influence()
+                self._render(thread_count, False)
+            except BaseException as e:
+                error = e
+            future._finish(error, self.c_map.is_render_cancelled())
+
+        threading.Thread(target=run, name="bluemap-render", daemon=True).start()
+        return future
+
+    cdef _check_no_async_render(self):
+        future = self._async_render() if self._async_render is not None else None
+        if future is not None and not future.done():
+            raise RuntimeError("A background rendering is still running, wait for its future first")
+
+    def cancel_render(self) -> None:
+        """
+        Stop all running workers after their current row. The image contains a partial rendering afterward. This does not
+        block, use the future returned by render_async to wait for the workers.
+        """
+        self.c_map.cancel_render()
+
+    @property
+    def render_progress(self) -> float:
+        """
+        The progress of the current (or last) rendering between 0.0 and 1.0
+        """
+        cdef unsigned long long total = <unsigned long long> self.c_map.get_width() * self.c_map.get_height()
+        if total == 0:
+            return 1.0
+        return min(1.0, self.c_map.get_rendered_pixels() / total)
+
+    @property
+    def rows_completed(self) -> int:
+        """
+        The number of full-width rows rendered so far, the workers render disjoint columns in parallel, so this is the
+        number of rendered pixels divided by the width.
+        """
+        cdef unsigned int width = self.c_map.get_width()
+        if width == 0:
+            return 0
+        return self.c_map.get_rendered_pixels() // width
+
+    @property
+    def stats(self) -> dict:
+        """
+        The statistics collected since the last call of reset_stats(), the dict contains:
+
+        - ``enabled``: False if the extension was compiled without ``EVE_MAPPER_STATS``, all values are zero then
+        - ``phases_ms``: the accumulated wall time per phase (``load_data``, ``calculate_influence``, ``render``, ...)
+        - ``worker_busy_ms``: the busy time of every worker, without the time waiting for the map lock
+        - ``pixels``, ``systems_visited``, ``owner_contributions``: the work done by the workers,
+          ``systems_per_pixel`` is the average number of systems in range of a pixel
+        - ``callback_calls`` and ``gil_wait_ms``: the calls of Python functions and the time spent acquiring the GIL
+        - ``image_mutex_wait_ms`` and ``map_mutex_wait_ms``: the time spent waiting for the internal locks
+
+        The statistics are compiled out by default, set ``GEN_STATS = True`` in setup.py to enable them.
+        """
+        cdef CRenderStats stats
+        with nogil:
+            stats = self.c_map.get_stats()
+        return {
+            "enabled": stats.enabled,
+            "phases_ms": {phase.decode("utf-8"): ms for phase, ms in dict(stats.phase_ms).items()},
+            "worker_busy_ms": list(stats.worker_busy_ms),
+            "pixels": stats.pixels,
+            "systems_visited": stats.systems_visited,
+            "systems_per_pixel": stats.systems_visited / stats.pixels if stats.pixels > 0 else 0.0,
+            "owner_contributions": stats.owner_contributions,
+            "callback_calls": stats.callback_calls,
+            "gil_wait_ms": stats.gil_wait_ms,
+            "image_mutex_wait_ms": stats.image_mutex_wait_ms,
+            "map_mutex_wait_ms": stats.map_mutex_wait_ms,
+        }
+
+    def reset_stats(self) -> None:
+        """
+        Reset the statistics returned by the stats property
+        """
+        with nogil:
+            self.c_map.reset_stats()
+
+    def start_trace(self) -> None:
+        """
+        Start recording the spans of all phases (loading, influence, every worker's row bands, lock waits, composite,
+        encoding). Previously recorded spans are discarded. Use save_trace to write them as Chrome trace-event JSON,
+        which can be opened with chrome://tracing or https://ui.perfetto.dev:
+
+        >>> sov_map.start_trace()
+        >>> sov_map.render(thread_count=8)
+        >>> sov_map.stop_trace()
+        >>> sov_map.save_trace("render_trace.json")
+        """
+        with nogil:
+            self.c_map.start_trace()
+
+    def stop_trace(self) -> None:
+        """
+        Stop recording spans, the recorded spans are kept until the next start_trace.
+        """
+        with nogil:
+            self.c_map.stop_trace()
+
+    def save_trace(self, path: Path | os.PathLike[str] | str) -> None:
+        """
+        Write the recorded spans as Chrome trace-event JSON. Waits for running workers to finish.
+        :param path: the path of the JSON file
+        """
+        cdef string c_path = str(path).encode('utf-8')
+        with nogil:
+            self.c_map.save_trace(c_path)
+
+    cdef _render(self, int thread_count, cbool reset=True):
+        cdef unsigned int c_thread_count = thread_count
+        if reset:
+            self.c_map.reset_render_state()
+        cdef string engine
+        with nogil:
+            engine = self.c_map.get_engine()
+        if engine != b"gather":
+            with nogil:
+                self.c_map.render_engine(c_thread_count)
+            return
         from concurrent.futures.thread import ThreadPoolExecutor
         with ThreadPoolExecutor(max_workers=thread_count) as pool:
             # If you want to implement your own rendering, be carefull with the ColumnWorker class. It's not meant to be
@@ -1219,19 +2226,283 @@ cdef class SovMap:
             for _ in res:
                 pass
 
+    def composite(self, thread_count: int = 0, out=None) -> None:
+        """
+        Recreate the image from the influence field of the last rendering, without calculating the influence again. This
+        is much faster than render and can be used after changing the owner colors, the influence_to_alpha function,
+        the border_alpha or the old owner image. The result is identical to a rendering with a single thread (with more
+        threads, render might draw a few less borders where two workers meet).
+
+        The image will be created again if it was removed with get_image. Like render, the image can be written into
+        an existing buffer instead.
+
+        This is a blocking operation on the underlying map object.
+        :param thread_count: the number of threads to use, 0 uses all available cores
+        :param out: a writable, C-contiguous uint8 buffer of the shape (height, width, 4), see render
+        :raises RuntimeError: if no influence field is available
+        :raises ValueError: if the buffer has the wrong shape, type or layout
+        :return:
+        """
+        if thread_count < 0:
+            raise ValueError("thread_count must not be negative")
+        cdef unsigned int c_thread_count = thread_count
+        cdef uint8_t[:, :, ::1] image_target
+        if out is not None:
+            image_target = self._image_target(out)
+            with nogil:
+                self.c_map.set_image_target(&image_target[0, 0, 0])
+        try:
+            with nogil:
+                self.c_map.composite(c_thread_count)
+        finally:
+            if out is not None:
+                with nogil:
+                    self.c_map.release_image_target()
+
+    @property
+    def border_alpha(self) -> int:
+        """
+        The minimum alpha value for pixels at the border of a territory (default 0x48). Changing it takes effect on
+        the next render or composite.
+        """
+        return self.c_map.get_border_alpha()
+
+    @border_alpha.setter
+    def border_alpha(self, value: int):
+        if value < 0 or value > 255:
+            raise ValueError("border_alpha must be between 0 and 255")
+        self.c_map.set_border_alpha(value)
+
+    def set_kernel(
+            self, name: str,
+            parameter: float | None = None, cutoff: float | None = None, threshold: float | None = None) -> None:
+        """
+        Set the spatial kernel, which defines how the influence of a solar system falls off with the distance to a pixel:
+
+        - "inverse_square": power / (parameter + d²), parameter is the softening (default 500, cutoff 400). This is the
+          default kernel.
+        - "gaussian": power * exp(-d² / (2 * parameter²)), parameter is sigma (default 50, cutoff 4 * sigma)
+        - "linear": power * (1 - d / cutoff), takes no parameter (default cutoff 200)
+
+        >>> sov_map.set_kernel("gaussian", 60)
+
+        Systems further away than the cutoff are ignored, pixels with less influence than the threshold (default 0.023)
+        have no owner. Every kernel is compiled into its own render loop, so there is no runtime overhead. It takes
+        effect on the next render, the influence does not have to be calculated again.
+
+        :param name: the name of the kernel
+        :param parameter: the parameter of the kernel, None for the default
+        :param cutoff: the cutoff distance in pixels, None for the default
+        :param threshold: the ownership threshold, None for the default
+        :raises ValueError: if the name is unknown or a value is out of range
+        """
+        cdef CKernelConfig config
+        if (parameter is not None and parameter < 0 or cutoff is not None and cutoff < 0 or
+                threshold is not None and threshold < 0):
+            raise ValueError("Kernel values must not be negative")
+        try:
+            config = CKernelConfig.from_name(
+                name.encode('utf-8'),
+                -1 if parameter is None else parameter,
+                -1 if cutoff is None else cutoff,
+                -1 if threshold is None else threshold)
+        except RuntimeError as e:
+            raise ValueError(str(e)) from e
+        with nogil:
+            self.c_map.set_kernel(config)
+
+    @property
+    def kernel(self) -> dict[str, str | float]:
+        """
+        The current kernel as a dict with the keys name, parameter, cutoff and threshold, see set_kernel.
+        """
+        cdef CKernelConfig config
+        with nogil:
+            config = self.c_map.get_kernel()
+        return {
+            "name": config.get_name().decode('utf-8'),
+            "parameter": config.parameter,
+            "cutoff": config.cutoff,
+            "threshold": config.threshold,
+        }
+
+    @property
+    def single_precision(self) -> bool:
+        """
+        If True, the influence of every pixel is accumulated in float32 instead of float64, e.g. to match the results
+        of a float32 pipeline. This is not faster: the render loop is scalar and bound by the kernel division and the
+        per-owner sums, which take as long in float32. In the benchmark (400 systems, 256x256) both precisions are within
+        about 7% of each other, so don't enable it for speed. The owner of pixels with a close tie may change, use
+        compare_precision to check the differences for the current data. Takes effect on the next render.
+        """
+        cdef cbool result
+        with nogil:
+            result = self.c_map.is_single_precision()
+        return result
+
+    @single_precision.setter
+    def single_precision(self, value: bool):
+        cdef cbool c_value = value
+        with nogil:
+            self.c_map.set_single_precision(c_value)
+
+    @property
+    def engine(self) -> str:
+        """
+        The engine that calculates the influence field in render:
+
+        - "gather": every pixel sums up the influence of the systems within the cutoff (the default)
+        - "fft": the systems of every owner are convolved with the kernel via FFT. The cost depends on the number of
+          owners and pixels instead of the number of systems, which suits dense maps at a high resolution. It always
+          calculates in float64. The convolution needs a power-of-two grid covering the map plus the cutoff with 24
+          bytes per cell, about 400 MB for a 1856x2048 map with the default kernel. The rendering raises a RuntimeError
+          if the grid would exceed 1 GiB.
+        - "scatter": every system adds its kernel into per-owner buffers of the 64x64 tiles it reaches, then the best
+          owner of every pixel is picked per tile. The result is identical to "gather", but the memory access is more
+          cache-friendly for sparse maps and systems with a small reach.
+
+        render_viewport and the tile jobs always use the gather engine. See compare_engine for the accuracy.
+        """
+        cdef string engine
+        with nogil:
+            engine = self.c_map.get_engine()
+        return engine.decode('utf-8')
+
+    @engine.setter
+    def engine(self, value: str):
+        cdef string c_value = value.encode('utf-8')
+        try:
+            with nogil:
+                self.c_map.set_engine(c_value)
+        except RuntimeError as e:
+            raise ValueError(str(e)) from e
+
+    def compare_engine(self, thread_count: int = 0, max_reported: int = 1000) -> dict[str, int | float | list]:
+        """
+        Calculate the influence field with the current engine and compare it with the gather engine in float64. The
+        influence must have been calculated. The result is a dict with the keys
+
+        - pixels: the number of compared pixels
+        - owner_differences: the number of pixels with a different owner
+        - max_influence_error: the largest relative influence error of the pixels with the same owner
+        - mean_influence_error: the mean relative influence error of the pixels with the same owner
+        - differences: a list of (x, y, gather_owner, engine_owner, gather_influence, engine_influence) tuples of the
+          first max_reported differences in row-major order, owner 0 means no owner
+
+        This is a blocking operation on the underlying map object.
+
+        :param thread_count: the number of threads, 0 uses all cores
+        :param max_reported: the maximum number of listed differences
+        """
+        if thread_count < 0 or max_reported < 0:
+            raise ValueError("thread_count and max_reported must not be negative")
+        cdef CMap.CEngineReport report
+        cdef unsigned int c_thread_count = thread_count
+        cdef size_t c_max_reported = max_reported
+        with nogil:
+            report = self.c_map.compare_engine(c_thread_count, c_max_reported)
+        return {
+            "pixels": report.pixels,
+            "owner_differences": report.owner_differences,
+            "max_influence_error": report.max_influence_error,
+            "mean_influence_error": report.mean_influence_error,
+            "differences": [
+                (d.x, d.y, d.reference_owner, d.engine_owner, d.reference_influence, d.engine_influence)
+                for d in report.differences
+            ],
+        }
+
+    def territory_diff(self, region_id: int | None = None, thread_count: int = 0) -> dict[str, object]:
+        """
+        Compare the owners of the last rendering with the loaded old owner data (see load_old_owner_data) pixel by
+        pixel. The result is a dict with the keys
+
+        - owners: the ids of the owners with pixels in either image, sorted, 0 (no owner) is always the first
+        - transfers: a numpy uint64 matrix, transfers[i, j] is the number of pixels that changed from owners[i] to
+          owners[j], the diagonal holds the unchanged pixels
+        - gained: a dict of owner id to the number of pixels gained
+        - lost: a dict of owner id to the number of pixels lost
+
+        >>> diff = sov_map.territory_diff()
+        >>> diff["gained"][99003581] - diff["lost"][99003581]
+
+        The diff can be restricted to a region. A pixel belongs to the region of its nearest solar system.
+
+        This is a blocking operation on the underlying map object.
+
+        :param region_id: only count the pixels of this region, None for the whole map
+        :param thread_count: the number of threads, 0 uses all cores
+        :raises RuntimeError: if no old owner data is loaded or the region has no systems
+        """
+        import numpy as np
+        if thread_count < 0:
+            raise ValueError("thread_count must not be negative")
+        cdef id_t c_region_id = 0 if region_id is None else region_id
+        cdef unsigned int c_thread_count = thread_count
+        cdef CMap.CTerritoryDiff diff
+        with nogil:
+            diff = self.c_map.diff_territory(c_region_id, c_thread_count)
+        owners = list(diff.owners)
+        size = len(owners)
+        return {
+            "owners": owners,
+            "transfers": np.array(diff.transfers, dtype=np.uint64).reshape((size, size)),
+            "gained": dict(zip(owners, diff.gained)),
+            "lost": dict(zip(owners, diff.lost)),
+        }
+
+    def compare_precision(self, thread_count: int = 0, max_reported: int = 1000) -> dict[str, int | list]:
+        """
+        Calculate every pixel with float32 and float64 influence and compare the owners and alpha values. The influence
+        must have been calculated. The result is a dict with the keys
+
+        - pixels: the number of compared pixels
+        - owner_differences: the number of pixels with a different owner
+        - alpha_differences: the number of pixels with the same owner but a different alpha
+        - max_alpha_difference: the largest alpha difference of pixels with the same owner
+        - differences: a list of (x, y, float64_owner, float32_owner, float64_alpha, float32_alpha) tuples of the first
+          max_reported differences in row-major order, owner 0 means no owner
+
+        This is a blocking operation on the underlying map object.
+
+        :param thread_count: the number of threads, 0 uses all cores
+        :param max_reported: the maximum number of listed differences
+        """
+        if thread_count < 0 or max_reported < 0:
+            raise ValueError("thread_count and max_reported must not be negative")
+        cdef CMap.CPrecisionReport report
+        cdef unsigned int c_thread_count = thread_count
+        cdef size_t c_max_reported = max_reported
+        with nogil:
+            report = self.c_map.compare_precision(c_thread_count, c_max_reported)
+        return {
+            "pixels": report.pixels,
+            "owner_differences": report.owner_differences,
+            "alpha_differences": report.alpha_differences,
+            "max_alpha_difference": report.max_alpha_difference,
+            "differences": [
+                (d.x, d.y, d.double_owner, d.float_owner, d.double_alpha, d.float_alpha) for d in report.differences
+            ],
+        }
+
     def calculate_labels(self) -> None:
         """
         This is a blocking operation on the underlying map object.
         :return:
         """
-        self.owner_labels = self.c_map.calculate_labels()
+        cdef vector[CMap.CMapOwnerLabel] labels
+        with nogil:
+            labels = self.c_map.calculate_labels()
+        self.owner_labels = labels
 
     def get_owner_labels(self) -> list[MapOwnerLabel]:
         # noinspection PyTypeChecker
         return [MapOwnerLabel.from_c_data(label) for label in self.owner_labels]
 
     cdef _retrieve_image_buffer(self):
-        cdef uint8_t * data = self.c_map.retrieve_image()
+        cdef uint8_t * data
+        with nogil:
+            data = self.c_map.retrieve_image()
         if data == NULL:
             return None
         width = self.c_map.get_width()
@@ -1241,7 +2512,9 @@ cdef class SovMap:
         return image_base
 
     cdef _retrieve_owner_buffer(self):
-        cdef id_t * data = self.c_map.create_owner_image()
+        cdef id_t * data
+        with nogil:
+            data = self.c_map.create_owner_image()
         if data == NULL:
             return None
         width = self.c_map.get_width()
@@ -1250,6 +2523,48 @@ cdef class SovMap:
         image_base.set_data(width, height, data, 1, 2)
         return image_base
 
+    cdef _retrieve_influence_buffer(self):
+        cdef float * data
+        with nogil:
+            data = self.c_map.retrieve_influence_image()
+        if data == NULL:
+            return None
+        width = self.c_map.get_width()
+        height = self.c_map.get_height()
+        image_base = BufferWrapper()
+        image_base.set_data(width, height, data, 1, 3)
+        return image_base
+
+    @property
+    def export_influence(self) -> bool:
+        """
+        If enabled, the rendering additionally writes the influence of the winning owner for every pixel into a float32
+        buffer, see get_influence_buffer. Disabled by default.
+        """
+        return self.c_map.is_export_influence()
+
+    @export_influence.setter
+    def export_influence(self, value: bool):
+        self.c_map.set_export_influence(value)
+
+    def get_influence_buffer(self) -> BufferWrapper | None:
+        """
+        Get the influence of the winning owner for every pixel of the last rendering as a float32 buffer with the shape
+        (height, width, 1). The owner of the pixel can be found at the same position in the owner buffer. Pixels where
+        the influence was too low for an owner still contain the highest influence.
+
+        The export has to be enabled via export_influence before rendering. Like get_image, this method transfers the
+        buffer without copying it and removes it from the map, further calls will return None until the next rendering.
+
+        >>> sov_map.export_influence = True
+        >>> sov_map.render()
+        >>> influence = sov_map.get_influence_buffer().as_ndarray()[:, :, 0]
+
+        This is a blocking operation on the underlying map object.
+        :return: the influence buffer if available, None otherwise
+        """
+        return self._retrieve_influence_buffer()
+
     def get_image(self) -> BufferWrapper | None:
         """
         Get the image as a buffer. This method will remove the image from the map, further calls to this method will
@@ -1272,41 +2587,76 @@ cdef class SovMap:
         """
         return self._retrieve_image_buffer()
 
-    def save(self, path: Path | os.PathLike[str] | str, strategy: Literal["PIL", "cv2"] | None = None) -> None:
+    def save(
+            self,
+            path: Path | os.PathLike[str] | str,
+            strategy: Literal["native", "PIL", "cv2"] | None = None,
+            level: int = 4,
+            thread_count: int = 0,
+            image_format: Literal["png", "qoi", "raw"] | None = None
+    ) -> None:
         """
-        Save the image to a file. Requires Pillow or OpenCV to be installed. Use the get_image method if you want to
-        get better control over the image.
+        Save the image to a file. By default, the built-in encoder is used, which compresses PNG images in parallel and
+        does not require any additional dependencies. Alternatively, Pillow or OpenCV can be used. Use the get_image
+        method if you want to get better control over the image.
 
-        This method will remove the image from the map, further calls to get_image will return None and further calls
-        to save will raise a ValueError.
+        Besides PNG, the native strategy supports two formats meant for passing the image to another process which
+        decodes it right away: "qoi" (https://qoiformat.org, fast lossless compression) and "raw" (uncompressed RGBA
+        with a 16 byte header). Both can be loaded with load_image.
+
+        The native strategy keeps the image inside the map. The PIL and cv2 strategies will remove the image from the
+        map, further calls to get_image will return None and further calls to save will raise a RuntimeError.
 
         This is a blocking operation on the underlying map object.
         :param path:
-        :param strategy: the strategy to use for saving the image, either "PIL" or "cv2". If None, the first available
-                         strategy will be used.
-        :raises ImportError: if no strategy is available (i.e., neither PIL, nor opencv-python are installed)
+        :param strategy: the strategy to use for saving the image, either "native", "PIL" or "cv2". If None, the
+                         native encoder will be used.
+        :param level: the compression level of the native encoder (0-9), 0 is the fastest and stores the image
+                      uncompressed, 9 produces the smallest files. Ignored by the other strategies.
+        :param thread_count: the number of threads used by the native encoder, 0 uses all available cores
+        :param image_format: the file format, "png", "qoi" or "raw". If None, it is derived from the file extension
+                             (.qoi, .raw/.rgba, everything else is saved as PNG).
+        :raises ImportError: if the selected strategy is not available
         :raises RuntimeError: if no image is available
-        :raises ValueError: if an invalid strategy is provided
+        :raises ValueError: if an invalid strategy or format is provided
         :return:
         """
         if not isinstance(path, Path):
             path = Path(path)
         if not path.parent.exists():
             path.parent.mkdir(parents=True, exist_ok=True)
-
-        if strategy is None:
-            try:
-                import PIL
-                strategy = "PIL"
-            except ImportError:
-                try:
-                    import cv2
-                    strategy = "cv2"
-                except ImportError:
-                    pass
-        if strategy is None:
-            raise ImportError(
-                "Please install Pillow (pip install Pillow) or OpenCV (pip install opencv-python) to save images.")
+        if image_format is None:
+            suffix = path.suffix.lower()
+            if suffix == ".qoi":
+                image_format = "qoi"
+            elif suffix in (".raw", ".rgba"):
+                image_format = "raw"
+            else:
+                image_format = "png"
+
+        cdef string c_path
+        cdef ImageFormat c_format
+        cdef int c_level
+        cdef unsigned int c_thread_count
+        if strategy is None or strategy == "native":
+            if image_format == "png":
+                c_format = FORMAT_PNG
+            elif image_format == "qoi":
+                c_format = FORMAT_QOI
+            elif image_format == "raw":
+                c_format = FORMAT_RAW
+            else:
+                raise ValueError(f"Invalid image format {image_format}")
+            if not 0 <= level <= 9:
+                raise ValueError(f"Invalid compression level {level}, must be between 0 and 9")
+            c_path = str(path).encode('utf-8')
+            c_level = level
+            c_thread_count = thread_count
+            with nogil:
+                self.c_map.save(c_path, c_format, c_level, c_thread_count)
+            return
+        if image_format != "png":
+            raise ValueError(f"The image format {image_format} is only supported by the native strategy")
         if strategy == "PIL":
             img_buffer = self.get_image()
             if img_buffer is None:
@@ -1416,11 +2766,10 @@ cdef class SovMap:
         # owner image to prevent it from being deallocated
         cdef id_t * data = <id_t *> buffer.data_ptr
         buffer.data_ptr = NULL
-        # noinspection PyProtectedMember
-        self.c_map.set_old_owner_image(
-            data,
-            owner_image_._buffer.width,
-            owner_image_._buffer.height)
+        cdef unsigned int width = buffer.width
+        cdef unsigned int height = buffer.height
+        with nogil:
+            self.c_map.set_old_owner_image(data, width, height)
 
     def update_size(self, width: int | None = None, height: int | None = None, sample_rate: int | None = None) -> None:
         """
@@ -1445,7 +2794,7 @@ cdef class SovMap:
     def draw_systems(self, draw: "ImageDraw"):
         """
         Draw the solar systems on the map. This method will draw the solar systems on the given ImageDraw object. The
-        ImageDraw object must have the same resolution as the map.
+        ImageDraw object must have the same resolution as the map. See render_systems for a much faster native version.
 
         :param draw: the ImageDraw object to draw the systems on
         :return:
@@ -1493,6 +2842,64 @@ cdef class SovMap:
             else:
                 draw.rectangle((x - 1, y, x, y), fill=color)
 
+    def render_systems(self, out=None, antialias: bool = False, thread_count: int = 0) -> BufferWrapper | None:
+        """
+        Draw the jumps and solar systems natively, this is the much faster counterpart of draw_systems. The same colors
+        and markers are used and the jumps cover the same pixels, the image is drawn without PIL and the rows are split
+        between the threads. The jumps are drawn in one pass and blended over each other with their alpha, instead of
+        overwriting each other like with PIL.
+
+        Without a target, a transparent image of the size of the map is returned:
+
+        >>> sys_layer = sov_map.render_systems(thread_count=4).as_pil_image()
+
+        The systems can also be blended directly over an existing image, e.g. the rendered map:
+
+        >>> image = sov_map.get_image().as_ndarray()
+        >>> sov_map.render_systems(out=image, antialias=True)
+
+        Owners without a color get one from next_color, like with draw_systems.
+
+        This is a blocking operation on the underlying map object.
+        :param out: a writable, C-contiguous uint8 buffer of the shape (height, width, 4) to draw on
+        :param antialias: whether the jumps are drawn anti-aliased
+        :param thread_count: the number of threads, 0 uses all cores
+        :raises ValueError: if the buffer has the wrong shape, type or layout, or is read-only
+        :return: the RGBA image, or None if out is given
+        """
+        cdef uint8_t[:, :, ::1] image_target
+        cdef BufferWrapper buffer = None
+        cdef uint8_t * data
+        if out is not None:
+            image_target = self._image_target(out)
+            data = &image_target[0, 0, 0]
+        else:
+            data = <uint8_t *> calloc(<size_t> self.c_map.get_width() * self.c_map.get_height() * 4, 1)
+            if data is NULL:
+                raise MemoryError("Failed to allocate memory")
+            buffer = BufferWrapper()
+            buffer.set_data(self.c_map.get_width(), self.c_map.get_height(), data, 4, 1)
+
+        cdef vector[id_t] uncolored
+        with nogil:
+            uncolored = self.c_map.get_uncolored_system_owners()
+        cdef Owner owner
+        for owner_id in uncolored:
+            owner = self._owners.get(owner_id, None)
+            if owner is not None:
+                owner.color = self.next_color(owner_id)
+
+        cdef CSystemStyle style
+        style.jump_system = self._style_color(self.color_jump_s)
+        style.jump_constellation = self._style_color(self.color_jump_c)
+        style.jump_region = self._style_color(self.color_jump_r)
+        style.no_sov = self._style_color(self.color_sys_no_sov)
+        style.antialias = antialias
+        cdef unsigned int c_thread_count = thread_count
+        with nogil:
+            self.c_map.draw_systems(data, style, c_thread_count)
+        return buffer
+
     def draw_owner_labels(self, draw: "ImageDraw", base_font: Union["ImageFont", "FreeTypeFont", None] = None) -> None:
         from PIL import ImageFont
 
@@ -1674,3 +3081,72 @@ cdef class SovMap:
         :return:
         """
         return self._color_generator.new_colors
+
+
+def create_tile_jobs(
+        state_path: Path | os.PathLike[str] | str,
+        width: int, height: int,
+        tile_size: int = 512,
+        sample_rate: int = 8,
+        border_alpha: int = 0x48) -> list[bytes]:
+    """
+    Splits the rendering of a map into independent tile jobs. The jobs reference a state file written by
+    SovMap.save_shared, so they can be executed by other processes or machines with access to the file, either with
+    execute_tile_job or with a worker process (python -m bluemap.tile_worker or evemapper --tile-worker) that reads the
+    jobs from stdin. The results are assembled by a TileMerger.
+
+    Python functions set on the map are not part of the state, the workers use the default functions.
+
+    :param state_path: the path of the state file
+    :param width: the width of the map
+    :param height: the height of the map
+    :param tile_size: the maximum width and height of a tile
+    :param sample_rate: the sample rate for the labels
+    :param border_alpha: the border alpha, see SovMap.border_alpha
+    :return: the serialized jobs
+    """
+    cdef vector[CTileJob] jobs = create_tile_jobs_c(
+        str(state_path).encode('utf-8'), width, height, tile_size, sample_rate, border_alpha)
+    return [<bytes> serialize_tile_job(job) for job in jobs]
+
+def execute_tile_job(job: bytes) -> bytes:
+    """
+    Renders a tile job created by create_tile_jobs. The state file is only loaded once for consecutive jobs of the same
+    state.
+
+    :param job: the serialized job
+    :raises RuntimeError: if the job or the state file is invalid
+    :return: the serialized result for TileMerger.add
+    """
+    cdef string c_job = job
+    cdef string result
+    with nogil:
+        result = execute_serialized_tile_job(c_job)
+    return <bytes> result
+
+def load_image(path: Path | os.PathLike[str] | str) -> BufferWrapper:
+    """
+    Load an image written by SovMap.save in the "qoi" or "raw" format. The format is detected from the file header.
+    The pixel data is returned as an RGBA buffer, see SovMap.get_image.
+
+    >>> sov_map = SovMap()
+    >>> #...
+    >>> sov_map.save("influence.qoi")
+    >>> image = load_image("influence.qoi").as_ndarray()
+
+    :param path: the path of the image
+    :raises FileNotFoundError: if the file does not exist
+    :raises RuntimeError: if the file is not a valid qoi or raw image
+    :return: the image buffer
+    """
+    if not isinstance(path, Path):
+        path = Path(path)
+    if not path.exists():
+        raise FileNotFoundError("File not found")
+    cdef string c_path = str(path).encode('utf-8')
+    cdef unique_ptr[CImage] image = unique_ptr[CImage](new CImage(0, 0))
+    with nogil:
+        image.get().read(c_path.c_str())
+    cdef BufferWrapper buffer = BufferWrapper()
+    buffer.set_data(image.get().get_width(), image.get().get_height(), image.get().retrieve_data(), 4, 1)
+    return buffer
@@ -399,13 +399,12 @@ def render(
 
     print("Rendering overlay...")
     sov_layer = sov_map.get_image().as_pil_image()
-    sys_layer = PIL.Image.new("RGBA", sov_layer.size, (0, 0, 0, 0))
+    sys_layer = sov_map.render_systems(thread_count=16).as_pil_image().copy()
     bg_layer = PIL.Image.new("RGBA", sov_layer.size, (0, 0, 0, 255))
     label_layer = PIL.Image.new("RGBA", bg_layer.size, (0, 0, 0, 0))
     legend_layer = PIL.Image.new("RGBA", bg_layer.size, (0, 0, 0, 0))
     change_layer = PIL.Image.new("RGBA", bg_layer.size, (0, 0, 0, 0))
     sys_draw = ImageDraw.Draw(sys_layer)
-    sov_map.draw_systems(sys_draw)
     sov_map.draw_region_labels(sys_draw, font=font_arial.font_variant(size=10))
     sov_map.draw_owner_labels(ImageDraw.Draw(label_layer), base_font=base_font_b)
 
@@ -0,0 +1,64 @@
+"""
+This module provides a worker process for tile jobs (see create_tile_jobs). It reads jobs from stdin and writes the
+results to stdout, every message is prefixed with its length as big endian uint32:
+
+    python -m bluemap.tile_worker
+
+The same protocol is implemented by the native worker (evemapper --tile-worker).
+"""
+
+import struct
+import sys
+from typing import BinaryIO
+
+from . import execute_tile_job
+
+__all__ = ["read_message", "write_message", "run"]
+
+_LENGTH = struct.Struct(">I")
+
+
+def _read_exact(stream: BinaryIO, size: int) -> bytes:
+    data = bytearray()
+    while len(data) < size:
+        chunk = stream.read(size - len(data))
+        if not chunk:
+            raise EOFError("Unexpected end of stream")
+        data += chunk
+    return bytes(data)
+
+
+def read_message(stream: BinaryIO) -> bytes | None:
+    """
+    Reads a length prefixed message.
+
+    :param stream: the stream to read from
+    :return: the message or None if the stream ended
+    """
+    header = stream.read(_LENGTH.size)
+    if not header:
+        return None
+    if len(header) < _LENGTH.size:
+        header += _read_exact(stream, _LENGTH.size - len(header))
+    return _read_exact(stream, _LENGTH.unpack(header)[0])
+
+
+def write_message(stream: BinaryIO, message: bytes) -> None:
+    """
+    Writes a length prefixed message and flushes the stream.
+    """
+    stream.write(_LENGTH.pack(len(message)))
+    stream.write(message)
+    stream.flush()
+
+
+def run(input_stream: BinaryIO, output_stream: BinaryIO) -> None:
+    """
+    Executes jobs until the input ends.
+    """
+    while (job := read_message(input_stream)) is not None:
+        write_message(output_stream, execute_tile_job(job))
+
+
+if __name__ == "__main__":
+    run(sys.stdin.buffer, sys.stdout.buffer)
@@ -0,0 +1,127 @@
+#ifndef ENTITYSTORE_H
+#define ENTITYSTORE_H
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bluemap {
+    /**
+     * Entities (owners, solar systems) by id with dense indices. Entities created with emplace() are stored in an
+     * arena instead of a separate allocation each, the shared pointers handed out reference the arena. The arena is
+     * released once the store and all pointers into it are gone, so entities stay valid after clear().
+     *
+     * Entities created elsewhere (e.g. by python) can be added with insert(). Lookups by id use a hash map, the
+     * entities are iterated by their index, which is the insertion order.
+     *
+     * Not thread-safe, the map lock protects the stores.
+     */
+    template<typename T>
+    class EntityStore {
+    public:
+        static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+    private:
+        /// A deque never moves its elements, so the entities don't have to be movable
+        std::shared_ptr<std::deque<T> > arena = std::make_shared<std::deque<T> >();
+        std::vector<std::shared_ptr<T> > entities;
+        std::unordered_map<unsigned long long, uint32_t> indices;
+
+        void put(const unsigned long long id, std::shared_ptr<T> entity) {
+            if (const auto it = indices.find(id); it != indices.end()) {
+                // The replaced entity stays in the arena until the arena is released, the maps clear() the stores before
+                // loading new data, so the arena doesn't grow over several loads
+                entities[it->second] = std::move(entity);
+                return;
+            }
+            if (entities.size() >= NO_INDEX) {
+                throw std::runtime_error("Too many entities");
+            }
+            indices.emplace(id, static_cast<uint32_t>(entities.size()));
+            entities.push_back(std::move(entity));
+        }
+
+    public:
+        /// Creates the entity in the arena, an entity with the same id is replaced
+        template<typename... Args>
+        std::shared_ptr<T> emplace(const unsigned long long id, Args &&... args) {
+            T &entity = arena->emplace_back(id, std::forward<Args>(args)...);
+            // Aliasing pointer, it shares the ownership of the whole arena
+            std::shared_ptr<T> pointer(arena, &entity);
+            put(id, pointer);
+            return pointer;
+        }
+
+        /// Adds an entity that was created elsewhere, an entity with the same id is replaced
+        void insert(std::shared_ptr<T> entity) {
+            if (entity == nullptr) {
+                throw std::runtime_error("Entity must not be null");
+            }
+            const auto id = entity->get_id();
+            put(id, std::move(entity));
+        }
+
+        [[nodiscard]] uint32_t index_of(const unsigned long long id) const {
+            const auto it = indices.find(id);
+            return it == indices.end() ? NO_INDEX : it->second;
+        }
+
+        /// Returns the entity or nullptr
+        [[nodiscard]] T *find(const unsigned long long id) const {
+            const auto it = indices.find(id);
+            return it == indices.end() ? nullptr : entities[it->second].get();
+        }
+
+        /// Returns the entity or nullptr
+        [[nodiscard]] std::shared_ptr<T> get(const unsigned long long id) const {
+            const auto it = indices.find(id);
+            return it == indices.end() ? nullptr : entities[it->second];
+        }
+
+        /// @throws std::out_of_range if there is no entity with this id
+        [[nodiscard]] const std::shared_ptr<T> &at(const unsigned long long id) const {
+            const auto it = indices.find(id);
+            if (it == indices.end()) {
+                throw std::out_of_range("Unknown id " + std::to_string(id));
+            }
+            return entities[it->second];
+        }
+
+        [[nodiscard]] const std::shared_ptr<T> &operator[](const uint32_t index) const {
+            return entities[index];
+        }
+
+        [[nodiscard]] size_t size() const {
+            return entities.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return entities.empty();
+        }
+
+        void reserve(const size_t count) {
+            entities.reserve(count);
+            indices.reserve(count);
+        }
+
+        void clear() {
+            entities.clear();
+            indices.clear();
+            // Pointers into the old arena may still be in use
+            arena = std::make_shared<std::deque<T> >();
+        }
+
+        [[nodiscard]] auto begin() const {
+            return entities.begin();
+        }
+
+        [[nodiscard]] auto end() const {
+            return entities.end();
+        }
+    };
+}
+
+#endif //ENTITYSTORE_H
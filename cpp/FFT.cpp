@@ -0,0 +1,131 @@
+#include "FFT.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace bluemap {
+    namespace {
+        std::vector<std::complex<double> > create_roots(const size_t size) {
+            const double pi = std::acos(-1.0);
+            std::vector<std::complex<double> > roots(size / 2);
+            for (size_t k = 0; k < roots.size(); ++k) {
+                const double angle = -2.0 * pi * static_cast<double>(k) / static_cast<double>(size);
+                roots[k] = {std::cos(angle), std::sin(angle)};
+            }
+            return roots;
+        }
+
+        /// Calls function(start, end) for count items split into bands, band 0 runs on the calling thread
+        template<typename Function>
+        void parallel_bands(const size_t count, unsigned int thread_count, const Function &function) {
+            thread_count = static_cast<unsigned int>(std::min<size_t>(std::max(1u, thread_count), count));
+            if (thread_count <= 1) {
+                function(0, count);
+                return;
+            }
+            std::vector<std::thread> threads;
+            std::vector<std::exception_ptr> errors(thread_count);
+            for (unsigned int i = 1; i < thread_count; ++i) {
+                threads.emplace_back([&, i] {
+                    try {
+                        function(i * count / thread_count, (i + 1) * count / thread_count);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                });
+            }
+            try {
+                function(0, count / thread_count);
+            } catch (...) {
+                errors[0] = std::current_exception();
+            }
+            for (auto &thread: threads) {
+                thread.join();
+            }
+            for (const auto &error: errors) {
+                if (error) std::rethrow_exception(error);
+            }
+        }
+    }
+
+    size_t next_power_of_two(const size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    FFT2D::FFT2D(const size_t width, const size_t height): width(width), height(height) {
+        if (width == 0 || height == 0 || (width & (width - 1)) != 0 || (height & (height - 1)) != 0) {
+            throw std::runtime_error(
+                "The FFT size must be a power of two, got " + std::to_string(width) + "x" + std::to_string(height));
+        }
+        roots_x = create_roots(width);
+        roots_y = create_roots(height);
+    }
+
+    void FFT2D::transform_line(std::complex<double> *line, const size_t size,
+                               const std::vector<std::complex<double> > &roots, const bool inverse) {
+        // Bit reversal permutation
+        for (size_t i = 1, j = 0; i < size; ++i) {
+            size_t bit = size >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j ^= bit;
+            if (i < j) std::swap(line[i], line[j]);
+        }
+        // Iterative Cooley-Tukey butterflies
+        for (size_t length = 2; length <= size; length <<= 1) {
+            const size_t half = length / 2;
+            const size_t step = size / length;
+            for (size_t start = 0; start < size; start += length) {
+                for (size_t k = 0; k < half; ++k) {
+                    const auto root = inverse ? std::conj(roots[k * step]) : roots[k * step];
+                    const auto odd = line[start + k + half] * root;
+                    line[start + k + half] = line[start + k] - odd;
+                    line[start + k] += odd;
+                }
+            }
+        }
+    }
+
+    void FFT2D::transform(std::vector<std::complex<double> > &data, const bool inverse,
+                          const unsigned int thread_count) const {
+        if (data.size() != width * height) {
+            throw std::runtime_error("The FFT data has the wrong size");
+        }
+        parallel_bands(height, thread_count, [&](const size_t start, const size_t end) {
+            for (size_t y = start; y < end; ++y) {
+                transform_line(data.data() + y * width, width, roots_x, inverse);
+            }
+        });
+        // The columns are copied into a contiguous buffer, the strided access would be slower
+        parallel_bands(width, thread_count, [&](const size_t start, const size_t end) {
+            std::vector<std::complex<double> > column(height);
+            for (size_t x = start; x < end; ++x) {
+                for (size_t y = 0; y < height; ++y) {
+                    column[y] = data[x + y * width];
+                }
+                transform_line(column.data(), height, roots_y, inverse);
+                for (size_t y = 0; y < height; ++y) {
+                    data[x + y * width] = column[y];
+                }
+            }
+        });
+    }
+
+    size_t FFT2D::get_width() const {
+        return width;
+    }
+
+    size_t FFT2D::get_height() const {
+        return height;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef FFT_H
+#define FFT_H
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace bluemap {
+    /// The smallest power of two that is at least value
+    size_t next_power_of_two(size_t value);
+
+    /**
+     * A two-dimensional radix-2 FFT over a row-major grid of complex values, used by the FFT influence engine to
+     * convolve the influence sources with the kernel. Both sides must be powers of two. The roots of unity are computed
+     * once per plan, a plan can be used from several threads.
+     */
+    class FFT2D {
+        size_t width;
+        size_t height;
+        /// exp(-2 pi i k / n) for k < n / 2
+        std::vector<std::complex<double> > roots_x;
+        std::vector<std::complex<double> > roots_y;
+
+        static void transform_line(std::complex<double> *line, size_t size,
+                                   const std::vector<std::complex<double> > &roots, bool inverse);
+
+    public:
+        /// @throws std::runtime_error if a side is not a power of two
+        FFT2D(size_t width, size_t height);
+
+        /**
+         * Transforms the grid in place. The inverse transform is not normalized, the result is scaled by
+         * width * height.
+         *
+         * @param data width * height values in row-major order
+         * @param inverse whether to calculate the inverse transform
+         * @param thread_count the number of threads to split the rows and columns between
+         */
+        void transform(std::vector<std::complex<double> > &data, bool inverse, unsigned int thread_count = 1) const;
+
+        [[nodiscard]] size_t get_width() const;
+
+        [[nodiscard]] size_t get_height() const;
+    };
+}
+
+#endif //FFT_H
@@ -0,0 +1,348 @@
+#include "Generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+namespace bluemap {
+    namespace {
+        constexpr id_t REGION_ID_OFFSET = 10000000;
+        constexpr id_t CONSTELLATION_ID_OFFSET = 20000000;
+        constexpr id_t SYSTEM_ID_OFFSET = 30000000;
+        constexpr id_t OWNER_ID_OFFSET = 99000000;
+
+        /**
+         * The distributions of the standard library are implementation defined, so they would produce different
+         * universes on different platforms. Only the raw output of the mt19937_64 engine is specified.
+         */
+        class Random {
+            std::mt19937_64 engine;
+
+        public:
+            explicit Random(const unsigned int seed) : engine(seed) {
+            }
+
+            /// Uniform in [0, 1)
+            double uniform() {
+                return static_cast<double>(engine() >> 11) * 0x1.0p-53;
+            }
+
+            /// Uniform in [0, n)
+            size_t index(const size_t n) {
+                return static_cast<size_t>(engine() % n);
+            }
+
+            double normal() {
+                // Box-Muller, 1 - uniform() is never zero
+                const double u1 = 1.0 - uniform();
+                const double u2 = uniform();
+                return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+            }
+        };
+
+        struct Point {
+            double x = 0.0;
+            double y = 0.0;
+        };
+
+        double dist_sq(const Point &a, const Point &b) {
+            return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+        }
+
+        /// Undirected jump graph without duplicates
+        class JumpSet {
+            std::set<std::pair<size_t, size_t> > jumps;
+
+        public:
+            bool add(size_t a, size_t b) {
+                if (a == b) return false;
+                if (a > b) std::swap(a, b);
+                return jumps.emplace(a, b).second;
+            }
+
+            [[nodiscard]] size_t size() const {
+                return jumps.size();
+            }
+
+            [[nodiscard]] const std::set<std::pair<size_t, size_t> > &get() const {
+                return jumps;
+            }
+        };
+
+        /// Returns the closest pair of systems between the two groups
+        std::pair<size_t, size_t> closest_pair(const std::vector<size_t> &a, const std::vector<size_t> &b,
+                                               const std::vector<Point> &positions) {
+            std::pair<size_t, size_t> best = {a.front(), b.front()};
+            double best_dist = std::numeric_limits<double>::max();
+            for (const auto i: a) {
+                for (const auto j: b) {
+                    if (const double d = dist_sq(positions[i], positions[j]); d < best_dist) {
+                        best_dist = d;
+                        best = {i, j};
+                    }
+                }
+            }
+            return best;
+        }
+
+        /// Connects every group to the closest of the previous groups (by center), the result is a spanning tree
+        void connect_groups(const std::vector<size_t> &groups, const std::vector<Point> &centers,
+                            const std::vector<std::vector<size_t> > &members, const std::vector<Point> &positions,
+                            JumpSet &jumps, std::vector<std::pair<size_t, size_t> > *links) {
+            for (size_t k = 1; k < groups.size(); ++k) {
+                const size_t group = groups[k];
+                size_t nearest = groups[0];
+                double nearest_dist = std::numeric_limits<double>::max();
+                for (size_t l = 0; l < k; ++l) {
+                    if (const double d = dist_sq(centers[group], centers[groups[l]]); d < nearest_dist) {
+                        nearest_dist = d;
+                        nearest = groups[l];
+                    }
+                }
+                const auto [from, to] = closest_pair(members[group], members[nearest], positions);
+                jumps.add(from, to);
+                if (links != nullptr) links->emplace_back(group, nearest);
+            }
+        }
+
+        double clamp(const double value, const double max) {
+            return std::min(std::max(value, 0.0), max);
+        }
+    }
+
+    Universe generate_universe(const UniverseConfig &config) {
+        if (config.system_count == 0 || config.width == 0 || config.height == 0 ||
+            config.systems_per_constellation == 0 || config.constellations_per_region == 0) {
+            throw std::invalid_argument("System count, resolution and group sizes must be positive");
+        }
+        Random random(config.seed);
+        const size_t system_count = config.system_count;
+        const size_t constellation_count = (system_count + config.systems_per_constellation - 1) /
+                                           config.systems_per_constellation;
+        const size_t region_count = (constellation_count + config.constellations_per_region - 1) /
+                                    config.constellations_per_region;
+        const double width = config.width - 1;
+        const double height = config.height - 1;
+
+        // Regions on a jittered grid which roughly matches the aspect ratio of the map
+        const auto columns = static_cast<size_t>(std::max(1.0, std::ceil(
+            std::sqrt(static_cast<double>(region_count) * config.width / config.height))));
+        const size_t rows = (region_count + columns - 1) / columns;
+        const double cell_width = config.width / static_cast<double>(columns);
+        const double cell_height = config.height / static_cast<double>(rows);
+        const double cell_size = std::min(cell_width, cell_height);
+        std::vector<Point> region_centers(region_count);
+        for (size_t r = 0; r < region_count; ++r) {
+            region_centers[r] = {
+                clamp((static_cast<double>(r % columns) + 0.2 + 0.6 * random.uniform()) * cell_width, width),
+                clamp((static_cast<double>(r / columns) + 0.2 + 0.6 * random.uniform()) * cell_height, height)
+            };
+        }
+        std::vector<Point> constellation_centers(constellation_count);
+        std::vector<size_t> constellation_region(constellation_count);
+        std::vector<std::vector<size_t> > region_constellations(region_count);
+        for (size_t c = 0; c < constellation_count; ++c) {
+            const size_t r = c / config.constellations_per_region;
+            constellation_region[c] = r;
+            region_constellations[r].push_back(c);
+            constellation_centers[c] = {
+                clamp(region_centers[r].x + random.normal() * cell_size * 0.25, width),
+                clamp(region_centers[r].y + random.normal() * cell_size * 0.25, height)
+            };
+        }
+        const double system_spread = cell_size * 0.25 / std::sqrt(static_cast<double>(config.constellations_per_region));
+        std::vector<Point> positions(system_count);
+        std::vector<size_t> system_constellation(system_count);
+        std::vector<std::vector<size_t> > constellation_systems(constellation_count);
+        for (size_t s = 0; s < system_count; ++s) {
+            const size_t c = s / config.systems_per_constellation;
+            system_constellation[s] = c;
+            constellation_systems[c].push_back(s);
+            positions[s] = {
+                std::round(clamp(constellation_centers[c].x + random.normal() * system_spread, width)),
+                std::round(clamp(constellation_centers[c].y + random.normal() * system_spread, height))
+            };
+        }
+        std::vector<std::vector<size_t> > region_systems(region_count);
+        for (size_t s = 0; s < system_count; ++s) {
+            region_systems[constellation_region[system_constellation[s]]].push_back(s);
+        }
+
+        // Spanning trees inside the constellations, between the constellations of a region and between the regions
+        JumpSet jumps;
+        std::vector<std::vector<size_t> > singletons(system_count);
+        for (size_t s = 0; s < system_count; ++s) singletons[s] = {s};
+        for (const auto &members: constellation_systems) {
+            connect_groups(members, positions, singletons, positions, jumps, nullptr);
+        }
+        std::vector<std::pair<size_t, size_t> > constellation_links;
+        for (const auto &members: region_constellations) {
+            connect_groups(members, constellation_centers, constellation_systems, positions, jumps,
+                           &constellation_links);
+        }
+        std::vector<size_t> regions(region_count);
+        for (size_t r = 0; r < region_count; ++r) regions[r] = r;
+        std::vector<std::pair<size_t, size_t> > region_links;
+        connect_groups(regions, region_centers, region_systems, positions, jumps, &region_links);
+        for (const auto &[a, b]: region_links) {
+            // The constellations at the region gate are neighbors as well
+            const auto [from, to] = closest_pair(region_systems[a], region_systems[b], positions);
+            constellation_links.emplace_back(system_constellation[from], system_constellation[to]);
+        }
+
+        // Additional jumps to the nearest systems of the constellation until the requested degree is reached
+        const auto target_jumps = static_cast<size_t>(config.jump_degree * static_cast<double>(system_count) / 2.0);
+        for (size_t attempt = 0; jumps.size() < target_jumps && attempt < target_jumps * 4; ++attempt) {
+            const size_t s = random.index(system_count);
+            const auto &members = constellation_systems[system_constellation[s]];
+            size_t nearest = s;
+            double nearest_dist = std::numeric_limits<double>::max();
+            for (const auto other: members) {
+                if (other == s) continue;
+                const auto key = std::minmax(s, other);
+                if (jumps.get().count({key.first, key.second})) continue;
+                if (const double d = dist_sq(positions[s], positions[other]); d < nearest_dist) {
+                    nearest_dist = d;
+                    nearest = other;
+                }
+            }
+            jumps.add(s, nearest);
+        }
+
+        // Owners grow from their home constellation over the constellation graph
+        std::vector<std::vector<size_t> > constellation_neighbors(constellation_count);
+        for (const auto &[a, b]: constellation_links) {
+            constellation_neighbors[a].push_back(b);
+            constellation_neighbors[b].push_back(a);
+        }
+        const size_t owner_count = std::min<size_t>(config.owner_count, constellation_count);
+        std::vector<size_t> constellation_owner(constellation_count, 0); // 0 = unclaimed, otherwise index + 1
+        std::vector<size_t> constellation_depth(constellation_count, 0);
+        std::vector<std::vector<size_t> > frontiers(owner_count);
+        for (size_t o = 0; o < owner_count; ++o) {
+            size_t home;
+            do {
+                home = random.index(constellation_count);
+            } while (constellation_owner[home] != 0);
+            constellation_owner[home] = o + 1;
+            frontiers[o].push_back(home);
+        }
+        const auto target_claimed = static_cast<size_t>(
+            std::ceil((1.0 - config.unclaimed_fraction) * static_cast<double>(constellation_count)));
+        size_t claimed = owner_count;
+        for (bool grown = true; grown && claimed < target_claimed;) {
+            grown = false;
+            for (size_t o = 0; o < owner_count && claimed < target_claimed; ++o) {
+                auto &frontier = frontiers[o];
+                while (!frontier.empty()) {
+                    const size_t pick = random.index(frontier.size());
+                    const size_t c = frontier[pick];
+                    std::vector<size_t> free;
+                    for (const auto n: constellation_neighbors[c]) {
+                        if (constellation_owner[n] == 0) free.push_back(n);
+                    }
+                    if (free.empty()) {
+                        frontier.erase(frontier.begin() + static_cast<std::ptrdiff_t>(pick));
+                        continue;
+                    }
+                    const size_t next = free[random.index(free.size())];
+                    constellation_owner[next] = o + 1;
+                    constellation_depth[next] = constellation_depth[c] + 1;
+                    frontier.push_back(next);
+                    ++claimed;
+                    grown = true;
+                    break;
+                }
+            }
+        }
+
+        Universe universe;
+        const auto npc_count = static_cast<size_t>(config.npc_fraction * static_cast<double>(owner_count));
+        for (size_t o = 0; o < owner_count; ++o) {
+            OwnerData owner;
+            owner.id = OWNER_ID_OFFSET + o + 1;
+            owner.npc = o < npc_count;
+            owner.color = NullableColor::null();
+            if (config.assign_colors) {
+                owner.color = NullableColor(
+                    static_cast<uint_fast8_t>(64 + random.index(192)),
+                    static_cast<uint_fast8_t>(64 + random.index(192)),
+                    static_cast<uint_fast8_t>(64 + random.index(192)));
+            }
+            universe.owners.push_back(owner);
+        }
+        for (size_t s = 0; s < system_count; ++s) {
+            const size_t c = system_constellation[s];
+            SolarSystemData system;
+            system.id = SYSTEM_ID_OFFSET + s + 1;
+            system.constellation_id = CONSTELLATION_ID_OFFSET + c + 1;
+            system.region_id = REGION_ID_OFFSET + constellation_region[c] + 1;
+            system.x = static_cast<unsigned int>(positions[s].x);
+            system.y = static_cast<unsigned int>(positions[s].y);
+            system.has_station = random.uniform() < config.station_density;
+            // The core of a territory is held more strongly than its edges
+            const double depth = static_cast<double>(constellation_depth[c]);
+            system.sov_power = std::max(1.0, 6.0 - depth * 0.75) * (0.6 + 0.4 * random.uniform());
+            system.owner = constellation_owner[c] == 0 ? 0 : universe.owners[constellation_owner[c] - 1].id;
+            universe.solar_systems.push_back(system);
+        }
+        for (const auto &[a, b]: jumps.get()) {
+            universe.jumps.push_back({universe.solar_systems[a].id, universe.solar_systems[b].id});
+            universe.jumps.push_back({universe.solar_systems[b].id, universe.solar_systems[a].id});
+        }
+        return universe;
+    }
+
+    void write_universe(const Universe &universe, const std::string &filename) {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Unable to open file");
+        }
+        write_big_endian<int32_t>(file, static_cast<int32_t>(universe.owners.size()));
+        for (const auto &owner: universe.owners) {
+            const std::string name = std::to_string(owner.id);
+            write_big_endian<int32_t>(file, static_cast<int32_t>(owner.id));
+            write_big_endian<uint16_t>(file, static_cast<uint16_t>(name.size()));
+            file.write(name.data(), static_cast<std::streamsize>(name.size()));
+            // The file format has no null colors
+            const Color color = owner.color ? static_cast<Color>(owner.color) : Color(255, 255, 255);
+            write_big_endian<int32_t>(file, color.red);
+            write_big_endian<int32_t>(file, color.green);
+            write_big_endian<int32_t>(file, color.blue);
+            write_big_endian<uint8_t>(file, owner.npc ? 1 : 0);
+        }
+        write_big_endian<int32_t>(file, static_cast<int32_t>(universe.solar_systems.size()));
+        for (const auto &system: universe.solar_systems) {
+            write_big_endian<int32_t>(file, static_cast<int32_t>(system.id));
+            write_big_endian<int32_t>(file, static_cast<int32_t>(system.x));
+            write_big_endian<int32_t>(file, static_cast<int32_t>(system.y));
+            write_big_endian<int32_t>(file, static_cast<int32_t>(system.region_id));
+            write_big_endian<int32_t>(file, static_cast<int32_t>(system.constellation_id));
+            write_big_endian<uint8_t>(file, system.has_station ? 1 : 0);
+            write_big_endian<double>(file, system.sov_power);
+            write_big_endian<int32_t>(file, static_cast<int32_t>(system.owner));
+        }
+        std::map<id_t, std::vector<id_t> > connections;
+        for (const auto &[from, to]: universe.jumps) {
+            connections[from].push_back(to);
+        }
+        write_big_endian<int32_t>(file, static_cast<int32_t>(connections.size()));
+        for (const auto &[from, targets]: connections) {
+            write_big_endian<int32_t>(file, static_cast<int32_t>(from));
+            write_big_endian<int32_t>(file, static_cast<int32_t>(targets.size()));
+            for (const auto to: targets) {
+                write_big_endian<int32_t>(file, static_cast<int32_t>(to));
+            }
+        }
+        if (!file) {
+            throw std::runtime_error("Unable to write file");
+        }
+    }
+}
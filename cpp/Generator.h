@@ -0,0 +1,56 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+#include <string>
+#include <vector>
+
+#include "Map.h"
+
+namespace bluemap {
+    /**
+     * The parameters for generate_universe(). The defaults resemble the real universe.
+     */
+    struct UniverseConfig {
+        unsigned int seed = 1;
+        unsigned int system_count = 5000;
+        /// Systems are grouped into constellations, constellations into regions
+        unsigned int systems_per_constellation = 8;
+        unsigned int constellations_per_region = 8;
+        /// The average number of jumps per system
+        double jump_degree = 2.5;
+        unsigned int owner_count = 60;
+        /// The fraction of constellations without an owner
+        double unclaimed_fraction = 0.3;
+        /// The fraction of owners which are npcs
+        double npc_fraction = 0.05;
+        double station_density = 0.15;
+        /// The resolution of the map, the systems are placed inside this area
+        unsigned int width = 928 * 2;
+        unsigned int height = 1024 * 2;
+        /// Assign random colors to the owners, otherwise the color generation function of the map is used
+        bool assign_colors = true;
+    };
+
+    struct Universe {
+        std::vector<OwnerData> owners;
+        std::vector<SolarSystemData> solar_systems;
+        /// Every jump is listed in both directions
+        std::vector<JumpData> jumps;
+    };
+
+    /**
+     * Generates a random universe. The same config (including the seed) always produces the same universe.
+     *
+     * The regions are spread evenly over the map, constellations and systems are clustered around their region and
+     * constellation centers. Systems are connected to their nearest neighbors inside the constellation, neighboring
+     * constellations and regions are connected by a few gates, so the whole universe is reachable. Owners claim
+     * connected areas around a randomly chosen home constellation.
+     *
+     * The result can be loaded with Map::load_data() or saved with write_universe().
+     */
+    [[nodiscard]] Universe generate_universe(const UniverseConfig &config);
+
+    /// Writes the universe in the binary format read by Map::load_data(const std::string &)
+    void write_universe(const Universe &universe, const std::string &filename);
+}
+
+#endif //GENERATOR_H
@@ -0,0 +1,293 @@
+#include "History.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+namespace bluemap {
+    namespace {
+        /// The size of a frame without its runs in the file: the date, the keyframe flag and the run count
+        constexpr size_t FRAME_HEADER_SIZE = 8 + 1 + 4;
+        /// The size of a run in the file: start, length and owner
+        constexpr size_t RUN_SIZE = 4 + 4 + 8;
+
+        /// Encodes the runs of all owned pixels
+        std::vector<OwnerHistory::Run> encode_keyframe(const id_t *raster, const size_t pixels) {
+            std::vector<OwnerHistory::Run> runs;
+            size_t i = 0;
+            while (i < pixels) {
+                const id_t owner = raster[i];
+                size_t end = i + 1;
+                while (end < pixels && raster[end] == owner) ++end;
+                if (owner != 0) {
+                    runs.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(end - i), owner});
+                }
+                i = end;
+            }
+            return runs;
+        }
+
+        /// Encodes the runs of pixels that differ from the previous raster, including pixels that lost their owner
+        std::vector<OwnerHistory::Run> encode_delta(const id_t *previous, const id_t *raster, const size_t pixels) {
+            std::vector<OwnerHistory::Run> runs;
+            size_t i = 0;
+            while (i < pixels) {
+                if (raster[i] == previous[i]) {
+                    ++i;
+                    continue;
+                }
+                const id_t owner = raster[i];
+                size_t end = i + 1;
+                while (end < pixels && raster[end] == owner && previous[end] != owner) ++end;
+                runs.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(end - i), owner});
+                i = end;
+            }
+            return runs;
+        }
+    }
+
+    OwnerHistory::OwnerHistory(const unsigned int width, const unsigned int height,
+                               const unsigned int keyframe_interval): width(width), height(height),
+                                                                      keyframe_interval(keyframe_interval) {
+        if (keyframe_interval == 0) {
+            throw std::runtime_error("The keyframe interval must be at least 1");
+        }
+        if (static_cast<unsigned long long>(width) * height > UINT32_MAX) {
+            throw std::runtime_error("The raster is too large for a history");
+        }
+    }
+
+    void OwnerHistory::apply(const Frame &frame, id_t *target, const size_t begin, const size_t end) {
+        const auto first = std::partition_point(frame.runs.begin(), frame.runs.end(), [begin](const Run &run) {
+            return static_cast<size_t>(run.start) + run.length <= begin;
+        });
+        for (auto run = first; run != frame.runs.end() && run->start < end; ++run) {
+            const size_t run_begin = std::max<size_t>(run->start, begin);
+            const size_t run_end = std::min<size_t>(static_cast<size_t>(run->start) + run->length, end);
+            std::fill(target + run_begin, target + run_end, run->owner);
+        }
+    }
+
+    void OwnerHistory::reconstruct_range(const size_t index, id_t *target, const size_t begin,
+                                         const size_t end) const {
+        size_t keyframe = index;
+        while (!frames[keyframe].keyframe) --keyframe;
+        std::fill(target + begin, target + end, 0);
+        for (size_t i = keyframe; i <= index; ++i) {
+            apply(frames[i], target, begin, end);
+        }
+    }
+
+    void OwnerHistory::append(const long long date, const id_t *raster) {
+        std::unique_lock lock(mutex);
+        if (!frames.empty() && date <= frames.back().date) {
+            throw std::runtime_error(
+                "The date " + std::to_string(date) + " is not after the last date " +
+                std::to_string(frames.back().date));
+        }
+        const size_t pixels = static_cast<size_t>(width) * height;
+        size_t since_keyframe = 0;
+        size_t keyframe_runs = 0;
+        for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame, ++since_keyframe) {
+            if (frame->keyframe) {
+                keyframe_runs = frame->runs.size();
+                break;
+            }
+        }
+
+        Frame frame{date, true, {}};
+        if (!frames.empty() && since_keyframe + 1 < keyframe_interval) {
+            frame.runs = encode_delta(last.get(), raster, pixels);
+            // If most of the map changed, a keyframe is about as large and faster to decode
+            frame.keyframe = frame.runs.size() > keyframe_runs;
+        }
+        if (frame.keyframe) {
+            frame.runs = encode_keyframe(raster, pixels);
+        }
+        if (last == nullptr) {
+            last = std::make_unique<id_t[]>(pixels);
+        }
+        std::copy_n(raster, pixels, last.get());
+        frames.push_back(std::move(frame));
+    }
+
+    size_t OwnerHistory::find(const long long date) const {
+        std::shared_lock lock(mutex);
+        const auto it = std::upper_bound(frames.begin(), frames.end(), date, [](const long long d, const Frame &frame) {
+            return d < frame.date;
+        });
+        if (it == frames.begin()) return frames.size();
+        return it - frames.begin() - 1;
+    }
+
+    void OwnerHistory::reconstruct(const size_t index, id_t *target, unsigned int thread_count) const {
+        std::shared_lock lock(mutex);
+        if (index >= frames.size()) {
+            throw std::runtime_error("Frame " + std::to_string(index) + " out of range");
+        }
+        const size_t pixels = static_cast<size_t>(width) * height;
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min(thread_count, std::max(1u, height));
+        // The bands are aligned to rows, so no two threads write into the same cache line of a row
+        auto band = [&](const unsigned int i) {
+            return static_cast<size_t>(i * static_cast<unsigned long long>(height) / thread_count) * width;
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < thread_count; ++i) {
+            threads.emplace_back([&, i] {
+                reconstruct_range(index, target, band(i), band(i + 1));
+            });
+        }
+        reconstruct_range(index, target, 0, thread_count > 1 ? band(1) : pixels);
+        for (auto &thread: threads) {
+            thread.join();
+        }
+    }
+
+    size_t OwnerHistory::size() const {
+        std::shared_lock lock(mutex);
+        return frames.size();
+    }
+
+    long long OwnerHistory::get_date(const size_t index) const {
+        std::shared_lock lock(mutex);
+        if (index >= frames.size()) {
+            throw std::runtime_error("Frame " + std::to_string(index) + " out of range");
+        }
+        return frames[index].date;
+    }
+
+    std::vector<long long> OwnerHistory::get_dates() const {
+        std::shared_lock lock(mutex);
+        std::vector<long long> dates;
+        dates.reserve(frames.size());
+        for (const auto &frame: frames) {
+            dates.push_back(frame.date);
+        }
+        return dates;
+    }
+
+    bool OwnerHistory::is_keyframe(const size_t index) const {
+        std::shared_lock lock(mutex);
+        if (index >= frames.size()) {
+            throw std::runtime_error("Frame " + std::to_string(index) + " out of range");
+        }
+        return frames[index].keyframe;
+    }
+
+    size_t OwnerHistory::run_count() const {
+        std::shared_lock lock(mutex);
+        size_t count = 0;
+        for (const auto &frame: frames) {
+            count += frame.runs.size();
+        }
+        return count;
+    }
+
+    unsigned int OwnerHistory::get_width() const {
+        return width;
+    }
+
+    unsigned int OwnerHistory::get_height() const {
+        return height;
+    }
+
+    void OwnerHistory::save(const std::string &filename) const {
+        std::shared_lock lock(mutex);
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Unable to open file");
+        }
+        file.write("SOVHV1.0", 8);
+        write_big_endian<int32_t>(file, width);
+        write_big_endian<int32_t>(file, height);
+        write_big_endian<int32_t>(file, keyframe_interval);
+        write_big_endian<uint32_t>(file, frames.size());
+        for (const auto &[date, keyframe, runs]: frames) {
+            write_big_endian<int64_t>(file, date);
+            write_big_endian<uint8_t>(file, keyframe);
+            write_big_endian<uint32_t>(file, runs.size());
+            for (const auto &[start, length, owner]: runs) {
+                write_big_endian<uint32_t>(file, start);
+                write_big_endian<uint32_t>(file, length);
+                write_big_endian<uint64_t>(file, owner);
+            }
+        }
+        file.close();
+    }
+
+    void OwnerHistory::load(const std::string &filename) {
+        std::unique_lock lock(mutex);
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw std::runtime_error("Unable to open file");
+        }
+        const auto file_size = static_cast<size_t>(file.tellg());
+        file.seekg(0);
+        char header[8] = {0};
+        file.read(header, 8);
+        if (std::string(header, 8) != "SOVHV1.0") {
+            throw std::runtime_error("Invalid file format: " + std::string(header, 8));
+        }
+        const auto file_width = read_big_endian<int32_t>(file);
+        const auto file_height = read_big_endian<int32_t>(file);
+        const auto file_interval = read_big_endian<int32_t>(file);
+        if (file_width <= 0 || file_height <= 0 || file_interval <= 0 ||
+            static_cast<unsigned long long>(file_width) * file_height > UINT32_MAX) {
+            throw std::runtime_error("Invalid history header");
+        }
+        const size_t pixels = static_cast<size_t>(file_width) * file_height;
+        // The counts are checked against the rest of the file before anything is allocated for them
+        auto remaining = [&] {
+            const auto position = file.tellg();
+            return position < 0 ? 0 : file_size - static_cast<size_t>(position);
+        };
+        const auto frame_count = read_big_endian<uint32_t>(file);
+        if (!file || frame_count > remaining() / FRAME_HEADER_SIZE) {
+            throw std::runtime_error("Invalid frame count in history file");
+        }
+        std::vector<Frame> loaded(frame_count);
+        for (size_t i = 0; i < loaded.size(); ++i) {
+            auto &[date, keyframe, runs] = loaded[i];
+            date = read_big_endian<int64_t>(file);
+            keyframe = read_big_endian<uint8_t>(file) != 0;
+            const auto run_count = read_big_endian<uint32_t>(file);
+            if (!file || run_count > remaining() / RUN_SIZE) {
+                throw std::runtime_error("Invalid run count in history file");
+            }
+            // find() does a binary search over the dates
+            if (i > 0 && date <= loaded[i - 1].date) {
+                throw std::runtime_error("Invalid history file, the dates are not increasing");
+            }
+            runs.resize(run_count);
+            size_t previous_end = 0;
+            for (auto &[start, length, owner]: runs) {
+                start = read_big_endian<uint32_t>(file);
+                length = read_big_endian<uint32_t>(file);
+                owner = read_big_endian<uint64_t>(file);
+                // apply() relies on sorted runs that do not overlap
+                if (start < previous_end || static_cast<size_t>(start) + length > pixels) {
+                    throw std::runtime_error("Invalid run in history file");
+                }
+                previous_end = static_cast<size_t>(start) + length;
+            }
+            if (!file) {
+                throw std::runtime_error("Unexpected end of history file");
+            }
+        }
+        if (!loaded.empty() && !loaded.front().keyframe) {
+            throw std::runtime_error("Invalid history file, the first frame is not a keyframe");
+        }
+        width = file_width;
+        height = file_height;
+        keyframe_interval = file_interval;
+        frames = std::move(loaded);
+        last = nullptr;
+        if (!frames.empty()) {
+            last = std::make_unique<id_t[]>(pixels);
+            reconstruct_range(frames.size() - 1, last.get(), 0, pixels);
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "Map.h"
+
+namespace bluemap {
+    /**
+     * A series of owner rasters (one per date, e.g. one per day), stored as run-length encoded keyframes and deltas.
+     *
+     * A raster has the layout of Map::set_old_owner_image(): width * height owner ids in row-major order, 0 means no
+     * owner. Every frame is either a keyframe, which lists the runs of all owned pixels, or a delta, which lists only the
+     * runs of pixels that changed since the previous frame. Usually only a few systems change their owner from one day
+     * to the next, so a delta is tiny compared to a full raster.
+     *
+     * The runs of a frame are sorted and never overlap, so a frame can be decoded for any range of pixels on its own.
+     * reconstruct() uses this to decode bands of the raster in parallel.
+     *
+     * All methods are thread safe.
+     */
+    class OwnerHistory {
+    public:
+        struct Run {
+            /// The index of the first pixel (x + y * width)
+            uint32_t start;
+            uint32_t length;
+            id_t owner;
+        };
+
+    private:
+        struct Frame {
+            long long date;
+            bool keyframe;
+            std::vector<Run> runs;
+        };
+
+        unsigned int width;
+        unsigned int height;
+        unsigned int keyframe_interval;
+        std::vector<Frame> frames;
+        /// The raster of the last frame, the next delta is calculated against it
+        std::unique_ptr<id_t[]> last = nullptr;
+        mutable std::shared_mutex mutex;
+
+        /// Applies the runs of the frame to the pixels [begin, end) of the target
+        static void apply(const Frame &frame, id_t *target, size_t begin, size_t end);
+
+        void reconstruct_range(size_t index, id_t *target, size_t begin, size_t end) const;
+
+    public:
+        /**
+         * @param width the width of the rasters
+         * @param height the height of the rasters
+         * @param keyframe_interval a keyframe is stored every keyframe_interval frames, this limits the number of deltas
+         * that have to be applied to reconstruct a frame
+         */
+        OwnerHistory(unsigned int width, unsigned int height, unsigned int keyframe_interval = 30);
+
+        /**
+         * Appends the raster as the newest frame. Only the changes to the previous frame are stored, unless a keyframe
+         * is due.
+         *
+         * @param date the date of the raster, e.g. the number of the day. Must be greater than the date of the last frame
+         * @param raster width * height owner ids
+         * @throws std::runtime_error if the date is not increasing
+         */
+        void append(long long date, const id_t *raster);
+
+        /// Returns the index of the newest frame with a date less than or equal to the given one, or size() if none
+        [[nodiscard]] size_t find(long long date) const;
+
+        /**
+         * Writes the raster of the frame into the target, the pixels are split into bands that are decoded by separate
+         * threads.
+         *
+         * @param index the index of the frame
+         * @param target width * height owner ids
+         * @param thread_count the number of threads to decode with
+         * @throws std::runtime_error if the index is out of range
+         */
+        void reconstruct(size_t index, id_t *target, unsigned int thread_count = 1) const;
+
+        [[nodiscard]] size_t size() const;
+
+        [[nodiscard]] long long get_date(size_t index) const;
+
+        [[nodiscard]] std::vector<long long> get_dates() const;
+
+        [[nodiscard]] bool is_keyframe(size_t index) const;
+
+        /// The number of stored runs over all frames, each run takes 16 bytes
+        [[nodiscard]] size_t run_count() const;
+
+        [[nodiscard]] unsigned int get_width() const;
+
+        [[nodiscard]] unsigned int get_height() const;
+
+        void save(const std::string &filename) const;
+
+        /// Replaces the content (including the size) with the history stored in the file
+        void load(const std::string &filename);
+    };
+}
+
+#endif //HISTORY_H
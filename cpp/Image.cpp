@@ -1,14 +1,68 @@
 #include "Image.h"
+#include "PngEncoder.h"
 
-#if defined(EVE_MAPPER_LINK_STB) && EVE_MAPPER_LINK_STB
-#ifndef STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#endif
-#include "stb_image_write.h"
-#endif
-
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr char RAW_MAGIC[4] = {'B', 'M', 'R', 'W'};
+    constexpr size_t RAW_HEADER_SIZE = 16;
+    constexpr char QOI_MAGIC[4] = {'q', 'o', 'i', 'f'};
+    constexpr size_t QOI_HEADER_SIZE = 14;
+    constexpr uint8_t QOI_END_MARKER[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    /// Limit from the QOI specification to prevent overflows in decoders
+    constexpr uint64_t QOI_PIXELS_MAX = 400000000;
+
+    constexpr uint8_t QOI_OP_INDEX = 0x00;
+    constexpr uint8_t QOI_OP_DIFF = 0x40;
+    constexpr uint8_t QOI_OP_LUMA = 0x80;
+    constexpr uint8_t QOI_OP_RUN = 0xC0;
+    constexpr uint8_t QOI_OP_RGB = 0xFE;
+    constexpr uint8_t QOI_OP_RGBA = 0xFF;
+    constexpr uint8_t QOI_MASK_2 = 0xC0;
+
+    /// Collects small writes in a fixed buffer and passes them to the stream in large blocks
+    class BufferedWriter {
+        std::ofstream &file;
+        std::vector<char> buffer;
+        size_t pos = 0;
+
+    public:
+        explicit BufferedWriter(std::ofstream &file, const size_t size = 1 << 20) : file(file), buffer(size) {
+        }
+
+        void put(const uint8_t value) {
+            if (pos == buffer.size()) flush();
+            buffer[pos++] = static_cast<char>(value);
+        }
+
+        void put_u32(const uint32_t value) {
+            put(static_cast<uint8_t>(value >> 24));
+            put(static_cast<uint8_t>(value >> 16));
+            put(static_cast<uint8_t>(value >> 8));
+            put(static_cast<uint8_t>(value));
+        }
+
+        void flush() {
+            file.write(buffer.data(), static_cast<std::streamsize>(pos));
+            pos = 0;
+        }
+    };
+
+    uint32_t get_u32(const uint8_t *bytes) {
+        return static_cast<uint32_t>(bytes[0]) << 24 | static_cast<uint32_t>(bytes[1]) << 16 |
+               static_cast<uint32_t>(bytes[2]) << 8 | static_cast<uint32_t>(bytes[3]);
+    }
+
+    int qoi_hash(const uint8_t *px) {
+        return (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+    }
+}
 
 Color Color::with_alpha(uint8_t alpha) const {
     return {red, green, blue, alpha};
@@ -27,11 +81,13 @@ Image::Image(const unsigned int width, const unsigned int height) : data(nullptr
 }
 
 Image::~Image() {
+    detach();
     delete[] data;
     data = nullptr;
 }
 
 void Image::resize(const unsigned int width, const unsigned int height) {
+    detach();
     delete[] data;
     data = nullptr;
     this->width = width;
@@ -83,7 +139,24 @@ void Image::reset() const {
     std::fill_n(data, width * height * 4, 0);
 }
 
+void Image::attach(uint8_t *target) {
+    if (target == nullptr) throw std::invalid_argument("Target must not be null");
+    if (owns_data) {
+        detached_data = data;
+        owns_data = false;
+    }
+    data = target;
+}
+
+void Image::detach() {
+    if (owns_data) return;
+    data = detached_data;
+    detached_data = nullptr;
+    owns_data = true;
+}
+
 uint8_t * Image::retrieve_data() {
+    if (!owns_data) return nullptr;
     const auto d = data;
     this->data = nullptr;
     return d;
@@ -107,15 +180,189 @@ const uint8_t *Image::get_pixel_unsafe(const unsigned int x, const unsigned int
     return &data[(y * width + x) * 4];
 }
 
-void Image::write(const char *filename) const {
+uint8_t *Image::get_row_unsafe(const unsigned int y) const {
+    if (data == nullptr)  throw std::runtime_error("Image has not been allocated");
+    return &data[static_cast<size_t>(y) * width * 4];
+}
+
+void Image::write(const char *filename, const int level, const unsigned int thread_count) const {
     if (data == nullptr)  throw std::runtime_error("Image has not been allocated");
-#if defined(EVE_MAPPER_LINK_STB) && EVE_MAPPER_LINK_STB
-    if (!stbi_write_png(filename, width, height, 4, data, width * 4)) {
+    png::write(filename, data, width, height, level, thread_count);
+}
+
+void Image::write_raw(const char *filename) const {
+    if (data == nullptr)  throw std::runtime_error("Image has not been allocated");
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Unable to open file");
+    }
+    uint8_t header[RAW_HEADER_SIZE] = {0};
+    std::memcpy(header, RAW_MAGIC, 4);
+    for (int i = 0; i < 4; ++i) {
+        header[4 + i] = static_cast<uint8_t>(width >> (24 - 8 * i));
+        header[8 + i] = static_cast<uint8_t>(height >> (24 - 8 * i));
+    }
+    header[12] = 4;
+    file.write(reinterpret_cast<const char *>(header), RAW_HEADER_SIZE);
+    file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(width) * height * 4);
+    if (!file) {
+        throw std::runtime_error("Unable to write image");
+    }
+}
+
+void Image::write_qoi(const char *filename) const {
+    if (data == nullptr)  throw std::runtime_error("Image has not been allocated");
+    if (width == 0 || height == 0 || static_cast<uint64_t>(width) * height >= QOI_PIXELS_MAX) {
+        throw std::runtime_error("Invalid image size for QOI");
+    }
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Unable to open file");
+    }
+    BufferedWriter out(file);
+    for (const char c: QOI_MAGIC) out.put(c);
+    out.put_u32(width);
+    out.put_u32(height);
+    out.put(4); // channels
+    out.put(0); // sRGB with linear alpha
+
+    uint8_t index[64][4] = {};
+    uint8_t prev[4] = {0, 0, 0, 255};
+    int run = 0;
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < pixel_count; ++i) {
+        const uint8_t *px = data + i * 4;
+        if (std::memcmp(px, prev, 4) == 0) {
+            ++run;
+            if (run == 62 || i == pixel_count - 1) {
+                out.put(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.put(QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+        const int hash = qoi_hash(px);
+        if (std::memcmp(index[hash], px, 4) == 0) {
+            out.put(QOI_OP_INDEX | hash);
+        } else {
+            std::memcpy(index[hash], px, 4);
+            if (px[3] == prev[3]) {
+                const auto vr = static_cast<int8_t>(px[0] - prev[0]);
+                const auto vg = static_cast<int8_t>(px[1] - prev[1]);
+                const auto vb = static_cast<int8_t>(px[2] - prev[2]);
+                const int vg_r = vr - vg;
+                const int vg_b = vb - vg;
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    out.put(QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                    out.put(QOI_OP_LUMA | (vg + 32));
+                    out.put((vg_r + 8) << 4 | (vg_b + 8));
+                } else {
+                    out.put(QOI_OP_RGB);
+                    out.put(px[0]);
+                    out.put(px[1]);
+                    out.put(px[2]);
+                }
+            } else {
+                out.put(QOI_OP_RGBA);
+                out.put(px[0]);
+                out.put(px[1]);
+                out.put(px[2]);
+                out.put(px[3]);
+            }
+        }
+        std::memcpy(prev, px, 4);
+    }
+    for (const uint8_t b: QOI_END_MARKER) out.put(b);
+    out.flush();
+    if (!file) {
         throw std::runtime_error("Unable to write image");
     }
-#else
-    throw std::runtime_error("STB image write is not linked");
-#endif
+}
+
+void Image::read(const char *filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Unable to open file");
+    }
+    const auto file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+    uint8_t header[RAW_HEADER_SIZE] = {0};
+    if (file_size < QOI_HEADER_SIZE || !file.read(reinterpret_cast<char *>(header), QOI_HEADER_SIZE)) {
+        throw std::runtime_error("Invalid image file: file too short");
+    }
+    const uint32_t file_width = get_u32(header + 4);
+    const uint32_t file_height = get_u32(header + 8);
+    if (file_width == 0 || file_height == 0) {
+        throw std::runtime_error("Invalid image size");
+    }
+    const size_t pixel_count = static_cast<size_t>(file_width) * file_height;
+
+    if (std::memcmp(header, RAW_MAGIC, 4) == 0) {
+        if (header[12] != 4) throw std::runtime_error("Invalid image file: unsupported channel count");
+        if (file_size != RAW_HEADER_SIZE + pixel_count * 4) {
+            throw std::runtime_error("Invalid image file: size does not match the header");
+        }
+        resize(file_width, file_height);
+        file.seekg(RAW_HEADER_SIZE);
+        if (!file.read(reinterpret_cast<char *>(data), static_cast<std::streamsize>(pixel_count * 4))) {
+            throw std::runtime_error("Unable to read image");
+        }
+        return;
+    }
+    if (std::memcmp(header, QOI_MAGIC, 4) != 0) {
+        throw std::runtime_error("Invalid image file: unsupported format");
+    }
+    if (header[12] != 3 && header[12] != 4) throw std::runtime_error("Invalid image file: unsupported channel count");
+    if (pixel_count >= QOI_PIXELS_MAX) throw std::runtime_error("Invalid image size for QOI");
+
+    std::vector<uint8_t> bytes(file_size - QOI_HEADER_SIZE);
+    if (!file.read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()))) {
+        throw std::runtime_error("Unable to read image");
+    }
+    resize(file_width, file_height);
+    uint8_t index[64][4] = {};
+    uint8_t px[4] = {0, 0, 0, 255};
+    int run = 0;
+    // The end marker is not part of the chunks, truncated files will be padded with the last pixel
+    const size_t chunks_end = bytes.size() >= sizeof(QOI_END_MARKER) ? bytes.size() - sizeof(QOI_END_MARKER) : 0;
+    size_t p = 0;
+    for (size_t i = 0; i < pixel_count; ++i) {
+        if (run > 0) {
+            --run;
+        } else if (p < chunks_end) {
+            const uint8_t b1 = bytes[p++];
+            if (b1 == QOI_OP_RGB) {
+                px[0] = bytes[p++];
+                px[1] = bytes[p++];
+                px[2] = bytes[p++];
+            } else if (b1 == QOI_OP_RGBA) {
+                px[0] = bytes[p++];
+                px[1] = bytes[p++];
+                px[2] = bytes[p++];
+                px[3] = bytes[p++];
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                std::memcpy(px, index[b1], 4);
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                px[0] += ((b1 >> 4) & 0x03) - 2;
+                px[1] += ((b1 >> 2) & 0x03) - 2;
+                px[2] += (b1 & 0x03) - 2;
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                const uint8_t b2 = bytes[p++];
+                const int vg = (b1 & 0x3F) - 32;
+                px[0] += vg - 8 + ((b2 >> 4) & 0x0F);
+                px[1] += vg;
+                px[2] += vg - 8 + (b2 & 0x0F);
+            } else {
+                run = b1 & 0x3F;
+            }
+            std::memcpy(index[qoi_hash(px)], px, 4);
+        }
+        std::memcpy(data + i * 4, px, 4);
+    }
 }
 
 unsigned int Image::get_width() const {
@@ -3,6 +3,16 @@
 #include <cstdint>
 #include <tuple>
 
+/// The file formats supported by Image::write and Map::save
+enum class ImageFormat {
+    /// Compressed PNG, see png::encode()
+    PNG,
+    /// The "Quite OK Image Format" (https://qoiformat.org), fast lossless compression
+    QOI,
+    /// Uncompressed RGBA data with a 16 byte header, see Image::write_raw()
+    RAW,
+};
+
 struct Color {
     uint8_t red = 0;
     uint8_t green = 0;
@@ -36,6 +46,9 @@ class Image {
     unsigned int height;
 
     uint8_t *data;
+    /// The own buffer while external memory is attached, see attach()
+    uint8_t *detached_data = nullptr;
+    bool owns_data = true;
 
 public:
     Image(unsigned int width, unsigned int height);
@@ -57,7 +70,17 @@ public:
 
     void reset() const;
 
-    /// Returns the raw data, THE CALLER IS RESPONSIBLE FOR DELETING IT
+    /**
+     * Lets the image use external memory instead of its own buffer, e.g. a numpy array or a memory mapped file. The
+     * memory must hold width * height * 4 bytes (RGBA, row-major, no padding), it is not freed by the image and must stay
+     * valid until detach() is called. The own buffer is kept and restored by detach().
+     */
+    void attach(uint8_t *target);
+
+    /// Switches back to the own buffer, does nothing if no external memory is attached
+    void detach();
+
+    /// Returns the raw data, THE CALLER IS RESPONSIBLE FOR DELETING IT. Returns nullptr while external memory is attached
     [[nodiscard]] uint8_t *retrieve_data();
 
     [[nodiscard]] Color get_pixel(unsigned int x, unsigned int y) const;
@@ -65,7 +88,29 @@ public:
     /// Get pixel without bounds checking
     [[nodiscard]] const uint8_t *get_pixel_unsafe(unsigned int x, unsigned int y) const;
 
-    void write(const char *filename) const;
+    /// The RGBA pixels of a row without bounds checking
+    [[nodiscard]] uint8_t *get_row_unsafe(unsigned int y) const;
+
+    /**
+     * Writes the image as a PNG file, see png::encode().
+     *
+     * @param filename the path of the file
+     * @param level the compression level (0-9)
+     * @param thread_count the number of threads to compress with, 0 for all available cores
+     */
+    void write(const char *filename, int level = 4, unsigned int thread_count = 0) const;
+
+    /**
+     * Writes the uncompressed RGBA data with a small header: the magic "BMRW", the width and height as big endian
+     * uint32, the channel count (always 4) and three reserved bytes. The pixel data follows directly (row-major).
+     */
+    void write_raw(const char *filename) const;
+
+    /// Writes the image in the QOI format
+    void write_qoi(const char *filename) const;
+
+    /// Loads an image written by write_raw() or write_qoi() into this image, the format is detected from the header
+    void read(const char *filename);
 
     [[nodiscard]] unsigned int get_width() const;
 
@@ -0,0 +1,195 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+/*
+ * The spatial kernels for the influence of a solar system on a pixel. Every kernel is a small struct with the weight
+ * function, the squared cutoff distance and the threshold below which a pixel has no owner. The render loops are
+ * templates over the kernel (see with_kernel()), so every kernel compiles to its own loop without a dispatch per pixel.
+ * The weight is a template over the floating point type, the influence can be accumulated in float or double. Hot loops
+ * use weight_function(), which converts the constants to that type once instead of on every call.
+ */
+namespace bluemap {
+    /// power / (softening + d²), the classic kernel
+    struct InverseSquareKernel {
+        double softening = 500.0;
+        double cutoff_sq = 160000.0;
+        double threshold = 0.023;
+
+        template<typename Real>
+        struct Weight {
+            Real softening;
+
+            Real operator()(const Real power, const Real dist_sq) const {
+                return power / (softening + dist_sq);
+            }
+        };
+
+        template<typename Real>
+        [[nodiscard]] Weight<Real> weight_function() const {
+            return {static_cast<Real>(softening)};
+        }
+
+        template<typename Real>
+        [[nodiscard]] Real weight(const Real power, const Real dist_sq) const {
+            return weight_function<Real>()(power, dist_sq);
+        }
+    };
+
+    /// power * exp(-d² / (2 sigma²))
+    struct GaussianKernel {
+        /// 1 / (2 sigma²)
+        double falloff = 1.0 / (2.0 * 50.0 * 50.0);
+        double cutoff_sq = 40000.0;
+        double threshold = 0.023;
+
+        template<typename Real>
+        struct Weight {
+            Real falloff;
+
+            Real operator()(const Real power, const Real dist_sq) const {
+                return power * std::exp(-dist_sq * falloff);
+            }
+        };
+
+        template<typename Real>
+        [[nodiscard]] Weight<Real> weight_function() const {
+            return {static_cast<Real>(falloff)};
+        }
+
+        template<typename Real>
+        [[nodiscard]] Real weight(const Real power, const Real dist_sq) const {
+            return weight_function<Real>()(power, dist_sq);
+        }
+    };
+
+    /// power * (1 - d / cutoff), reaches zero at the cutoff
+    struct LinearKernel {
+        /// 1 / cutoff
+        double taper = 1.0 / 200.0;
+        double cutoff_sq = 40000.0;
+        double threshold = 0.023;
+
+        template<typename Real>
+        struct Weight {
+            Real taper;
+
+            Real operator()(const Real power, const Real dist_sq) const {
+                return power * (Real(1) - std::sqrt(dist_sq) * taper);
+            }
+        };
+
+        template<typename Real>
+        [[nodiscard]] Weight<Real> weight_function() const {
+            return {static_cast<Real>(taper)};
+        }
+
+        template<typename Real>
+        [[nodiscard]] Real weight(const Real power, const Real dist_sq) const {
+            return weight_function<Real>()(power, dist_sq);
+        }
+    };
+
+    enum class KernelType {
+        INVERSE_SQUARE,
+        GAUSSIAN,
+        LINEAR,
+    };
+
+    struct KernelConfig {
+        KernelType type = KernelType::INVERSE_SQUARE;
+        /// The softening of the inverse square kernel or sigma of the gaussian kernel, always 0 for the linear kernel
+        double parameter = 500.0;
+        /// Systems further away than the cutoff don't influence a pixel
+        double cutoff = 400.0;
+        /// Pixels with less influence have no owner
+        double threshold = 0.023;
+
+        /**
+         * Creates the config of a kernel by its name: "inverse_square", "gaussian" or "linear". Negative values are
+         * replaced by the defaults of the kernel.
+         *
+         * @throws std::runtime_error if the name is unknown or a value is invalid
+         */
+        static KernelConfig from_name(const std::string &name, double parameter = -1, double cutoff = -1,
+                                      double threshold = -1) {
+            KernelConfig config;
+            if (name == "inverse_square") {
+                config = {KernelType::INVERSE_SQUARE, 500.0, 400.0, 0.023};
+            } else if (name == "gaussian") {
+                config = {KernelType::GAUSSIAN, 50.0, 200.0, 0.023};
+                // Four sigma by default, the weight is below the default threshold there
+                if (parameter >= 0 && cutoff < 0) config.cutoff = 4 * parameter;
+            } else if (name == "linear") {
+                config = {KernelType::LINEAR, 0.0, 200.0, 0.023};
+            } else {
+                throw std::runtime_error("Unknown kernel " + name);
+            }
+            if (parameter >= 0) config.parameter = parameter;
+            if (cutoff >= 0) config.cutoff = cutoff;
+            if (threshold >= 0) config.threshold = threshold;
+            config.validate();
+            return config;
+        }
+
+        [[nodiscard]] std::string get_name() const {
+            switch (type) {
+                case KernelType::INVERSE_SQUARE: return "inverse_square";
+                case KernelType::GAUSSIAN: return "gaussian";
+                case KernelType::LINEAR: return "linear";
+            }
+            return "unknown";
+        }
+
+        /// @throws std::runtime_error if a value is out of range for the kernel
+        void validate() const {
+            if (!(cutoff > 0) || !std::isfinite(cutoff)) {
+                throw std::runtime_error("The kernel cutoff must be positive");
+            }
+            if (!(threshold >= 0) || !std::isfinite(threshold)) {
+                throw std::runtime_error("The kernel threshold must not be negative");
+            }
+            if (type == KernelType::LINEAR && parameter != 0.0) {
+                throw std::runtime_error("The linear kernel has no parameter");
+            }
+            if (type != KernelType::LINEAR && (!(parameter > 0) || !std::isfinite(parameter))) {
+                throw std::runtime_error("The " + get_name() + " kernel requires a positive parameter");
+            }
+        }
+    };
+
+    /// Calls the function with the kernel of the config, the function is instantiated once per kernel type
+    template<typename Function>
+    decltype(auto) with_kernel(const KernelConfig &config, Function &&function) {
+        const double cutoff_sq = config.cutoff * config.cutoff;
+        switch (config.type) {
+            case KernelType::GAUSSIAN:
+                return function(GaussianKernel{
+                    1.0 / (2.0 * config.parameter * config.parameter), cutoff_sq, config.threshold
+                });
+            case KernelType::LINEAR:
+                return function(LinearKernel{1.0 / config.cutoff, cutoff_sq, config.threshold});
+            case KernelType::INVERSE_SQUARE:
+            default:
+                return function(InverseSquareKernel{config.parameter, cutoff_sq, config.threshold});
+        }
+    }
+
+    /**
+     * with_kernel() that also selects the floating point type of the influence sums. The function is called with the
+     * kernel and a value of the type (float or double) as tag.
+     */
+    template<typename Function>
+    decltype(auto) with_kernel(const KernelConfig &config, const bool single_precision, Function &&function) {
+        return with_kernel(config, [&](const auto &kernel) {
+            if (single_precision) {
+                return function(kernel, 0.0f);
+            }
+            return function(kernel, 0.0);
+        });
+    }
+}
+
+#endif //KERNEL_H
@@ -1,13 +1,20 @@
 #include "Map.h"
+#include "FFT.h"
+#include "Raster.h"
+#include "Tiles.h"
+#include "Topology.h"
 
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <filesystem>
 #include <functional>
 #include <queue>
 #include <thread>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 #if defined(EVE_MAPPER_PYTHON) && EVE_MAPPER_PYTHON
@@ -49,8 +56,7 @@ namespace bluemap {
     }
 
     void Owner::increment_counter() {
-        std::lock_guard lock(guard);
-        count++;
+        count.fetch_add(1, std::memory_order_relaxed);
     }
 
     id_t Owner::get_id() const {
@@ -149,7 +155,7 @@ namespace bluemap {
         return y;
     }
 
-    std::vector<std::tuple<std::shared_ptr<Owner>, double> > SolarSystem::get_influences() {
+    const std::vector<std::tuple<std::shared_ptr<Owner>, double> > &SolarSystem::get_influences() const {
         return influences;
     }
 
@@ -165,14 +171,13 @@ namespace bluemap {
 
         while (!current.empty()) {
             for (const auto s_id: current) {
-                const auto sys = solar_systems[s_id];
+                const auto sys = solar_systems.find(s_id);
                 if (sys == nullptr) continue;
                 if (std::find(visited.begin(), visited.end(), s_id) != visited.end()) continue;
                 visited.push_back(s_id);
                 sys->add_influence(owner, value);
-                if (std::find(sov_solar_systems.begin(), sov_solar_systems.end(), sys.get()) == sov_solar_systems.
-                    end()) {
-                    sov_solar_systems.push_back(sys.get());
+                if (std::find(sov_solar_systems.begin(), sov_solar_systems.end(), sys) == sov_solar_systems.end()) {
+                    sov_solar_systems.push_back(sys);
                 }
                 for (const auto &neighbor: connections[s_id]) {
                     if (std::find(visited.begin(), visited.end(), neighbor->get_id()) != visited.end()) continue;
@@ -188,42 +193,177 @@ namespace bluemap {
         }
     }
 
+    Color Map::compose_pixel(Owner *owner, const double influence, const bool draw_border) {
+        int alpha;
+        Py_Trace_Errors(alpha = static_cast<int>(influence_to_alpha(influence));)
+        if (!owner->has_color()) {
+            Color new_color;
+            Py_Trace_Errors(new_color = generate_owner_color(owner->get_id());)
+            owner->set_color(new_color);
+        }
+        return owner->get_color().with_alpha(draw_border ? std::max(border_alpha, alpha) : alpha);
+    }
+
+    void Map::draw_old_owner_hatch(uint8_t *pixels, Owner *const *row_owners, const double *row_influence,
+                                   const uint32_t *old_owner_row, const std::vector<Owner *> &palette,
+                                   const unsigned int count, const unsigned int pattern_x,
+                                   const unsigned int pattern_y) {
+        // Only the pixels with (pattern_y + pattern_x + i) % slant == 0 are part of the hatching
+        constexpr unsigned int slant = 5;
+        for (unsigned int i = (slant - (pattern_y % slant + pattern_x % slant) % slant) % slant; i < count; i += slant) {
+            Owner *old_owner = palette[old_owner_row[i]];
+            const Owner *owner = row_owners[i];
+            if (old_owner == nullptr || owner == nullptr || owner->is_npc() ||
+                old_owner->get_id() == owner->get_id()) {
+                continue;
+            }
+            int alpha;
+            Py_Trace_Errors(alpha = static_cast<int>(influence_to_alpha(row_influence[i]));)
+            if (!old_owner->has_color()) {
+                Color new_color;
+                Py_Trace_Errors(new_color = generate_owner_color(old_owner->get_id());)
+                old_owner->set_color(new_color);
+            }
+            const auto color = static_cast<Color>(old_owner->get_color()).with_alpha(alpha); // NOLINT(*-slicing)
+            uint8_t *pixel = pixels + static_cast<size_t>(i) * 4;
+            pixel[0] = color.red;
+            pixel[1] = color.green;
+            pixel[2] = color.blue;
+            pixel[3] = color.alpha;
+        }
+    }
+
+    void Map::index_old_owners() {
+        old_owner_palette.assign(1, 0);
+        old_owner_indices = nullptr;
+        if (old_owners_image == nullptr) return;
+        const size_t size = static_cast<size_t>(width) * height;
+        auto indices = std::make_unique<uint32_t[]>(size);
+        std::unordered_map<id_t, uint32_t> palette_indices;
+        const id_t *old_owners = old_owners_image.get();
+        // Neighboring pixels mostly have the same old owner
+        id_t last_id = 0;
+        uint32_t last_index = 0;
+        for (size_t i = 0; i < size; ++i) {
+            const id_t id = old_owners[i];
+            if (id != last_id) {
+                last_id = id;
+                if (id == 0) {
+                    last_index = 0;
+                } else {
+                    const auto [it, inserted] = palette_indices.try_emplace(
+                        id, static_cast<uint32_t>(old_owner_palette.size()));
+                    if (inserted) old_owner_palette.push_back(id);
+                    last_index = it->second;
+                }
+            }
+            indices[i] = last_index;
+        }
+        old_owner_indices = std::move(indices);
+    }
+
+    std::vector<Owner *> Map::resolve_old_owner_palette() const {
+        std::vector<Owner *> palette(old_owner_palette.size(), nullptr);
+        for (size_t i = 1; i < palette.size(); ++i) {
+            if (const auto owner = owners.find(old_owner_palette[i]); owner != nullptr && !owner->is_npc()) {
+                palette[i] = owner;
+            }
+        }
+        return palette;
+    }
+
     Map::ColumnWorker::ColumnWorker(Map *map, const unsigned int start_x,
                                     const unsigned int end_x): map(map),
                                                                start_x(start_x),
                                                                end_x(end_x), cache(end_x - start_x, 16) {
         assert(map != nullptr);
         assert(start_x < end_x);
-        this->render_old_owners = map->old_owners_image != nullptr;
+        this->render_old_owners = map->old_owner_indices != nullptr;
     }
 
-    std::tuple<Owner *, double> Map::ColumnWorker::calculate_influence(unsigned int x, unsigned int y) const {
-        std::map<Owner *, double> total_influence = {};
-        for (auto &solar_system: map->sov_solar_systems) {
+    void Map::ColumnWorker::prepare_sources() {
+        prepare_sources(map->sov_solar_systems);
+    }
+
+    void Map::ColumnWorker::prepare_sources(const std::vector<SolarSystem *> &systems) {
+        sources.clear();
+        contribution_owners.clear();
+        contribution_powers.clear();
+        contribution_powers_float.clear();
+        sources.reserve(systems.size());
+        for (const auto solar_system: systems) {
             assert(solar_system != nullptr);
-            const int dx = static_cast<int>(x) - static_cast<int>(solar_system->get_x());
-            const int dy = static_cast<int>(y) - static_cast<int>(solar_system->get_y());
-            const double dist_sq = dx * dx + dy * dy;
-            if (dist_sq > 160000) continue;
-            for (auto &[owner, power]: solar_system->get_influences()) {
+            const auto begin = static_cast<uint32_t>(contribution_owners.size());
+            for (const auto &[owner, power]: solar_system->get_influences()) {
                 assert(owner != nullptr);
-                //const auto res = total_influence.try_emplace(owner, 0.0);
-                const double old = total_influence[owner.get()];
-                total_influence[owner.get()] = old + power / (500 + dist_sq);
+                const uint32_t index = map->owners.index_of(owner->get_id());
+                if (index == EntityStore<Owner>::NO_INDEX || map->owners[index] != owner) {
+                    throw std::runtime_error("Solar system " + std::to_string(solar_system->get_id()) +
+                                             " is influenced by an owner that is not part of the map");
+                }
+                contribution_owners.push_back(index);
+                contribution_powers.push_back(power);
+                contribution_powers_float.push_back(static_cast<float>(power));
+            }
+            sources.push_back({
+                static_cast<int>(solar_system->get_x()), static_cast<int>(solar_system->get_y()), begin,
+                static_cast<uint32_t>(contribution_owners.size())
+            });
+        }
+        owner_sums.assign(map->owners.size(), 0.0);
+        owner_sums_float.assign(map->owners.size(), 0.0f);
+        touched_owners.clear();
+    }
+
+    std::tuple<Owner *, double> Map::ColumnWorker::calculate_influence(const unsigned int x, const unsigned int y) const {
+        return with_kernel(map->kernel_config, map->single_precision, [&](const auto &kernel, auto real) {
+            return calculate_influence<std::decay_t<decltype(kernel)>, decltype(real)>(x, y, kernel);
+        });
+    }
+
+    template<typename Kernel, typename Real, typename Coordinate>
+    std::tuple<Owner *, double> Map::ColumnWorker::calculate_influence(const Coordinate x, const Coordinate y,
+                                                                       const Kernel &kernel) const {
+        // Pixels use exact integer distances, fractional coordinates are measured in double
+        using Difference = std::conditional_t<std::is_floating_point_v<Coordinate>, double, int>;
+        // Local copies of the constants and data pointers, the writes to the sums could alias them otherwise
+        const auto weight = kernel.template weight_function<Real>();
+        const auto cutoff_sq = static_cast<Real>(kernel.cutoff_sq);
+        const Real threshold = static_cast<Real>(kernel.threshold);
+        const uint32_t *const owner_indices = contribution_owners.data();
+        const Real *const owner_powers = powers<Real>().data();
+        Real *const owner_sums = sums<Real>().data();
+        for (const auto &source: sources) {
+            const Difference dx = static_cast<Difference>(x) - source.x;
+            const Difference dy = static_cast<Difference>(y) - source.y;
+            const Real dist_sq = static_cast<Real>(dx * dx + dy * dy);
+            if (dist_sq > cutoff_sq) continue;
+            STATS(++systems_visited;)
+            for (uint32_t i = source.begin; i < source.end; ++i) {
+                STATS(++owner_contributions;)
+                const uint32_t owner = owner_indices[i];
+                if (owner_sums[owner] == Real(0)) touched_owners.push_back(owner);
+                owner_sums[owner] += weight(owner_powers[i], dist_sq);
             }
         }
-        double best_influence = 0.0;
+        Real best_influence = 0;
         Owner *best_owner = nullptr;
-        for (const auto &[owner, influence]: total_influence) {
-            if (influence > best_influence) {
+        for (const uint32_t index: touched_owners) {
+            const Real influence = owner_sums[index];
+            owner_sums[index] = 0;
+            Owner *owner = map->owners[index].get();
+            // Ties go to the lowest address, the order the owners had in the std::map this replaced
+            if (influence > best_influence || (influence == best_influence && influence > 0 && owner < best_owner)) {
                 best_owner = owner;
                 best_influence = influence;
             }
         }
-        if (best_influence < 0.023) best_owner = nullptr;
-        return {best_owner, best_influence};
+        touched_owners.clear();
+        if (best_influence < threshold) best_owner = nullptr;
+        return {best_owner, static_cast<double>(best_influence)};
     }
 
+    template<typename Kernel, typename Real>
     void Map::ColumnWorker::process_pixel(
         const unsigned int width,
         const unsigned int i,
@@ -231,10 +371,11 @@ namespace bluemap {
         std::vector<Owner *> &this_row,
         const std::vector<Owner *> &prev_row,
         std::vector<double> &prev_influence,
-        std::vector<bool> &border
+        std::vector<bool> &border,
+        const Kernel &kernel
     ) const {
         const unsigned int x = start_x + i;
-        auto [owner, influence] = calculate_influence(x, y);
+        auto [owner, influence] = calculate_influence<Kernel, Real>(x, y, kernel);
 
         this_row[i] = owner;
 
@@ -250,50 +391,19 @@ namespace bluemap {
                 const bool draw_border = border[i] || owner_changed ||
                                          i > 0 && prev_row[i - 1] != prev_row[i] ||
                                          i < width - 1 && prev_row[i + 1] != prev_row[i];
-                int alpha;
-                Py_Trace_Errors(alpha = static_cast<int>(map->influence_to_alpha(prev_influence[i]));)
-                if (!prev_owner->is_npc()) {
-                    if (!prev_owner->has_color()) {
-                        Color new_color;
-                        Py_Trace_Errors(new_color = map->generate_owner_color(prev_owner->get_id());)
-                        prev_owner->set_color(new_color);
-                    }
-                    const auto color = prev_owner->get_color().with_alpha(
-                        draw_border ? std::max(map->border_alpha, alpha) : alpha
-                    );
-                    cache.set_pixel(i, y - row_offset, color);
-                } else {
-                    cache.set_pixel(i, y - row_offset, {0, 0, 0, 0});
-                }
-
-                if (render_old_owners) {
-                    if (const auto old_owner_id = map->old_owners_image.get()[x + y * map->get_width()];
-                        old_owner_id != 0 && old_owner_id != prev_owner->get_id()
-                    ) {
-                        const auto old_owner = map->owners[old_owner_id];
-                        if (old_owner != nullptr && !old_owner->is_npc()) {
-                            Color old_color = {255, 255, 255};
-                            if (!old_owner->has_color()) {
-                                Color new_color;
-                                Py_Trace_Errors(new_color = map->generate_owner_color(old_owner->get_id());)
-                                old_owner->set_color(new_color);
-                            }
-                            old_color = static_cast<Color>(old_owner->get_color()); // NOLINT(*-slicing)
-
-                            if (constexpr int slant = 5;
-                                (y % slant + x) % slant == 0
-                            ) {
-                                cache.set_pixel(i, y - row_offset, old_color.with_alpha(alpha));
-                            }
-                        }
-                    }
-                }
+                Color color;
+                Py_Trace_Errors(color = map->compose_pixel(prev_owner, prev_influence[i], draw_border);)
+                cache.set_pixel(i, y - row_offset, color);
             }
         }
         if (owner != nullptr) {
             owner->increment_counter();
-            const size_t index = x + y * map->width;
-            map->owner_image.get()[index] = owner;
+        }
+        const size_t index = x + y * map->width;
+        map->owner_image.get()[index] = owner;
+        map->influence_image.get()[index] = influence;
+        if (const auto export_buffer = map->influence_export.get(); export_buffer != nullptr) {
+            export_buffer[index] = static_cast<float>(influence);
         }
 
         prev_influence[i] = influence;
@@ -301,8 +411,17 @@ namespace bluemap {
     }
 
     void Map::ColumnWorker::render() {
+        STATS(const auto start = StatsClock::now();)
+        TraceSpan worker_span(map->tracer, "render_worker", "render", start_x, end_x);
         std::lock_guard render_lock(render_mutex);
-        std::shared_lock map_lock(map->map_mutex);
+        std::shared_lock map_lock(map->map_mutex, std::defer_lock);
+        {
+            TraceSpan wait_span(map->tracer, "wait_map_lock", "lock");
+            map_lock.lock();
+        }
+        STATS(const auto busy_start = StatsClock::now();)
+        STATS(systems_visited = 0;)
+        STATS(owner_contributions = 0;)
 
         const unsigned int width = end_x - start_x;
         const unsigned int height = map->get_height();
@@ -310,24 +429,60 @@ namespace bluemap {
         std::vector<Owner *> prev_row(width);
         std::vector<bool> border(width);
         std::vector<double> prev_influence(width);
+        row_offset = 0;
+        cache.reset();
+        // The worker may have been created before the influence was calculated
+        prepare_sources();
+        render_old_owners = map->old_owner_indices != nullptr;
+        if (render_old_owners) {
+            old_owner_palette = map->resolve_old_owner_palette();
+        }
 
-        for (unsigned int y = 0; y < height; ++y) {
-            for (unsigned int i = 0; i < width; ++i) {
-                Py_Trace_Errors(process_pixel(width, i, y, this_row, prev_row, prev_influence, border);)
-            }
+        long long band_start = map->tracer.now();
+        unsigned int y = 0;
+        // The rows are rendered by a loop specialized for the kernel and precision
+        with_kernel(map->kernel_config, map->single_precision, [&](const auto &kernel, auto real) {
+            using Kernel = std::decay_t<decltype(kernel)>;
+            using Real = decltype(real);
+            for (; y < height; ++y) {
+                if (map->render_cancelled.load(std::memory_order_relaxed)) break;
+                for (unsigned int i = 0; i < width; ++i) {
+                    // Parentheses, the template arguments would split the macro argument
+                    Py_Trace_Errors((process_pixel<Kernel, Real>(width, i, y, this_row, prev_row, prev_influence,
+                        border, kernel));)
+                }
+                if (render_old_owners && y > 0) {
+                    // The owners drawn into row y are the owners of row y - 1
+                    const size_t row_start = start_x + static_cast<size_t>(y - 1) * map->width;
+                    map->draw_old_owner_hatch(cache.get_row_unsafe(y - row_offset), map->owner_image.get() + row_start,
+                                              map->influence_image.get() + row_start,
+                                              map->old_owner_indices.get() + row_start + map->width, old_owner_palette,
+                                              width, start_x, y);
+                }
 
-            const auto t = prev_row;
-            prev_row = this_row;
-            this_row = t;
-            if (y > row_offset && y - row_offset == 15) {
-                map->paste_cache(start_x, y - 15, cache);
-                row_offset = y + 1;
-                cache.reset();
-                // Fuck C why the hell did this line cause so much trouble: cache = Image(width, 16);
+                const auto t = prev_row;
+                prev_row = this_row;
+                this_row = t;
+                if (y > row_offset && y - row_offset == 15) {
+                    map->tracer.record("rows", "render", band_start, row_offset, y + 1);
+                    map->paste_cache(start_x, y - 15, cache);
+                    row_offset = y + 1;
+                    cache.reset();
+                    band_start = map->tracer.now();
+                    // Fuck C why the hell did this line cause so much trouble: cache = Image(width, 16);
+                }
+                map->rendered_pixels.fetch_add(width, std::memory_order_relaxed);
             }
+        });
+        if (y > row_offset) {
+            map->tracer.record("rows", "render", band_start, row_offset, y);
         }
-        // Paste the remaining cache
-        map->paste_cache(start_x, row_offset, cache, height - row_offset);
+        // Paste the remaining cache (only the finished rows if the rendering got cancelled)
+        map->paste_cache(start_x, row_offset, cache, static_cast<int>(y - row_offset));
+        STATS(map->stats.pixels.fetch_add(static_cast<unsigned long long>(width) * y, std::memory_order_relaxed);)
+        STATS(map->stats.systems_visited.fetch_add(systems_visited, std::memory_order_relaxed);)
+        STATS(map->stats.owner_contributions.fetch_add(owner_contributions, std::memory_order_relaxed);)
+        STATS(map->stats.add_worker(start, busy_start);)
     }
 
     Map::MapOwnerLabel::MapOwnerLabel() = default;
@@ -338,13 +493,14 @@ namespace bluemap {
     /**
      *
      * Performs a flood fill on the owner_image to detect connected regions of the same owner
-     * As a result, all entries in the owner_image will be set to nullptr
+     * All visited pixels are marked in the visited vector, the owner_image itself is not modified
      *
      * @param x the x coordinate to start the flood fill
      * @param y the y coordinate
      * @param label the label to detect the region
+     * @param visited the already visited pixels, must have a size of width * height
      */
-    void Map::owner_flood_fill(unsigned int x, unsigned int y, MapOwnerLabel &label) {
+    void Map::owner_flood_fill(unsigned int x, unsigned int y, MapOwnerLabel &label, std::vector<bool> &visited) {
         std::queue<std::pair<unsigned int, unsigned int> > q;
         q.emplace(x, y);
 
@@ -353,12 +509,11 @@ namespace bluemap {
             q.pop();
 
             const size_t index = cx + cy * width;
-            if (owner_image[index] == nullptr || owner_image[index]->get_id() != label.owner_id) {
+            if (visited[index] || owner_image[index] == nullptr || owner_image[index]->get_id() != label.owner_id) {
                 continue;
             }
 
-            // Set the current pixel to nullptr
-            owner_image[index] = nullptr;
+            visited[index] = true;
             ++label.count;
             label.x += cx;
             label.y += cy;
@@ -373,6 +528,7 @@ namespace bluemap {
 
     Map::Map() {
         this->owner_image = std::make_unique<Owner *[]>(width * height);
+        this->influence_image = std::make_unique<double[]>(width * height);
 
         sov_power_function = [](const double sov_power, bool, id_t) {
             double influence = 10.0;
@@ -406,32 +562,45 @@ namespace bluemap {
 
     void Map::clear() {
         std::unique_lock lock(map_mutex);
+        clear_topology();
         owners.clear();
         solar_systems.clear();
         connections.clear();
         sov_solar_systems.clear();
         owner_image = nullptr;
+        influence_image = nullptr;
     }
 
     void Map::update_size(const unsigned int width, const unsigned int height, const unsigned int sample_rate) {
         std::unique_lock lock(map_mutex);
+        if (topology != nullptr && (topology->get_width() != width || topology->get_height() != height)) {
+            clear_topology();
+        }
         this->width = width;
         this->height = height;
         this->sample_rate = sample_rate;
         image.resize(width, height);
         owner_image = std::make_unique<Owner *[]>(width * height);
+        influence_image = std::make_unique<double[]>(width * height);
+        influence_export = nullptr;
         old_owners_image = nullptr;
+        index_old_owners();
     }
 
     void Map::load_data(const std::string &filename) {
+        STATS(PhaseTimer timer(stats, "load_data");)
+        TraceSpan span(tracer, "load_data", "load");
         std::unique_lock lock(map_mutex);
         std::ifstream file(filename, std::ios::binary);
         if (!file) {
             throw std::runtime_error("Unable to open file");
         }
+        clear_topology();
+        clear_entities();
 
         int owner_size = read_big_endian<int32_t>(file);
         LOG("Loading " << owner_size << " owners")
+        owners.reserve(std::max(owner_size, 0));
         for (int i = 0; i < owner_size; ++i) {
             int id = read_big_endian<int32_t>(file);
             int name_length = read_big_endian<uint16_t>(file);
@@ -441,13 +610,12 @@ namespace bluemap {
             int color_green = read_big_endian<int32_t>(file);
             int color_blue = read_big_endian<int32_t>(file);
             int is_npc = read_big_endian<uint8_t>(file);
-            std::shared_ptr<Owner> owner = std::make_shared<Owner>(
-                id, name, color_red, color_green, color_blue, is_npc);
-            owners[id] = owner;
+            owners.emplace(id, name, color_red, color_green, color_blue, is_npc);
         }
 
         int systems_size = read_big_endian<int32_t>(file);
         LOG("Loading " << systems_size << " solar systems")
+        solar_systems.reserve(std::max(systems_size, 0));
         for (int i = 0; i < systems_size; ++i) {
             int id = read_big_endian<int32_t>(file);
             int x = read_big_endian<int32_t>(file);
@@ -458,9 +626,8 @@ namespace bluemap {
             auto adm = read_big_endian<double>(file);
             int sovereignty_id = read_big_endian<int32_t>(file);
 
-            std::shared_ptr<Owner> sovereignty = (sovereignty_id == 0) ? nullptr : owners[sovereignty_id];
-            solar_systems[id] = std::make_shared<SolarSystem>(id, constellation_id, region_id, x, y, has_station, adm,
-                                                              sovereignty);
+            std::shared_ptr<Owner> sovereignty = (sovereignty_id == 0) ? nullptr : owners.get(sovereignty_id);
+            solar_systems.emplace(id, constellation_id, region_id, x, y, has_station, adm, sovereignty);
         }
 
         int jumps_table_size = read_big_endian<int32_t>(file);
@@ -473,7 +640,7 @@ namespace bluemap {
             value.reserve(value_size);
             for (int j = 0; j < value_size; ++j) {
                 int ss_id = read_big_endian<int32_t>(file);
-                value.push_back(solar_systems[ss_id].get());
+                value.push_back(solar_systems.find(ss_id));
             }
             connections[key_id] = value;
         }
@@ -483,20 +650,24 @@ namespace bluemap {
 
     void Map::load_data(const std::vector<OwnerData> &owners, const std::vector<SolarSystemData> &solar_systems,
                         const std::vector<JumpData> &jumps) {
+        STATS(PhaseTimer timer(stats, "load_data");)
+        TraceSpan span(tracer, "load_data", "load");
         std::unique_lock lock(map_mutex);
+        clear_topology();
+        clear_entities();
+        this->owners.reserve(owners.size());
         for (const auto &owner_data: owners) {
             if (owner_data.color)
-                this->owners[owner_data.id] = std::make_shared<Owner>(
+                this->owners.emplace(
                     owner_data.id, "", owner_data.color.red,
                     owner_data.color.green, owner_data.color.blue, owner_data.npc
                 );
             else
-                this->owners[owner_data.id] = std::make_shared<Owner>(
-                    owner_data.id, "", owner_data.npc
-                );
+                this->owners.emplace(owner_data.id, "", owner_data.npc);
         }
+        this->solar_systems.reserve(solar_systems.size());
         for (const auto &solar_system_data: solar_systems) {
-            this->solar_systems[solar_system_data.id] = std::make_shared<SolarSystem>(
+            this->solar_systems.emplace(
                 solar_system_data.id,
                 solar_system_data.constellation_id,
                 solar_system_data.region_id,
@@ -506,246 +677,1338 @@ namespace bluemap {
                 solar_system_data.sov_power,
                 solar_system_data.owner == 0
                     ? nullptr
-                    : this->owners[solar_system_data.owner]
+                    : this->owners.get(solar_system_data.owner)
             );
         }
         for (const auto &[sys_from, sys_to]: jumps) {
-            connections[sys_from].push_back(this->solar_systems[sys_to].get());
+            connections[sys_from].push_back(this->solar_systems.find(sys_to));
         }
     }
 
     void Map::set_data(const std::vector<std::shared_ptr<Owner> > &owners,
                        const std::vector<std::shared_ptr<SolarSystem> > &solar_systems,
                        const std::vector<JumpData> &jumps) {
+        STATS(PhaseTimer timer(stats, "set_data");)
+        TraceSpan span(tracer, "set_data", "load");
         std::unique_lock lock(map_mutex);
+        clear_topology();
+        clear_entities();
+        this->owners.reserve(owners.size());
         for (const auto &owner: owners) {
-            this->owners[owner->get_id()] = owner;
+            this->owners.insert(owner);
         }
+        this->solar_systems.reserve(solar_systems.size());
         for (const auto &solar_system: solar_systems) {
-            this->solar_systems[solar_system->get_id()] = solar_system;
+            this->solar_systems.insert(solar_system);
         }
         for (const auto &[sys_from, sys_to]: jumps) {
-            connections[sys_from].push_back(this->solar_systems[sys_to].get());
+            connections[sys_from].push_back(this->solar_systems.find(sys_to));
         }
     }
 
-    void Map::set_sov_power_function(std::function<double(double, bool, id_t)> sov_power_function) {
-        std::unique_lock lock(map_mutex);
-        this->sov_power_function = std::move(sov_power_function);
-    }
-
-    void Map::set_power_falloff_function(std::function<double(double, double, int)> power_falloff_function) {
-        std::unique_lock lock(map_mutex);
-        this->power_falloff_function = std::move(power_falloff_function);
-    }
-
-    void Map::set_influence_to_alpha_function(std::function<double(double)> influence_to_alpha) {
+    std::shared_ptr<const Topology> Map::create_topology() const {
         std::unique_lock lock(map_mutex);
-        this->influence_to_alpha = std::move(influence_to_alpha);
+        return build_topology();
     }
 
-    void Map::calculate_influence() {
-        std::unique_lock lock(map_mutex);
-        if (sov_solar_systems.empty()) {
-            for (const auto &sys: solar_systems) {
-                if (sys.second->get_owner() != nullptr) {
-                    sov_solar_systems.push_back(sys.second.get());
-                }
-            }
+    std::shared_ptr<const Topology> Map::build_topology() const {
+        if (topology != nullptr) {
+            return topology;
         }
-        LOG("Calculating influence for " << sov_solar_systems.size() << " solar systems")
-        auto sov_orig = sov_solar_systems;
-
-        for (const auto &solar_system: sov_orig) {
-            const id_t owner_id = solar_system->get_owner() == nullptr ? 0 : solar_system->get_owner()->get_id();
-            double influence;
-            Py_Trace_Errors(
-                influence = sov_power_function(
-                    solar_system->get_sov_power(),
-                    solar_system->is_has_station(),
-                    owner_id);)
-            const int level = (solar_system->get_sov_power() >= 6.0) ? 1 : 2;
-            Py_Trace_Errors(
-                add_influence(solar_system, solar_system->get_owner(), influence, influence, level);)
+        std::vector<Topology::System> systems;
+        systems.reserve(solar_systems.size());
+        for (const auto &system: solar_systems) {
+            systems.push_back({
+                system->get_id(), system->get_constellation_id(), system->get_region_id(), system->get_x(), system->get_y()
+            });
+        }
+        std::vector<JumpData> jumps;
+        for (const auto &[sys_from, targets]: connections) {
+            for (const auto target: targets) {
+                if (target != nullptr) jumps.push_back({sys_from, target->get_id()});
+            }
         }
+        return std::make_shared<const Topology>(width, height, std::move(systems), jumps);
     }
 
-    void Map::render_multithreaded() {
-        const unsigned int thread_count = std::thread::hardware_concurrency();
-        std::vector<std::thread> threads;
-        std::vector<ColumnWorker *> workers;
-        LOG("Starting " << thread_count << " threads")
-        for (int i = 0; i < thread_count; ++i) {
-            const unsigned int start_x = i * width / thread_count;
-            const unsigned int end_x = (i + 1) * width / thread_count;
-            workers.emplace_back(create_worker(start_x, end_x));
-            //std::cout << "Starting thread " << i << " with x range " << start_x << " to " << end_x << std::endl;
-            threads.emplace_back(&ColumnWorker::render, workers.back());
+    void Map::set_topology(std::shared_ptr<const Topology> topology) {
+        std::unique_lock lock(map_mutex);
+        if (topology == nullptr) {
+            throw std::runtime_error("Topology must not be null");
         }
-        LOG("Waiting for threads to finish")
-        for (auto &thread: threads) {
-            if (thread.joinable())
-                thread.join();
+        if (topology->get_width() != width || topology->get_height() != height) {
+            throw std::runtime_error(
+                "Invalid topology dimensions, expected " + std::to_string(width) + "x" + std::to_string(height) +
+                " but got " + std::to_string(topology->get_width()) + "x" + std::to_string(topology->get_height()));
         }
-        for (const auto worker: workers) {
-            delete worker;
+        clear_topology();
+        owners.clear();
+        solar_systems.clear();
+        connections.clear();
+        sov_solar_systems.clear();
+        if (owner_image != nullptr) {
+            std::fill_n(owner_image.get(), static_cast<size_t>(width) * height, nullptr);
         }
-        LOG("Rendering completed")
+        this->topology = std::move(topology);
+        snapshot.assign(this->topology->size(), {});
     }
 
-    std::vector<Map::MapOwnerLabel> Map::calculate_labels() {
+    void Map::load_snapshot(const std::vector<std::shared_ptr<Owner> > &owners,
+                            const std::vector<SolarSystemData> &solar_systems) {
+        TraceSpan span(tracer, "load_snapshot", "load");
         std::unique_lock lock(map_mutex);
-        std::vector<MapOwnerLabel> labels;
-        // Iterate over all pixels according to the sample rate
-        for (unsigned int y = 0; y < height; y += sample_rate) {
-            for (unsigned int x = 0; x < width; x += sample_rate) {
-                // Get the owner at the current pixel
-                const Owner *owner = owner_image.get()[x + y * width];
-                if (owner == nullptr) {
-                    continue;
-                }
-                if (owner->is_npc()) {
-                    continue;
-                }
-                auto label = MapOwnerLabel{owner->get_id()};
-                owner_flood_fill(x, y, label);
-                label.x = label.x / label.count + sample_rate / 2;
-                label.y = label.y / label.count + sample_rate / 2;
-                labels.push_back(label);
+        if (topology == nullptr) {
+            throw std::runtime_error("No topology set");
+        }
+        // The influence and owner image reference the owners of the previous snapshot
+        sov_solar_systems.clear();
+        influenced_systems.clear();
+        if (owner_image != nullptr) {
+            std::fill_n(owner_image.get(), static_cast<size_t>(width) * height, nullptr);
+        }
+        this->owners.clear();
+        this->owners.reserve(owners.size());
+        for (const auto &owner: owners) {
+            this->owners.insert(owner);
+        }
+        snapshot.assign(topology->size(), {});
+        for (const auto &system: solar_systems) {
+            const size_t index = topology->find(system.id);
+            if (index == topology->size()) continue;
+            auto &state = snapshot[index];
+            state.has_station = system.has_station;
+            state.sov_power = system.sov_power;
+            if (system.owner != 0) {
+                state.owner = this->owners.get(system.owner);
             }
         }
-        return labels;
     }
 
-    Map::ColumnWorker *Map::create_worker(unsigned int start_x, unsigned int end_x) {
-        image.alloc();
-        return new ColumnWorker(this, start_x, end_x);
+    void Map::clear_entities() {
+        // The previous data is replaced, sov_solar_systems and connections would keep dangling pointers otherwise
+        owners.clear();
+        solar_systems.clear();
+        connections.clear();
+        sov_solar_systems.clear();
+        // The cached owners might be deleted as well
+        if (owner_image != nullptr) {
+            std::fill_n(owner_image.get(), static_cast<size_t>(width) * height, nullptr);
+        }
     }
 
-    void Map::paste_cache(const unsigned int start_x, const unsigned int start_y, const Image &cache, int height) {
-        std::lock_guard lock(image_mutex);
-        if (height == -1) {
-            height = cache.get_height();
-        }
-        for (unsigned int y = 0; y < height; ++y) {
-            for (unsigned int x = 0; x < cache.get_width(); ++x) {
-                auto [r, g, b, a] = cache.get_pixel(x, y);
-                image.set_pixel(start_x + x, start_y + y, r, g, b, a);
-            }
+    void Map::clear_topology() {
+        if (topology == nullptr) return;
+        topology = nullptr;
+        snapshot.clear();
+        sov_solar_systems.clear();
+        influenced_systems.clear();
+        if (owner_image != nullptr) {
+            std::fill_n(owner_image.get(), static_cast<size_t>(width) * height, nullptr);
         }
     }
 
-    void Map::save_owner_image(const std::string &filename) const {
-        std::ofstream file(filename, std::ios::binary);
-        if (!file) {
-            throw std::runtime_error("Unable to open file");
+    void Map::calculate_snapshot_influence() {
+        const size_t count = topology->size();
+        sov_solar_systems.clear();
+        influenced_systems.clear();
+        std::vector<SolarSystem *> carriers(count, nullptr);
+        auto carrier = [&](const size_t i) {
+            if (carriers[i] == nullptr) {
+                const auto &[id, constellation_id, region_id, x, y] = topology->get_system(i);
+                influenced_systems.push_back(std::make_unique<SolarSystem>(id, constellation_id, region_id, x, y));
+                carriers[i] = influenced_systems.back().get();
+                sov_solar_systems.push_back(carriers[i]);
+            }
+            return carriers[i];
+        };
+        // Same order as for own data: the owned systems by id, followed by the systems reached by the influence
+        for (size_t i = 0; i < count; ++i) {
+            if (snapshot[i].owner != nullptr) carrier(i);
         }
-        file.write("SOVNV1.0", 8);
-        // Write header with width and height
-        write_big_endian<int32_t>(file, width);
-        write_big_endian<int32_t>(file, height);
-        // Write the owner ids
-        for (unsigned int x = 0; x < width; ++x) {
-            for (unsigned int y = 0; y < height; ++y) {
-                if (const Owner *owner = owner_image.get()[x + y * width]; owner == nullptr) {
-                    write_big_endian<int64_t>(file, -1);
-                } else {
-                    write_big_endian<int64_t>(file, static_cast<int64_t>(owner->get_id()));
+        LOG("Calculating influence for " << sov_solar_systems.size() << " solar systems")
+
+        // Same spreading as add_influence(), the visited systems are marked with the number of the source
+        std::vector<size_t> visited(count, 0);
+        std::vector<size_t> current;
+        std::vector<size_t> next;
+        size_t source_mark = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const auto &[owner, sov_power, has_station] = snapshot[i];
+            if (owner == nullptr) continue;
+            double influence;
+            Py_Trace_Errors(influence = sov_power_function(sov_power, has_station, owner->get_id());)
+            const double base_value = influence;
+            int distance = sov_power >= 6.0 ? 1 : 2;
+            ++source_mark;
+            current.assign(1, i);
+            while (!current.empty()) {
+                for (const auto s: current) {
+                    if (visited[s] == source_mark) continue;
+                    visited[s] = source_mark;
+                    carrier(s)->add_influence(owner, influence);
+                    for (auto n = topology->neighbors_begin(s); n != topology->neighbors_end(s); ++n) {
+                        if (visited[*n] != source_mark) next.push_back(*n);
+                    }
                 }
+                std::swap(current, next);
+                next.clear();
+                ++distance;
+                if (power_max_distance >= 0 && distance >= power_max_distance) break;
+                Py_Trace_Errors(influence = power_falloff_function(influence, base_value, distance);)
+                if (influence <= 0.0) break;
             }
         }
-        file.close();
     }
 
-    void Map::load_old_owners(const std::string &filename) {
-        std::unique_lock lock(map_mutex);
-        std::ifstream file(filename, std::ios::binary);
-        if (!file) {
-            throw std::runtime_error("Unable to open file");
+    namespace {
+        constexpr char SHARED_STATE_MAGIC[8] = {'S', 'O', 'V', 'S', 'V', '1', '.', '2'};
+        constexpr uint8_t SHARED_OWNER_HAS_COLOR = 1;
+        constexpr uint8_t SHARED_OWNER_NPC = 2;
+
+        struct SharedStateHeader {
+            char magic[8];
+            uint32_t width;
+            uint32_t height;
+            uint64_t system_count;
+            uint64_t jump_count;
+            uint64_t owner_count;
+            uint64_t name_bytes;
+            uint64_t influenced_count;
+            uint64_t influence_count;
+            uint64_t has_old_owners;
+            /// The size of the old owner palette, see Map::index_old_owners()
+            uint64_t old_owner_palette_count;
+            uint64_t total_size;
+            /// The render settings, an attached map renders like the exporting one
+            uint32_t kernel_type;
+            uint32_t engine;
+            double kernel_parameter;
+            double kernel_cutoff;
+            double kernel_threshold;
+            uint64_t single_precision;
+        };
+
+        struct SharedSystemState {
+            id_t owner;
+            double sov_power;
+            uint64_t has_station;
+        };
+
+        struct SharedOwner {
+            id_t id;
+            uint64_t name_offset;
+            uint32_t name_length;
+            uint8_t red;
+            uint8_t green;
+            uint8_t blue;
+            uint8_t flags;
+        };
+
+        struct SharedInfluence {
+            id_t owner;
+            double value;
+        };
+
+        static_assert(sizeof(Topology::System) == 32, "Unexpected padding of Topology::System");
+        static_assert(sizeof(SharedOwner) == 24, "Unexpected padding of SharedOwner");
+
+        /// The offsets of the sections of a shared state, every section is aligned to 8 bytes
+        struct SharedStateLayout {
+            size_t systems;
+            size_t neighbor_offsets;
+            size_t neighbors;
+            size_t states;
+            size_t owners;
+            size_t names;
+            /// The topology indices of the systems with influence, in the order of sov_solar_systems
+            size_t influenced;
+            size_t influence_offsets;
+            size_t influences;
+            size_t old_owners;
+            size_t old_owner_palette;
+            size_t old_owner_indices;
+            size_t total;
+
+            explicit SharedStateLayout(const SharedStateHeader &header) {
+                size_t offset = 0;
+                auto section = [&offset](const size_t bytes) {
+                    const size_t start = offset;
+                    offset = (offset + bytes + 7) & ~static_cast<size_t>(7);
+                    return start;
+                };
+                section(sizeof(SharedStateHeader));
+                systems = section(header.system_count * sizeof(Topology::System));
+                neighbor_offsets = section((header.system_count + 1) * sizeof(uint32_t));
+                neighbors = section(header.jump_count * sizeof(uint32_t));
+                states = section(header.system_count * sizeof(SharedSystemState));
+                owners = section(header.owner_count * sizeof(SharedOwner));
+                names = section(header.name_bytes);
+                influenced = section(header.influenced_count * sizeof(uint64_t));
+                influence_offsets = section((header.influenced_count + 1) * sizeof(uint64_t));
+                influences = section(header.influence_count * sizeof(SharedInfluence));
+                old_owners = section(header.has_old_owners
+                                         ? static_cast<size_t>(header.width) * header.height * sizeof(id_t)
+                                         : 0);
+                // The palette indices are written once by the exporting map, the attached maps don't build their own
+                old_owner_palette = section(header.old_owner_palette_count * sizeof(id_t));
+                old_owner_indices = section(header.has_old_owners
+                                                ? static_cast<size_t>(header.width) * header.height * sizeof(uint32_t)
+                                                : 0);
+                total = offset;
+            }
+        };
+    }
+
+    size_t Map::write_shared_state(const Topology &topology, uint8_t *target) const {
+        SharedStateHeader header{};
+        std::copy_n(SHARED_STATE_MAGIC, 8, header.magic);
+        header.width = width;
+        header.height = height;
+        header.system_count = topology.size();
+        header.jump_count = topology.jump_count();
+        for (const auto &owner: owners) {
+            ++header.owner_count;
+            header.name_bytes += owner->get_name().size();
         }
-        // Read the header
-        char header[8] = {0};
-        file.read(header, 8);
-        if (std::string(header, 8) != "SOVNV1.0") {
-            throw std::runtime_error("Invalid file format: " + std::string(header, 8));
+        for (const auto system: sov_solar_systems) {
+            if (topology.find(system->get_id()) == topology.size()) continue;
+            ++header.influenced_count;
+            header.influence_count += system->get_influences().size();
         }
-        // Read the width and height
-        const auto file_width = read_big_endian<int32_t>(file);
-        const auto file_height = read_big_endian<int32_t>(file);
-        if (file_width != width || file_height != height) {
-            throw std::runtime_error("Invalid file dimensions, expected " + std::to_string(width) + "x" +
-                                     std::to_string(height) + " but got " + std::to_string(file_width) + "x" +
-                                     std::to_string(file_height));
+        header.has_old_owners = old_owners_image != nullptr;
+        header.old_owner_palette_count = old_owners_image != nullptr ? old_owner_palette.size() : 0;
+        header.kernel_type = static_cast<uint32_t>(kernel_config.type);
+        header.engine = static_cast<uint32_t>(engine);
+        header.kernel_parameter = kernel_config.parameter;
+        header.kernel_cutoff = kernel_config.cutoff;
+        header.kernel_threshold = kernel_config.threshold;
+        header.single_precision = single_precision;
+        const SharedStateLayout layout(header);
+        header.total_size = layout.total;
+        if (target == nullptr) {
+            return layout.total;
         }
-        old_owners_image = std::make_unique<id_t[]>(width * height);
-        // Read the owner ids
-        for (unsigned int x = 0; x < width; ++x) {
-            for (unsigned int y = 0; y < height; ++y) {
-                const auto owner_id = read_big_endian<int64_t>(file);
-                if (x == 1335 && y == 25) {
-                    LOG(owner_id << " into " << (x + y * width))
-                }
-                if (owner_id == -1) {
-                    old_owners_image.get()[x + y * width] = 0;
-                } else {
-                    old_owners_image.get()[x + y * width] = owner_id;
-                }
+
+        // The padding is zeroed as well, so the same state always produces the same bytes
+        std::fill_n(target, layout.total, 0);
+        std::memcpy(target, &header, sizeof(header));
+        std::memcpy(target + layout.systems, topology.get_systems(), header.system_count * sizeof(Topology::System));
+        std::memcpy(target + layout.neighbor_offsets, topology.get_neighbor_offsets(),
+                    (header.system_count + 1) * sizeof(uint32_t));
+        std::memcpy(target + layout.neighbors, topology.get_neighbors(), header.jump_count * sizeof(uint32_t));
+
+        auto *states = reinterpret_cast<SharedSystemState *>(target + layout.states);
+        for (size_t i = 0; i < header.system_count; ++i) {
+            if (this->topology != nullptr) {
+                const auto &[owner, sov_power, has_station] = snapshot[i];
+                states[i] = {owner == nullptr ? 0 : owner->get_id(), sov_power, has_station};
+            } else {
+                const auto system = solar_systems.find(topology.get_system(i).id);
+                const auto owner = system->get_owner();
+                states[i] = {owner == nullptr ? 0 : owner->get_id(), system->get_sov_power(), system->is_has_station()};
             }
         }
-        file.close();
-    }
 
-    void Map::debug_save_old_owners(const std::string &filename) const {
-        Image debug_image(width, height);
-        for (unsigned int x = 0; x < width; ++x) {
-            for (unsigned int y = 0; y < height; ++y) {
-                const auto owner_id = old_owners_image.get()[x + y * width];
-                if (owner_id == 0) {
-                    debug_image.set_pixel(x, y, 0, 0, 0);
-                } else {
-                    const auto owner = owners.at(owner_id);
-                    debug_image.set_pixel(x, y, owner->get_color().with_alpha(255));
-                }
+        auto *shared_owners = reinterpret_cast<SharedOwner *>(target + layout.owners);
+        auto *names = reinterpret_cast<char *>(target + layout.names);
+        size_t name_offset = 0;
+        for (const auto &owner: owners) {
+            const std::string name = owner->get_name();
+            const auto color = owner->get_color();
+            const uint8_t flags = (owner->has_color() ? SHARED_OWNER_HAS_COLOR : 0) |
+                                  (owner->is_npc() ? SHARED_OWNER_NPC : 0);
+            *shared_owners++ = {
+                owner->get_id(), name_offset, static_cast<uint32_t>(name.size()), color.red, color.green, color.blue, flags
+            };
+            std::memcpy(names + name_offset, name.data(), name.size());
+            name_offset += name.size();
+        }
+
+        auto *influenced = reinterpret_cast<uint64_t *>(target + layout.influenced);
+        auto *influence_offsets = reinterpret_cast<uint64_t *>(target + layout.influence_offsets);
+        auto *influences = reinterpret_cast<SharedInfluence *>(target + layout.influences);
+        size_t influence_count = 0;
+        for (const auto system: sov_solar_systems) {
+            const size_t index = topology.find(system->get_id());
+            if (index == topology.size()) continue;
+            *influenced++ = index;
+            for (const auto &[owner, value]: system->get_influences()) {
+                influences[influence_count++] = {owner->get_id(), value};
             }
+            *++influence_offsets = influence_count;
         }
-        debug_image.write(filename.c_str());
+        if (old_owners_image != nullptr) {
+            std::memcpy(target + layout.old_owners, old_owners_image.get(),
+                        static_cast<size_t>(width) * height * sizeof(id_t));
+            std::memcpy(target + layout.old_owner_palette, old_owner_palette.data(),
+                        old_owner_palette.size() * sizeof(id_t));
+            std::memcpy(target + layout.old_owner_indices, old_owner_indices.get(),
+                        static_cast<size_t>(width) * height * sizeof(uint32_t));
+        }
+        return layout.total;
     }
 
-    void Map::save(const std::string &filename) const {
+    size_t Map::shared_state_size() const {
         std::unique_lock lock(map_mutex);
-        image.write(filename.c_str());
+        return write_shared_state(*build_topology(), nullptr);
     }
 
-    uint8_t *Map::retrieve_image() {
+    void Map::export_shared_state(uint8_t *target, const size_t size) const {
+        TraceSpan span(tracer, "export_shared_state", "encode");
         std::unique_lock lock(map_mutex);
-        return image.retrieve_data();
+        const auto shared_topology = build_topology();
+        if (const size_t required = write_shared_state(*shared_topology, nullptr); size < required) {
+            throw std::runtime_error("The shared state requires " + std::to_string(required) + " bytes, but only " +
+                                     std::to_string(size) + " are available");
+        }
+        if (reinterpret_cast<uintptr_t>(target) % 8 != 0) {
+            throw std::runtime_error("The shared state must be aligned to 8 bytes");
+        }
+        write_shared_state(*shared_topology, target);
     }
 
-    id_t *Map::create_owner_image() const {
-        const auto owner_image = new id_t[width * height];
-        for (unsigned int x = 0; x < width; ++x) {
-            for (unsigned int y = 0; y < height; ++y) {
-                const auto owner = this->owner_image.get()[x + y * width];
-                if (owner == nullptr) {
-                    owner_image[x + y * width] = 0;
-                } else {
-                    owner_image[x + y * width] = owner->get_id();
-                }
-            }
+    void Map::attach_shared_state(const uint8_t *data, const size_t size) {
+        TraceSpan span(tracer, "attach_shared_state", "load");
+        if (size < sizeof(SharedStateHeader) || reinterpret_cast<uintptr_t>(data) % 8 != 0) {
+            throw std::runtime_error("Invalid shared state");
         }
-        return owner_image;
-    }
+        SharedStateHeader header{};
+        std::memcpy(&header, data, sizeof(header));
+        if (!std::equal(header.magic, header.magic + 8, SHARED_STATE_MAGIC)) {
+            throw std::runtime_error("Invalid shared state format: " + std::string(header.magic, 8));
+        }
+        // Every count is bounded by the size, so the layout calculation can't overflow
+        for (const uint64_t count: {
+                 header.system_count, header.jump_count, header.owner_count, header.name_bytes,
+                 header.influenced_count, header.influence_count, header.old_owner_palette_count
+             }) {
+            if (count > size) throw std::runtime_error("Invalid shared state");
+        }
+        const SharedStateLayout layout(header);
+        if (layout.total != header.total_size || layout.total > size) {
+            throw std::runtime_error("Invalid shared state size");
+        }
+        if (header.kernel_type > static_cast<uint32_t>(KernelType::LINEAR) ||
+            header.engine > static_cast<uint32_t>(InfluenceEngine::SCATTER)) {
+            throw std::runtime_error("Invalid shared state settings");
+        }
+        const KernelConfig new_kernel{
+            static_cast<KernelType>(header.kernel_type), header.kernel_parameter, header.kernel_cutoff,
+            header.kernel_threshold
+        };
+        new_kernel.validate();
 
-    void Map::set_old_owner_image(id_t *old_owner_image, const unsigned int width, const unsigned int height) {
         std::unique_lock lock(map_mutex);
-        this->old_owners_image = std::unique_ptr<id_t[]>(old_owner_image);
-        if (this->width != width || this->height != height) {
-            this->old_owners_image = nullptr;
+        if (header.width != width || header.height != height) {
             throw std::runtime_error(
-                "Invalid dimensions for old owner image, expected " +
-                std::to_string(this->width) + "x" + std::to_string(this->height) + " but got " +
-                std::to_string(width) + "x" + std::to_string(height));
+                "Invalid shared state dimensions, expected " + std::to_string(width) + "x" + std::to_string(height) +
+                " but got " + std::to_string(header.width) + "x" + std::to_string(header.height));
         }
+        const auto *neighbor_offsets = reinterpret_cast<const uint32_t *>(data + layout.neighbor_offsets);
+        if (neighbor_offsets[header.system_count] != header.jump_count) {
+            throw std::runtime_error("Invalid shared state");
+        }
+        auto shared_topology = Topology::view(
+            width, height, reinterpret_cast<const Topology::System *>(data + layout.systems), header.system_count,
+            neighbor_offsets, reinterpret_cast<const uint32_t *>(data + layout.neighbors));
+
+        // Everything is built before the map is modified, so an invalid state leaves the map untouched
+        EntityStore<Owner> new_owners;
+        new_owners.reserve(header.owner_count);
+        const auto *shared_owners = reinterpret_cast<const SharedOwner *>(data + layout.owners);
+        const auto *names = reinterpret_cast<const char *>(data + layout.names);
+        for (size_t i = 0; i < header.owner_count; ++i) {
+            const auto &[id, name_offset, name_length, red, green, blue, flags] = shared_owners[i];
+            if (name_offset + name_length > header.name_bytes) {
+                throw std::runtime_error("Invalid shared state");
+            }
+            std::string name(names + name_offset, name_length);
+            const bool npc = flags & SHARED_OWNER_NPC;
+            if (flags & SHARED_OWNER_HAS_COLOR) {
+                new_owners.emplace(id, std::move(name), red, green, blue, npc);
+            } else {
+                new_owners.emplace(id, std::move(name), npc);
+            }
+        }
+        auto owner_of = [&new_owners](const id_t id) -> std::shared_ptr<Owner> {
+            return new_owners.get(id);
+        };
+
+        std::vector<SnapshotSystem> new_snapshot(header.system_count);
+        const auto *states = reinterpret_cast<const SharedSystemState *>(data + layout.states);
+        for (size_t i = 0; i < header.system_count; ++i) {
+            new_snapshot[i] = {owner_of(states[i].owner), states[i].sov_power, states[i].has_station != 0};
+        }
+
+        std::vector<std::unique_ptr<SolarSystem> > new_influenced;
+        new_influenced.reserve(header.influenced_count);
+        const auto *influenced = reinterpret_cast<const uint64_t *>(data + layout.influenced);
+        const auto *influence_offsets = reinterpret_cast<const uint64_t *>(data + layout.influence_offsets);
+        const auto *influences = reinterpret_cast<const SharedInfluence *>(data + layout.influences);
+        for (size_t i = 0; i < header.influenced_count; ++i) {
+            if (influenced[i] >= header.system_count || influence_offsets[i] > influence_offsets[i + 1] ||
+                influence_offsets[i + 1] > header.influence_count) {
+                throw std::runtime_error("Invalid shared state");
+            }
+            const auto &[id, constellation_id, region_id, x, y] = shared_topology->get_system(influenced[i]);
+            auto system = std::make_unique<SolarSystem>(id, constellation_id, region_id, x, y);
+            for (size_t j = influence_offsets[i]; j < influence_offsets[i + 1]; ++j) {
+                const auto owner = owner_of(influences[j].owner);
+                if (owner == nullptr) {
+                    throw std::runtime_error("Invalid shared state, unknown owner " +
+                                             std::to_string(influences[j].owner));
+                }
+                system->add_influence(owner, influences[j].value);
+            }
+            new_influenced.push_back(std::move(system));
+        }
+
+        std::vector<id_t> new_palette = {0};
+        if (header.has_old_owners) {
+            const auto *palette = reinterpret_cast<const id_t *>(data + layout.old_owner_palette);
+            if (header.old_owner_palette_count == 0 || palette[0] != 0) {
+                throw std::runtime_error("Invalid shared state");
+            }
+            new_palette.assign(palette, palette + header.old_owner_palette_count);
+            // The indices are only read, so checking them does not copy the memory into this process
+            const auto *indices = reinterpret_cast<const uint32_t *>(data + layout.old_owner_indices);
+            const uint32_t max_index = *std::max_element(indices, indices + static_cast<size_t>(width) * height);
+            if (max_index >= header.old_owner_palette_count) {
+                throw std::runtime_error("Invalid shared state");
+            }
+        }
+
+        clear_topology();
+        solar_systems.clear();
+        connections.clear();
+        sov_solar_systems.clear();
+        if (owner_image != nullptr) {
+            std::fill_n(owner_image.get(), static_cast<size_t>(width) * height, nullptr);
+        }
+        owners = std::move(new_owners);
+        topology = std::move(shared_topology);
+        snapshot = std::move(new_snapshot);
+        kernel_config = new_kernel;
+        engine = static_cast<InfluenceEngine>(header.engine);
+        single_precision = header.single_precision != 0;
+        influenced_systems = std::move(new_influenced);
+        for (const auto &system: influenced_systems) {
+            sov_solar_systems.push_back(system.get());
+        }
+        // Views without ownership, the memory is kept alive by the caller
+        old_owners_image = header.has_old_owners
+                               ? std::shared_ptr<const id_t[]>(std::shared_ptr<const id_t[]>(),
+                                                               reinterpret_cast<const id_t *>(data + layout.old_owners))
+                               : nullptr;
+        old_owner_indices = header.has_old_owners
+                                ? std::shared_ptr<const uint32_t[]>(
+                                    std::shared_ptr<const uint32_t[]>(),
+                                    reinterpret_cast<const uint32_t *>(data + layout.old_owner_indices))
+                                : nullptr;
+        old_owner_palette = std::move(new_palette);
+    }
+
+    std::vector<std::shared_ptr<Owner> > Map::get_owners() const {
+        std::unique_lock lock(map_mutex);
+        std::vector<std::shared_ptr<Owner> > result;
+        result.reserve(owners.size());
+        result.assign(owners.begin(), owners.end());
+        std::sort(result.begin(), result.end(), [](const auto &a, const auto &b) {
+            return a->get_id() < b->get_id();
+        });
+        return result;
+    }
+
+    std::pair<unsigned int, unsigned int> Map::get_shared_state_size(const uint8_t *data, const size_t size) {
+        if (size < sizeof(SharedStateHeader)) {
+            throw std::runtime_error("Invalid shared state");
+        }
+        SharedStateHeader header{};
+        std::memcpy(&header, data, sizeof(header));
+        if (!std::equal(header.magic, header.magic + 8, SHARED_STATE_MAGIC)) {
+            throw std::runtime_error("Invalid shared state format: " + std::string(header.magic, 8));
+        }
+        return {header.width, header.height};
+    }
+
+    TileResult Map::render_tile(const unsigned int x, const unsigned int y, const unsigned int tile_width,
+                                const unsigned int tile_height, const unsigned int sample_rate,
+                                unsigned int thread_count) {
+        STATS(PhaseTimer timer(stats, "render_tile");)
+        TraceSpan span(tracer, "render_tile", "render", x, y);
+        std::unique_lock lock(map_mutex);
+        if (tile_width == 0 || tile_height == 0 || sample_rate == 0 ||
+            static_cast<unsigned long long>(x) + tile_width > width ||
+            static_cast<unsigned long long>(y) + tile_height > height) {
+            throw std::runtime_error(
+                "Invalid tile " + std::to_string(tile_width) + "x" + std::to_string(tile_height) + " at " +
+                std::to_string(x) + "," + std::to_string(y) + " for a map of " + std::to_string(width) + "x" +
+                std::to_string(height));
+        }
+
+        // A pixel depends on the owners of the previous two rows and the neighboring columns, so the field is
+        // calculated with a halo around the tile
+        const unsigned int field_x0 = x > 0 ? x - 1 : 0;
+        const unsigned int field_x1 = std::min(width, x + tile_width + 1);
+        const unsigned int field_y0 = y > 2 ? y - 2 : 0;
+        const unsigned int field_y1 = y + tile_height;
+        const unsigned int field_width = field_x1 - field_x0;
+        const unsigned int field_height = field_y1 - field_y0;
+        std::vector<Owner *> field(static_cast<size_t>(field_width) * field_height);
+        std::vector<double> field_influence(field.size());
+
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min(thread_count, field_height);
+        auto calculate_rows = [&](const unsigned int start_row, const unsigned int end_row) {
+            ColumnWorker worker(this, 0, 1);
+            worker.prepare_sources();
+            with_kernel(kernel_config, single_precision, [&](const auto &kernel, auto real) {
+                using Kernel = std::decay_t<decltype(kernel)>;
+                for (unsigned int row = start_row; row < end_row; ++row) {
+                    for (unsigned int column = 0; column < field_width; ++column) {
+                        const size_t index = column + static_cast<size_t>(row) * field_width;
+                        std::tie(field[index], field_influence[index]) =
+                                worker.calculate_influence<Kernel, decltype(real)>(
+                                    field_x0 + column, field_y0 + row, kernel);
+                    }
+                }
+            });
+        };
+        {
+            std::vector<std::thread> threads;
+            std::vector<std::exception_ptr> errors(thread_count);
+            for (unsigned int i = 1; i < thread_count; ++i) {
+                threads.emplace_back([&, i] {
+                    try {
+                        calculate_rows(i * field_height / thread_count, (i + 1) * field_height / thread_count);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                });
+            }
+            try {
+                calculate_rows(0, field_height / thread_count);
+            } catch (...) {
+                errors[0] = std::current_exception();
+            }
+            for (auto &thread: threads) {
+                thread.join();
+            }
+            for (const auto &error: errors) {
+                if (error) std::rethrow_exception(error);
+            }
+        }
+        auto field_at = [&](const unsigned int px, const unsigned int py) {
+            return field[(px - field_x0) + static_cast<size_t>(py - field_y0) * field_width];
+        };
+
+        TileResult result;
+        result.x = x;
+        result.y = y;
+        result.width = tile_width;
+        result.height = tile_height;
+        result.sample_rate = sample_rate;
+        result.rgba.assign(static_cast<size_t>(tile_width) * tile_height * 4, 0);
+        result.owners.resize(static_cast<size_t>(tile_width) * tile_height);
+
+        // Same rules as composite()
+        const bool render_old_owners = old_owner_indices != nullptr;
+        const auto old_owner_palette = resolve_old_owner_palette();
+        for (unsigned int py = std::max(y, 1u); py < y + tile_height; ++py) {
+            for (unsigned int px = x; px < x + tile_width; ++px) {
+                Owner *owner = field_at(px, py - 1);
+                if (owner == nullptr || owner->is_npc()) continue;
+                const bool draw_border = is_border_pixel(field_at, owner, px, py, width);
+                Color color;
+                Py_Trace_Errors(
+                    color = compose_pixel(owner, field_influence[(px - field_x0) + static_cast<size_t>(py - 1 -
+                        field_y0) * field_width], draw_border);)
+                const size_t index = ((px - x) + static_cast<size_t>(py - y) * tile_width) * 4;
+                result.rgba[index] = color.red;
+                result.rgba[index + 1] = color.green;
+                result.rgba[index + 2] = color.blue;
+                result.rgba[index + 3] = color.alpha;
+            }
+            if (render_old_owners) {
+                const size_t field_row = (x - field_x0) + static_cast<size_t>(py - 1 - field_y0) * field_width;
+                draw_old_owner_hatch(result.rgba.data() + static_cast<size_t>(py - y) * tile_width * 4,
+                                     field.data() + field_row, field_influence.data() + field_row,
+                                     old_owner_indices.get() + x + static_cast<size_t>(py) * width, old_owner_palette,
+                                     tile_width, x, py);
+            }
+        }
+        for (unsigned int py = y; py < y + tile_height; ++py) {
+            for (unsigned int px = x; px < x + tile_width; ++px) {
+                const Owner *owner = field_at(px, py);
+                result.owners[(px - x) + static_cast<size_t>(py - y) * tile_width] =
+                        owner == nullptr ? 0 : owner->get_id();
+            }
+        }
+
+        // Same flood fill as calculate_labels(), limited to the grid points inside the tile
+        const unsigned int grid_x0 = (x + sample_rate - 1) / sample_rate;
+        const unsigned int grid_y0 = (y + sample_rate - 1) / sample_rate;
+        const unsigned int grid_width = (x + tile_width + sample_rate - 1) / sample_rate - grid_x0;
+        const unsigned int grid_height = (y + tile_height + sample_rate - 1) / sample_rate - grid_y0;
+        result.label_grid.assign(static_cast<size_t>(grid_width) * grid_height, TileResult::NO_LABEL);
+        auto grid_owner = [&](const unsigned int gx, const unsigned int gy) -> const Owner * {
+            return field_at((grid_x0 + gx) * sample_rate, (grid_y0 + gy) * sample_rate);
+        };
+        for (unsigned int gy = 0; gy < grid_height; ++gy) {
+            for (unsigned int gx = 0; gx < grid_width; ++gx) {
+                const Owner *owner = grid_owner(gx, gy);
+                if (owner == nullptr || owner->is_npc() ||
+                    result.label_grid[gx + static_cast<size_t>(gy) * grid_width] != TileResult::NO_LABEL) {
+                    continue;
+                }
+                const auto label_index = static_cast<uint32_t>(result.labels.size());
+                LabelPartial label{owner->get_id()};
+                label.first_x = (grid_x0 + gx) * sample_rate;
+                label.first_y = (grid_y0 + gy) * sample_rate;
+                std::queue<std::pair<unsigned int, unsigned int> > q;
+                q.emplace(gx, gy);
+                while (!q.empty()) {
+                    auto [cx, cy] = q.front();
+                    q.pop();
+                    auto &visited = result.label_grid[cx + static_cast<size_t>(cy) * grid_width];
+                    const Owner *current = grid_owner(cx, cy);
+                    if (visited != TileResult::NO_LABEL || current == nullptr ||
+                        current->get_id() != label.owner_id) {
+                        continue;
+                    }
+                    visited = label_index;
+                    ++label.count;
+                    label.sum_x += (grid_x0 + cx) * sample_rate;
+                    label.sum_y += (grid_y0 + cy) * sample_rate;
+                    if (cx > 0) q.emplace(cx - 1, cy);
+                    if (cx + 1 < grid_width) q.emplace(cx + 1, cy);
+                    if (cy > 0) q.emplace(cx, cy - 1);
+                    if (cy + 1 < grid_height) q.emplace(cx, cy + 1);
+                }
+                result.labels.push_back(label);
+            }
+        }
+        return result;
+    }
+
+    void Map::render_viewport(const Viewport &viewport, uint8_t *target, id_t *owner_target,
+                              const ptrdiff_t owner_row_stride, const ptrdiff_t owner_column_stride,
+                              unsigned int thread_count) {
+        STATS(PhaseTimer timer(stats, "render_viewport");)
+        TraceSpan span(tracer, "render_viewport", "render", viewport.output_width, viewport.output_height);
+        const unsigned int output_width = viewport.output_width;
+        const unsigned int output_height = viewport.output_height;
+        if (output_width == 0 || output_height == 0 || !(viewport.width > 0.0) || !(viewport.height > 0.0)) {
+            throw std::runtime_error("The viewport must not be empty");
+        }
+        std::unique_lock lock(map_mutex);
+        // The size of an output pixel in map coordinates
+        const double step_x = viewport.width / output_width;
+        const double step_y = viewport.height / output_height;
+
+        // Like render_tile(), the field has a halo of one column on each side and two rows above the image
+        const unsigned int field_width = output_width + 2;
+        const unsigned int field_height = output_height + 2;
+        auto map_x = [&](const unsigned int column) { return viewport.x + (static_cast<double>(column) - 1.0) * step_x; };
+        auto map_y = [&](const unsigned int row) { return viewport.y + (static_cast<double>(row) - 2.0) * step_y; };
+
+        // Systems further away than the cutoff of the kernel can't influence the viewport
+        const double cutoff = kernel_config.cutoff;
+        const double min_x = map_x(0) - cutoff, max_x = map_x(field_width - 1) + cutoff;
+        const double min_y = map_y(0) - cutoff, max_y = map_y(field_height - 1) + cutoff;
+        std::vector<SolarSystem *> systems;
+        for (const auto system: sov_solar_systems) {
+            if (system->get_x() >= min_x && system->get_x() <= max_x &&
+                system->get_y() >= min_y && system->get_y() <= max_y) {
+                systems.push_back(system);
+            }
+        }
+
+        std::vector<Owner *> field(static_cast<size_t>(field_width) * field_height);
+        std::vector<double> field_influence(field.size());
+        // The same gather as the render, at fractional coordinates and only over the culled systems
+        auto calculate_rows = [&](const unsigned int start_row, const unsigned int end_row) {
+            ColumnWorker worker(this, 0, 1);
+            worker.prepare_sources(systems);
+            with_kernel(kernel_config, single_precision, [&](const auto &kernel, auto real) {
+                using Kernel = std::decay_t<decltype(kernel)>;
+                for (unsigned int row = start_row; row < end_row; ++row) {
+                    const double y = map_y(row);
+                    for (unsigned int column = 0; column < field_width; ++column) {
+                        const size_t index = column + static_cast<size_t>(row) * field_width;
+                        std::tie(field[index], field_influence[index]) =
+                                worker.calculate_influence<Kernel, decltype(real)>(map_x(column), y, kernel);
+                    }
+                }
+            });
+        };
+
+        // The old owner and the hatching of an output pixel, the hatching keeps its size on screen when zooming
+        const bool render_old_owners = old_owner_indices != nullptr;
+        const auto old_owner_palette = resolve_old_owner_palette();
+        const auto origin_x = static_cast<long long>(std::floor(viewport.x / step_x));
+        const auto origin_y = static_cast<long long>(std::floor(viewport.y / step_y));
+        auto old_owner_at = [&](const unsigned int column, const unsigned int row) -> uint32_t {
+            if (!render_old_owners) return 0;
+            const double x = std::floor(map_x(column + 1));
+            const double y = std::floor(map_y(row + 2));
+            if (x < 0 || y < 0 || x >= width || y >= height) return 0;
+            return old_owner_indices.get()[static_cast<size_t>(x) + static_cast<size_t>(y) * width];
+        };
+        auto pattern = [](const long long value) {
+            return static_cast<unsigned int>((value % 5 + 5) % 5);
+        };
+
+        // Inside the map, the edges are handled like composite(): the first row stays empty, the second row is a
+        // border and the neighbors beyond the left and right edge are ignored. Outside the map, all neighbors count.
+        auto inside_map = [&](const double x, const double y) {
+            return x >= 0.0 && y >= 0.0 && x < width && y < height;
+        };
+        auto composite_rows = [&](const unsigned int start_y, const unsigned int end_y) {
+            std::vector<uint32_t> old_owner_row(render_old_owners ? output_width : 0);
+            for (unsigned int y = start_y; y < end_y; ++y) {
+                const double pixel_y = map_y(y + 2);
+                for (unsigned int x = 0; x < output_width; ++x) {
+                    // The owner of the previous row, see composite()
+                    const size_t index = x + 1 + static_cast<size_t>(y + 1) * field_width;
+                    const auto owner = field[index];
+                    uint8_t *pixel = target + (x + static_cast<size_t>(y) * output_width) * 4;
+                    const double pixel_x = map_x(x + 1);
+                    const bool clamp = inside_map(pixel_x, pixel_y);
+                    if (owner == nullptr || owner->is_npc() || (clamp && pixel_y - step_y < 0.0)) {
+                        std::fill_n(pixel, 4, 0);
+                        continue;
+                    }
+                    const bool draw_border = field[index + field_width] != owner ||
+                                             (clamp && pixel_y - 2 * step_y < 0.0) ||
+                                             field[index - field_width] != owner ||
+                                             ((!clamp || pixel_x - step_x >= 0.0) && field[index - 1] != owner) ||
+                                             ((!clamp || pixel_x + step_x < width) && field[index + 1] != owner);
+                    Color color;
+                    Py_Trace_Errors(color = compose_pixel(owner, field_influence[index], draw_border);)
+                    pixel[0] = color.red;
+                    pixel[1] = color.green;
+                    pixel[2] = color.blue;
+                    pixel[3] = color.alpha;
+                }
+                if (render_old_owners) {
+                    for (unsigned int x = 0; x < output_width; ++x) {
+                        // No hatching on the first row of the map either
+                        old_owner_row[x] = pixel_y - step_y < 0.0 && inside_map(map_x(x + 1), pixel_y)
+                                               ? 0
+                                               : old_owner_at(x, y);
+                    }
+                    const size_t field_row = 1 + static_cast<size_t>(y + 1) * field_width;
+                    draw_old_owner_hatch(target + static_cast<size_t>(y) * output_width * 4, field.data() + field_row,
+                                         field_influence.data() + field_row, old_owner_row.data(), old_owner_palette,
+                                         output_width, pattern(origin_x), pattern(origin_y + y));
+                }
+            }
+        };
+
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min(thread_count, output_height);
+        auto run_parallel = [thread_count](const unsigned int rows, const auto &function) {
+            std::vector<std::thread> threads;
+            std::vector<std::exception_ptr> errors(thread_count);
+            for (unsigned int i = 1; i < thread_count; ++i) {
+                threads.emplace_back([&, i] {
+                    try {
+                        function(i * rows / thread_count, (i + 1) * rows / thread_count);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                });
+            }
+            try {
+                function(0, rows / thread_count);
+            } catch (...) {
+                errors[0] = std::current_exception();
+            }
+            for (auto &thread: threads) {
+                thread.join();
+            }
+            for (const auto &error: errors) {
+                if (error) std::rethrow_exception(error);
+            }
+        };
+
+        run_parallel(field_height, calculate_rows);
+        // Generate the missing colors in advance, the threads below must not modify the owners
+        for (unsigned int y = 0; y < output_height; ++y) {
+            for (unsigned int x = 0; x < output_width; ++x) {
+                Owner *owner = field[x + 1 + static_cast<size_t>(y + 1) * field_width];
+                if (owner == nullptr || owner->is_npc()) continue;
+                if (!owner->has_color()) {
+                    Color new_color;
+                    Py_Trace_Errors(new_color = generate_owner_color(owner->get_id());)
+                    owner->set_color(new_color);
+                }
+                if (const auto old_owner = old_owner_palette[old_owner_at(x, y)];
+                    old_owner != nullptr && old_owner->get_id() != owner->get_id() && !old_owner->has_color()) {
+                    Color new_color;
+                    Py_Trace_Errors(new_color = generate_owner_color(old_owner->get_id());)
+                    old_owner->set_color(new_color);
+                }
+            }
+        }
+        run_parallel(output_height, composite_rows);
+
+        if (owner_target != nullptr) {
+            for (unsigned int y = 0; y < output_height; ++y) {
+                auto row = reinterpret_cast<char *>(owner_target) + static_cast<ptrdiff_t>(y) * owner_row_stride;
+                for (unsigned int x = 0; x < output_width; ++x) {
+                    const Owner *owner = field[x + 1 + static_cast<size_t>(y + 2) * field_width];
+                    *reinterpret_cast<id_t *>(row + static_cast<ptrdiff_t>(x) * owner_column_stride) =
+                            owner == nullptr ? 0 : owner->get_id();
+                }
+            }
+        }
+    }
+
+    void Map::set_sov_power_function(std::function<double(double, bool, id_t)> sov_power_function) {
+        std::unique_lock lock(map_mutex);
+        this->sov_power_function = std::move(sov_power_function);
+    }
+
+    void Map::set_power_falloff_function(std::function<double(double, double, int)> power_falloff_function) {
+        std::unique_lock lock(map_mutex);
+        this->power_falloff_function = std::move(power_falloff_function);
+    }
+
+    void Map::set_influence_to_alpha_function(std::function<double(double)> influence_to_alpha) {
+        std::unique_lock lock(map_mutex);
+        this->influence_to_alpha = std::move(influence_to_alpha);
+    }
+
+    void Map::calculate_influence() {
+        STATS(PhaseTimer timer(stats, "calculate_influence");)
+        TraceSpan span(tracer, "calculate_influence", "influence");
+        std::unique_lock lock(map_mutex);
+        if (topology != nullptr) {
+            calculate_snapshot_influence();
+            return;
+        }
+        if (sov_solar_systems.empty()) {
+            for (const auto &sys: solar_systems) {
+                if (sys->get_owner() != nullptr) {
+                    sov_solar_systems.push_back(sys.get());
+                }
+            }
+            // The order of the systems determines the order of the influence sums
+            std::sort(sov_solar_systems.begin(), sov_solar_systems.end(), [](const SolarSystem *a, const SolarSystem *b) {
+                return a->get_id() < b->get_id();
+            });
+        }
+        LOG("Calculating influence for " << sov_solar_systems.size() << " solar systems")
+        auto sov_orig = sov_solar_systems;
+
+        for (const auto &solar_system: sov_orig) {
+            const id_t owner_id = solar_system->get_owner() == nullptr ? 0 : solar_system->get_owner()->get_id();
+            double influence;
+            Py_Trace_Errors(
+                influence = sov_power_function(
+                    solar_system->get_sov_power(),
+                    solar_system->is_has_station(),
+                    owner_id);)
+            const int level = (solar_system->get_sov_power() >= 6.0) ? 1 : 2;
+            Py_Trace_Errors(
+                add_influence(solar_system, solar_system->get_owner(), influence, influence, level);)
+        }
+    }
+
+    void Map::render_multithreaded() {
+        const unsigned int thread_count = std::thread::hardware_concurrency();
+        reset_render_state();
+        std::vector<std::thread> threads;
+        std::vector<ColumnWorker *> workers;
+        LOG("Starting " << thread_count << " threads")
+        for (int i = 0; i < thread_count; ++i) {
+            const unsigned int start_x = i * width / thread_count;
+            const unsigned int end_x = (i + 1) * width / thread_count;
+            workers.emplace_back(create_worker(start_x, end_x));
+            //std::cout << "Starting thread " << i << " with x range " << start_x << " to " << end_x << std::endl;
+            threads.emplace_back(&ColumnWorker::render, workers.back());
+        }
+        LOG("Waiting for threads to finish")
+        for (auto &thread: threads) {
+            if (thread.joinable())
+                thread.join();
+        }
+        for (const auto worker: workers) {
+            delete worker;
+        }
+        LOG("Rendering completed")
+    }
+
+    void Map::composite(unsigned int thread_count) {
+        STATS(PhaseTimer timer(stats, "composite");)
+        TraceSpan span(tracer, "composite", "composite");
+        std::unique_lock lock(map_mutex);
+        if (owner_image == nullptr || influence_image == nullptr) {
+            throw std::runtime_error("No influence field available, the map has to be rendered first");
+        }
+        image.alloc();
+        const bool render_old_owners = old_owner_indices != nullptr;
+        const auto old_owner_palette = resolve_old_owner_palette();
+        Owner *const *owners_field = owner_image.get();
+
+        // Generate the missing colors in advance, the threads below must not modify the owners
+        auto ensure_color = [this](Owner *owner) {
+            if (!owner->has_color()) {
+                Color new_color;
+                Py_Trace_Errors(new_color = generate_owner_color(owner->get_id());)
+                owner->set_color(new_color);
+            }
+        };
+        for (unsigned int y = 1; y < height; ++y) {
+            for (unsigned int x = 0; x < width; ++x) {
+                Owner *owner = owner_image.get()[x + (y - 1) * width];
+                if (owner == nullptr || owner->is_npc()) continue;
+                ensure_color(owner);
+                if (!render_old_owners) continue;
+                if (const auto old_owner = old_owner_palette[old_owner_indices[x + y * width]];
+                    old_owner != nullptr && old_owner->get_id() != owner->get_id()) {
+                    ensure_color(old_owner);
+                }
+            }
+        }
+
+        // Same rules as ColumnWorker::process_pixel, which draws the owner of row y - 1 into row y once the owners of
+        // row y are known. Because of that, the first row is never drawn.
+        auto owner_at = [owners_field, this](const unsigned int x, const unsigned int y) {
+            return owners_field[x + static_cast<size_t>(y) * width];
+        };
+        auto composite_rows = [&](const unsigned int start_y, const unsigned int end_y) {
+            TraceSpan band_span(tracer, "composite_band", "composite", start_y, end_y);
+            for (unsigned int y = start_y; y < end_y; ++y) {
+                for (unsigned int x = 0; x < width; ++x) {
+                    if (y == 0) {
+                        image.set_pixel(x, y, 0, 0, 0, 0);
+                        continue;
+                    }
+                    const size_t index = x + static_cast<size_t>(y - 1) * width;
+                    const auto owner = owners_field[index];
+                    if (owner == nullptr || owner->is_npc()) {
+                        image.set_pixel(x, y, 0, 0, 0, 0);
+                        continue;
+                    }
+                    const bool draw_border = is_border_pixel(owner_at, owner, x, y, width);
+                    Color color;
+                    Py_Trace_Errors(color = compose_pixel(owner, influence_image.get()[index], draw_border);)
+                    image.set_pixel(x, y, color);
+                }
+                if (render_old_owners && y > 0) {
+                    const size_t field_row = static_cast<size_t>(y - 1) * width;
+                    draw_old_owner_hatch(image.get_row_unsafe(y), owners_field + field_row,
+                                         influence_image.get() + field_row,
+                                         old_owner_indices.get() + field_row + width, old_owner_palette, width, 0, y);
+                }
+            }
+        };
+
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min(thread_count, std::max(1u, height));
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(thread_count);
+        for (unsigned int i = 1; i < thread_count; ++i) {
+            threads.emplace_back([&, i] {
+                try {
+                    composite_rows(i * height / thread_count, (i + 1) * height / thread_count);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+        try {
+            composite_rows(0, height / thread_count);
+        } catch (...) {
+            errors[0] = std::current_exception();
+        }
+        for (auto &thread: threads) {
+            thread.join();
+        }
+        for (const auto &error: errors) {
+            if (error) std::rethrow_exception(error);
+        }
+    }
+
+    void Map::reset_render_state() {
+        rendered_pixels = 0;
+        render_cancelled = false;
+        STATS(stats.begin_render();)
+    }
+
+    void Map::cancel_render() {
+        render_cancelled = true;
+    }
+
+    bool Map::is_render_cancelled() const {
+        return render_cancelled;
+    }
+
+    unsigned long long Map::get_rendered_pixels() const {
+        return rendered_pixels;
+    }
+
+    RenderStats Map::get_stats() const {
+#if defined(EVE_MAPPER_STATS) && EVE_MAPPER_STATS
+        RenderStats result = stats.snapshot();
+        result.map_mutex_wait_ms = static_cast<double>(map_mutex.wait_ns) / 1e6;
+        result.image_mutex_wait_ms = static_cast<double>(image_mutex.wait_ns) / 1e6;
+        return result;
+#else
+        return {};
+#endif
+    }
+
+    void Map::start_trace() {
+        std::unique_lock lock(map_mutex);
+        tracer.start();
+    }
+
+    void Map::stop_trace() {
+        tracer.stop();
+    }
+
+    void Map::save_trace(const std::string &filename) {
+        std::unique_lock lock(map_mutex);
+        tracer.write(filename);
+    }
+
+    void Map::reset_stats() {
+        STATS(stats.reset();)
+        STATS(map_mutex.wait_ns = 0;)
+        STATS(image_mutex.wait_ns = 0;)
+    }
+
+    std::vector<Map::MapOwnerLabel> Map::calculate_labels() {
+        STATS(PhaseTimer timer(stats, "calculate_labels");)
+        TraceSpan span(tracer, "calculate_labels", "labels");
+        std::unique_lock lock(map_mutex);
+        std::vector<MapOwnerLabel> labels;
+        std::vector<bool> visited(static_cast<size_t>(width) * height);
+        // Iterate over all pixels according to the sample rate
+        for (unsigned int y = 0; y < height; y += sample_rate) {
+            for (unsigned int x = 0; x < width; x += sample_rate) {
+                // Get the owner at the current pixel
+                const Owner *owner = owner_image.get()[x + y * width];
+                if (owner == nullptr || visited[x + y * width]) {
+                    continue;
+                }
+                if (owner->is_npc()) {
+                    continue;
+                }
+                auto label = MapOwnerLabel{owner->get_id()};
+                owner_flood_fill(x, y, label, visited);
+                label.x = label.x / label.count + sample_rate / 2;
+                label.y = label.y / label.count + sample_rate / 2;
+                labels.push_back(label);
+            }
+        }
+        return labels;
+    }
+
+    Map::ColumnWorker *Map::create_worker(unsigned int start_x, unsigned int end_x) {
+        image.alloc();
+        if (export_influence && influence_export == nullptr) {
+            influence_export = std::make_unique<float[]>(width * height);
+        }
+        return new ColumnWorker(this, start_x, end_x);
+    }
+
+    void Map::paste_cache(const unsigned int start_x, const unsigned int start_y, const Image &cache, int height) {
+        STATS(PhaseTimer timer(stats, "paste_cache");)
+        if (height == -1) {
+            height = cache.get_height();
+        }
+        TraceSpan span(tracer, "paste_cache", "composite", start_y, start_y + height);
+        std::unique_lock lock(image_mutex, std::defer_lock);
+        {
+            TraceSpan wait_span(tracer, "wait_image_lock", "lock");
+            lock.lock();
+        }
+        for (unsigned int y = 0; y < height; ++y) {
+            for (unsigned int x = 0; x < cache.get_width(); ++x) {
+                auto [r, g, b, a] = cache.get_pixel(x, y);
+                image.set_pixel(start_x + x, start_y + y, r, g, b, a);
+            }
+        }
+    }
+
+    void Map::save_owner_image(const std::string &filename) const {
+        STATS(PhaseTimer timer(stats, "save_owner_image");)
+        TraceSpan span(tracer, "save_owner_image", "encode");
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Unable to open file");
+        }
+        file.write("SOVNV1.0", 8);
+        // Write header with width and height
+        write_big_endian<int32_t>(file, width);
+        write_big_endian<int32_t>(file, height);
+        // Write the owner ids
+        for (unsigned int x = 0; x < width; ++x) {
+            for (unsigned int y = 0; y < height; ++y) {
+                if (const Owner *owner = owner_image.get()[x + y * width]; owner == nullptr) {
+                    write_big_endian<int64_t>(file, -1);
+                } else {
+                    write_big_endian<int64_t>(file, static_cast<int64_t>(owner->get_id()));
+                }
+            }
+        }
+        file.close();
+    }
+
+    void Map::load_old_owners(const std::string &filename) {
+        STATS(PhaseTimer timer(stats, "load_old_owners");)
+        TraceSpan span(tracer, "load_old_owners", "load");
+        std::unique_lock lock(map_mutex);
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Unable to open file");
+        }
+        // Read the header
+        char header[8] = {0};
+        file.read(header, 8);
+        if (std::string(header, 8) != "SOVNV1.0") {
+            throw std::runtime_error("Invalid file format: " + std::string(header, 8));
+        }
+        // Read the width and height
+        const auto file_width = read_big_endian<int32_t>(file);
+        const auto file_height = read_big_endian<int32_t>(file);
+        if (file_width != width || file_height != height) {
+            throw std::runtime_error("Invalid file dimensions, expected " + std::to_string(width) + "x" +
+                                     std::to_string(height) + " but got " + std::to_string(file_width) + "x" +
+                                     std::to_string(file_height));
+        }
+        auto old_owners = std::make_unique<id_t[]>(width * height);
+        // Read the owner ids
+        for (unsigned int x = 0; x < width; ++x) {
+            for (unsigned int y = 0; y < height; ++y) {
+                const auto owner_id = read_big_endian<int64_t>(file);
+                if (x == 1335 && y == 25) {
+                    LOG(owner_id << " into " << (x + y * width))
+                }
+                if (owner_id == -1) {
+                    old_owners.get()[x + y * width] = 0;
+                } else {
+                    old_owners.get()[x + y * width] = owner_id;
+                }
+            }
+        }
+        old_owners_image = std::move(old_owners);
+        index_old_owners();
+        file.close();
+    }
+
+    void Map::debug_save_old_owners(const std::string &filename) const {
+        Image debug_image(width, height);
+        for (unsigned int x = 0; x < width; ++x) {
+            for (unsigned int y = 0; y < height; ++y) {
+                const auto owner_id = old_owners_image.get()[x + y * width];
+                if (owner_id == 0) {
+                    debug_image.set_pixel(x, y, 0, 0, 0);
+                } else {
+                    const auto &owner = owners.at(owner_id);
+                    debug_image.set_pixel(x, y, owner->get_color().with_alpha(255));
+                }
+            }
+        }
+        debug_image.write(filename.c_str());
+    }
+
+    void Map::save(const std::string &filename, const ImageFormat format, const int level,
+                   const unsigned int thread_count) const {
+        STATS(PhaseTimer timer(stats, "save");)
+        TraceSpan span(tracer, "save", "encode");
+        std::unique_lock lock(map_mutex);
+        switch (format) {
+            case ImageFormat::QOI:
+                image.write_qoi(filename.c_str());
+                break;
+            case ImageFormat::RAW:
+                image.write_raw(filename.c_str());
+                break;
+            default:
+                image.write(filename.c_str(), level, thread_count);
+                break;
+        }
+    }
+
+    uint8_t *Map::retrieve_image() {
+        std::unique_lock lock(map_mutex);
+        return image.retrieve_data();
+    }
+
+    float *Map::retrieve_influence_image() {
+        std::unique_lock lock(map_mutex);
+        return influence_export.release();
+    }
+
+    void Map::set_export_influence(const bool export_influence) {
+        std::unique_lock lock(map_mutex);
+        this->export_influence = export_influence;
+        if (!export_influence) {
+            influence_export = nullptr;
+        }
+    }
+
+    bool Map::is_export_influence() const {
+        return export_influence;
+    }
+
+    id_t *Map::create_owner_image() const {
+        auto owner_image = std::make_unique<id_t[]>(static_cast<size_t>(width) * height);
+        write_owner_image(owner_image.get(), static_cast<ptrdiff_t>(width * sizeof(id_t)), sizeof(id_t));
+        return owner_image.release();
+    }
+
+    void Map::write_owner_image(id_t *target, const ptrdiff_t row_stride, const ptrdiff_t column_stride) const {
+        std::unique_lock lock(map_mutex);
+        const Owner *const *owners_field = owner_image.get();
+        if (owners_field == nullptr) {
+            throw std::runtime_error("No owner image available");
+        }
+        for (unsigned int y = 0; y < height; ++y) {
+            auto row = reinterpret_cast<char *>(target) + static_cast<ptrdiff_t>(y) * row_stride;
+            const auto field_row = owners_field + static_cast<size_t>(y) * width;
+            for (unsigned int x = 0; x < width; ++x) {
+                const Owner *owner = field_row[x];
+                *reinterpret_cast<id_t *>(row + static_cast<ptrdiff_t>(x) * column_stride) =
+                        owner == nullptr ? 0 : owner->get_id();
+            }
+        }
+    }
+
+    void Map::set_image_target(uint8_t *target) {
+        std::unique_lock lock(map_mutex);
+        image.attach(target);
+    }
+
+    void Map::release_image_target() {
+        std::unique_lock lock(map_mutex);
+        image.detach();
+    }
+
+    void Map::set_old_owner_image(id_t *old_owner_image, const unsigned int width, const unsigned int height) {
+        std::unique_lock lock(map_mutex);
+        this->old_owners_image = std::unique_ptr<id_t[]>(old_owner_image);
+        if (this->width != width || this->height != height) {
+            this->old_owners_image = nullptr;
+            index_old_owners();
+            throw std::runtime_error(
+                "Invalid dimensions for old owner image, expected " +
+                std::to_string(this->width) + "x" + std::to_string(this->height) + " but got " +
+                std::to_string(width) + "x" + std::to_string(height));
+        }
+        index_old_owners();
     }
 
     unsigned int Map::get_width() const {
@@ -759,15 +2022,876 @@ namespace bluemap {
     bool Map::has_old_owner_image() const {
         return old_owners_image != nullptr;
     }
+
+    int Map::get_border_alpha() const {
+        return border_alpha;
+    }
+
+    KernelConfig Map::get_kernel() const {
+        std::unique_lock lock(map_mutex);
+        return kernel_config;
+    }
+
+    bool Map::is_single_precision() const {
+        std::unique_lock lock(map_mutex);
+        return single_precision;
+    }
+
+    void Map::set_single_precision(const bool single_precision) {
+        std::unique_lock lock(map_mutex);
+        this->single_precision = single_precision;
+    }
+
+    Map::PrecisionReport Map::compare_precision(unsigned int thread_count, const size_t max_reported) {
+        STATS(PhaseTimer timer(stats, "compare_precision");)
+        TraceSpan span(tracer, "compare_precision", "render");
+        std::unique_lock lock(map_mutex);
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min(thread_count, std::max(1u, height));
+        std::vector<PrecisionReport> reports(thread_count);
+        auto compare_rows = [&](const unsigned int band, const unsigned int start_y, const unsigned int end_y) {
+            ColumnWorker worker(this, 0, 1);
+            worker.prepare_sources();
+            auto &report = reports[band];
+            auto alpha_of = [this](const double influence) {
+                int alpha;
+                Py_Trace_Errors(alpha = static_cast<int>(influence_to_alpha(influence));)
+                return alpha;
+            };
+            with_kernel(kernel_config, [&](const auto &kernel) {
+                using Kernel = std::decay_t<decltype(kernel)>;
+                for (unsigned int y = start_y; y < end_y; ++y) {
+                    for (unsigned int x = 0; x < width; ++x) {
+                        const auto [double_owner, double_influence] =
+                                worker.calculate_influence<Kernel, double>(x, y, kernel);
+                        const auto [float_owner, float_influence] =
+                                worker.calculate_influence<Kernel, float>(x, y, kernel);
+                        ++report.pixels;
+                        int double_alpha = 0, float_alpha = 0;
+                        if (double_owner == float_owner) {
+                            if (double_owner == nullptr) continue;
+                            double_alpha = alpha_of(double_influence);
+                            float_alpha = alpha_of(float_influence);
+                            if (double_alpha == float_alpha) continue;
+                            ++report.alpha_differences;
+                            report.max_alpha_difference = std::max(report.max_alpha_difference,
+                                                                   std::abs(double_alpha - float_alpha));
+                        } else {
+                            ++report.owner_differences;
+                            if (double_owner != nullptr) double_alpha = alpha_of(double_influence);
+                            if (float_owner != nullptr) float_alpha = alpha_of(float_influence);
+                        }
+                        if (report.differences.size() < max_reported) {
+                            report.differences.push_back({
+                                x, y, double_owner == nullptr ? 0 : double_owner->get_id(),
+                                float_owner == nullptr ? 0 : float_owner->get_id(), double_alpha, float_alpha
+                            });
+                        }
+                    }
+                }
+            });
+        };
+
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(thread_count);
+        for (unsigned int i = 1; i < thread_count; ++i) {
+            threads.emplace_back([&, i] {
+                try {
+                    compare_rows(i, i * height / thread_count, (i + 1) * height / thread_count);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+        try {
+            compare_rows(0, 0, height / thread_count);
+        } catch (...) {
+            errors[0] = std::current_exception();
+        }
+        for (auto &thread: threads) {
+            thread.join();
+        }
+        for (const auto &error: errors) {
+            if (error) std::rethrow_exception(error);
+        }
+
+        // The bands are in row order, so the differences stay in row-major order
+        PrecisionReport result;
+        for (auto &report: reports) {
+            result.pixels += report.pixels;
+            result.owner_differences += report.owner_differences;
+            result.alpha_differences += report.alpha_differences;
+            result.max_alpha_difference = std::max(result.max_alpha_difference, report.max_alpha_difference);
+            for (auto &difference: report.differences) {
+                if (result.differences.size() >= max_reported) break;
+                result.differences.push_back(difference);
+            }
+        }
+        return result;
+    }
+
+    void Map::set_kernel(const KernelConfig &kernel) {
+        kernel.validate();
+        std::unique_lock lock(map_mutex);
+        kernel_config = kernel;
+    }
+
+    namespace {
+        /// Calls function(band, start_row, end_row) for every band of rows, band 0 runs on the calling thread
+        template<typename Function>
+        void run_row_bands(const unsigned int rows, const unsigned int thread_count, const Function &function) {
+            std::vector<std::thread> threads;
+            std::vector<std::exception_ptr> errors(thread_count);
+            for (unsigned int i = 1; i < thread_count; ++i) {
+                threads.emplace_back([&, i] {
+                    try {
+                        function(i, i * rows / thread_count, (i + 1) * rows / thread_count);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                });
+            }
+            try {
+                function(0u, 0u, rows / thread_count);
+            } catch (...) {
+                errors[0] = std::current_exception();
+            }
+            for (auto &thread: threads) {
+                thread.join();
+            }
+            for (const auto &error: errors) {
+                if (error) std::rethrow_exception(error);
+            }
+        }
+
+        /// The largest integer distance within the cutoff
+        unsigned int kernel_radius(const double cutoff_sq) {
+            auto radius = static_cast<unsigned int>(std::sqrt(cutoff_sq));
+            while (static_cast<double>(radius + 1) * (radius + 1) <= cutoff_sq) ++radius;
+            return radius;
+        }
+    }
+
+    std::string Map::get_engine() const {
+        std::unique_lock lock(map_mutex);
+        switch (engine) {
+            case InfluenceEngine::FFT: return "fft";
+            case InfluenceEngine::SCATTER: return "scatter";
+            case InfluenceEngine::GATHER:
+            default: return "gather";
+        }
+    }
+
+    void Map::set_engine(const std::string &name) {
+        InfluenceEngine new_engine;
+        if (name == "gather") {
+            new_engine = InfluenceEngine::GATHER;
+        } else if (name == "fft") {
+            new_engine = InfluenceEngine::FFT;
+        } else if (name == "scatter") {
+            new_engine = InfluenceEngine::SCATTER;
+        } else {
+            throw std::runtime_error("Unknown engine " + name);
+        }
+        std::unique_lock lock(map_mutex);
+        engine = new_engine;
+    }
+
+    bool Map::calculate_fft_field(Owner **field, double *field_influence, const unsigned int thread_count,
+                                  const bool cancellable) const {
+        TraceSpan span(tracer, "fft_field", "render");
+        struct Source {
+            unsigned int x;
+            unsigned int y;
+            double power;
+        };
+
+        return with_kernel(kernel_config, [&](const auto &kernel) {
+            const unsigned int radius = kernel_radius(kernel.cutoff_sq);
+
+            // The sources of every owner. Like the std::map in ColumnWorker::calculate_influence(), the owners are
+            // ordered by address, so ties are resolved the same way.
+            std::map<Owner *, std::vector<Source> > sources;
+            unsigned int source_width = 1, source_height = 1;
+            for (const auto system: sov_solar_systems) {
+                const unsigned int x = system->get_x();
+                const unsigned int y = system->get_y();
+                if (static_cast<unsigned long long>(x) >= static_cast<unsigned long long>(width) + radius ||
+                    static_cast<unsigned long long>(y) >= static_cast<unsigned long long>(height) + radius) {
+                    continue;
+                }
+                for (const auto &[owner, power]: system->get_influences()) {
+                    if (power == 0.0) continue;
+                    sources[owner.get()].push_back({x, y, power});
+                    source_width = std::max(source_width, x + 1);
+                    source_height = std::max(source_height, y + 1);
+                }
+            }
+
+            // Only offsets that occur between a source and a pixel are needed. The grid is large enough that the
+            // cyclic convolution of the FFT doesn't wrap around between them.
+            const unsigned int reach_x = std::min(radius, std::max(width, source_width) - 1);
+            const unsigned int reach_y = std::min(radius, std::max(height, source_height) - 1);
+            const size_t grid_width = next_power_of_two(static_cast<size_t>(std::max(width, source_width)) + reach_x);
+            const size_t grid_height = next_power_of_two(
+                static_cast<size_t>(std::max(height, source_height)) + reach_y);
+            // The grid and the kernel spectrum
+            const size_t grid_bytes = grid_width * grid_height * (sizeof(std::complex<double>) + sizeof(double));
+            if (grid_bytes > FFT_MEMORY_LIMIT) {
+                throw std::runtime_error(
+                    "The FFT engine needs a grid of " + std::to_string(grid_width) + "x" + std::to_string(grid_height) +
+                    " (" + std::to_string(grid_bytes >> 20) + " MiB) for this map, more than the limit of " +
+                    std::to_string(FFT_MEMORY_LIMIT >> 20) + " MiB. Use the gather or scatter engine instead");
+            }
+            const FFT2D fft(grid_width, grid_height);
+
+            // All kernels are linear in the power, so the kernel image is the weight of a power of one
+            std::vector<std::complex<double> > grid(grid_width * grid_height);
+            double peak_weight = 0.0;
+            for (int dy = -static_cast<int>(reach_y); dy <= static_cast<int>(reach_y); ++dy) {
+                for (int dx = -static_cast<int>(reach_x); dx <= static_cast<int>(reach_x); ++dx) {
+                    const double dist_sq = dx * dx + dy * dy;
+                    if (dist_sq > kernel.cutoff_sq) continue;
+                    const double weight = kernel.weight(1.0, dist_sq);
+                    peak_weight = std::max(peak_weight, std::abs(weight));
+                    const size_t gx = (dx + static_cast<long long>(grid_width)) % grid_width;
+                    const size_t gy = (dy + static_cast<long long>(grid_height)) % grid_height;
+                    grid[gx + gy * grid_width] = weight;
+                }
+            }
+            fft.transform(grid, false, thread_count);
+            // The kernel is symmetric, so its spectrum is real. The normalization of the inverse is folded into it.
+            std::vector<double> spectrum(grid.size());
+            const double scale = 1.0 / static_cast<double>(grid.size());
+            for (size_t i = 0; i < grid.size(); ++i) {
+                spectrum[i] = grid[i].real() * scale;
+            }
+
+            std::fill_n(field, static_cast<size_t>(width) * height, nullptr);
+            std::fill_n(field_influence, static_cast<size_t>(width) * height, 0.0);
+            // The kernel spectrum is real, so two owners are convolved at once as the real and imaginary part
+            std::vector<std::pair<Owner *, const std::vector<Source> *> > owners_in_order;
+            owners_in_order.reserve(sources.size());
+            for (const auto &[owner, owner_sources]: sources) {
+                owners_in_order.emplace_back(owner, &owner_sources);
+            }
+            for (size_t pair = 0; pair < owners_in_order.size(); pair += 2) {
+                if (cancellable && render_cancelled.load(std::memory_order_relaxed)) return false;
+                TraceSpan pair_span(tracer, "fft_owners", "render", pair, pair + 2);
+                std::fill(grid.begin(), grid.end(), std::complex<double>());
+                // Rounding errors of the FFT are proportional to the total power, values below are considered zero
+                double noise_floor = 0.0;
+                Owner *pair_owners[2] = {nullptr, nullptr};
+                for (size_t part = 0; part < 2 && pair + part < owners_in_order.size(); ++part) {
+                    pair_owners[part] = owners_in_order[pair + part].first;
+                    for (const auto &source: *owners_in_order[pair + part].second) {
+                        auto &value = grid[source.x + source.y * grid_width];
+                        if (part == 0) {
+                            value.real(value.real() + source.power);
+                        } else {
+                            value.imag(value.imag() + source.power);
+                        }
+                        noise_floor += std::abs(source.power);
+                    }
+                }
+                noise_floor *= 1e-9 * peak_weight;
+
+                fft.transform(grid, false, thread_count);
+                for (size_t i = 0; i < grid.size(); ++i) {
+                    grid[i] *= spectrum[i];
+                }
+                fft.transform(grid, true, thread_count);
+
+                run_row_bands(height, std::min(thread_count, std::max(1u, height)),
+                              [&](unsigned int, const unsigned int start_y, const unsigned int end_y) {
+                                  for (unsigned int y = start_y; y < end_y; ++y) {
+                                      for (unsigned int x = 0; x < width; ++x) {
+                                          const auto value = grid[x + y * grid_width];
+                                          const size_t index = x + static_cast<size_t>(y) * width;
+                                          const double influence[2] = {value.real(), value.imag()};
+                                          for (int part = 0; part < 2; ++part) {
+                                              if (pair_owners[part] == nullptr) continue;
+                                              if (influence[part] > noise_floor &&
+                                                  influence[part] > field_influence[index]) {
+                                                  field[index] = pair_owners[part];
+                                                  field_influence[index] = influence[part];
+                                              }
+                                          }
+                                      }
+                                  }
+                              });
+            }
+            for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i) {
+                if (field_influence[i] < kernel.threshold) field[i] = nullptr;
+            }
+            return true;
+        });
+    }
+
+    bool Map::calculate_scatter_field(Owner **field, double *field_influence, const unsigned int thread_count,
+                                      const bool cancellable) const {
+        TraceSpan span(tracer, "scatter_field", "render");
+        constexpr unsigned int tile_size = SCATTER_TILE_SIZE;
+        const unsigned int tiles_x = (width + tile_size - 1) / tile_size;
+        const unsigned int tiles_y = (height + tile_size - 1) / tile_size;
+
+        return with_kernel(kernel_config, single_precision, [&](const auto &kernel, auto real) {
+            using Real = decltype(real);
+            const auto radius = static_cast<long long>(kernel_radius(kernel.cutoff_sq));
+            const auto cutoff_sq = static_cast<Real>(kernel.cutoff_sq);
+            const auto weight = kernel.template weight_function<Real>();
+
+            // The systems reaching every tile, in the order of sov_solar_systems. Every pixel sums up its systems in
+            // the same order as ColumnWorker::calculate_influence(), so the result is identical.
+            std::vector<std::vector<SolarSystem *> > bins(static_cast<size_t>(tiles_x) * tiles_y);
+            for (const auto system: sov_solar_systems) {
+                const long long x = system->get_x();
+                const long long y = system->get_y();
+                const long long x0 = std::max(0LL, x - radius);
+                const long long x1 = std::min(static_cast<long long>(width) - 1, x + radius);
+                const long long y0 = std::max(0LL, y - radius);
+                const long long y1 = std::min(static_cast<long long>(height) - 1, y + radius);
+                if (x0 > x1 || y0 > y1) continue;
+                for (long long ty = y0 / tile_size; ty <= y1 / tile_size; ++ty) {
+                    for (long long tx = x0 / tile_size; tx <= x1 / tile_size; ++tx) {
+                        bins[tx + ty * tiles_x].push_back(system);
+                    }
+                }
+            }
+
+            std::atomic<bool> cancelled = false;
+            run_row_bands(tiles_y, std::min(thread_count, std::max(1u, tiles_y)),
+                          [&](unsigned int, const unsigned int start_ty, const unsigned int end_ty) {
+                // The accumulators of the owners in the current tile, reused by the following tiles
+                std::vector<std::vector<Real> > buffers;
+                std::vector<Owner *> slot_owners;
+                std::unordered_map<Owner *, size_t> slots;
+                std::vector<size_t> order;
+                for (unsigned int ty = start_ty; ty < end_ty; ++ty) {
+                    for (unsigned int tx = 0; tx < tiles_x; ++tx) {
+                        if (cancellable && render_cancelled.load(std::memory_order_relaxed)) {
+                            cancelled = true;
+                            return;
+                        }
+                        const int tile_x0 = static_cast<int>(tx * tile_size);
+                        const int tile_y0 = static_cast<int>(ty * tile_size);
+                        const int tile_x1 = static_cast<int>(std::min(width, (tx + 1) * tile_size));
+                        const int tile_y1 = static_cast<int>(std::min(height, (ty + 1) * tile_size));
+                        slots.clear();
+                        slot_owners.clear();
+
+                        for (const auto system: bins[tx + static_cast<size_t>(ty) * tiles_x]) {
+                            const int sx = static_cast<int>(system->get_x());
+                            const int sy = static_cast<int>(system->get_y());
+                            const auto &influences = system->get_influences();
+                            const int row0 = std::max(tile_y0, static_cast<int>(sy - radius));
+                            const int row1 = std::min(tile_y1 - 1, static_cast<int>(sy + radius));
+                            for (int py = row0; py <= row1; ++py) {
+                                const int dy = py - sy;
+                                // The columns within the cutoff in this row, the exact test is done per pixel
+                                const int reach = static_cast<int>(std::sqrt(std::max(
+                                    0.0, kernel.cutoff_sq - static_cast<double>(dy) * dy))) + 1;
+                                const int col0 = std::max(tile_x0, sx - reach);
+                                const int col1 = std::min(tile_x1 - 1, sx + reach);
+                                if (col0 > col1) continue;
+                                for (const auto &[owner, power]: influences) {
+                                    auto [slot, inserted] = slots.try_emplace(owner.get(), slot_owners.size());
+                                    if (inserted) {
+                                        slot_owners.push_back(owner.get());
+                                        if (slot->second == buffers.size()) {
+                                            buffers.emplace_back(static_cast<size_t>(tile_size) * tile_size);
+                                        } else {
+                                            std::fill(buffers[slot->second].begin(), buffers[slot->second].end(),
+                                                      Real(0));
+                                        }
+                                    }
+                                    Real *row = buffers[slot->second].data() + (py - tile_y0) * tile_size;
+                                    const auto real_power = static_cast<Real>(power);
+                                    for (int px = col0; px <= col1; ++px) {
+                                        const int dx = px - sx;
+                                        const auto dist_sq = static_cast<Real>(dx * dx + dy * dy);
+                                        if (dist_sq > cutoff_sq) continue;
+                                        row[px - tile_x0] += weight(real_power, dist_sq);
+                                    }
+                                }
+                            }
+                        }
+
+                        // Pick the best owner per pixel, the owners are compared in the order of their address like
+                        // the std::map in ColumnWorker::calculate_influence()
+                        order.resize(slot_owners.size());
+                        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+                        std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+                            return std::less<Owner *>()(slot_owners[a], slot_owners[b]);
+                        });
+                        for (int py = tile_y0; py < tile_y1; ++py) {
+                            for (int px = tile_x0; px < tile_x1; ++px) {
+                                const size_t offset = (px - tile_x0) + static_cast<size_t>(py - tile_y0) * tile_size;
+                                Real best_influence = 0;
+                                Owner *best_owner = nullptr;
+                                for (const size_t slot: order) {
+                                    if (buffers[slot][offset] > best_influence) {
+                                        best_owner = slot_owners[slot];
+                                        best_influence = buffers[slot][offset];
+                                    }
+                                }
+                                if (best_influence < static_cast<Real>(kernel.threshold)) best_owner = nullptr;
+                                const size_t index = px + static_cast<size_t>(py) * width;
+                                field[index] = best_owner;
+                                field_influence[index] = static_cast<double>(best_influence);
+                            }
+                        }
+                    }
+                }
+            });
+            return !cancelled;
+        });
+    }
+
+    bool Map::calculate_field(Owner **field, double *field_influence, const unsigned int thread_count,
+                              const bool cancellable) {
+        if (engine == InfluenceEngine::FFT) {
+            return calculate_fft_field(field, field_influence, thread_count, cancellable);
+        }
+        if (engine == InfluenceEngine::SCATTER) {
+            return calculate_scatter_field(field, field_influence, thread_count, cancellable);
+        }
+        std::atomic<bool> cancelled = false;
+        run_row_bands(height, std::min(thread_count, std::max(1u, height)),
+                      [&](unsigned int, const unsigned int start_y, const unsigned int end_y) {
+                          ColumnWorker worker(this, 0, 1);
+                          worker.prepare_sources();
+                          with_kernel(kernel_config, single_precision, [&](const auto &kernel, auto real) {
+                              using Kernel = std::decay_t<decltype(kernel)>;
+                              for (unsigned int y = start_y; y < end_y; ++y) {
+                                  if (cancellable && render_cancelled.load(std::memory_order_relaxed)) {
+                                      cancelled = true;
+                                      return;
+                                  }
+                                  for (unsigned int x = 0; x < width; ++x) {
+                                      const size_t index = x + static_cast<size_t>(y) * width;
+                                      std::tie(field[index], field_influence[index]) =
+                                              worker.calculate_influence<Kernel, decltype(real)>(x, y, kernel);
+                                  }
+                              }
+                          });
+                      });
+        return !cancelled;
+    }
+
+    void Map::render_engine(unsigned int thread_count) {
+        STATS(PhaseTimer timer(stats, "render_engine");)
+        TraceSpan span(tracer, "render_engine", "render");
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        {
+            std::unique_lock lock(map_mutex);
+            const size_t size = static_cast<size_t>(width) * height;
+            // A cancelled rendering keeps the previous field
+            auto new_owner_image = std::make_unique<Owner *[]>(size);
+            auto new_influence_image = std::make_unique<double[]>(size);
+            if (!calculate_field(new_owner_image.get(), new_influence_image.get(), thread_count, true)) return;
+            owner_image = std::move(new_owner_image);
+            influence_image = std::move(new_influence_image);
+            for (size_t i = 0; i < size; ++i) {
+                if (owner_image[i] != nullptr) owner_image[i]->increment_counter();
+            }
+            if (export_influence) {
+                if (influence_export == nullptr) {
+                    influence_export = std::make_unique<float[]>(size);
+                }
+                for (size_t i = 0; i < size; ++i) {
+                    influence_export[i] = static_cast<float>(influence_image[i]);
+                }
+            }
+            rendered_pixels.store(size, std::memory_order_relaxed);
+            STATS(stats.pixels.fetch_add(size, std::memory_order_relaxed);)
+        }
+        composite(thread_count);
+    }
+
+    Map::EngineReport Map::compare_engine(unsigned int thread_count, const size_t max_reported) {
+        STATS(PhaseTimer timer(stats, "compare_engine");)
+        TraceSpan span(tracer, "compare_engine", "render");
+        std::unique_lock lock(map_mutex);
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min(thread_count, std::max(1u, height));
+        const size_t size = static_cast<size_t>(width) * height;
+        std::vector<Owner *> field(size);
+        std::vector<double> field_influence(size);
+        calculate_field(field.data(), field_influence.data(), thread_count, false);
+
+        std::vector<EngineReport> reports(thread_count);
+        std::vector<unsigned long long> error_counts(thread_count);
+        run_row_bands(height, thread_count, [&](const unsigned int band, const unsigned int start_y,
+                                                const unsigned int end_y) {
+            ColumnWorker worker(this, 0, 1);
+            worker.prepare_sources();
+            auto &report = reports[band];
+            with_kernel(kernel_config, [&](const auto &kernel) {
+                using Kernel = std::decay_t<decltype(kernel)>;
+                for (unsigned int y = start_y; y < end_y; ++y) {
+                    for (unsigned int x = 0; x < width; ++x) {
+                        const auto [owner, influence] = worker.calculate_influence<Kernel, double>(x, y, kernel);
+                        const size_t index = x + static_cast<size_t>(y) * width;
+                        ++report.pixels;
+                        if (owner == field[index]) {
+                            if (owner == nullptr) continue;
+                            const double error = std::abs(field_influence[index] - influence) / influence;
+                            report.max_influence_error = std::max(report.max_influence_error, error);
+                            // Summed up here, divided by the count when merging
+                            report.mean_influence_error += error;
+                            ++error_counts[band];
+                            continue;
+                        }
+                        ++report.owner_differences;
+                        if (report.differences.size() < max_reported) {
+                            report.differences.push_back({
+                                x, y, owner == nullptr ? 0 : owner->get_id(),
+                                field[index] == nullptr ? 0 : field[index]->get_id(), influence,
+                                field_influence[index]
+                            });
+                        }
+                    }
+                }
+            });
+        });
+
+        // The bands are in row order, so the differences stay in row-major order
+        EngineReport result;
+        unsigned long long error_count = 0;
+        for (unsigned int band = 0; band < thread_count; ++band) {
+            auto &report = reports[band];
+            result.pixels += report.pixels;
+            result.owner_differences += report.owner_differences;
+            result.max_influence_error = std::max(result.max_influence_error, report.max_influence_error);
+            result.mean_influence_error += report.mean_influence_error;
+            error_count += error_counts[band];
+            for (auto &difference: report.differences) {
+                if (result.differences.size() >= max_reported) break;
+                result.differences.push_back(difference);
+            }
+        }
+        if (error_count > 0) result.mean_influence_error /= static_cast<double>(error_count);
+        return result;
+    }
+
+    std::vector<uint8_t> Map::region_mask(const id_t region_id, unsigned int thread_count) const {
+        TraceSpan span(tracer, "region_mask", "diff");
+        struct Point {
+            long long x;
+            long long y;
+            bool in_region;
+        };
+        // Sorted by id, so ties go to the system with the lowest id
+        const auto systems = build_topology();
+        std::vector<Point> points;
+        points.reserve(systems->size());
+        bool has_region = false;
+        for (size_t i = 0; i < systems->size(); ++i) {
+            const auto &system = systems->get_system(i);
+            points.push_back({system.x, system.y, system.region_id == region_id});
+            has_region = has_region || system.region_id == region_id;
+        }
+        if (!has_region) {
+            throw std::runtime_error("Unknown region " + std::to_string(region_id));
+        }
+
+        // The systems binned into cells, systems outside the map are put into the border cells
+        constexpr unsigned int cell_size = 32;
+        const unsigned int cells_x = (width + cell_size - 1) / cell_size;
+        const unsigned int cells_y = (height + cell_size - 1) / cell_size;
+        std::vector<std::vector<uint32_t> > cells(static_cast<size_t>(cells_x) * cells_y);
+        for (uint32_t i = 0; i < points.size(); ++i) {
+            const auto cx = std::min<long long>(points[i].x / cell_size, cells_x - 1);
+            const auto cy = std::min<long long>(points[i].y / cell_size, cells_y - 1);
+            cells[cx + cy * cells_x].push_back(i);
+        }
+
+        std::vector<uint8_t> mask(static_cast<size_t>(width) * height);
+        run_row_bands(height, std::min(thread_count, std::max(1u, height)),
+                      [&](unsigned int, const unsigned int start_y, const unsigned int end_y) {
+            for (unsigned int y = start_y; y < end_y; ++y) {
+                for (unsigned int x = 0; x < width; ++x) {
+                    const long long cx = x / cell_size;
+                    const long long cy = y / cell_size;
+                    long long best_dist_sq = -1;
+                    uint32_t best = 0;
+                    // Search rings of cells around the pixel, the systems of ring r are at least (r - 1) cells away
+                    for (long long r = 0; r <= std::max(cells_x, cells_y); ++r) {
+                        if (best_dist_sq >= 0 && r > 0 &&
+                            best_dist_sq <= (r - 1) * (r - 1) * static_cast<long long>(cell_size * cell_size)) {
+                            break;
+                        }
+                        for (long long ny = cy - r; ny <= cy + r; ++ny) {
+                            if (ny < 0 || ny >= cells_y) continue;
+                            // Only the border of the ring
+                            const long long step = ny == cy - r || ny == cy + r ? 1 : std::max(1LL, 2 * r);
+                            for (long long nx = cx - r; nx <= cx + r; nx += step) {
+                                if (nx < 0 || nx >= cells_x) continue;
+                                for (const uint32_t i: cells[nx + ny * cells_x]) {
+                                    const long long dx = points[i].x - x;
+                                    const long long dy = points[i].y - y;
+                                    const long long dist_sq = dx * dx + dy * dy;
+                                    if (best_dist_sq < 0 || dist_sq < best_dist_sq ||
+                                        (dist_sq == best_dist_sq && i < best)) {
+                                        best_dist_sq = dist_sq;
+                                        best = i;
+                                    }
+                                }
+                            }
+                        }
+                    }
+                    mask[x + static_cast<size_t>(y) * width] = best_dist_sq >= 0 && points[best].in_region;
+                }
+            }
+        });
+        return mask;
+    }
+
+    Map::TerritoryDiff Map::diff_territory(const id_t region_id, unsigned int thread_count) {
+        STATS(PhaseTimer timer(stats, "diff_territory");)
+        TraceSpan span(tracer, "diff_territory", "diff");
+        std::unique_lock lock(map_mutex);
+        if (old_owner_indices == nullptr) {
+            throw std::runtime_error("No old owner image loaded");
+        }
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min(thread_count, std::max(1u, height));
+        const std::vector<uint8_t> mask = region_id == 0 ? std::vector<uint8_t>() : region_mask(region_id, thread_count);
+
+        // Every owner id that can occur gets an index: the old owners of the palette and the owners of the map
+        std::vector<id_t> ids(old_owner_palette.begin(), old_owner_palette.end());
+        for (const auto &owner: owners) {
+            ids.push_back(owner->get_id());
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        auto index_of = [&ids](const id_t id) {
+            return static_cast<uint64_t>(std::lower_bound(ids.begin(), ids.end(), id) - ids.begin());
+        };
+        std::vector<uint64_t> palette_index(old_owner_palette.size());
+        for (size_t i = 0; i < palette_index.size(); ++i) {
+            palette_index[i] = index_of(old_owner_palette[i]);
+        }
+        std::unordered_map<const Owner *, uint64_t> owner_index;
+        for (const auto &owner: owners) {
+            owner_index.emplace(owner.get(), index_of(owner->get_id()));
+        }
+        const uint64_t count = ids.size();
+
+        // Pairs of old and new owner, counted in runs because neighboring pixels mostly belong to the same pair
+        std::vector<std::unordered_map<uint64_t, unsigned long long> > band_transfers(thread_count);
+        run_row_bands(height, thread_count, [&](const unsigned int band, const unsigned int start_y,
+                                                const unsigned int end_y) {
+            auto &transfers = band_transfers[band];
+            const Owner *last_owner = nullptr;
+            uint64_t last_index = 0;
+            for (unsigned int y = start_y; y < end_y; ++y) {
+                uint64_t run_key = 0;
+                unsigned long long run = 0;
+                for (unsigned int x = 0; x < width; ++x) {
+                    const size_t i = x + static_cast<size_t>(y) * width;
+                    if (!mask.empty() && !mask[i]) continue;
+                    if (const Owner *owner = owner_image[i]; owner != last_owner) {
+                        last_owner = owner;
+                        if (owner == nullptr) {
+                            last_index = 0;
+                        } else {
+                            const auto it = owner_index.find(owner);
+                            if (it == owner_index.end()) {
+                                throw std::runtime_error("The owner image is outdated, the map has to be rendered again");
+                            }
+                            last_index = it->second;
+                        }
+                    }
+                    const uint64_t key = palette_index[old_owner_indices[i]] * count + last_index;
+                    if (key != run_key && run > 0) {
+                        transfers[run_key] += run;
+                        run = 0;
+                    }
+                    run_key = key;
+                    ++run;
+                }
+                if (run > 0) transfers[run_key] += run;
+            }
+        });
+
+        // Only the owners with pixels in either image are reported
+        std::unordered_map<uint64_t, unsigned long long> transfers;
+        std::vector<bool> active(count, false);
+        active[0] = true;
+        for (const auto &band: band_transfers) {
+            for (const auto &[key, pixels]: band) {
+                transfers[key] += pixels;
+                active[key / count] = true;
+                active[key % count] = true;
+            }
+        }
+        TerritoryDiff diff;
+        std::vector<size_t> reported_index(count);
+        for (size_t i = 0; i < count; ++i) {
+            if (!active[i]) continue;
+            reported_index[i] = diff.owners.size();
+            diff.owners.push_back(ids[i]);
+        }
+        const size_t size = diff.owners.size();
+        diff.transfers.assign(size * size, 0);
+        diff.gained.assign(size, 0);
+        diff.lost.assign(size, 0);
+        for (const auto &[key, pixels]: transfers) {
+            const size_t from = reported_index[key / count];
+            const size_t to = reported_index[key % count];
+            diff.transfers[from * size + to] += pixels;
+            if (from != to) {
+                diff.lost[from] += pixels;
+                diff.gained[to] += pixels;
+            }
+        }
+        return diff;
+    }
+
+    std::vector<Owner *> Map::system_owners(const Topology &systems) const {
+        std::vector<Owner *> result(systems.size(), nullptr);
+        for (size_t i = 0; i < systems.size(); ++i) {
+            Owner *owner = nullptr;
+            if (topology != nullptr) {
+                owner = snapshot[i].owner.get();
+            } else if (const auto system = solar_systems.find(systems.get_system(i).id); system != nullptr) {
+                owner = system->get_owner().get();
+            }
+            if (owner != nullptr && !owner->is_npc()) {
+                result[i] = owner;
+            }
+        }
+        return result;
+    }
+
+    void Map::draw_systems(uint8_t *target, const SystemStyle &style, unsigned int thread_count) {
+        STATS(PhaseTimer timer(stats, "draw_systems");)
+        TraceSpan span(tracer, "draw_systems", "render");
+        std::unique_lock lock(map_mutex);
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min(thread_count, std::max(1u, height));
+        const auto systems = build_topology();
+        const auto owners_of_systems = system_owners(*systems);
+
+        struct Jump {
+            long long x0, y0, x1, y1;
+            Color color;
+        };
+        struct Marker {
+            long long x, y;
+            Color color;
+            /// 0: no owner, 1: owned, 2: owned with a sov power of at least 6
+            int shape;
+        };
+        // Every jump is listed in both directions, it is drawn once so the alpha is not applied twice
+        std::vector<Jump> jumps;
+        jumps.reserve(systems->jump_count() / 2);
+        for (size_t i = 0; i < systems->size(); ++i) {
+            const auto &from = systems->get_system(i);
+            for (auto it = systems->neighbors_begin(i); it != systems->neighbors_end(i); ++it) {
+                if (*it <= i) continue;
+                const auto &to = systems->get_system(*it);
+                const Color &color = from.constellation_id == to.constellation_id
+                                         ? style.jump_system
+                                         : from.region_id == to.region_id
+                                               ? style.jump_constellation
+                                               : style.jump_region;
+                jumps.push_back({from.x, from.y, to.x, to.y, color});
+            }
+        }
+        std::vector<Marker> markers;
+        markers.reserve(systems->size());
+        for (size_t i = 0; i < systems->size(); ++i) {
+            const auto &system = systems->get_system(i);
+            const Owner *owner = owners_of_systems[i];
+            const NullableColor color = owner != nullptr ? owner->get_color() : NullableColor::null();
+            if (!color) {
+                markers.push_back({system.x, system.y, style.no_sov, 0});
+                continue;
+            }
+            const double sov_power = topology != nullptr
+                                         ? snapshot[i].sov_power
+                                         : solar_systems.find(system.id)->get_sov_power();
+            markers.push_back({system.x, system.y, static_cast<Color>(color), sov_power >= 6.0 ? 2 : 1});
+        }
+
+        run_row_bands(height, thread_count, [&](unsigned int, const unsigned int start_y, const unsigned int end_y) {
+            const RasterBand band(target, width, height, start_y, end_y);
+            for (const auto &[x0, y0, x1, y1, color]: jumps) {
+                if (style.antialias) {
+                    band.line_antialiased(x0, y0, x1, y1, color);
+                } else {
+                    band.line(x0, y0, x1, y1, color);
+                }
+            }
+            // The pixels of a marker are only drawn once, overlapping rectangles would blend twice
+            for (const auto &[x, y, color, shape]: markers) {
+                if (!band.intersects(y - 2, y + 2)) continue;
+                switch (shape) {
+                    case 2:
+                        band.fill_rect(x - 1, y, x, y, color);
+                        band.outline_rect(x - 2, y - 2, x + 2, y + 2, color);
+                        break;
+                    case 1:
+                        band.fill_rect(x - 2, y, x - 2, y, color);
+                        band.fill_rect(x - 1, y - 1, x + 1, y + 1, color);
+                        break;
+                    default:
+                        band.fill_rect(x - 1, y, x, y, color);
+                }
+            }
+        });
+    }
+
+    std::vector<id_t> Map::get_uncolored_system_owners() {
+        std::unique_lock lock(map_mutex);
+        const auto systems = build_topology();
+        std::vector<id_t> result;
+        std::unordered_set<const Owner *> seen;
+        for (const Owner *owner: system_owners(*systems)) {
+            if (owner == nullptr || owner->has_color() || !seen.insert(owner).second) continue;
+            result.push_back(owner->get_id());
+        }
+        return result;
+    }
+
+    void Map::set_border_alpha(const int border_alpha) {
+        std::unique_lock lock(map_mutex);
+        this->border_alpha = border_alpha;
+    }
 #if defined(EVE_MAPPER_PYTHON) && EVE_MAPPER_PYTHON
     void Map::set_sov_power_function(PyObject *pyfunc) {
         std::unique_lock lock(map_mutex);
+        if (double (*native)(double, bool, id_t) = nullptr; py::native_function(pyfunc, native)) {
+            if (native == nullptr) {
+                throw std::runtime_error(
+                    "Invalid native function, expected the signature double(double, bool, uint64)");
+            }
+            sov_power_native = py::Object(pyfunc);
+            sov_power_pyfunc = nullptr;
+            sov_power_function = native;
+            return;
+        }
         sov_power_pyfunc = std::make_unique<py::Callable<double, double, bool, id_t> >(pyfunc);
         if (!sov_power_pyfunc->validate()) {
             sov_power_pyfunc = nullptr;
             throw std::runtime_error(
                 "Invalid callable, expected a function with signature (double, bool, int) -> double");
         }
+        sov_power_native = py::Object();
+        STATS(sov_power_pyfunc->set_stats_counters(&stats.callback_calls, &stats.gil_wait_ns);)
         sov_power_function = [this](const double sov_power, const bool has_station, const id_t owner_id) {
             Py_Trace_Errors(
                 return (*sov_power_pyfunc)(sov_power, has_station, owner_id);)
@@ -776,12 +2900,24 @@ namespace bluemap {
 
     void Map::set_power_falloff_function(PyObject *pyfunc) {
         std::unique_lock lock(map_mutex);
+        if (double (*native)(double, double, int) = nullptr; py::native_function(pyfunc, native)) {
+            if (native == nullptr) {
+                throw std::runtime_error(
+                    "Invalid native function, expected the signature double(double, double, int)");
+            }
+            power_falloff_native = py::Object(pyfunc);
+            power_falloff_pyfunc = nullptr;
+            power_falloff_function = native;
+            return;
+        }
         power_falloff_pyfunc = std::make_unique<py::Callable<double, double, double, int> >(pyfunc);
         if (!power_falloff_pyfunc->validate()) {
             power_falloff_pyfunc = nullptr;
             throw std::runtime_error(
                 "Invalid callable, expected a function with signature (double, double, int) -> double");
         }
+        power_falloff_native = py::Object();
+        STATS(power_falloff_pyfunc->set_stats_counters(&stats.callback_calls, &stats.gil_wait_ns);)
         power_falloff_function = [this](const double value, const double base_value, const int distance) {
             Py_Trace_Errors(
                 return (*power_falloff_pyfunc)(value, base_value, distance);)
@@ -790,11 +2926,22 @@ namespace bluemap {
 
     void Map::set_influence_to_alpha_function(PyObject *pyfunc) {
         std::unique_lock lock(map_mutex);
+        if (double (*native)(double) = nullptr; py::native_function(pyfunc, native)) {
+            if (native == nullptr) {
+                throw std::runtime_error("Invalid native function, expected the signature double(double)");
+            }
+            influence_to_alpha_native = py::Object(pyfunc);
+            influence_to_alpha_pyfunc = nullptr;
+            influence_to_alpha = native;
+            return;
+        }
         influence_to_alpha_pyfunc = std::make_unique<py::Callable<double, double> >(pyfunc);
         if (!influence_to_alpha_pyfunc->validate()) {
             influence_to_alpha_pyfunc = nullptr;
             throw std::runtime_error("Invalid callable, expected a function with signature (double) -> double");
         }
+        influence_to_alpha_native = py::Object();
+        STATS(influence_to_alpha_pyfunc->set_stats_counters(&stats.callback_calls, &stats.gil_wait_ns);)
         influence_to_alpha = [this](const double influence) {
             Py_Trace_Errors(
                 return (*influence_to_alpha_pyfunc)(influence);)
@@ -803,12 +2950,26 @@ namespace bluemap {
 
     void Map::set_generate_owner_color_function(PyObject *pyfunc) {
         std::unique_lock lock(map_mutex);
+        if (uint32_t (*native)(id_t) = nullptr; py::native_function(pyfunc, native)) {
+            if (native == nullptr) {
+                throw std::runtime_error("Invalid native function, expected the signature uint32(uint64)");
+            }
+            generate_owner_color_native = py::Object(pyfunc);
+            generate_owner_color_pyfunc = nullptr;
+            generate_owner_color = [native](const id_t owner_id) {
+                const uint32_t rgb = native(owner_id);
+                return Color((rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF);
+            };
+            return;
+        }
         generate_owner_color_pyfunc = std::make_unique<py::Callable<std::tuple<int, int, int>, id_t> >(pyfunc);
         if (!generate_owner_color_pyfunc->validate()) {
             generate_owner_color_pyfunc = nullptr;
             throw std::runtime_error(
                 "Invalid callable, expected a function with signature (int) -> tuple[int, int, int]");
         }
+        generate_owner_color_native = py::Object();
+        STATS(generate_owner_color_pyfunc->set_stats_counters(&stats.callback_calls, &stats.gil_wait_ns);)
         generate_owner_color = [this](const id_t owner_id) {
             std::tuple<int, int, int> color;
             Py_Trace_Errors(
@@ -1,14 +1,21 @@
 #ifndef MAP_H
 #define MAP_H
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <EntityStore.h>
 #include <fstream>
 #include <functional>
 #include <Image.h>
+#include <Kernel.h>
+#include <Stats.h>
+#include <Trace.h>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -36,7 +43,7 @@ namespace bluemap {
     }
 
     template<typename T>
-    T read_big_endian(std::ifstream &file) {
+    T read_big_endian(std::istream &file) {
         T value;
         file.read(reinterpret_cast<char *>(&value), sizeof(T));
         const bool need_reverse = !is_big_endian();
@@ -49,7 +56,7 @@ namespace bluemap {
     }
 
     template<typename T>
-    void write_big_endian(std::ofstream &file, T value) {
+    void write_big_endian(std::ostream &file, T value) {
         if constexpr (sizeof(T) > 1) {
             if (!is_big_endian()) {
                 std::reverse(reinterpret_cast<char *>(&value), reinterpret_cast<char *>(&value) + sizeof(T));
@@ -108,8 +115,7 @@ namespace bluemap {
         std::string name;
         NullableColor color;
         bool npc;
-        std::mutex guard{};
-        unsigned long long count = 0;
+        std::atomic<unsigned long long> count = 0;
 
     public:
         Owner(id_t id, std::string name, int color_red, int color_green, int color_blue, bool is_npc);
@@ -172,7 +178,43 @@ namespace bluemap {
 
         [[nodiscard]] unsigned int get_y() const;
 
-        [[nodiscard]] std::vector<std::tuple<std::shared_ptr<Owner>, double> > get_influences();
+        [[nodiscard]] const std::vector<std::tuple<std::shared_ptr<Owner>, double> > &get_influences() const;
+    };
+
+    class Topology;
+    struct TileResult;
+
+    /// A rectangle of the map in map coordinates (the coordinates of the solar systems) and the size of its image
+    struct Viewport {
+        double x = 0.0;
+        double y = 0.0;
+        double width = 0.0;
+        double height = 0.0;
+        unsigned int output_width = 0;
+        unsigned int output_height = 0;
+    };
+
+    /// The colors of Map::draw_systems(), the defaults are the ones of SovMap
+    struct SystemStyle {
+        /// Jumps inside a constellation
+        Color jump_system = Color(0x00, 0x00, 0xFF, 0x30);
+        /// Jumps between constellations of the same region
+        Color jump_constellation = Color(0xFF, 0x00, 0x00, 0x30);
+        /// Jumps between regions
+        Color jump_region = Color(0xFF, 0x00, 0xFF, 0x30);
+        /// Systems without an owner or owned by an NPC
+        Color no_sov = Color(0xB0, 0xB0, 0xFF);
+        bool antialias = false;
+    };
+
+    /// How the influence field of a full rendering is calculated, see Map::set_engine()
+    enum class InfluenceEngine {
+        /// Every pixel sums up the systems within the cutoff (ColumnWorker)
+        GATHER,
+        /// Every owner's sources are convolved with the kernel via FFT
+        FFT,
+        /// Every system adds its kernel into per-owner buffers of the tiles it reaches
+        SCATTER,
     };
 
     class Map {
@@ -184,18 +226,55 @@ namespace bluemap {
         //double power_falloff = 0.3;
         int power_max_distance = 4;
         int border_alpha = 0x48;
+        /// The spatial kernel of the influence, see Kernel.h
+        KernelConfig kernel_config;
+        /// Accumulate the influence in float instead of double, see compare_precision()
+        bool single_precision = false;
+        InfluenceEngine engine = InfluenceEngine::GATHER;
 
 
-        std::map<id_t, std::shared_ptr<Owner> > owners = {};
-        std::map<id_t, std::shared_ptr<SolarSystem> > solar_systems = {};
+        EntityStore<Owner> owners;
+        EntityStore<SolarSystem> solar_systems;
         std::vector<SolarSystem *> sov_solar_systems = {};
         std::map<id_t, std::vector<SolarSystem *> > connections = {};
-        mutable std::shared_mutex map_mutex;
+        mutable TimedMutex<std::shared_mutex> map_mutex;
 
-        std::mutex image_mutex;
+        struct SnapshotSystem {
+            std::shared_ptr<Owner> owner = nullptr;
+            double sov_power = 1.0;
+            bool has_station = false;
+        };
+
+        /// If set, the map uses this shared topology instead of solar_systems and connections, see set_topology()
+        std::shared_ptr<const Topology> topology = nullptr;
+        /// The state of every system of the topology, by topology index
+        std::vector<SnapshotSystem> snapshot = {};
+        /// The systems of the topology which received influence, sov_solar_systems points to them
+        std::vector<std::unique_ptr<SolarSystem> > influenced_systems = {};
+
+        TimedMutex<std::mutex> image_mutex;
         Image image = Image(width, height);
         std::unique_ptr<Owner *[]> owner_image = nullptr;
-        std::unique_ptr<id_t[]> old_owners_image = nullptr;
+        /// The influence of the owner in owner_image for every pixel, together they form the cached influence field
+        std::unique_ptr<double[]> influence_image = nullptr;
+        /// Either owned by the map or a view of a shared memory segment, see attach_shared_state()
+        std::shared_ptr<const id_t[]> old_owners_image = nullptr;
+        /// The distinct old owner ids, index 0 is no owner
+        std::vector<id_t> old_owner_palette = {0};
+        /// The palette index of the old owner of every pixel, set together with old_owners_image. Like the image, either
+        /// owned by the map or a view of a shared memory segment
+        std::shared_ptr<const uint32_t[]> old_owner_indices = nullptr;
+        /// Optional float32 copy of the influence field, filled during rendering if export_influence is set
+        std::unique_ptr<float[]> influence_export = nullptr;
+        bool export_influence = false;
+
+        /// The number of pixels processed by all workers since the last reset_render_state()
+        std::atomic<unsigned long long> rendered_pixels = 0;
+        /// Checked by the workers before every row, see cancel_render()
+        std::atomic<bool> render_cancelled = false;
+
+        STATS(mutable StatsCollector stats;)
+        mutable Tracer tracer;
 
         // Functional interfaces
         std::function<double(double, bool, id_t)> sov_power_function;
@@ -209,6 +288,12 @@ namespace bluemap {
         std::unique_ptr<py::Callable<double, double, double, int> > power_falloff_pyfunc = nullptr;
         std::unique_ptr<py::Callable<double, double> > influence_to_alpha_pyfunc = nullptr;
         std::unique_ptr<py::Callable<std::tuple<int, int, int>, id_t> > generate_owner_color_pyfunc = nullptr;
+        /// The native functions (see py::native_function) are called without the GIL, their Python objects are kept
+        /// alive while they are set
+        py::Object sov_power_native = {};
+        py::Object power_falloff_native = {};
+        py::Object influence_to_alpha_native = {};
+        py::Object generate_owner_color_native = {};
 #endif
 
         void add_influence(const SolarSystem *solar_system,
@@ -217,27 +302,211 @@ namespace bluemap {
                            double base_value,
                            int distance);
 
+        /**
+         * Calculates the final color of a pixel from the influence field. This is shared by the ColumnWorker and
+         * composite() so both produce the same image. The old owner overlay is drawn afterward by
+         * draw_old_owner_hatch().
+         *
+         * @param owner the owner of the pixel, must not be nullptr or a npc
+         * @param influence the influence of the owner
+         * @param draw_border if the pixel is part of a border
+         * @return the color of the pixel
+         */
+        Color compose_pixel(Owner *owner, double influence, bool draw_border);
+
+        /**
+         * The border rule of ColumnWorker::process_pixel(), shared by composite() and render_tile(). The pixel (x, y)
+         * shows the owner of the field pixel (x, y - 1), it is a border if the field pixel is in the second row of the
+         * map or any of its four neighbours inside the map has another owner.
+         *
+         * @param owner_at returns the owner of a field pixel (x, y)
+         * @param owner the owner of the field pixel (x, y - 1)
+         * @param x the x coordinate of the pixel
+         * @param y the y coordinate of the pixel, must be at least 1 and below the map height
+         * @param width the width of the map
+         */
+        template<typename OwnerAt>
+        static bool is_border_pixel(const OwnerAt &owner_at, const Owner *owner, const unsigned int x,
+                                    const unsigned int y, const unsigned int width) {
+            return y == 1 || owner_at(x, y - 2) != owner || owner_at(x, y) != owner ||
+                   (x > 0 && owner_at(x - 1, y - 1) != owner) ||
+                   (x < width - 1 && owner_at(x + 1, y - 1) != owner);
+        }
+
+        /**
+         * Draws the old owner overlay over a row of composed pixels: on every fifth pixel (a diagonal hatching) whose
+         * old owner differs from its owner, the color of the old owner is drawn. The old owners are resolved to
+         * palette indices when they are set, so this is a strided pass over plain arrays.
+         *
+         * @param pixels the RGBA pixels of the row
+         * @param row_owners the owner drawn into every pixel, i.e. the field row above, see composite()
+         * @param row_influence the influence of these owners
+         * @param old_owner_row the palette indices of the old owners of the pixels
+         * @param palette the old owners by palette index, see resolve_old_owner_palette()
+         * @param count the number of pixels
+         * @param pattern_x the x coordinate of the first pixel for the hatching
+         * @param pattern_y the y coordinate of the row for the hatching
+         */
+        void draw_old_owner_hatch(uint8_t *pixels, Owner *const *row_owners, const double *row_influence,
+                                  const uint32_t *old_owner_row, const std::vector<Owner *> &palette,
+                                  unsigned int count, unsigned int pattern_x, unsigned int pattern_y);
+
+        /// Builds old_owner_palette and old_owner_indices from old_owners_image, the map lock must be held
+        void index_old_owners();
+
+        /**
+         * The old owners of the palette, nullptr for index 0, unknown owners and npcs. The owners are looked up once
+         * per rendering, the map lock must be held.
+         */
+        [[nodiscard]] std::vector<Owner *> resolve_old_owner_palette() const;
+
+        /// calculate_influence() for a map with a topology, the map lock must be held
+        void calculate_snapshot_influence();
+
+        /// Switches back from a topology to own data, the map lock must be held
+        void clear_topology();
+
+        /// Removes the owners, solar systems and jumps before new data is loaded, the map lock must be held
+        void clear_entities();
+
+        /// create_topology() without locking
+        [[nodiscard]] std::shared_ptr<const Topology> build_topology() const;
+
+        /// Writes the shared state into the target if it is not null, returns the size of the state
+        size_t write_shared_state(const Topology &topology, uint8_t *target) const;
+
+        /**
+         * Calculates the owner and influence of every pixel by convolving the sources of every owner with the kernel via
+         * FFT. The cost depends on the number of owners and pixels, not on the number of systems. The map lock must be
+         * held.
+         *
+         * The convolution runs on a power-of-two grid that covers the map (and systems outside of it) plus the kernel
+         * reach, each cell takes 24 bytes: 4096x4096 and about 400 MB for a 1856x2048 map with the default cutoff.
+         *
+         * @param field the owner of every pixel, width * height
+         * @param field_influence the influence of the owner, width * height
+         * @param thread_count the number of threads
+         * @param cancellable whether to stop if the rendering gets cancelled
+         * @return false if the rendering was cancelled
+         * @throws std::runtime_error if the grid would need more than FFT_MEMORY_LIMIT bytes
+         */
+        bool calculate_fft_field(Owner **field, double *field_influence, unsigned int thread_count,
+                                 bool cancellable) const;
+
+        /// The largest grid calculate_fft_field() allocates, in bytes
+        static constexpr size_t FFT_MEMORY_LIMIT = size_t{1} << 30;
+
+        /// The side of the tiles of the scatter engine, the per-owner buffers of a tile should fit into the cache
+        static constexpr unsigned int SCATTER_TILE_SIZE = 64;
+
+        /**
+         * calculate_fft_field() for the scatter engine: every system adds its kernel into the tiles within its cutoff,
+         * accumulated per owner in buffers of the tile. Then the best owner of every pixel of the tile is picked. The
+         * result is identical to ColumnWorker::calculate_influence().
+         */
+        bool calculate_scatter_field(Owner **field, double *field_influence, unsigned int thread_count,
+                                     bool cancellable) const;
+
+        /**
+         * Marks the pixels of a region: every pixel belongs to the region of its nearest solar system. The map lock must
+         * be held.
+         *
+         * @throws std::runtime_error if the region has no systems
+         */
+        [[nodiscard]] std::vector<uint8_t> region_mask(id_t region_id, unsigned int thread_count) const;
+
+        /**
+         * The owner of every system of build_topology(), by topology index. NPC owners are returned as nullptr. The map
+         * lock must be held.
+         */
+        [[nodiscard]] std::vector<Owner *> system_owners(const Topology &systems) const;
+
+        /// Calculates the owner and influence of every pixel with the engine, the map lock must be held
+        bool calculate_field(Owner **field, double *field_influence, unsigned int thread_count, bool cancellable);
+
     public:
         class ColumnWorker {
             Map *map;
             unsigned int start_x;
             unsigned int end_x;
             bool render_old_owners = false;
+            /// See resolve_old_owner_palette(), resolved at the start of render()
+            std::vector<Owner *> old_owner_palette;
 
             // The current start offset for the cache
             unsigned int row_offset = 0;
 
+            /// A solar system with influence, its contributions are contribution_owners/powers[begin, end)
+            struct InfluenceSource {
+                int x = 0;
+                int y = 0;
+                uint32_t begin = 0;
+                uint32_t end = 0;
+            };
+
+            /// The sov_solar_systems flattened by prepare_sources(), the owners are indices into the owner store
+            std::vector<InfluenceSource> sources;
+            std::vector<uint32_t> contribution_owners;
+            /// The powers in both precisions, the float loop only touches float data
+            std::vector<double> contribution_powers;
+            std::vector<float> contribution_powers_float;
+            /// The influence sum of every owner index for the current pixel, a worker is used by one thread at a time
+            mutable std::vector<double> owner_sums;
+            mutable std::vector<float> owner_sums_float;
+            /// The owner indices with a non-zero sum, reset after every pixel
+            mutable std::vector<uint32_t> touched_owners;
+
             Image cache;
 
             std::mutex render_mutex;
 
+            STATS(mutable unsigned long long systems_visited = 0;)
+            STATS(mutable unsigned long long owner_contributions = 0;)
+
             void flush_cache();
 
+            template<typename Real>
+            [[nodiscard]] const std::vector<Real> &powers() const {
+                if constexpr (std::is_same_v<Real, float>) {
+                    return contribution_powers_float;
+                } else {
+                    return contribution_powers;
+                }
+            }
+
+            template<typename Real>
+            [[nodiscard]] std::vector<Real> &sums() const {
+                if constexpr (std::is_same_v<Real, float>) {
+                    return owner_sums_float;
+                } else {
+                    return owner_sums;
+                }
+            }
+
         public:
             ColumnWorker(Map *map, unsigned int start_x, unsigned int end_x);
 
+            /**
+             * Flattens the influence of the map for calculate_influence(), the map lock must be held. render() calls it,
+             * other users of calculate_influence() have to call it first.
+             */
+            void prepare_sources();
+
+            /// prepare_sources() for a subset of the sov_solar_systems, e.g. the ones that can reach a viewport
+            void prepare_sources(const std::vector<SolarSystem *> &systems);
+
+            /// Calculates the owner of the pixel with the kernel and precision of the map, see prepare_sources()
             [[nodiscard]] std::tuple<Owner *, double> calculate_influence(unsigned int x, unsigned int y) const;
 
+            /**
+             * @tparam Real the type the influence is accumulated in
+             * @tparam Coordinate unsigned int for pixels, double for fractional coordinates (see render_viewport())
+             */
+            template<typename Kernel, typename Real = double, typename Coordinate = unsigned int>
+            [[nodiscard]] std::tuple<Owner *, double> calculate_influence(Coordinate x, Coordinate y,
+                                                                          const Kernel &kernel) const;
+
+            template<typename Kernel, typename Real = double>
             void process_pixel(
                 unsigned int width,
                 unsigned int i,
@@ -245,11 +514,66 @@ namespace bluemap {
                 std::vector<Owner *> &this_row,
                 const std::vector<Owner *> &prev_row,
                 std::vector<double> &prev_influence,
-                std::vector<bool> &border) const;
+                std::vector<bool> &border,
+                const Kernel &kernel) const;
 
             void render();
         };
 
+        /// A pixel whose owner or alpha differs between float and double precision
+        struct PrecisionDifference {
+            unsigned int x = 0;
+            unsigned int y = 0;
+            id_t double_owner = 0;
+            id_t float_owner = 0;
+            int double_alpha = 0;
+            int float_alpha = 0;
+        };
+
+        struct PrecisionReport {
+            unsigned long long pixels = 0;
+            unsigned long long owner_differences = 0;
+            /// Pixels with the same owner, but a different alpha
+            unsigned long long alpha_differences = 0;
+            int max_alpha_difference = 0;
+            /// The first differences in row-major order, at most max_reported
+            std::vector<PrecisionDifference> differences;
+        };
+
+        /// A pixel whose owner differs between an engine and ColumnWorker::calculate_influence()
+        struct EngineDifference {
+            unsigned int x = 0;
+            unsigned int y = 0;
+            id_t reference_owner = 0;
+            id_t engine_owner = 0;
+            double reference_influence = 0.0;
+            double engine_influence = 0.0;
+        };
+
+        struct EngineReport {
+            unsigned long long pixels = 0;
+            unsigned long long owner_differences = 0;
+            /// The largest and mean relative influence error of the pixels with the same owner
+            double max_influence_error = 0.0;
+            double mean_influence_error = 0.0;
+            /// The first differences in row-major order, at most max_reported
+            std::vector<EngineDifference> differences;
+        };
+
+        /// The pixels that changed hands between the old owner image and the last rendering
+        struct TerritoryDiff {
+            /// The owners with pixels in either image, sorted by id, 0 (no owner) is always the first
+            std::vector<id_t> owners;
+            /**
+             * transfers[old * owners.size() + new] is the number of pixels that changed from the old to the new owner
+             * (indices into owners), the diagonal holds the unchanged pixels
+             */
+            std::vector<unsigned long long> transfers;
+            /// The pixels gained and lost by every owner, in the order of owners
+            std::vector<unsigned long long> gained;
+            std::vector<unsigned long long> lost;
+        };
+
         struct MapOwnerLabel {
             id_t owner_id = 0;
             unsigned long long x = 0;
@@ -265,13 +589,14 @@ namespace bluemap {
         /**
          *
          * Performs a flood fill on the owner_image to detect connected regions of the same owner
-         * As a result, all entries in the owner_image will be set to nullptr
+         * All visited pixels are marked in the visited vector, the owner_image itself is not modified
          *
          * @param x the x coordinate to start the flood fill
          * @param y the y coordinate
          * @param label the label to detect the region
+         * @param visited the already visited pixels, must have a size of width * height
          */
-        void owner_flood_fill(unsigned int x, unsigned int y, MapOwnerLabel &label);
+        void owner_flood_fill(unsigned int x, unsigned int y, MapOwnerLabel &label, std::vector<bool> &visited);
 
     public:
         Map();
@@ -292,6 +617,116 @@ namespace bluemap {
                       const std::vector<std::shared_ptr<SolarSystem> > &solar_systems,
                       const std::vector<JumpData> &jumps);
 
+        /// Creates a topology from the loaded solar systems and jumps, which can be shared with other maps
+        [[nodiscard]] std::shared_ptr<const Topology> create_topology() const;
+
+        /**
+         * Uses the shared topology instead of own solar systems and connections. All loaded data is removed, the
+         * ownership is loaded with load_snapshot(). load_data() and set_data() switch back to own data, as does
+         * changing the size of the map.
+         *
+         * @throws std::runtime_error if the size of the topology does not match the size of the map
+         */
+        void set_topology(std::shared_ptr<const Topology> topology);
+
+        /**
+         * Loads the ownership of the systems of the topology, replacing the previous snapshot. Only the id,
+         * has_station, sov_power and owner of the solar systems are used. Systems unknown to the topology are ignored,
+         * systems not listed are unclaimed.
+         *
+         * @throws std::runtime_error if no topology is set
+         */
+        void load_snapshot(const std::vector<std::shared_ptr<Owner> > &owners,
+                           const std::vector<SolarSystemData> &solar_systems);
+
+        /// The number of bytes export_shared_state() writes
+        [[nodiscard]] size_t shared_state_size() const;
+
+        /**
+         * Writes the state needed for rendering into a flat block of memory, usually a shared memory segment or a
+         * memory mapped file: the topology, the ownership and sov power of the systems, the owners, the calculated
+         * influence of every system, the old owner image with its palette indices and the kernel, precision and
+         * engine. Other processes can use it with attach_shared_state().
+         *
+         * The block is only valid on machines with the same byte order.
+         *
+         * @param target the memory, it must be aligned to 8 bytes
+         * @param size the size of the memory
+         * @throws std::runtime_error if the memory is smaller than shared_state_size()
+         */
+        void export_shared_state(uint8_t *target, size_t size) const;
+
+        /**
+         * Uses a state written by export_shared_state() without copying the topology, the old owner image and its
+         * palette indices. The map is switched to the topology mode (see set_topology()), the influence is already
+         * calculated and the kernel, precision and engine are taken from the state. The memory is only read and must
+         * stay valid until the map is destroyed or another state is attached.
+         *
+         * @param data the memory, it must be aligned to 8 bytes
+         * @param size the size of the memory
+         * @throws std::runtime_error if the memory does not contain a valid state or the size does not match the map
+         */
+        void attach_shared_state(const uint8_t *data, size_t size);
+
+        /// All owners of the map, sorted by id
+        [[nodiscard]] std::vector<std::shared_ptr<Owner> > get_owners() const;
+
+        /// Returns the width and height of a state written by export_shared_state()
+        /// @throws std::runtime_error if the memory does not contain a shared state
+        static std::pair<unsigned int, unsigned int> get_shared_state_size(const uint8_t *data, size_t size);
+
+        /**
+         * Renders a rectangle of the map independently of the other pixels, see Tiles.h. The image of the tile matches
+         * composite(), the owners match the owner image and the label partials can be merged into calculate_labels()
+         * with a TileMerger. The influence must be calculated.
+         *
+         * @param x the left edge of the tile
+         * @param y the top edge of the tile
+         * @param tile_width the width of the tile
+         * @param tile_height the height of the tile
+         * @param sample_rate the distance between the label grid points
+         * @param thread_count the number of threads to render with
+         * @throws std::runtime_error if the tile is not inside the map
+         */
+        [[nodiscard]] TileResult render_tile(unsigned int x, unsigned int y, unsigned int tile_width,
+                                             unsigned int tile_height, unsigned int sample_rate,
+                                             unsigned int thread_count = 1);
+
+        /**
+         * Renders a rectangle of the map into an image of any size, e.g. to zoom into a region. Only the systems within
+         * the influence range of the rectangle are evaluated and only the output image is written, the size of the map
+         * does not matter. At a scale of 1 and integer coordinates, the image matches the same area of composite(),
+         * the edges of the map get the same borders. Outside the map, the influence is rendered as if the map
+         * continued. The influence must be calculated.
+         *
+         * @param viewport the rectangle and the size of the image
+         * @param target the RGBA image, output_width * output_height * 4 bytes
+         * @param owner_target the owner ids of the pixels or nullptr
+         * @param owner_row_stride the distance between two rows of owner_target in bytes
+         * @param owner_column_stride the distance between two columns of owner_target in bytes
+         * @param thread_count the number of threads to render with, 0 uses all cores
+         * @throws std::runtime_error if the viewport is empty
+         */
+        void render_viewport(const Viewport &viewport, uint8_t *target, id_t *owner_target = nullptr,
+                             ptrdiff_t owner_row_stride = 0, ptrdiff_t owner_column_stride = 0,
+                             unsigned int thread_count = 1);
+
+        /**
+         * Draws the jumps and the solar systems into an RGBA image of the size of the map, blended over its content. The
+         * jumps are colored by the style (same constellation, same region or between regions), the systems get the
+         * color of their owner: a cross of 3x3 pixels, or a 5x5 outline for a sov power of at least 6. Systems without
+         * an owner, NPC owned systems and owners without a color get a small marker in the no_sov color. The rows are
+         * split between the threads, the result does not depend on the thread count.
+         *
+         * @param target the RGBA image, width * height * 4 bytes
+         * @param style the colors and whether the jumps are anti-aliased
+         * @param thread_count the number of threads, 0 uses all cores
+         */
+        void draw_systems(uint8_t *target, const SystemStyle &style, unsigned int thread_count = 0);
+
+        /// The distinct non-NPC owners of solar systems that have no color, ordered by the lowest id of their systems
+        [[nodiscard]] std::vector<id_t> get_uncolored_system_owners();
+
         void set_sov_power_function(std::function<double(double, bool, id_t)> sov_power_function);
 
         void set_power_falloff_function(std::function<double(double, double, int)> power_falloff_function);
@@ -304,6 +739,43 @@ namespace bluemap {
 
         void render_multithreaded();
 
+        /// Resets the progress counter and the cancellation flag, call this before starting the workers
+        void reset_render_state();
+
+        /**
+         * Requests all running workers to stop after their current row. The workers paste the rows they have finished,
+         * so the image and owner data contain a partial rendering afterward. The map can be rendered again after
+         * reset_render_state() was called.
+         */
+        void cancel_render();
+
+        [[nodiscard]] bool is_render_cancelled() const;
+
+        /// The number of pixels rendered by all workers since the last reset_render_state()
+        [[nodiscard]] unsigned long long get_rendered_pixels() const;
+
+        /// The statistics collected since the last reset_stats(), only available if compiled with EVE_MAPPER_STATS
+        [[nodiscard]] RenderStats get_stats() const;
+
+        void reset_stats();
+
+        /// Starts recording the spans of all phases and workers, previously recorded spans are discarded
+        void start_trace();
+
+        void stop_trace();
+
+        /// Writes the recorded spans as Chrome trace-event JSON, waits until running workers have finished
+        void save_trace(const std::string &filename);
+
+        /**
+         * Recreates the image from the influence field cached by the last rendering without recalculating the
+         * influence. Use this after changing the owner colors, the influence_to_alpha function, the border alpha or
+         * the old owner image. The result is the same as a full rendering with a single worker.
+         *
+         * @param thread_count the number of threads to use, 0 for all available cores
+         */
+        void composite(unsigned int thread_count = 0);
+
         std::vector<MapOwnerLabel> calculate_labels();
 
         ColumnWorker *create_worker(unsigned int start_x, unsigned int end_x);
@@ -316,14 +788,53 @@ namespace bluemap {
 
         void debug_save_old_owners(const std::string &filename) const;
 
-        void save(const std::string &filename) const;
+        /**
+         * Saves the rendered image. PNG images are compressed in parallel strips, QOI and RAW are meant as fast
+         * intermediate formats (see Image::write_qoi() and Image::write_raw()).
+         *
+         * @param filename the path of the file
+         * @param format the file format
+         * @param level the PNG compression level (0-9), 0 stores the data uncompressed
+         * @param thread_count the number of threads to compress the PNG with, 0 for all available cores
+         */
+        void save(const std::string &filename, ImageFormat format = ImageFormat::PNG, int level = 4,
+                  unsigned int thread_count = 0) const;
 
         /// Returns and clears the rendered image, the caller is responsible for deleting the data
         [[nodiscard]] uint8_t *retrieve_image();
 
+        /// Returns and clears the influence of the winning owner per pixel of the last rendering, nullptr if the export
+        /// was disabled. The caller is responsible for deleting the data
+        [[nodiscard]] float *retrieve_influence_image();
+
+        /// If enabled, the influence of the winning owner per pixel is written into a float buffer during rendering
+        void set_export_influence(bool export_influence);
+
+        [[nodiscard]] bool is_export_influence() const;
+
         /// Returns the owner image, the caller is responsible for deleting the data
         [[nodiscard]] id_t *create_owner_image() const;
 
+        /**
+         * Writes the owner ids (0 for no owner) of the last rendering into the given memory, e.g. a numpy array. The
+         * strides are given in bytes, so padded rows or views with a different layout can be used.
+         *
+         * @param target the position of the first pixel (0, 0)
+         * @param row_stride the distance between two rows in bytes
+         * @param column_stride the distance between two pixels of the same row in bytes
+         */
+        void write_owner_image(id_t *target, ptrdiff_t row_stride, ptrdiff_t column_stride) const;
+
+        /**
+         * Lets the rendering (and composite()) write directly into the given memory instead of the internal image, see
+         * Image::attach(). The memory must hold width * height * 4 bytes and stay valid until release_image_target() is
+         * called.
+         */
+        void set_image_target(uint8_t *target);
+
+        /// Switches back to the internal image after set_image_target()
+        void release_image_target();
+
         /// Sets the old owner image, this will transfer ownership of the data to the map
         /// Must have a size of width * height
         void set_old_owner_image(id_t *old_owner_image, unsigned int width, unsigned int height);
@@ -334,6 +845,73 @@ namespace bluemap {
 
         [[nodiscard]] bool has_old_owner_image() const;
 
+        /// The minimum alpha value of border pixels
+        [[nodiscard]] int get_border_alpha() const;
+
+        void set_border_alpha(int border_alpha);
+
+        [[nodiscard]] KernelConfig get_kernel() const;
+
+        [[nodiscard]] bool is_single_precision() const;
+
+        /**
+         * Accumulates the influence in float instead of double when rendering, see compare_precision(). Meant for
+         * matching float pipelines, it is not faster: the scalar loop is bound by the kernel division and the sums.
+         */
+        void set_single_precision(bool single_precision);
+
+        /**
+         * Calculates the owner and alpha of every pixel with float and with double precision and reports the pixels
+         * that differ, so the accuracy of set_single_precision() can be checked for the current data and kernel. The
+         * influence must be calculated.
+         *
+         * @param thread_count the number of threads, 0 uses all cores
+         * @param max_reported the maximum number of differences listed in the report, all are counted
+         */
+        [[nodiscard]] PrecisionReport compare_precision(unsigned int thread_count = 0, size_t max_reported = 1000);
+
+        /// @throws std::runtime_error if the config is invalid
+        void set_kernel(const KernelConfig &kernel);
+
+        /// The name of the engine: "gather", "fft" or "scatter"
+        [[nodiscard]] std::string get_engine() const;
+
+        /**
+         * Sets the engine used by render_engine(), by name: "gather" (the default, the same as the ColumnWorkers),
+         * "fft" or "scatter". The FFT engine always calculates with double precision. render_tile() and
+         * render_viewport() always use the gather engine.
+         *
+         * @throws std::runtime_error if the name is unknown
+         */
+        void set_engine(const std::string &name);
+
+        /**
+         * Renders the whole map with the engine set by set_engine(): the influence field is calculated and then
+         * composited like composite(). Call reset_render_state() before, like for the workers.
+         *
+         * @param thread_count the number of threads, 0 uses all cores
+         */
+        void render_engine(unsigned int thread_count = 0);
+
+        /**
+         * Calculates the influence field with the engine set by set_engine() and compares it with
+         * ColumnWorker::calculate_influence() in double precision. The influence must be calculated.
+         *
+         * @param thread_count the number of threads, 0 uses all cores
+         * @param max_reported the maximum number of differences listed in the report, all are counted
+         */
+        [[nodiscard]] EngineReport compare_engine(unsigned int thread_count = 0, size_t max_reported = 1000);
+
+        /**
+         * Compares the owner image of the last rendering with the old owner image pixel by pixel and counts the pixels
+         * per pair of old and new owner. The rows are split between the threads, no copies of the images are made.
+         *
+         * @param region_id only count the pixels of this region (see region_mask()), 0 for the whole map
+         * @param thread_count the number of threads, 0 uses all cores
+         * @throws std::runtime_error if no old owner image is loaded or the region is unknown
+         */
+        [[nodiscard]] TerritoryDiff diff_territory(id_t region_id = 0, unsigned int thread_count = 0);
+
         // Python only API
 #if defined(EVE_MAPPER_PYTHON) && EVE_MAPPER_PYTHON
         /**
@@ -343,6 +921,11 @@ namespace bluemap {
          *
          * The influence then is spread to neighboring solar systems with a reduced value based on the power_falloff.
          *
+         * Instead of a Python function, a native function (a ctypes function pointer or a numba cfunc) with the signature
+         * double(double, bool, uint64) can be passed. It is called directly without the GIL. The other setters accept
+         * native functions as well: double(double, double, int), double(double) and, for the owner colors,
+         * uint32(uint64) returning 0xRRGGBB.
+         *
          * @param pyfunc a python function with the signature (double, bool, int) -> double
          */
         void set_sov_power_function(PyObject *pyfunc);
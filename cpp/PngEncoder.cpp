@@ -0,0 +1,638 @@
+#include "PngEncoder.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+
+namespace png {
+    namespace {
+        constexpr unsigned int BYTES_PER_PIXEL = 4;
+
+        constexpr int WINDOW_SIZE = 32768;
+        constexpr int WINDOW_MASK = WINDOW_SIZE - 1;
+        constexpr int HASH_BITS = 15;
+        constexpr int MIN_MATCH = 4;
+        constexpr int MAX_MATCH = 258;
+        /// Number of symbols collected before a deflate block is emitted
+        constexpr size_t BLOCK_SYMBOLS = 1 << 16;
+
+        constexpr int LITLEN_CODES = 286;
+        constexpr int DIST_CODES = 30;
+        constexpr int CODELEN_CODES = 19;
+
+        constexpr uint16_t LENGTH_BASE[29] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195,
+            227, 258
+        };
+        constexpr uint8_t LENGTH_EXTRA[29] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+        };
+        constexpr uint16_t DIST_BASE[30] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+            4097, 6145, 8193, 12289, 16385, 24577
+        };
+        constexpr uint8_t DIST_EXTRA[30] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+        };
+        constexpr uint8_t CODELEN_ORDER[CODELEN_CODES] = {
+            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+        };
+
+        /// Max hash chain length per compression level
+        constexpr int MAX_CHAIN[10] = {0, 2, 4, 8, 16, 32, 64, 128, 512, 2048};
+
+        struct Tables {
+            std::array<uint32_t, 256> crc{};
+            std::array<uint8_t, MAX_MATCH + 1> length_code{};
+            std::array<uint8_t, WINDOW_SIZE + 1> dist_code{};
+
+            Tables() {
+                for (uint32_t n = 0; n < 256; ++n) {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; ++k) {
+                        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    crc[n] = c;
+                }
+                for (int code = 0; code < 29; ++code) {
+                    const int end = code == 28 ? MAX_MATCH + 1 : LENGTH_BASE[code + 1];
+                    for (int len = LENGTH_BASE[code]; len < end; ++len) {
+                        length_code[len] = static_cast<uint8_t>(code);
+                    }
+                }
+                for (int code = 0; code < 30; ++code) {
+                    const int end = code == 29 ? WINDOW_SIZE + 1 : DIST_BASE[code + 1];
+                    for (int dist = DIST_BASE[code]; dist < end; ++dist) {
+                        dist_code[dist] = static_cast<uint8_t>(code);
+                    }
+                }
+            }
+        };
+
+        const Tables &tables() {
+            static const Tables instance;
+            return instance;
+        }
+
+        class BitWriter {
+            std::vector<uint8_t> &out;
+            uint64_t buffer = 0;
+            int count = 0;
+
+        public:
+            explicit BitWriter(std::vector<uint8_t> &out) : out(out) {
+            }
+
+            /// Writes the lowest n bits (n <= 32) of value, LSB first
+            void put(const uint32_t value, const int n) {
+                buffer |= static_cast<uint64_t>(value) << count;
+                count += n;
+                while (count >= 8) {
+                    out.push_back(static_cast<uint8_t>(buffer));
+                    buffer >>= 8;
+                    count -= 8;
+                }
+            }
+
+            /// Appends raw bytes, the writer must be aligned
+            void write_bytes(const uint8_t *data, const size_t len) {
+                out.insert(out.end(), data, data + len);
+            }
+
+            void align() {
+                if (count > 0) {
+                    out.push_back(static_cast<uint8_t>(buffer));
+                }
+                buffer = 0;
+                count = 0;
+            }
+        };
+
+        struct Symbol {
+            /// Literal byte or match length
+            uint16_t value;
+            /// 0 for literals, otherwise the match distance
+            uint16_t dist;
+        };
+
+        struct HuffmanCode {
+            std::vector<uint8_t> lengths;
+            std::vector<uint16_t> codes;
+        };
+
+        /// Builds length limited huffman code lengths. If the tree gets too deep, the frequencies are flattened and the
+        /// tree is rebuilt. Always assigns at least two codes, as some decoders reject single-code trees.
+        void build_lengths(std::vector<uint32_t> freq, const int max_len, std::vector<uint8_t> &lengths) {
+            const int n = static_cast<int>(freq.size());
+            lengths.assign(n, 0);
+            int used = 0;
+            for (const auto f: freq) if (f > 0) ++used;
+            for (int i = 0; used < 2 && i < n; ++i) {
+                if (freq[i] == 0) {
+                    freq[i] = 1;
+                    ++used;
+                }
+            }
+
+            struct Node {
+                uint32_t freq;
+                int left;
+                int right;
+            };
+            std::vector<Node> nodes;
+            std::vector<int> depth;
+            while (true) {
+                nodes.clear();
+                using Entry = std::pair<uint32_t, int>;
+                std::priority_queue<Entry, std::vector<Entry>, std::greater<> > queue;
+                for (int i = 0; i < n; ++i) {
+                    if (freq[i] == 0) continue;
+                    nodes.push_back({freq[i], -1 - i, -1 - i});
+                    queue.emplace(freq[i], static_cast<int>(nodes.size()) - 1);
+                }
+                while (queue.size() > 1) {
+                    const auto [fa, a] = queue.top();
+                    queue.pop();
+                    const auto [fb, b] = queue.top();
+                    queue.pop();
+                    nodes.push_back({fa + fb, a, b});
+                    queue.emplace(fa + fb, static_cast<int>(nodes.size()) - 1);
+                }
+                // Nodes are created children first, so walking backwards from the root assigns the depths top-down
+                depth.assign(nodes.size(), 0);
+                int max_depth = 0;
+                for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; --i) {
+                    const auto &node = nodes[i];
+                    if (node.left < 0) {
+                        lengths[-1 - node.left] = static_cast<uint8_t>(depth[i]);
+                        max_depth = std::max(max_depth, depth[i]);
+                    } else {
+                        depth[node.left] = depth[i] + 1;
+                        depth[node.right] = depth[i] + 1;
+                    }
+                }
+                if (max_depth <= max_len) return;
+                for (auto &f: freq) {
+                    if (f > 0) f = (f >> 1) | 1;
+                }
+            }
+        }
+
+        /// Assigns canonical codes to the lengths, the codes are bit-reversed as deflate writes them LSB first
+        HuffmanCode build_code(const std::vector<uint32_t> &freq, const int max_len) {
+            HuffmanCode code;
+            build_lengths(freq, max_len, code.lengths);
+            code.codes.assign(code.lengths.size(), 0);
+            std::array<uint16_t, 16> bl_count{};
+            for (const auto len: code.lengths) bl_count[len]++;
+            bl_count[0] = 0;
+            std::array<uint16_t, 16> next_code{};
+            uint16_t c = 0;
+            for (int bits = 1; bits < 16; ++bits) {
+                c = static_cast<uint16_t>((c + bl_count[bits - 1]) << 1);
+                next_code[bits] = c;
+            }
+            for (size_t i = 0; i < code.lengths.size(); ++i) {
+                const int len = code.lengths[i];
+                if (len == 0) continue;
+                uint16_t value = next_code[len]++;
+                uint16_t reversed = 0;
+                for (int b = 0; b < len; ++b) {
+                    reversed = static_cast<uint16_t>((reversed << 1) | (value & 1));
+                    value >>= 1;
+                }
+                code.codes[i] = reversed;
+            }
+            return code;
+        }
+
+        void write_dynamic_block(BitWriter &writer, const std::vector<Symbol> &symbols, const bool final) {
+            const auto &t = tables();
+            std::vector<uint32_t> litlen_freq(LITLEN_CODES, 0);
+            std::vector<uint32_t> dist_freq(DIST_CODES, 0);
+            for (const auto &sym: symbols) {
+                if (sym.dist == 0) {
+                    litlen_freq[sym.value]++;
+                } else {
+                    litlen_freq[257 + t.length_code[sym.value]]++;
+                    dist_freq[t.dist_code[sym.dist]]++;
+                }
+            }
+            litlen_freq[256] = 1;
+            const auto litlen = build_code(litlen_freq, 15);
+            const auto dist = build_code(dist_freq, 15);
+
+            int hlit = LITLEN_CODES;
+            while (hlit > 257 && litlen.lengths[hlit - 1] == 0) --hlit;
+            int hdist = DIST_CODES;
+            while (hdist > 1 && dist.lengths[hdist - 1] == 0) --hdist;
+
+            // Run-length encode the code lengths of both trees
+            std::vector<uint8_t> all_lengths;
+            all_lengths.reserve(hlit + hdist);
+            all_lengths.insert(all_lengths.end(), litlen.lengths.begin(), litlen.lengths.begin() + hlit);
+            all_lengths.insert(all_lengths.end(), dist.lengths.begin(), dist.lengths.begin() + hdist);
+            std::vector<std::pair<uint8_t, uint8_t> > rle; // (symbol, extra bits value)
+            for (size_t i = 0; i < all_lengths.size();) {
+                const uint8_t len = all_lengths[i];
+                size_t run = 1;
+                while (i + run < all_lengths.size() && all_lengths[i + run] == len) ++run;
+                size_t left = run;
+                if (len == 0) {
+                    while (left >= 11) {
+                        const auto n = static_cast<uint8_t>(std::min<size_t>(left, 138));
+                        rle.emplace_back(18, n - 11);
+                        left -= n;
+                    }
+                    if (left >= 3) {
+                        rle.emplace_back(17, static_cast<uint8_t>(left - 3));
+                        left = 0;
+                    }
+                } else {
+                    rle.emplace_back(len, 0);
+                    --left;
+                    while (left >= 3) {
+                        const auto n = static_cast<uint8_t>(std::min<size_t>(left, 6));
+                        rle.emplace_back(16, n - 3);
+                        left -= n;
+                    }
+                }
+                for (; left > 0; --left) rle.emplace_back(len, 0);
+                i += run;
+            }
+            std::vector<uint32_t> codelen_freq(CODELEN_CODES, 0);
+            for (const auto &[sym, _]: rle) codelen_freq[sym]++;
+            const auto codelen = build_code(codelen_freq, 7);
+            int hclen = CODELEN_CODES;
+            while (hclen > 4 && codelen.lengths[CODELEN_ORDER[hclen - 1]] == 0) --hclen;
+
+            writer.put(final ? 1 : 0, 1);
+            writer.put(2, 2);
+            writer.put(hlit - 257, 5);
+            writer.put(hdist - 1, 5);
+            writer.put(hclen - 4, 4);
+            for (int i = 0; i < hclen; ++i) {
+                writer.put(codelen.lengths[CODELEN_ORDER[i]], 3);
+            }
+            for (const auto &[sym, extra]: rle) {
+                writer.put(codelen.codes[sym], codelen.lengths[sym]);
+                if (sym == 16) writer.put(extra, 2);
+                else if (sym == 17) writer.put(extra, 3);
+                else if (sym == 18) writer.put(extra, 7);
+            }
+
+            for (const auto &sym: symbols) {
+                if (sym.dist == 0) {
+                    writer.put(litlen.codes[sym.value], litlen.lengths[sym.value]);
+                } else {
+                    const int lc = t.length_code[sym.value];
+                    writer.put(litlen.codes[257 + lc], litlen.lengths[257 + lc]);
+                    if (LENGTH_EXTRA[lc]) writer.put(sym.value - LENGTH_BASE[lc], LENGTH_EXTRA[lc]);
+                    const int dc = t.dist_code[sym.dist];
+                    writer.put(dist.codes[dc], dist.lengths[dc]);
+                    if (DIST_EXTRA[dc]) writer.put(sym.dist - DIST_BASE[dc], DIST_EXTRA[dc]);
+                }
+            }
+            writer.put(litlen.codes[256], litlen.lengths[256]);
+        }
+
+        void write_stored(BitWriter &writer, const uint8_t *data, size_t len, const bool final) {
+            do {
+                const auto n = static_cast<uint16_t>(std::min<size_t>(len, 0xFFFF));
+                len -= n;
+                writer.put(final && len == 0 ? 1 : 0, 1);
+                writer.put(0, 2);
+                writer.align();
+                writer.put(n, 16);
+                writer.put(static_cast<uint16_t>(~n), 16);
+                writer.write_bytes(data, n);
+                data += n;
+            } while (len > 0);
+        }
+
+        /// Deflates the data as a sequence of raw deflate blocks. If final is false, the stream is terminated by a
+        /// sync flush so another stream can be appended.
+        void deflate(const uint8_t *data, const size_t size, const int level, const bool final,
+                     std::vector<uint8_t> &out) {
+            BitWriter writer(out);
+            if (level <= LEVEL_STORE) {
+                write_stored(writer, data, size, final);
+                writer.align();
+                return;
+            }
+            const int max_chain = MAX_CHAIN[std::min(level, LEVEL_BEST)];
+            const bool insert_all = level >= 4;
+            const int nice_len = level <= 3 ? 32 : MAX_MATCH;
+
+            std::vector<int32_t> head(1 << HASH_BITS, -1);
+            std::vector<int32_t> prev(WINDOW_SIZE, -1);
+            const auto hash = [data](const size_t pos) {
+                uint32_t v;
+                std::memcpy(&v, data + pos, 4);
+                return (v * 2654435761u) >> (32 - HASH_BITS);
+            };
+            const auto insert = [&](const size_t pos) {
+                const auto h = hash(pos);
+                prev[pos & WINDOW_MASK] = head[h];
+                head[h] = static_cast<int32_t>(pos);
+            };
+
+            std::vector<Symbol> symbols;
+            symbols.reserve(BLOCK_SYMBOLS);
+            size_t i = 0;
+            while (i < size) {
+                int best_len = 0;
+                int best_dist = 0;
+                if (i + MIN_MATCH <= size) {
+                    const int limit = static_cast<int>(std::min<size_t>(MAX_MATCH, size - i));
+                    int32_t candidate = head[hash(i)];
+                    int chain = max_chain;
+                    while (candidate >= 0 && i - candidate <= WINDOW_SIZE && chain-- > 0) {
+                        const uint8_t *a = data + candidate;
+                        const uint8_t *b = data + i;
+                        if (a[best_len] == b[best_len]) {
+                            int len = 0;
+                            while (len < limit && a[len] == b[len]) ++len;
+                            if (len > best_len) {
+                                best_len = len;
+                                best_dist = static_cast<int>(i - candidate);
+                                if (len >= nice_len || len == limit) break;
+                            }
+                        }
+                        const int32_t next = prev[candidate & WINDOW_MASK];
+                        if (next >= candidate) break;
+                        candidate = next;
+                    }
+                    insert(i);
+                }
+                if (best_len >= MIN_MATCH) {
+                    symbols.push_back({static_cast<uint16_t>(best_len), static_cast<uint16_t>(best_dist)});
+                    if (insert_all) {
+                        const size_t end = std::min(i + best_len, size - MIN_MATCH + 1);
+                        for (size_t j = i + 1; j < end; ++j) insert(j);
+                    }
+                    i += best_len;
+                } else {
+                    symbols.push_back({data[i], 0});
+                    ++i;
+                }
+                if (symbols.size() >= BLOCK_SYMBOLS && i < size) {
+                    write_dynamic_block(writer, symbols, false);
+                    symbols.clear();
+                }
+            }
+            write_dynamic_block(writer, symbols, final);
+            if (!final) {
+                // Sync flush: an empty stored block aligns the stream to a byte boundary
+                writer.put(0, 1);
+                writer.put(0, 2);
+                writer.align();
+                writer.put(0x0000, 16);
+                writer.put(0xFFFF, 16);
+            }
+            writer.align();
+        }
+
+        uint8_t paeth(const int a, const int b, const int c) {
+            const int p = a + b - c;
+            const int pa = std::abs(p - a);
+            const int pb = std::abs(p - b);
+            const int pc = std::abs(p - c);
+            if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+            if (pb <= pc) return static_cast<uint8_t>(b);
+            return static_cast<uint8_t>(c);
+        }
+
+        /// Applies the given PNG filter to a row, out must have room for the filter type byte and the row
+        void filter_row(const int type, const uint8_t *row, const uint8_t *prior, const size_t stride, uint8_t *out) {
+            out[0] = static_cast<uint8_t>(type);
+            ++out;
+            for (size_t i = 0; i < stride; ++i) {
+                const int a = i >= BYTES_PER_PIXEL ? row[i - BYTES_PER_PIXEL] : 0;
+                const int b = prior ? prior[i] : 0;
+                const int c = prior && i >= BYTES_PER_PIXEL ? prior[i - BYTES_PER_PIXEL] : 0;
+                switch (type) {
+                    case 0: out[i] = row[i];
+                        break;
+                    case 1: out[i] = static_cast<uint8_t>(row[i] - a);
+                        break;
+                    case 2: out[i] = static_cast<uint8_t>(row[i] - b);
+                        break;
+                    case 3: out[i] = static_cast<uint8_t>(row[i] - ((a + b) >> 1));
+                        break;
+                    default: out[i] = static_cast<uint8_t>(row[i] - paeth(a, b, c));
+                        break;
+                }
+            }
+        }
+
+        /// Filters the rows [y_start, y_end), picking the filter per row depending on the level
+        std::vector<uint8_t> filter_rows(const uint8_t *rgba, const unsigned int width, const unsigned int y_start,
+                                         const unsigned int y_end, const int level) {
+            const size_t stride = static_cast<size_t>(width) * BYTES_PER_PIXEL;
+            std::vector<uint8_t> filtered((stride + 1) * (y_end - y_start));
+            std::vector<uint8_t> candidate(stride + 1);
+            for (unsigned int y = y_start; y < y_end; ++y) {
+                const uint8_t *row = rgba + y * stride;
+                const uint8_t *prior = y > 0 ? row - stride : nullptr;
+                uint8_t *out = filtered.data() + (y - y_start) * (stride + 1);
+                if (level <= LEVEL_STORE) {
+                    filter_row(0, row, prior, stride, out);
+                } else if (level == LEVEL_FASTEST) {
+                    filter_row(2, row, prior, stride, out);
+                } else {
+                    // Minimum sum of absolute differences heuristic (as recommended by the PNG specification)
+                    uint64_t best_sum = UINT64_MAX;
+                    for (int type = 0; type < 5; ++type) {
+                        filter_row(type, row, prior, stride, candidate.data());
+                        uint64_t sum = 0;
+                        for (size_t i = 1; i <= stride; ++i) {
+                            sum += candidate[i] < 128 ? candidate[i] : 256 - candidate[i];
+                        }
+                        if (sum < best_sum) {
+                            best_sum = sum;
+                            std::copy(candidate.begin(), candidate.end(), out);
+                        }
+                    }
+                }
+            }
+            return filtered;
+        }
+
+        void put_u32(std::vector<uint8_t> &out, const uint32_t value) {
+            out.push_back(static_cast<uint8_t>(value >> 24));
+            out.push_back(static_cast<uint8_t>(value >> 16));
+            out.push_back(static_cast<uint8_t>(value >> 8));
+            out.push_back(static_cast<uint8_t>(value));
+        }
+
+        /// Wraps data into a PNG chunk (length, type, data, crc)
+        std::vector<uint8_t> make_chunk(const char *type, const std::vector<uint8_t> &data) {
+            std::vector<uint8_t> chunk;
+            chunk.reserve(data.size() + 12);
+            put_u32(chunk, static_cast<uint32_t>(data.size()));
+            chunk.insert(chunk.end(), type, type + 4);
+            chunk.insert(chunk.end(), data.begin(), data.end());
+            put_u32(chunk, crc32(0, chunk.data() + 4, data.size() + 4));
+            return chunk;
+        }
+
+        struct Strip {
+            std::vector<uint8_t> chunk;
+            uint32_t adler = 1;
+            size_t raw_size = 0;
+        };
+
+        /// Encodes the image into a list of PNG chunks, the strips are compressed in parallel
+        std::vector<std::vector<uint8_t> > encode_chunks(const uint8_t *rgba, const unsigned int width,
+                                                         const unsigned int height, int level,
+                                                         unsigned int thread_count) {
+            if (rgba == nullptr) throw std::runtime_error("Image has not been allocated");
+            if (width == 0 || height == 0) throw std::runtime_error("Invalid image size");
+            level = std::clamp(level, LEVEL_STORE, LEVEL_BEST);
+            if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+            tables();
+
+            // More strips than threads, so uneven strips (e.g. empty space vs. detailed areas) are balanced
+            const unsigned int rows_per_strip = std::max(16u, (height + thread_count * 4 - 1) / (thread_count * 4));
+            const unsigned int strip_count = (height + rows_per_strip - 1) / rows_per_strip;
+            thread_count = std::min(thread_count, strip_count);
+
+            std::vector<Strip> strips(strip_count);
+            std::atomic<unsigned int> next_strip{0};
+            std::vector<std::exception_ptr> errors(thread_count);
+            const auto worker = [&](const unsigned int thread_index) {
+                try {
+                    for (unsigned int s = next_strip++; s < strip_count; s = next_strip++) {
+                        const unsigned int y_start = s * rows_per_strip;
+                        const unsigned int y_end = std::min(height, y_start + rows_per_strip);
+                        const auto filtered = filter_rows(rgba, width, y_start, y_end, level);
+                        std::vector<uint8_t> data;
+                        data.reserve(filtered.size() / (level == LEVEL_STORE ? 1 : 4) + 64);
+                        if (s == 0) {
+                            // zlib header, deflate with 32K window and the level hint
+                            data.push_back(0x78);
+                            data.push_back(level <= 1 ? 0x01 : level <= 5 ? 0x5E : level <= 7 ? 0x9C : 0xDA);
+                        }
+                        deflate(filtered.data(), filtered.size(), level, s == strip_count - 1, data);
+                        strips[s].chunk = make_chunk("IDAT", data);
+                        strips[s].adler = adler32(1, filtered.data(), filtered.size());
+                        strips[s].raw_size = filtered.size();
+                    }
+                } catch (...) {
+                    errors[thread_index] = std::current_exception();
+                    next_strip = strip_count;
+                }
+            };
+            std::vector<std::thread> threads;
+            for (unsigned int i = 1; i < thread_count; ++i) {
+                threads.emplace_back(worker, i);
+            }
+            worker(0);
+            for (auto &thread: threads) {
+                thread.join();
+            }
+            for (const auto &error: errors) {
+                if (error) std::rethrow_exception(error);
+            }
+
+            std::vector<std::vector<uint8_t> > chunks;
+            chunks.reserve(strip_count + 3);
+            chunks.push_back({0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'});
+            std::vector<uint8_t> ihdr;
+            put_u32(ihdr, width);
+            put_u32(ihdr, height);
+            ihdr.insert(ihdr.end(), {8, 6, 0, 0, 0}); // 8 bit depth, RGBA, deflate, adaptive filter, no interlace
+            chunks.push_back(make_chunk("IHDR", ihdr));
+            uint32_t adler = 1;
+            for (auto &strip: strips) {
+                adler = adler32_combine(adler, strip.adler, strip.raw_size);
+                chunks.push_back(std::move(strip.chunk));
+            }
+            // The checksum is only known after all strips are done, so it gets its own IDAT chunk
+            std::vector<uint8_t> trailer;
+            put_u32(trailer, adler);
+            chunks.push_back(make_chunk("IDAT", trailer));
+            chunks.push_back(make_chunk("IEND", {}));
+            return chunks;
+        }
+    }
+
+    uint32_t crc32(uint32_t crc, const uint8_t *data, const size_t len) {
+        const auto &table = tables().crc;
+        crc = ~crc;
+        for (size_t i = 0; i < len; ++i) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    uint32_t adler32(const uint32_t adler, const uint8_t *data, size_t len) {
+        constexpr uint32_t BASE = 65521;
+        // Largest n such that 255n(n+1)/2 + (n+1)(BASE-1) fits into 32 bits
+        constexpr size_t NMAX = 5552;
+        uint32_t a = adler & 0xFFFF;
+        uint32_t b = adler >> 16;
+        while (len > 0) {
+            const size_t n = std::min(len, NMAX);
+            len -= n;
+            for (size_t i = 0; i < n; ++i) {
+                a += data[i];
+                b += a;
+            }
+            data += n;
+            a %= BASE;
+            b %= BASE;
+        }
+        return b << 16 | a;
+    }
+
+    uint32_t adler32_combine(const uint32_t adler1, const uint32_t adler2, const size_t len2) {
+        constexpr uint64_t BASE = 65521;
+        const uint64_t rem = len2 % BASE;
+        uint64_t sum1 = adler1 & 0xFFFF;
+        uint64_t sum2 = rem * sum1 % BASE;
+        sum1 += (adler2 & 0xFFFF) + BASE - 1;
+        sum2 += (adler1 >> 16 & 0xFFFF) + (adler2 >> 16 & 0xFFFF) + BASE - rem;
+        if (sum1 >= BASE) sum1 -= BASE;
+        if (sum1 >= BASE) sum1 -= BASE;
+        if (sum2 >= BASE << 1) sum2 -= BASE << 1;
+        if (sum2 >= BASE) sum2 -= BASE;
+        return static_cast<uint32_t>(sum1 | sum2 << 16);
+    }
+
+    std::vector<uint8_t> encode(const uint8_t *rgba, const unsigned int width, const unsigned int height,
+                                const int level, const unsigned int thread_count) {
+        const auto chunks = encode_chunks(rgba, width, height, level, thread_count);
+        size_t size = 0;
+        for (const auto &chunk: chunks) size += chunk.size();
+        std::vector<uint8_t> result;
+        result.reserve(size);
+        for (const auto &chunk: chunks) {
+            result.insert(result.end(), chunk.begin(), chunk.end());
+        }
+        return result;
+    }
+
+    void write(const std::string &filename, const uint8_t *rgba, const unsigned int width, const unsigned int height,
+               const int level, const unsigned int thread_count) {
+        const auto chunks = encode_chunks(rgba, width, height, level, thread_count);
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Unable to open file");
+        }
+        for (const auto &chunk: chunks) {
+            file.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+        }
+        if (!file) {
+            throw std::runtime_error("Unable to write image");
+        }
+    }
+}
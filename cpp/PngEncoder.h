@@ -0,0 +1,46 @@
+#ifndef PNGENCODER_H
+#define PNGENCODER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A small, self-contained PNG encoder for 8-bit RGBA images.
+ *
+ * The image is split into horizontal strips which are filtered and deflated independently on multiple threads. Every
+ * strip is written as its own IDAT chunk, the strips are joined with sync flushes (empty stored blocks), so the result
+ * is a single valid zlib stream. Only the adler32 checksums have to be combined sequentially.
+ */
+namespace png {
+    /// Fastest level, the data is only filtered and stored without compression
+    constexpr int LEVEL_STORE = 0;
+    constexpr int LEVEL_FASTEST = 1;
+    constexpr int LEVEL_DEFAULT = 4;
+    constexpr int LEVEL_BEST = 9;
+
+    uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+    uint32_t adler32(uint32_t adler, const uint8_t *data, size_t len);
+
+    /// Combines the adler32 checksums of two consecutive data blocks, len2 is the length of the second block
+    uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2);
+
+    /**
+     * Encodes an RGBA image (row-major, 4 bytes per pixel, no padding) into a PNG file in memory.
+     *
+     * @param rgba the pixel data
+     * @param width the width of the image
+     * @param height the height of the image
+     * @param level the compression level (0-9), higher levels are slower but produce smaller files
+     * @param thread_count the number of threads to use, 0 for std::thread::hardware_concurrency()
+     * @return the encoded PNG file
+     */
+    [[nodiscard]] std::vector<uint8_t> encode(const uint8_t *rgba, unsigned int width, unsigned int height,
+                                              int level = LEVEL_DEFAULT, unsigned int thread_count = 0);
+
+    /// Encodes the image and writes it to the given file, see encode()
+    void write(const std::string &filename, const uint8_t *rgba, unsigned int width, unsigned int height,
+               int level = LEVEL_DEFAULT, unsigned int thread_count = 0);
+}
+
+#endif //PNGENCODER_H
@@ -1,5 +1,8 @@
 #include "PyWrapper.h"
 
+#include <cstring>
+#include <string>
+
 namespace py {
     GILGuard::GILGuard() {
         gstate = PyGILState_Ensure();
@@ -26,6 +29,8 @@ namespace py {
     }
 
     Object::~Object() {
+        // Empty objects may be destroyed after the interpreter has finalized, e.g. by a cached static map
+        if (py_obj == nullptr) return;
         PyGILState_STATE gstate = PyGILState_Ensure();
         Py_XDECREF(py_obj);
         PyGILState_Release(gstate);
@@ -166,4 +171,88 @@ namespace py {
     void err::raise_type_error(const std::string &msg, bool set_cause) {
         raise_type_error(msg.c_str(), set_cause);
     }
+
+    namespace {
+        /// Checks if the ctypes type matches the spec, type_obj may be None or nullptr
+        bool matches_ctype(PyObject *ctypes, PyObject *type_obj, const CTypeSpec &spec) {
+            if (type_obj == nullptr || type_obj == Py_None) return false;
+            const RefGuard code = PyObject_GetAttrString(type_obj, "_type_");
+            if (!code || !PyUnicode_Check(code)) {
+                PyErr_Clear();
+                return false;
+            }
+            const char *code_str = PyUnicode_AsUTF8(code);
+            if (code_str == nullptr || std::strlen(code_str) != 1 || std::strchr(spec.codes, code_str[0]) == nullptr) {
+                PyErr_Clear();
+                return false;
+            }
+            const RefGuard size = PyObject_CallMethod(ctypes, "sizeof", "O", type_obj);
+            if (!size) {
+                PyErr_Clear();
+                return false;
+            }
+            return PyLong_AsSize_t(size) == spec.size;
+        }
+    }
+
+    bool native_function_address(PyObject *obj, const CTypeSpec &restype, const std::vector<CTypeSpec> &argtypes,
+                                 void *&address) {
+        GILGuard gil;
+        address = nullptr;
+        const RefGuard ctypes = PyImport_ImportModule("ctypes");
+        if (!ctypes) {
+            PyErr_Clear();
+            return false;
+        }
+        const RefGuard func_ptr_type = PyObject_GetAttrString(ctypes, "_CFuncPtr");
+        if (!func_ptr_type) {
+            PyErr_Clear();
+            return false;
+        }
+        // numba cfuncs (and similar wrappers) expose a ctypes function pointer as their ctypes attribute
+        RefGuard function;
+        if (PyObject_IsInstance(obj, func_ptr_type) == 1) {
+            Py_INCREF(obj);
+            function = obj;
+        } else if (PyObject_HasAttrString(obj, "ctypes")) {
+            function = PyObject_GetAttrString(obj, "ctypes");
+            if (!function || PyObject_IsInstance(function, func_ptr_type) != 1) {
+                PyErr_Clear();
+                return false;
+            }
+        } else {
+            PyErr_Clear();
+            return false;
+        }
+
+        const RefGuard res = PyObject_GetAttrString(function, "restype");
+        const RefGuard args = PyObject_GetAttrString(function, "argtypes");
+        bool valid = matches_ctype(ctypes, res, restype) && args && PyTuple_Check(args.get()) &&
+                     PyTuple_Size(args) == static_cast<Py_ssize_t>(argtypes.size());
+        for (size_t i = 0; valid && i < argtypes.size(); ++i) {
+            valid = matches_ctype(ctypes, PyTuple_GetItem(args, static_cast<Py_ssize_t>(i)), argtypes[i]);
+        }
+        PyErr_Clear();
+        if (!valid) {
+            err::raise_type_error("Native function signature mismatch, restype and argtypes must be set to the "
+                                  "ctypes types matching the expected signature");
+            return true;
+        }
+        const RefGuard void_p = PyObject_GetAttrString(ctypes, "c_void_p");
+        const RefGuard pointer = void_p
+                                     ? PyObject_CallMethod(ctypes, "cast", "OO", function.get(), void_p.get())
+                                     : nullptr;
+        const RefGuard value = pointer ? PyObject_GetAttrString(pointer, "value") : nullptr;
+        if (!value || value.get() == Py_None) {
+            PyErr_Clear();
+            err::raise_type_error("Unable to get the address of the native function");
+            return true;
+        }
+        address = PyLong_AsVoidPtr(value);
+        if (address == nullptr) {
+            PyErr_Clear();
+            err::raise_type_error("Unable to get the address of the native function");
+        }
+        return true;
+    }
 }
@@ -2,8 +2,13 @@
 #define PYWRAPPER_H
 
 #include <Python.h>
+#include <cstdint>
 #include <stdexcept>
 #include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include "Stats.h"
 
 
 namespace py {
@@ -104,6 +109,56 @@ namespace py {
         void raise_type_error(const std::string& msg, bool set_cause = false);
     }
 
+    /// Describes a C type by the type codes of the matching ctypes types (their _type_ attribute) and its size
+    struct CTypeSpec {
+        const char *codes;
+        size_t size;
+    };
+
+    template<typename T>
+    inline constexpr bool dependent_false = false;
+
+    template<typename T>
+    constexpr CTypeSpec ctype_spec() {
+        if constexpr (std::is_same_v<T, double>) {
+            return {"d", sizeof(double)};
+        } else if constexpr (std::is_same_v<T, bool>) {
+            return {"?", sizeof(bool)};
+        } else if constexpr (std::is_same_v<T, int>) {
+            return {"il", sizeof(int)};
+        } else if constexpr (std::is_same_v<T, uint32_t>) {
+            return {"IL", sizeof(uint32_t)};
+        } else if constexpr (std::is_same_v<T, unsigned long long>) {
+            return {"QLP", sizeof(unsigned long long)};
+        } else {
+            static_assert(dependent_false<T>, "Unsupported native type");
+            return {"", 0};
+        }
+    }
+
+    /**
+     * Checks if the object is a native function: a ctypes function pointer (a CFUNCTYPE object or a function of a
+     * CDLL) or an object holding one as its ctypes attribute (e.g. a numba cfunc). The GIL must be held.
+     *
+     * @param obj the object to check
+     * @param restype the expected return type
+     * @param argtypes the expected argument types
+     * @param address set to the function pointer, nullptr (with a TypeError raised) if the signature does not match
+     * @return false if the object is not a native function
+     */
+    bool native_function_address(PyObject *obj, const CTypeSpec &restype, const std::vector<CTypeSpec> &argtypes,
+                                 void *&address);
+
+    /// Typed version of native_function_address(), see there
+    template<typename ReturnType, typename... Args>
+    bool native_function(PyObject *obj, ReturnType (*&function)(Args...)) {
+        void *address = nullptr;
+        const bool is_native = native_function_address(obj, ctype_spec<ReturnType>(), {ctype_spec<Args>()...},
+                                                       address);
+        function = reinterpret_cast<ReturnType (*)(Args...)>(address);
+        return is_native;
+    }
+
     template<typename ReturnType, typename... Args>
     class Callable : public Object {
         using Object::Object;
@@ -139,14 +194,36 @@ namespace py {
         struct always_false : std::false_type {
         };
 
+#if defined(EVE_MAPPER_STATS) && EVE_MAPPER_STATS
+        std::atomic<unsigned long long> *call_counter = nullptr;
+        std::atomic<unsigned long long> *gil_wait_counter = nullptr;
+#endif
+
     public:
+#if defined(EVE_MAPPER_STATS) && EVE_MAPPER_STATS
+        /// Every call increments call_counter and adds the time spent acquiring the GIL to gil_wait_counter
+        void set_stats_counters(std::atomic<unsigned long long> *call_counter,
+                                std::atomic<unsigned long long> *gil_wait_counter) {
+            this->call_counter = call_counter;
+            this->gil_wait_counter = gil_wait_counter;
+        }
+#endif
+
         /**
          * Call the Python function with the given arguments. Will aquire the GIL and release it after the call.
          * @param args
          * @return
          */
         ReturnType operator()(Args... args) {
+#if defined(EVE_MAPPER_STATS) && EVE_MAPPER_STATS
+            const auto wait_start = bluemap::StatsClock::now();
+            PyGILState_STATE gstate = PyGILState_Ensure();
+            if (gil_wait_counter != nullptr)
+                gil_wait_counter->fetch_add(bluemap::elapsed_ns(wait_start), std::memory_order_relaxed);
+            if (call_counter != nullptr) call_counter->fetch_add(1, std::memory_order_relaxed);
+#else
             PyGILState_STATE gstate = PyGILState_Ensure();
+#endif
 
             if (!py_obj || !PyCallable_Check(py_obj)) {
                 PyGILState_Release(gstate);
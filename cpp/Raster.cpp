@@ -0,0 +1,150 @@
+#include "Raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+namespace bluemap {
+    namespace {
+        /**
+         * The offset along the minor axis after step steps of a line, rounded half up like Bresenham's algorithm. At
+         * exactly half a pixel, the algorithm rounds towards the end point, so drawn from the other end it picks the
+         * previous offset: tie is set and the line covers both.
+         */
+        long long minor_offset(const long long step, const long long minor, const long long major, bool &tie) {
+            if (major == 0) {
+                tie = false;
+                return 0;
+            }
+            const long long numerator = 2 * step * minor + major;
+            tie = numerator % (2 * major) == 0 && step > 0 && step < major;
+            return numerator / (2 * major);
+        }
+    }
+
+    RasterBand::RasterBand(uint8_t *data, const unsigned int width, const unsigned int height,
+                           const unsigned int start_y, const unsigned int end_y)
+        : data(data), width(width), height(height), start_y(start_y), end_y(std::min(end_y, height)) {
+    }
+
+    bool RasterBand::intersects(const long long y0, const long long y1) const {
+        return std::max(y0, y1) >= start_y && std::min(y0, y1) < end_y;
+    }
+
+    void RasterBand::blend(const long long x, const long long y, const Color &color, const double coverage) const {
+        if (x < 0 || x >= width || y < start_y || y >= end_y) return;
+        const auto alpha = static_cast<unsigned int>(std::lround(color.alpha * std::clamp(coverage, 0.0, 1.0)));
+        if (alpha == 0) return;
+        uint8_t *pixel = data + (x + y * width) * 4;
+        // Non-premultiplied "over", all values are scaled by 255 to stay in integers
+        const unsigned int inverse = pixel[3] * (255 - alpha);
+        const unsigned int total = alpha * 255 + inverse;
+        pixel[0] = static_cast<uint8_t>((color.red * alpha * 255 + pixel[0] * inverse + total / 2) / total);
+        pixel[1] = static_cast<uint8_t>((color.green * alpha * 255 + pixel[1] * inverse + total / 2) / total);
+        pixel[2] = static_cast<uint8_t>((color.blue * alpha * 255 + pixel[2] * inverse + total / 2) / total);
+        pixel[3] = static_cast<uint8_t>((total + 127) / 255);
+    }
+
+    void RasterBand::line(const long long x0, const long long y0, const long long x1, const long long y1,
+                          const Color &color) const {
+        if (!intersects(y0, y1)) return;
+        const long long dx = std::llabs(x1 - x0);
+        const long long dy = std::llabs(y1 - y0);
+        const long long step_x = x0 < x1 ? 1 : -1;
+        const long long step_y = y0 < y1 ? 1 : -1;
+        if (dx < dy) {
+            // Steep: one pixel per row, only the rows of the band are visited
+            const long long first = step_y > 0 ? std::max(0LL, start_y - y0) : std::max(0LL, y0 - (end_y - 1));
+            const long long last = step_y > 0 ? std::min(dy, end_y - 1 - y0) : std::min(dy, y0 - start_y);
+            for (long long k = first; k <= last; ++k) {
+                bool tie;
+                const long long offset = minor_offset(k, dx, dy, tie);
+                blend(x0 + step_x * offset, y0 + step_y * k, color);
+                if (tie) blend(x0 + step_x * (offset - 1), y0 + step_y * k, color);
+            }
+            return;
+        }
+        // Flat: the steps whose row lies in the band, from the inverse of minor_offset()
+        long long first = 0;
+        long long last = dx;
+        if (dy > 0) {
+            const long long first_row = step_y > 0 ? start_y - y0 : y0 - (end_y - 1);
+            const long long last_row = step_y > 0 ? end_y - 1 - y0 : y0 - start_y;
+            // One step of margin for the second pixel of a tie, which lies one row back
+            if (first_row > 0) first = std::max(0LL, (2 * dx * first_row - dx + 2 * dy - 1) / (2 * dy) - 1);
+            if (last_row < dy) last = std::min(dx, (2 * dx * (last_row + 1) - dx - 1) / (2 * dy) + 1);
+        }
+        for (long long k = first; k <= last; ++k) {
+            bool tie;
+            const long long offset = minor_offset(k, dy, dx, tie);
+            blend(x0 + step_x * k, y0 + step_y * offset, color);
+            if (tie) blend(x0 + step_x * k, y0 + step_y * (offset - 1), color);
+        }
+    }
+
+    void RasterBand::line_antialiased(long long x0, long long y0, long long x1, long long y1,
+                                      const Color &color) const {
+        if (!intersects(y0, y1)) return;
+        const bool steep = std::llabs(y1 - y0) > std::llabs(x1 - x0);
+        if (steep) {
+            std::swap(x0, y0);
+            std::swap(x1, y1);
+        }
+        if (x0 > x1) {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+        // Along the major axis the line advances one pixel per step and covers two pixels of the minor axis
+        const auto plot = [&](const long long major, const long long minor, const double coverage) {
+            if (steep) {
+                blend(minor, major, color, coverage);
+            } else {
+                blend(major, minor, color, coverage);
+            }
+        };
+        plot(x0, y0, 1.0);
+        if (x0 == x1) return;
+        plot(x1, y1, 1.0);
+        const double gradient = static_cast<double>(y1 - y0) / static_cast<double>(x1 - x0);
+        // Only the steps that reach the band are visited, one step of margin covers the rounding
+        long long first = x0 + 1;
+        long long last = x1 - 1;
+        if (steep) {
+            first = std::max(first, start_y);
+            last = std::min(last, end_y - 1);
+        } else if (gradient != 0.0) {
+            const double a = static_cast<double>(x0) + static_cast<double>(start_y - 1 - y0) / gradient;
+            const double b = static_cast<double>(x0) + static_cast<double>(end_y - y0) / gradient;
+            first = std::max(first, static_cast<long long>(std::floor(std::min(a, b))) - 1);
+            last = std::min(last, static_cast<long long>(std::ceil(std::max(a, b))) + 1);
+        }
+        for (long long x = first; x <= last; ++x) {
+            const double y = static_cast<double>(y0) + gradient * static_cast<double>(x - x0);
+            const double floor_y = std::floor(y);
+            const double fraction = y - floor_y;
+            plot(x, static_cast<long long>(floor_y), 1.0 - fraction);
+            plot(x, static_cast<long long>(floor_y) + 1, fraction);
+        }
+    }
+
+    void RasterBand::fill_rect(const long long x0, const long long y0, const long long x1, const long long y1,
+                               const Color &color) const {
+        for (long long y = std::max(std::min(y0, y1), start_y); y <= std::min(std::max(y0, y1), end_y - 1); ++y) {
+            for (long long x = std::min(x0, x1); x <= std::max(x0, x1); ++x) {
+                blend(x, y, color);
+            }
+        }
+    }
+
+    void RasterBand::outline_rect(long long x0, long long y0, long long x1, long long y1, const Color &color) const {
+        if (x0 > x1) std::swap(x0, x1);
+        if (y0 > y1) std::swap(y0, y1);
+        fill_rect(x0, y0, x1, y0, color);
+        if (y1 == y0) return;
+        fill_rect(x0, y1, x1, y1, color);
+        if (y1 - y0 < 2) return;
+        fill_rect(x0, y0 + 1, x0, y1 - 1, color);
+        if (x1 != x0) fill_rect(x1, y0 + 1, x1, y1 - 1, color);
+    }
+}
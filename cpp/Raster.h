@@ -0,0 +1,48 @@
+#ifndef RASTER_H
+#define RASTER_H
+#include <cstdint>
+
+#include "Image.h"
+
+namespace bluemap {
+    /**
+     * Draws into the rows start_y to end_y (exclusive) of a row-major RGBA buffer, everything outside is clipped. The
+     * colors are blended "over" the existing pixels with their alpha. Several bands of the same buffer can be drawn by
+     * different threads, the result is the same as drawing the whole buffer with one band.
+     */
+    class RasterBand {
+        uint8_t *data;
+        long long width;
+        long long height;
+        long long start_y;
+        long long end_y;
+
+    public:
+        RasterBand(uint8_t *data, unsigned int width, unsigned int height, unsigned int start_y, unsigned int end_y);
+
+        /// Whether any row between y0 and y1 (inclusive, in any order) lies inside the band
+        [[nodiscard]] bool intersects(long long y0, long long y1) const;
+
+        /// Blends the color into the pixel, its alpha is scaled by the coverage (0 to 1)
+        void blend(long long x, long long y, const Color &color, double coverage = 1.0) const;
+
+        /**
+         * A one pixel wide line including both end points. It covers the pixels of Bresenham's algorithm drawn in both
+         * directions (like PIL drawing a jump listed in both directions), so it does not depend on the order of the end
+         * points. Only the rows of the band are visited.
+         */
+        void line(long long x0, long long y0, long long x1, long long y1, const Color &color) const;
+
+        /// An anti-aliased line between the pixel centers (Xiaolin Wu), the end points are drawn with full coverage.
+        /// Only the steps that reach the band are visited
+        void line_antialiased(long long x0, long long y0, long long x1, long long y1, const Color &color) const;
+
+        /// Fills the rectangle including the edges x1 and y1
+        void fill_rect(long long x0, long long y0, long long x1, long long y1, const Color &color) const;
+
+        /// The one pixel wide outline of the rectangle including the edges x1 and y1, every pixel is drawn once
+        void outline_rect(long long x0, long long y0, long long x1, long long y1, const Color &color) const;
+    };
+}
+
+#endif //RASTER_H
@@ -0,0 +1,188 @@
+#ifndef STATS_H
+#define STATS_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Optional instrumentation of the rendering pipeline. It is only compiled in if EVE_MAPPER_STATS is defined, otherwise
+ * all STATS(...) statements vanish and TimedMutex is the plain mutex, so a normal build has no overhead at all.
+ */
+#if defined(EVE_MAPPER_STATS) && EVE_MAPPER_STATS
+#define STATS(x) x
+#else
+#define STATS(x)
+#endif
+
+namespace bluemap {
+    /**
+     * A snapshot of the statistics collected since the last Map::reset_stats(). All values stay zero (and enabled is
+     * false) if the library was compiled without EVE_MAPPER_STATS.
+     */
+    struct RenderStats {
+        bool enabled = false;
+        /// The accumulated wall time per phase (load_data, calculate_influence, render, composite, ...)
+        std::map<std::string, double> phase_ms = {};
+        /// The busy time of every ColumnWorker::render() call, excluding the time waiting for the map lock
+        std::vector<double> worker_busy_ms = {};
+        unsigned long long pixels = 0;
+        /// The number of solar systems within range of a pixel, summed over all pixels
+        unsigned long long systems_visited = 0;
+        /// The number of owner influences added up for the pixels
+        unsigned long long owner_contributions = 0;
+        unsigned long long callback_calls = 0;
+        double gil_wait_ms = 0.0;
+        double image_mutex_wait_ms = 0.0;
+        double map_mutex_wait_ms = 0.0;
+    };
+
+#if defined(EVE_MAPPER_STATS) && EVE_MAPPER_STATS
+    using StatsClock = std::chrono::steady_clock;
+
+    inline unsigned long long elapsed_ns(const StatsClock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(StatsClock::now() - start).count();
+    }
+
+    /// A mutex which adds the time spent waiting for it to wait_ns
+    template<typename Mutex>
+    class TimedMutex {
+        Mutex mutex;
+
+    public:
+        std::atomic<unsigned long long> wait_ns = 0;
+
+        void lock() {
+            if (mutex.try_lock()) return;
+            const auto start = StatsClock::now();
+            mutex.lock();
+            wait_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+        }
+
+        bool try_lock() {
+            return mutex.try_lock();
+        }
+
+        void unlock() {
+            mutex.unlock();
+        }
+
+        void lock_shared() {
+            if (mutex.try_lock_shared()) return;
+            const auto start = StatsClock::now();
+            mutex.lock_shared();
+            wait_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+        }
+
+        bool try_lock_shared() {
+            return mutex.try_lock_shared();
+        }
+
+        void unlock_shared() {
+            mutex.unlock_shared();
+        }
+    };
+
+    class StatsCollector {
+        mutable std::mutex guard;
+        std::map<std::string, double> phase_ms;
+        std::vector<double> worker_busy_ms;
+        // The span of the current rendering, from the first worker start to the last worker end
+        bool render_active = false;
+        StatsClock::time_point render_start;
+        StatsClock::time_point render_end;
+
+        void finish_render() {
+            if (!render_active) return;
+            phase_ms["render"] += std::chrono::duration<double, std::milli>(render_end - render_start).count();
+            render_active = false;
+        }
+
+    public:
+        std::atomic<unsigned long long> pixels = 0;
+        std::atomic<unsigned long long> systems_visited = 0;
+        std::atomic<unsigned long long> owner_contributions = 0;
+        std::atomic<unsigned long long> callback_calls = 0;
+        std::atomic<unsigned long long> gil_wait_ns = 0;
+
+        void add_phase(const std::string &phase, const double ms) {
+            std::lock_guard lock(guard);
+            phase_ms[phase] += ms;
+        }
+
+        /// Starts a new rendering, the workers recorded afterward count as one render phase
+        void begin_render() {
+            std::lock_guard lock(guard);
+            finish_render();
+        }
+
+        void add_worker(const StatsClock::time_point start, const StatsClock::time_point busy_start) {
+            const auto end = StatsClock::now();
+            std::lock_guard lock(guard);
+            worker_busy_ms.push_back(std::chrono::duration<double, std::milli>(end - busy_start).count());
+            if (!render_active) {
+                render_active = true;
+                render_start = start;
+                render_end = end;
+            } else {
+                render_start = std::min(render_start, start);
+                render_end = std::max(render_end, end);
+            }
+        }
+
+        void reset() {
+            std::lock_guard lock(guard);
+            phase_ms.clear();
+            worker_busy_ms.clear();
+            render_active = false;
+            pixels = 0;
+            systems_visited = 0;
+            owner_contributions = 0;
+            callback_calls = 0;
+            gil_wait_ns = 0;
+        }
+
+        /// The mutex wait times are kept by the mutexes themselves and are filled in by the map
+        [[nodiscard]] RenderStats snapshot() const {
+            std::lock_guard lock(guard);
+            RenderStats stats;
+            stats.enabled = true;
+            stats.phase_ms = phase_ms;
+            if (render_active) {
+                stats.phase_ms["render"] += std::chrono::duration<double, std::milli>(render_end - render_start).
+                        count();
+            }
+            stats.worker_busy_ms = worker_busy_ms;
+            stats.pixels = pixels;
+            stats.systems_visited = systems_visited;
+            stats.owner_contributions = owner_contributions;
+            stats.callback_calls = callback_calls;
+            stats.gil_wait_ms = static_cast<double>(gil_wait_ns) / 1e6;
+            return stats;
+        }
+    };
+
+    /// Adds the lifetime of the object to a phase
+    class PhaseTimer {
+        StatsCollector &stats;
+        const char *phase;
+        StatsClock::time_point start = StatsClock::now();
+
+    public:
+        PhaseTimer(StatsCollector &stats, const char *phase) : stats(stats), phase(phase) {
+        }
+
+        ~PhaseTimer() {
+            stats.add_phase(phase, static_cast<double>(elapsed_ns(start)) / 1e6);
+        }
+    };
+#else
+    template<typename Mutex>
+    using TimedMutex = Mutex;
+#endif
+}
+
+#endif //STATS_H
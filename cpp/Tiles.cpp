@@ -0,0 +1,376 @@
+#include "Tiles.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+namespace bluemap {
+    namespace {
+        /// The range of grid indices of the grid points inside [start, start + size)
+        std::pair<unsigned int, unsigned int> grid_range(const unsigned int start, const unsigned int size,
+                                                         const unsigned int sample_rate) {
+            return {
+                (start + sample_rate - 1) / sample_rate,
+                static_cast<unsigned int>((static_cast<unsigned long long>(start) + size + sample_rate - 1) / sample_rate)
+            };
+        }
+
+        void read_header(std::istream &stream, const char *expected) {
+            char header[8] = {0};
+            stream.read(header, 8);
+            if (!stream || std::string(header, 8) != std::string(expected, 8)) {
+                throw std::runtime_error("Invalid file format: " + std::string(header, 8));
+            }
+        }
+
+        unsigned int read_dimension(std::istream &stream) {
+            const auto value = read_big_endian<int32_t>(stream);
+            if (value < 0) {
+                throw std::runtime_error("Invalid tile dimension");
+            }
+            return value;
+        }
+
+        /// The state used by execute_tile_job(), kept between jobs of the same state
+        struct LoadedState {
+            std::mutex mutex;
+            std::string path;
+            /// The size and modification time of the file when it was loaded, a rewritten state is loaded again
+            uintmax_t file_size = 0;
+            std::filesystem::file_time_type modified;
+            /// The file content, 8-byte aligned as required by Map::attach_shared_state()
+            std::vector<uint64_t> data;
+            std::unique_ptr<Map> map;
+        };
+
+        LoadedState &loaded_state() {
+            static LoadedState state;
+            return state;
+        }
+    }
+
+    void write_tile_job(std::ostream &stream, const TileJob &job) {
+        if (job.state_path.size() > UINT16_MAX) {
+            throw std::runtime_error("The state path is too long");
+        }
+        stream.write("SOVJV1.0", 8);
+        write_big_endian<uint16_t>(stream, job.state_path.size());
+        stream.write(job.state_path.data(), static_cast<std::streamsize>(job.state_path.size()));
+        write_big_endian<int32_t>(stream, job.x);
+        write_big_endian<int32_t>(stream, job.y);
+        write_big_endian<int32_t>(stream, job.width);
+        write_big_endian<int32_t>(stream, job.height);
+        write_big_endian<int32_t>(stream, job.sample_rate);
+        write_big_endian<int32_t>(stream, job.border_alpha);
+        write_big_endian<int32_t>(stream, job.thread_count);
+    }
+
+    TileJob read_tile_job(std::istream &stream) {
+        read_header(stream, "SOVJV1.0");
+        TileJob job;
+        job.state_path.resize(read_big_endian<uint16_t>(stream));
+        stream.read(job.state_path.data(), static_cast<std::streamsize>(job.state_path.size()));
+        job.x = read_dimension(stream);
+        job.y = read_dimension(stream);
+        job.width = read_dimension(stream);
+        job.height = read_dimension(stream);
+        job.sample_rate = read_dimension(stream);
+        job.border_alpha = read_big_endian<int32_t>(stream);
+        job.thread_count = read_dimension(stream);
+        if (!stream) {
+            throw std::runtime_error("Unexpected end of tile job");
+        }
+        return job;
+    }
+
+    void write_tile_result(std::ostream &stream, const TileResult &result) {
+        stream.write("SOVTV1.0", 8);
+        write_big_endian<int32_t>(stream, result.x);
+        write_big_endian<int32_t>(stream, result.y);
+        write_big_endian<int32_t>(stream, result.width);
+        write_big_endian<int32_t>(stream, result.height);
+        write_big_endian<int32_t>(stream, result.sample_rate);
+        stream.write(reinterpret_cast<const char *>(result.rgba.data()), static_cast<std::streamsize>(result.rgba.size()));
+        for (const auto owner: result.owners) {
+            write_big_endian<uint64_t>(stream, owner);
+        }
+        write_big_endian<uint32_t>(stream, result.labels.size());
+        for (const auto &[owner_id, sum_x, sum_y, count, first_x, first_y]: result.labels) {
+            write_big_endian<uint64_t>(stream, owner_id);
+            write_big_endian<uint64_t>(stream, sum_x);
+            write_big_endian<uint64_t>(stream, sum_y);
+            write_big_endian<uint64_t>(stream, count);
+            write_big_endian<uint32_t>(stream, first_x);
+            write_big_endian<uint32_t>(stream, first_y);
+        }
+        for (const auto index: result.label_grid) {
+            write_big_endian<uint32_t>(stream, index);
+        }
+    }
+
+    TileResult read_tile_result(std::istream &stream) {
+        read_header(stream, "SOVTV1.0");
+        TileResult result;
+        result.x = read_dimension(stream);
+        result.y = read_dimension(stream);
+        result.width = read_dimension(stream);
+        result.height = read_dimension(stream);
+        result.sample_rate = read_dimension(stream);
+        if (result.sample_rate == 0 || static_cast<unsigned long long>(result.width) * result.height > INT32_MAX) {
+            throw std::runtime_error("Invalid tile result");
+        }
+        const size_t pixels = static_cast<size_t>(result.width) * result.height;
+        result.rgba.resize(pixels * 4);
+        stream.read(reinterpret_cast<char *>(result.rgba.data()), static_cast<std::streamsize>(result.rgba.size()));
+        result.owners.resize(pixels);
+        for (auto &owner: result.owners) {
+            owner = read_big_endian<uint64_t>(stream);
+        }
+        const auto label_count = read_big_endian<uint32_t>(stream);
+        if (!stream || label_count > pixels) {
+            throw std::runtime_error("Invalid tile result");
+        }
+        result.labels.resize(label_count);
+        for (auto &[owner_id, sum_x, sum_y, count, first_x, first_y]: result.labels) {
+            owner_id = read_big_endian<uint64_t>(stream);
+            sum_x = read_big_endian<uint64_t>(stream);
+            sum_y = read_big_endian<uint64_t>(stream);
+            count = read_big_endian<uint64_t>(stream);
+            first_x = read_big_endian<uint32_t>(stream);
+            first_y = read_big_endian<uint32_t>(stream);
+        }
+        const auto [grid_x0, grid_x1] = grid_range(result.x, result.width, result.sample_rate);
+        const auto [grid_y0, grid_y1] = grid_range(result.y, result.height, result.sample_rate);
+        result.label_grid.resize(static_cast<size_t>(grid_x1 - grid_x0) * (grid_y1 - grid_y0));
+        for (auto &index: result.label_grid) {
+            index = read_big_endian<uint32_t>(stream);
+            if (index != TileResult::NO_LABEL && index >= label_count) {
+                throw std::runtime_error("Invalid tile result");
+            }
+        }
+        if (!stream) {
+            throw std::runtime_error("Unexpected end of tile result");
+        }
+        return result;
+    }
+
+    std::string serialize_tile_job(const TileJob &job) {
+        std::ostringstream stream;
+        write_tile_job(stream, job);
+        return stream.str();
+    }
+
+    TileResult parse_tile_result(const std::string &data) {
+        std::istringstream stream(data);
+        return read_tile_result(stream);
+    }
+
+    std::vector<TileJob> create_tile_jobs(const std::string &state_path, const unsigned int width,
+                                          const unsigned int height, const unsigned int tile_size,
+                                          const unsigned int sample_rate, const int border_alpha) {
+        if (tile_size == 0) {
+            throw std::runtime_error("The tile size must be at least 1");
+        }
+        std::vector<TileJob> jobs;
+        for (unsigned int y = 0; y < height; y += tile_size) {
+            for (unsigned int x = 0; x < width; x += tile_size) {
+                jobs.push_back({
+                    state_path, x, y, std::min(tile_size, width - x), std::min(tile_size, height - y), sample_rate,
+                    border_alpha, 1
+                });
+            }
+        }
+        return jobs;
+    }
+
+    TileResult execute_tile_job(const TileJob &job) {
+        auto &state = loaded_state();
+        std::lock_guard lock(state.mutex);
+        std::error_code error;
+        const auto file_size = std::filesystem::file_size(job.state_path, error);
+        const auto modified = std::filesystem::last_write_time(job.state_path, error);
+        if (error) {
+            throw std::runtime_error("Unable to open file " + job.state_path);
+        }
+        if (state.map == nullptr || state.path != job.state_path || state.file_size != file_size ||
+            state.modified != modified) {
+            state.map = nullptr;
+            state.path.clear();
+            std::ifstream file(job.state_path, std::ios::binary | std::ios::ate);
+            if (!file) {
+                throw std::runtime_error("Unable to open file " + job.state_path);
+            }
+            const auto size = static_cast<size_t>(file.tellg());
+            state.data.assign((size + 7) / 8, 0);
+            file.seekg(0);
+            file.read(reinterpret_cast<char *>(state.data.data()), static_cast<std::streamsize>(size));
+            if (!file) {
+                throw std::runtime_error("Unable to read file " + job.state_path);
+            }
+            const auto *data = reinterpret_cast<const uint8_t *>(state.data.data());
+            const auto [width, height] = Map::get_shared_state_size(data, size);
+            auto map = std::make_unique<Map>();
+            map->update_size(width, height, job.sample_rate);
+            map->attach_shared_state(data, size);
+            state.map = std::move(map);
+            state.path = job.state_path;
+            state.file_size = file_size;
+            state.modified = modified;
+        }
+        state.map->set_border_alpha(job.border_alpha);
+        return state.map->render_tile(job.x, job.y, job.width, job.height, job.sample_rate, job.thread_count);
+    }
+
+    std::string execute_serialized_tile_job(const std::string &job) {
+        std::istringstream job_stream(job);
+        const auto result = execute_tile_job(read_tile_job(job_stream));
+        std::ostringstream result_stream;
+        write_tile_result(result_stream, result);
+        return result_stream.str();
+    }
+
+    void run_tile_worker(std::istream &input, std::ostream &output) {
+        while (input.peek() != std::char_traits<char>::eof()) {
+            std::string message(read_big_endian<uint32_t>(input), '\0');
+            input.read(message.data(), static_cast<std::streamsize>(message.size()));
+            if (!input) {
+                throw std::runtime_error("Unexpected end of tile job");
+            }
+            const std::string data = execute_serialized_tile_job(message);
+            write_big_endian<uint32_t>(output, data.size());
+            output.write(data.data(), static_cast<std::streamsize>(data.size()));
+            output.flush();
+        }
+    }
+
+    TileMerger::TileMerger(const unsigned int width, const unsigned int height,
+                           const unsigned int sample_rate): width(width), height(height), sample_rate(sample_rate) {
+        if (sample_rate == 0) {
+            throw std::runtime_error("The sample rate must be at least 1");
+        }
+        grid_width = grid_range(0, width, sample_rate).second;
+        grid_height = grid_range(0, height, sample_rate).second;
+        rgba.assign(static_cast<size_t>(width) * height * 4, 0);
+        owners.assign(static_cast<size_t>(width) * height, 0);
+        label_grid.assign(static_cast<size_t>(grid_width) * grid_height, TileResult::NO_LABEL);
+    }
+
+    void TileMerger::add(const TileResult &tile) {
+        if (static_cast<unsigned long long>(tile.x) + tile.width > width ||
+            static_cast<unsigned long long>(tile.y) + tile.height > height) {
+            throw std::runtime_error("The tile does not fit into the map");
+        }
+        if (tile.sample_rate != sample_rate) {
+            throw std::runtime_error("The tile has a different sample rate");
+        }
+        for (unsigned int row = 0; row < tile.height; ++row) {
+            const size_t source = static_cast<size_t>(row) * tile.width;
+            const size_t target = tile.x + static_cast<size_t>(tile.y + row) * width;
+            std::copy_n(tile.rgba.begin() + source * 4, tile.width * 4, rgba.begin() + target * 4);
+            std::copy_n(tile.owners.begin() + source, tile.width, owners.begin() + target);
+        }
+        const auto offset = static_cast<uint32_t>(partials.size());
+        partials.insert(partials.end(), tile.labels.begin(), tile.labels.end());
+        const auto [grid_x0, grid_x1] = grid_range(tile.x, tile.width, sample_rate);
+        const auto [grid_y0, grid_y1] = grid_range(tile.y, tile.height, sample_rate);
+        const unsigned int tile_grid_width = grid_x1 - grid_x0;
+        for (unsigned int gy = grid_y0; gy < grid_y1; ++gy) {
+            for (unsigned int gx = grid_x0; gx < grid_x1; ++gx) {
+                const uint32_t index = tile.label_grid[(gx - grid_x0) + static_cast<size_t>(gy - grid_y0) *
+                                                       tile_grid_width];
+                label_grid[gx + static_cast<size_t>(gy) * grid_width] =
+                        index == TileResult::NO_LABEL ? TileResult::NO_LABEL : offset + index;
+            }
+        }
+        covered_pixels += static_cast<size_t>(tile.width) * tile.height;
+    }
+
+    const std::vector<uint8_t> &TileMerger::get_image() const {
+        return rgba;
+    }
+
+    const std::vector<id_t> &TileMerger::get_owners() const {
+        return owners;
+    }
+
+    std::vector<Map::MapOwnerLabel> TileMerger::get_labels() const {
+        // Union the partials of neighboring grid points with the same owner, they were split by a tile edge
+        std::vector<uint32_t> parent(partials.size());
+        for (uint32_t i = 0; i < parent.size(); ++i) parent[i] = i;
+        auto find = [&parent](uint32_t i) {
+            while (parent[i] != i) {
+                parent[i] = parent[parent[i]];
+                i = parent[i];
+            }
+            return i;
+        };
+        auto unite = [&](const uint32_t a, const uint32_t b) {
+            if (a == TileResult::NO_LABEL || b == TileResult::NO_LABEL) return;
+            if (partials[a].owner_id != partials[b].owner_id) return;
+            const uint32_t root_a = find(a);
+            const uint32_t root_b = find(b);
+            if (root_a != root_b) parent[std::max(root_a, root_b)] = std::min(root_a, root_b);
+        };
+        for (unsigned int gy = 0; gy < grid_height; ++gy) {
+            for (unsigned int gx = 0; gx < grid_width; ++gx) {
+                const uint32_t index = label_grid[gx + static_cast<size_t>(gy) * grid_width];
+                if (gx + 1 < grid_width) unite(index, label_grid[gx + 1 + static_cast<size_t>(gy) * grid_width]);
+                if (gy + 1 < grid_height) unite(index, label_grid[gx + static_cast<size_t>(gy + 1) * grid_width]);
+            }
+        }
+
+        std::vector<LabelPartial> merged(partials.size());
+        std::vector<bool> used(partials.size(), false);
+        for (uint32_t i = 0; i < partials.size(); ++i) {
+            const uint32_t root = find(i);
+            auto &label = merged[root];
+            const auto &partial = partials[i];
+            if (!used[root]) {
+                label = partial;
+                used[root] = true;
+                continue;
+            }
+            label.sum_x += partial.sum_x;
+            label.sum_y += partial.sum_y;
+            label.count += partial.count;
+            if (std::tie(partial.first_y, partial.first_x) < std::tie(label.first_y, label.first_x)) {
+                label.first_x = partial.first_x;
+                label.first_y = partial.first_y;
+            }
+        }
+        std::vector<LabelPartial> roots;
+        for (uint32_t i = 0; i < partials.size(); ++i) {
+            if (used[i]) roots.push_back(merged[i]);
+        }
+        // Map::calculate_labels() finds the areas in row-major order
+        std::sort(roots.begin(), roots.end(), [](const LabelPartial &a, const LabelPartial &b) {
+            return std::tie(a.first_y, a.first_x) < std::tie(b.first_y, b.first_x);
+        });
+        std::vector<Map::MapOwnerLabel> labels;
+        labels.reserve(roots.size());
+        for (const auto &root: roots) {
+            auto label = Map::MapOwnerLabel{root.owner_id};
+            label.count = root.count;
+            label.x = root.sum_x / root.count + sample_rate / 2;
+            label.y = root.sum_y / root.count + sample_rate / 2;
+            labels.push_back(label);
+        }
+        return labels;
+    }
+
+    size_t TileMerger::get_covered_pixels() const {
+        return covered_pixels;
+    }
+
+    unsigned int TileMerger::get_width() const {
+        return width;
+    }
+
+    unsigned int TileMerger::get_height() const {
+        return height;
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef TILES_H
+#define TILES_H
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Map.h"
+
+/*
+ * Rendering of large maps split into tiles, which can be executed by other processes or machines. A job references a
+ * shared state file (Map::export_shared_state(), SovMap.save_shared on the python side), so every worker only loads
+ * the state once and renders any number of tiles from it. The results are assembled by a TileMerger.
+ *
+ * Jobs and results have a binary format (big endian like the other files), a worker reads jobs from a stream and
+ * writes the results back, see run_tile_worker().
+ */
+namespace bluemap {
+    struct TileJob {
+        /// The path of the shared state file
+        std::string state_path;
+        unsigned int x = 0;
+        unsigned int y = 0;
+        unsigned int width = 0;
+        unsigned int height = 0;
+        /// The distance between the label grid points
+        unsigned int sample_rate = 8;
+        int border_alpha = 0x48;
+        unsigned int thread_count = 1;
+    };
+
+    /// A connected area of one owner on the label grid inside a tile, see Map::calculate_labels()
+    struct LabelPartial {
+        id_t owner_id = 0;
+        unsigned long long sum_x = 0;
+        unsigned long long sum_y = 0;
+        unsigned long long count = 0;
+        /// The first grid point of the area in row-major order, the labels are ordered by it
+        unsigned int first_x = 0;
+        unsigned int first_y = 0;
+    };
+
+    struct TileResult {
+        static constexpr uint32_t NO_LABEL = UINT32_MAX;
+
+        unsigned int x = 0;
+        unsigned int y = 0;
+        unsigned int width = 0;
+        unsigned int height = 0;
+        unsigned int sample_rate = 8;
+        /// width * height RGBA pixels
+        std::vector<uint8_t> rgba;
+        /// width * height owner ids, 0 means no owner
+        std::vector<id_t> owners;
+        std::vector<LabelPartial> labels;
+        /// The index of the label partial of every grid point inside the tile in row-major order, or NO_LABEL
+        std::vector<uint32_t> label_grid;
+    };
+
+    void write_tile_job(std::ostream &stream, const TileJob &job);
+
+    /// @throws std::runtime_error if the stream does not contain a valid job
+    TileJob read_tile_job(std::istream &stream);
+
+    void write_tile_result(std::ostream &stream, const TileResult &result);
+
+    /// @throws std::runtime_error if the stream does not contain a valid result
+    TileResult read_tile_result(std::istream &stream);
+
+    std::string serialize_tile_job(const TileJob &job);
+
+    /// @throws std::runtime_error if the data is not a valid result
+    TileResult parse_tile_result(const std::string &data);
+
+    /// Splits the map into tiles of at most tile_size x tile_size pixels, in row-major order
+    std::vector<TileJob> create_tile_jobs(const std::string &state_path, unsigned int width, unsigned int height,
+                                          unsigned int tile_size, unsigned int sample_rate = 8, int border_alpha = 0x48);
+
+    /**
+     * Renders the tile. The shared state is kept loaded, consecutive jobs of the same state don't load it again unless
+     * the file was rewritten (its size or modification time changed). The kernel and precision are taken from the
+     * state, owners without a color get the default color of the map.
+     */
+    TileResult execute_tile_job(const TileJob &job);
+
+    /// execute_tile_job() for a serialized job, returns the serialized result
+    std::string execute_serialized_tile_job(const std::string &job);
+
+    /**
+     * Executes jobs read from the input until it ends and writes one result per job. Every job and result is prefixed
+     * with its size as big endian uint32, so the worker can be used over pipes (evemapper --tile-worker).
+     */
+    void run_tile_worker(std::istream &input, std::ostream &output);
+
+    /// Assembles tile results into the full image, owner image and labels
+    class TileMerger {
+        unsigned int width;
+        unsigned int height;
+        unsigned int sample_rate;
+        unsigned int grid_width;
+        unsigned int grid_height;
+        std::vector<uint8_t> rgba;
+        std::vector<id_t> owners;
+        std::vector<LabelPartial> partials;
+        /// The global index of the partial of every grid point
+        std::vector<uint32_t> label_grid;
+        size_t covered_pixels = 0;
+
+    public:
+        TileMerger(unsigned int width, unsigned int height, unsigned int sample_rate = 8);
+
+        /// @throws std::runtime_error if the tile does not fit into the map or has a different sample rate
+        void add(const TileResult &tile);
+
+        /// width * height RGBA pixels
+        [[nodiscard]] const std::vector<uint8_t> &get_image() const;
+
+        /// width * height owner ids
+        [[nodiscard]] const std::vector<id_t> &get_owners() const;
+
+        /// The same labels as Map::calculate_labels(), in the same order
+        [[nodiscard]] std::vector<Map::MapOwnerLabel> get_labels() const;
+
+        /// The number of pixels added, overlapping tiles are counted twice
+        [[nodiscard]] size_t get_covered_pixels() const;
+
+        [[nodiscard]] unsigned int get_width() const;
+
+        [[nodiscard]] unsigned int get_height() const;
+    };
+}
+
+#endif //TILES_H
@@ -0,0 +1,144 @@
+#include "Topology.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace bluemap {
+    namespace {
+        std::vector<Topology::System> to_systems(const std::vector<SolarSystemData> &systems) {
+            std::vector<Topology::System> result;
+            result.reserve(systems.size());
+            for (const auto &system: systems) {
+                result.push_back({system.id, system.constellation_id, system.region_id, system.x, system.y});
+            }
+            return result;
+        }
+    }
+
+    Topology::Topology(const unsigned int width, const unsigned int height): width(width), height(height) {
+    }
+
+    Topology::Topology(const unsigned int width, const unsigned int height, std::vector<System> systems,
+                       const std::vector<JumpData> &jumps): width(width), height(height),
+                                                            system_storage(std::move(systems)) {
+        std::stable_sort(system_storage.begin(), system_storage.end(),
+                         [](const System &a, const System &b) { return a.id < b.id; });
+        for (size_t i = 1; i < system_storage.size(); ++i) {
+            if (system_storage[i - 1].id == system_storage[i].id) {
+                throw std::runtime_error("Duplicate solar system " + std::to_string(system_storage[i].id));
+            }
+        }
+        if (system_storage.size() >= UINT32_MAX) {
+            throw std::runtime_error("Too many solar systems for a topology");
+        }
+        this->systems = system_storage.data();
+        system_count = system_storage.size();
+        // Counting sort of the jumps by their source, this keeps the order of the jumps per system
+        std::vector<size_t> counts(system_count + 1, 0);
+        for (const auto &[sys_from, sys_to]: jumps) {
+            const size_t from = find(sys_from);
+            if (from == size() || find(sys_to) == size()) continue;
+            ++counts[from + 1];
+        }
+        for (size_t i = 0; i < system_count; ++i) {
+            counts[i + 1] += counts[i];
+        }
+        if (counts.back() >= UINT32_MAX) {
+            throw std::runtime_error("Too many jumps for a topology");
+        }
+        offset_storage.assign(counts.begin(), counts.end());
+        neighbor_storage.resize(counts.back());
+        for (const auto &[sys_from, sys_to]: jumps) {
+            const size_t from = find(sys_from);
+            const size_t to = find(sys_to);
+            if (from == size() || to == size()) continue;
+            neighbor_storage[counts[from]++] = static_cast<uint32_t>(to);
+        }
+        neighbor_offsets = offset_storage.data();
+        neighbors = neighbor_storage.data();
+    }
+
+    Topology::Topology(const unsigned int width, const unsigned int height,
+                       const std::vector<SolarSystemData> &systems,
+                       const std::vector<JumpData> &jumps): Topology(width, height, to_systems(systems), jumps) {
+    }
+
+    std::shared_ptr<const Topology> Topology::view(const unsigned int width, const unsigned int height,
+                                                   const System *systems, const size_t system_count,
+                                                   const uint32_t *neighbor_offsets, const uint32_t *neighbors) {
+        for (size_t i = 1; i < system_count; ++i) {
+            if (systems[i - 1].id >= systems[i].id) {
+                throw std::runtime_error("The solar systems of a topology must be sorted by id");
+            }
+        }
+        if (neighbor_offsets[0] != 0) {
+            throw std::runtime_error("Invalid topology adjacency");
+        }
+        for (size_t i = 0; i < system_count; ++i) {
+            if (neighbor_offsets[i] > neighbor_offsets[i + 1]) {
+                throw std::runtime_error("Invalid topology adjacency");
+            }
+        }
+        for (size_t i = 0; i < neighbor_offsets[system_count]; ++i) {
+            if (neighbors[i] >= system_count) {
+                throw std::runtime_error("Invalid topology adjacency");
+            }
+        }
+        // The constructor is private, so make_shared can't be used
+        const auto topology = std::shared_ptr<Topology>(new Topology(width, height));
+        topology->systems = systems;
+        topology->system_count = system_count;
+        topology->neighbor_offsets = neighbor_offsets;
+        topology->neighbors = neighbors;
+        return topology;
+    }
+
+    unsigned int Topology::get_width() const {
+        return width;
+    }
+
+    unsigned int Topology::get_height() const {
+        return height;
+    }
+
+    size_t Topology::size() const {
+        return system_count;
+    }
+
+    const Topology::System &Topology::get_system(const size_t i) const {
+        return systems[i];
+    }
+
+    size_t Topology::find(const id_t id) const {
+        const System *end = systems + system_count;
+        const System *it = std::lower_bound(systems, end, id, [](const System &system, const id_t value) {
+            return system.id < value;
+        });
+        return it != end && it->id == id ? it - systems : system_count;
+    }
+
+    const uint32_t *Topology::neighbors_begin(const size_t i) const {
+        return neighbors + neighbor_offsets[i];
+    }
+
+    const uint32_t *Topology::neighbors_end(const size_t i) const {
+        return neighbors + neighbor_offsets[i + 1];
+    }
+
+    size_t Topology::jump_count() const {
+        return neighbor_offsets[system_count];
+    }
+
+    const Topology::System *Topology::get_systems() const {
+        return systems;
+    }
+
+    const uint32_t *Topology::get_neighbor_offsets() const {
+        return neighbor_offsets;
+    }
+
+    const uint32_t *Topology::get_neighbors() const {
+        return neighbors;
+    }
+}
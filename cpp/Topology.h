@@ -0,0 +1,105 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Map.h"
+
+namespace bluemap {
+    /**
+     * The static part of a map: the solar systems with their coordinates and the jump graph. A topology is immutable
+     * after construction, so it can be shared by several maps (e.g. one per day of a history or per what-if scenario),
+     * which then only hold the ownership, sov power and influence of the systems. See Map::set_topology().
+     *
+     * The coordinates are pixel coordinates, all maps using a topology must have the size of the topology.
+     *
+     * The systems and the adjacency are plain arrays, so a topology can also be a view of external memory like a shared
+     * memory segment, see view().
+     */
+    class Topology {
+    public:
+        struct System {
+            id_t id = 0;
+            id_t constellation_id = 0;
+            id_t region_id = 0;
+            unsigned int x = 0;
+            unsigned int y = 0;
+        };
+
+    private:
+        unsigned int width;
+        unsigned int height;
+        /// The owned arrays, empty if the topology is a view
+        std::vector<System> system_storage;
+        std::vector<uint32_t> offset_storage;
+        std::vector<uint32_t> neighbor_storage;
+        /// Sorted by id
+        const System *systems = nullptr;
+        size_t system_count = 0;
+        /// The neighbors of system i are neighbors[neighbor_offsets[i]] to neighbors[neighbor_offsets[i + 1]]
+        const uint32_t *neighbor_offsets = nullptr;
+        const uint32_t *neighbors = nullptr;
+
+        Topology(unsigned int width, unsigned int height);
+
+    public:
+        /**
+         * Jumps to unknown systems are ignored. The neighbors of a system keep the order of the jumps.
+         *
+         * @param width the width of the maps using this topology
+         * @param height the height
+         * @param systems the solar systems, the ids must be unique
+         * @param jumps the jumps, every direction has to be listed
+         */
+        Topology(unsigned int width, unsigned int height, std::vector<System> systems,
+                 const std::vector<JumpData> &jumps);
+
+        /// Uses the static fields of the solar systems (id, constellation, region and coordinates)
+        Topology(unsigned int width, unsigned int height, const std::vector<SolarSystemData> &systems,
+                 const std::vector<JumpData> &jumps);
+
+        Topology(const Topology &) = delete;
+
+        Topology &operator=(const Topology &) = delete;
+
+        /**
+         * Creates a topology that uses the given arrays without copying them, they must stay valid as long as the
+         * topology is used. The arrays have the layout of the arrays returned by get_systems(), get_neighbor_offsets()
+         * and get_neighbors().
+         *
+         * @throws std::runtime_error if the systems are not sorted by id or the adjacency is invalid
+         */
+        static std::shared_ptr<const Topology> view(unsigned int width, unsigned int height, const System *systems,
+                                                    size_t system_count, const uint32_t *neighbor_offsets,
+                                                    const uint32_t *neighbors);
+
+        [[nodiscard]] unsigned int get_width() const;
+
+        [[nodiscard]] unsigned int get_height() const;
+
+        [[nodiscard]] size_t size() const;
+
+        [[nodiscard]] const System &get_system(size_t i) const;
+
+        /// Returns the index of the system or size() if the id is unknown
+        [[nodiscard]] size_t find(id_t id) const;
+
+        [[nodiscard]] const uint32_t *neighbors_begin(size_t i) const;
+
+        [[nodiscard]] const uint32_t *neighbors_end(size_t i) const;
+
+        [[nodiscard]] size_t jump_count() const;
+
+        /// All size() systems, sorted by id
+        [[nodiscard]] const System *get_systems() const;
+
+        /// size() + 1 offsets into get_neighbors()
+        [[nodiscard]] const uint32_t *get_neighbor_offsets() const;
+
+        /// jump_count() system indices
+        [[nodiscard]] const uint32_t *get_neighbors() const;
+    };
+}
+
+#endif //TOPOLOGY_H
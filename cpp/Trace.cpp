@@ -0,0 +1,138 @@
+#include "Trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <tuple>
+
+namespace bluemap {
+    namespace {
+        /// Generations are unique over all tracers, so a cached buffer of a destroyed tracer is never reused
+        std::atomic<unsigned long long> next_generation = 1;
+    }
+
+    Tracer::ThreadBuffer *Tracer::thread_buffer() {
+        // The last buffers used by this thread, searched linearly as there are only a few maps per thread
+        thread_local std::vector<std::tuple<const Tracer *, unsigned long long, std::shared_ptr<ThreadBuffer> > > cache;
+        const unsigned long long current = session();
+        for (auto it = cache.begin(); it != cache.end(); ++it) {
+            auto &[tracer, gen, buffer] = *it;
+            if (tracer != this) continue;
+            if (gen == current) return buffer.get();
+            // The buffer of a previous recording, it is released once no thread writes into it anymore
+            cache.erase(it);
+            break;
+        }
+        auto buffer = std::make_shared<ThreadBuffer>();
+        buffer->thread = std::this_thread::get_id();
+        buffer->events.reserve(1024);
+        {
+            std::lock_guard lock(registry_mutex);
+            // start() was called in between, the buffer would not be part of the new recording
+            if (generation.load(std::memory_order_relaxed) == current) {
+                buffers.push_back(buffer);
+            }
+        }
+        if (cache.size() >= 8) cache.erase(cache.begin());
+        cache.emplace_back(this, current, buffer);
+        return buffer.get();
+    }
+
+    void Tracer::start() {
+        std::lock_guard lock(registry_mutex);
+        enabled = false;
+        // Threads still recording into the old buffers keep them alive, their spans are not written
+        buffers.clear();
+        origin_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        generation.store(next_generation.fetch_add(1), std::memory_order_release);
+        enabled = true;
+    }
+
+    void Tracer::stop() {
+        enabled = false;
+    }
+
+    long long Tracer::now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count() -
+               origin_ns.load(std::memory_order_relaxed);
+    }
+
+    void Tracer::record(const char *name, const char *category, const long long start_ns, const long long arg_start,
+                        const long long arg_end) {
+        if (!is_enabled()) return;
+        thread_buffer()->events.push_back({name, category, start_ns, now() - start_ns, arg_start, arg_end});
+    }
+
+    size_t Tracer::event_count() {
+        std::lock_guard lock(registry_mutex);
+        size_t count = 0;
+        for (const auto &buffer: buffers) {
+            count += buffer->events.size();
+        }
+        return count;
+    }
+
+    void Tracer::write(const std::string &filename) {
+        std::lock_guard lock(registry_mutex);
+        std::ofstream file(filename);
+        if (!file) {
+            throw std::runtime_error("Unable to open file");
+        }
+        // A thread might have several buffers if it was used by other tracers in between, they share one track
+        std::vector<std::thread::id> threads;
+        auto thread_index = [&threads](const std::thread::id thread) {
+            for (size_t i = 0; i < threads.size(); ++i) {
+                if (threads[i] == thread) return i;
+            }
+            threads.push_back(thread);
+            return threads.size() - 1;
+        };
+
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        for (const auto &buffer: buffers) {
+            const size_t tid = thread_index(buffer->thread);
+            for (const auto &[name, category, start_ns, duration_ns, arg_start, arg_end]: buffer->events) {
+                file << (first ? "" : ",\n")
+                        << "{\"name\": \"" << name << "\", \"cat\": \"" << category
+                        << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+                        << ", \"ts\": " << static_cast<double>(start_ns) / 1000.0
+                        << ", \"dur\": " << static_cast<double>(duration_ns) / 1000.0;
+                if (arg_start >= 0) {
+                    file << ", \"args\": {\"start\": " << arg_start << ", \"end\": " << arg_end << "}";
+                }
+                file << "}";
+                first = false;
+            }
+        }
+        for (size_t tid = 0; tid < threads.size(); ++tid) {
+            file << (first ? "" : ",\n")
+                    << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+                    << ", \"args\": {\"name\": \"thread " << tid << "\"}}";
+            first = false;
+        }
+        file << "\n]}\n";
+        if (!file) {
+            throw std::runtime_error("Unable to write file");
+        }
+    }
+
+    TraceSpan::TraceSpan(Tracer &tracer, const char *name, const char *category, const long long arg_start,
+                         const long long arg_end): name(name), category(category), arg_start(arg_start),
+                                                   arg_end(arg_end) {
+        if (tracer.is_enabled()) {
+            this->tracer = &tracer;
+            session = tracer.session();
+            start_ns = tracer.now();
+        }
+    }
+
+    TraceSpan::~TraceSpan() {
+        if (tracer != nullptr && tracer->session() == session) {
+            tracer->record(name, category, start_ns, arg_start, arg_end);
+        }
+    }
+}
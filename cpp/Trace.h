@@ -0,0 +1,106 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bluemap {
+    /**
+     * Records spans (name, start, duration) of the rendering pipeline and writes them as Chrome trace-event JSON, which
+     * can be opened with chrome://tracing or https://ui.perfetto.dev.
+     *
+     * Every thread writes into its own buffer, so recording a span does not take any lock. The buffer of a thread is
+     * registered once per start(). The buffers must not be read while spans are recorded, write() has to be called
+     * after all traced work has finished (the Map ensures this with its map lock). start() may be called while spans
+     * are still recorded: the buffers of the previous recording are kept alive by the threads that use them, and spans
+     * that started before are dropped.
+     *
+     * While the tracer is stopped, recording a span costs a single relaxed atomic load.
+     */
+    class Tracer {
+    public:
+        struct Event {
+            const char *name;
+            const char *category;
+            long long start_ns;
+            long long duration_ns;
+            /// Optional arguments (e.g. the row range of a band), -1 if unused
+            long long arg_start;
+            long long arg_end;
+        };
+
+    private:
+        struct ThreadBuffer {
+            std::thread::id thread;
+            std::vector<Event> events;
+        };
+
+        std::atomic<bool> enabled = false;
+        /// Identifies the current recording, the thread local buffer caches are invalidated by changing it
+        std::atomic<unsigned long long> generation = 0;
+        /// The steady clock time of the last start() in nanoseconds
+        std::atomic<long long> origin_ns = 0;
+        std::mutex registry_mutex;
+        /// Shared with the thread local caches, so a thread still writing into a buffer of the previous recording
+        /// keeps it alive
+        std::vector<std::shared_ptr<ThreadBuffer> > buffers;
+
+        ThreadBuffer *thread_buffer();
+
+    public:
+        /// Discards all recorded spans and starts recording
+        void start();
+
+        /// Stops recording, the recorded spans are kept until the next start()
+        void stop();
+
+        [[nodiscard]] bool is_enabled() const {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        /// The current time in nanoseconds since the last start()
+        [[nodiscard]] long long now() const;
+
+        /// Identifies the current recording, changed by every start()
+        [[nodiscard]] unsigned long long session() const {
+            return generation.load(std::memory_order_acquire);
+        }
+
+        /// Records a span from start_ns until now on the buffer of the calling thread, does nothing if stopped
+        void record(const char *name, const char *category, long long start_ns, long long arg_start = -1,
+                    long long arg_end = -1);
+
+        [[nodiscard]] size_t event_count();
+
+        /// Writes the recorded spans as Chrome trace-event JSON
+        void write(const std::string &filename);
+    };
+
+    /// Records the lifetime of the object as a span, if the tracer is running
+    class TraceSpan {
+        Tracer *tracer = nullptr;
+        const char *name;
+        const char *category;
+        /// The recording the span started in, it is dropped if the tracer was restarted in between
+        unsigned long long session = 0;
+        long long start_ns = 0;
+        long long arg_start;
+        long long arg_end;
+
+    public:
+        TraceSpan(Tracer &tracer, const char *name, const char *category, long long arg_start = -1,
+                  long long arg_end = -1);
+
+        ~TraceSpan();
+
+        TraceSpan(const TraceSpan &) = delete;
+
+        TraceSpan &operator=(const TraceSpan &) = delete;
+    };
+}
+
+#endif //TRACE_H
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Generator.h>
+#include <Map.h>
+
+/**
+ * Benchmarks every phase of the rendering pipeline separately on synthetic data (see Generator.h). Every repetition runs the whole
+ * pipeline on a fresh map, the results are printed as a table and written as JSON (see --help).
+ */
+namespace {
+    using bluemap::Map;
+    using bluemap::id_t;
+
+    struct Config {
+        std::vector<unsigned int> systems = {100, 400};
+        unsigned int owners = 50;
+        double degree = 2.5;
+        double station_density = 0.2;
+        unsigned int width = 256;
+        unsigned int height = 256;
+        unsigned int sample_rate = 8;
+        unsigned int threads = 0;
+        unsigned int repeat = 3;
+        int png_level = 4;
+        unsigned int seed = 42;
+        std::string output = "benchmark.json";
+        /// Writes the generated universe in the dump.dat format, the system count is appended to the name
+        std::string dump;
+        /// Writes a Chrome trace of the last repetition, the system count is appended to the name
+        std::string trace;
+    };
+
+    struct Result {
+        std::string phase;
+        unsigned int systems = 0;
+        std::vector<double> times_ms;
+    };
+
+    template<typename F>
+    double measure(F &&f) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    void render(Map &map, const unsigned int thread_count) {
+        const unsigned int width = map.get_width();
+        std::vector<std::unique_ptr<Map::ColumnWorker> > workers;
+        for (unsigned int i = 0; i < thread_count; ++i) {
+            workers.emplace_back(map.create_worker(i * width / thread_count, (i + 1) * width / thread_count));
+        }
+        std::vector<std::thread> threads;
+        for (auto &worker: workers) {
+            threads.emplace_back(&Map::ColumnWorker::render, worker.get());
+        }
+        for (auto &thread: threads) {
+            thread.join();
+        }
+    }
+
+    void run(const Config &config, const unsigned int system_count, std::vector<Result> &results) {
+        bluemap::UniverseConfig universe_config;
+        universe_config.seed = config.seed;
+        universe_config.system_count = system_count;
+        universe_config.jump_degree = config.degree;
+        universe_config.owner_count = config.owners;
+        universe_config.station_density = config.station_density;
+        universe_config.width = config.width;
+        universe_config.height = config.height;
+        const bluemap::Universe data = generate_universe(universe_config);
+        const auto tmp = std::filesystem::temp_directory_path();
+        const std::string dump_file = (tmp / "bluemap_bench_dump.dat").string();
+        bluemap::write_universe(data, dump_file);
+        if (!config.dump.empty()) {
+            bluemap::write_universe(data, config.dump + "." + std::to_string(system_count));
+        }
+        const std::string owner_file = (tmp / "bluemap_bench_owners.bin").string();
+        const std::string png_file = (tmp / "bluemap_bench.png").string();
+        const std::string qoi_file = (tmp / "bluemap_bench.qoi").string();
+        const std::string raw_file = (tmp / "bluemap_bench.raw").string();
+        const unsigned int thread_count = config.threads == 0
+                                              ? std::max(1u, std::thread::hardware_concurrency())
+                                              : config.threads;
+
+        std::vector<std::pair<std::string, std::vector<double> > > times;
+        auto record = [&](const std::string &phase, const double ms) {
+            for (auto &[name, values]: times) {
+                if (name == phase) {
+                    values.push_back(ms);
+                    return;
+                }
+            }
+            times.push_back({phase, {ms}});
+        };
+
+        for (unsigned int r = 0; r < config.repeat; ++r) {
+            // Every loader gets a fresh map, so neither is timed on top of the data of the other
+            {
+                const auto file_map = std::make_unique<Map>();
+                file_map->update_size(config.width, config.height, config.sample_rate);
+                record("load_data_file", measure([&] { file_map->load_data(dump_file); }));
+            }
+            const auto map = std::make_unique<Map>();
+            map->update_size(config.width, config.height, config.sample_rate);
+            const bool trace = !config.trace.empty() && r + 1 == config.repeat;
+            if (trace) map->start_trace();
+            record("load_data", measure([&] { map->load_data(data.owners, data.solar_systems, data.jumps); }));
+            record("calculate_influence", measure([&] { map->calculate_influence(); }));
+            record("render_1_thread", measure([&] { render(*map, 1); }));
+            map->set_single_precision(true);
+            record("render_1_thread_single_precision", measure([&] { render(*map, 1); }));
+            map->set_single_precision(false);
+            if (thread_count > 1) {
+                record("render_" + std::to_string(thread_count) + "_threads",
+                       measure([&] { render(*map, thread_count); }));
+            }
+
+            Image cache(config.width, 16);
+            record("paste_cache", measure([&] {
+                for (unsigned int y = 0; y < config.height; y += 16) {
+                    map->paste_cache(0, y, cache, static_cast<int>(std::min(16u, config.height - y)));
+                }
+            }));
+            // paste_cache overwrote the image, render it again for the writers
+            render(*map, thread_count);
+
+            record("calculate_labels", measure([&] { (void) map->calculate_labels(); }));
+            record("save_owner_image", measure([&] { map->save_owner_image(owner_file); }));
+            record("load_old_owners", measure([&] { map->load_old_owners(owner_file); }));
+            record("write_png", measure([&] {
+                map->save(png_file, ImageFormat::PNG, config.png_level, thread_count);
+            }));
+            record("write_qoi", measure([&] { map->save(qoi_file, ImageFormat::QOI); }));
+            record("write_raw", measure([&] { map->save(raw_file, ImageFormat::RAW); }));
+            if (trace) {
+                map->stop_trace();
+                map->save_trace(config.trace + "." + std::to_string(system_count) + ".json");
+            }
+        }
+        for (const auto &file: {dump_file, owner_file, png_file, qoi_file, raw_file}) {
+            std::filesystem::remove(file);
+        }
+        for (auto &[phase, values]: times) {
+            results.push_back({phase, system_count, values});
+        }
+    }
+
+    double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        const size_t n = values.size();
+        return n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+    }
+
+    void write_json(const Config &config, const std::vector<Result> &results) {
+        std::ofstream file(config.output);
+        if (!file) {
+            throw std::runtime_error("Unable to open file " + config.output);
+        }
+        file << "{\n  \"config\": {"
+                << "\"owners\": " << config.owners
+                << ", \"degree\": " << config.degree
+                << ", \"station_density\": " << config.station_density
+                << ", \"width\": " << config.width
+                << ", \"height\": " << config.height
+                << ", \"sample_rate\": " << config.sample_rate
+                << ", \"threads\": " << config.threads
+                << ", \"hardware_concurrency\": " << std::thread::hardware_concurrency()
+                << ", \"repeat\": " << config.repeat
+                << ", \"png_level\": " << config.png_level
+                << ", \"seed\": " << config.seed
+#ifdef NDEBUG
+                << ", \"optimized\": true"
+#else
+                << ", \"optimized\": false"
+#endif
+                << "},\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto &[phase, systems, values] = results[i];
+            file << "    {\"phase\": \"" << phase << "\", \"systems\": " << systems
+                    << ", \"min_ms\": " << *std::min_element(values.begin(), values.end())
+                    << ", \"median_ms\": " << median(values)
+                    << ", \"max_ms\": " << *std::max_element(values.begin(), values.end())
+                    << ", \"times_ms\": [";
+            for (size_t j = 0; j < values.size(); ++j) {
+                file << (j > 0 ? ", " : "") << values[j];
+            }
+            file << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        file << "  ]\n}\n";
+    }
+
+    std::vector<unsigned int> parse_list(const std::string &value) {
+        std::vector<unsigned int> list;
+        std::stringstream stream(value);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            list.push_back(std::stoul(item));
+        }
+        return list;
+    }
+
+    void print_usage() {
+        std::cout << "Usage: evemapper_benchmark [options]\n"
+                "  --systems N[,N...]    system counts to benchmark (default 100,400)\n"
+                "  --owners N            number of owners (default 50)\n"
+                "  --degree F            average jumps per system (default 2.5)\n"
+                "  --stations F          fraction of systems with a station (default 0.2)\n"
+                "  --width N --height N  map resolution (default 256x256, the real map is about 5000 systems on 1856x2048)\n"
+                "  --threads N           render and PNG threads, 0 for all cores (default 0)\n"
+                "  --repeat N            repetitions per dataset (default 3)\n"
+                "  --level N             PNG compression level (default 4)\n"
+                "  --seed N              seed for the synthetic data (default 42)\n"
+                "  --output FILE         JSON result file (default benchmark.json)\n"
+                "  --dump FILE           also write the generated universes as FILE.<systems> in the dump.dat format\n"
+                "  --trace FILE          write a Chrome trace of the last repetition as FILE.<systems>.json\n";
+    }
+}
+
+int main(const int argc, char **argv) {
+    Config config;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h") {
+                print_usage();
+                return 0;
+            }
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Missing value for " + arg);
+            }
+            const std::string value = argv[++i];
+            if (arg == "--systems") config.systems = parse_list(value);
+            else if (arg == "--owners") config.owners = std::stoul(value);
+            else if (arg == "--degree") config.degree = std::stod(value);
+            else if (arg == "--stations") config.station_density = std::stod(value);
+            else if (arg == "--width") config.width = std::stoul(value);
+            else if (arg == "--height") config.height = std::stoul(value);
+            else if (arg == "--threads") config.threads = std::stoul(value);
+            else if (arg == "--repeat") config.repeat = std::max(1ul, std::stoul(value));
+            else if (arg == "--level") config.png_level = std::stoi(value);
+            else if (arg == "--seed") config.seed = std::stoul(value);
+            else if (arg == "--output") config.output = value;
+            else if (arg == "--dump") config.dump = value;
+            else if (arg == "--trace") config.trace = value;
+            else throw std::invalid_argument("Unknown option " + arg);
+        }
+        if (config.width == 0 || config.height == 0) {
+            throw std::invalid_argument("Width and height must be positive");
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        print_usage();
+        return 2;
+    }
+
+    std::vector<Result> results;
+    for (const auto system_count: config.systems) {
+        std::cout << "Benchmarking " << system_count << " systems on " << config.width << "x" << config.height
+                << std::endl;
+        run(config, system_count, results);
+    }
+
+    std::printf("%-22s %10s %12s %12s %12s\n", "phase", "systems", "min ms", "median ms", "max ms");
+    for (const auto &[phase, systems, values]: results) {
+        std::printf("%-22s %10u %12.3f %12.3f %12.3f\n", phase.c_str(), systems,
+                    *std::min_element(values.begin(), values.end()), median(values),
+                    *std::max_element(values.begin(), values.end()));
+    }
+    write_json(config, results);
+    std::cout << "Results written to " << config.output << std::endl;
+    return 0;
+}
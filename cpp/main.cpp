@@ -1,8 +1,21 @@
 
+#include <cstring>
 #include <iostream>
 #include <Map.h>
+#include <Tiles.h>
 
-int main() {
+int main(const int argc, char *argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--tile-worker") == 0) {
+        // Reads tile jobs from stdin and writes the results to stdout, see bluemap::run_tile_worker
+        std::ios::sync_with_stdio(false);
+        try {
+            bluemap::run_tile_worker(std::cin, std::cout);
+        } catch (const std::exception &e) {
+            std::cerr << "Tile worker failed: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
     const auto map = std::make_shared<bluemap::Map>();
     map->load_data("../dump.dat");
     map->load_old_owners("../old.n.dat");
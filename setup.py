@@ -4,11 +4,15 @@ from Cython.Build import cythonize
 from setuptools import setup, Extension
 
 GEN_COVERAGE = False
+# Compile in the render statistics (SovMap.stats), they are compiled out otherwise
+GEN_STATS = False
 
 
 macros = [("EVE_MAPPER_PYTHON", "1")]
 if GEN_COVERAGE:
     macros.append(("CYTHON_TRACE_NOGIL", "1"))
+if GEN_STATS:
+    macros.append(("EVE_MAPPER_STATS", "1"))
 
 extensions = [
     Extension(
@@ -17,7 +21,14 @@ extensions = [
             "bluemap/_map.pyx",
             "cpp/Image.cpp",
             "cpp/Map.cpp",
+            "cpp/PngEncoder.cpp",
             "cpp/PyWrapper.cpp",
+            "cpp/Trace.cpp",
+            "cpp/Topology.cpp",
+            "cpp/History.cpp",
+            "cpp/Tiles.cpp",
+            "cpp/FFT.cpp",
+            "cpp/Raster.cpp",
             "cpp/traceback_wrapper.cpp",
         ],
         include_dirs=["cpp"],
@@ -1,13 +1,31 @@
+import os
+import tempfile
 import unittest
 
 import PIL
 import numpy as np
 from PIL import Image, ImageDraw
 
-from bluemap import SovMap, SolarSystem, Region, Owner
+from bluemap import SovMap, SolarSystem, Region, Owner, load_image
 from bluemap._map import Constellation
 from mock_data import mock_owners, mock_systems, mock_connections, mock_regions, alternative_owners
 
+_output_dir = None
+_previous_cwd = None
+
+
+def setUpModule():
+    # The tests write their images and data files into the working directory, keep them out of the repository
+    global _output_dir, _previous_cwd
+    _output_dir = tempfile.TemporaryDirectory()
+    _previous_cwd = os.getcwd()
+    os.chdir(_output_dir.name)
+
+
+def tearDownModule():
+    os.chdir(_previous_cwd)
+    _output_dir.cleanup()
+
 
 class TestSovMap(unittest.TestCase):
     def __init__(self, *args, **kwargs):
@@ -163,6 +181,110 @@ class TestSovMap(unittest.TestCase):
             self.assertColorAlmostEqual(sov_arr, 42, 48, (255, 255, 0, 72), delta=1.5)
             self.assertColorAlmostEqual(sov_arr, 42, 49, (255, 0, 0, 71), delta=1.5)
 
+    def test_old_owner_hatch(self):
+        self._create_mock_map()
+        self.sov_map.render(1)
+        plain = self.sov_map.get_image().as_ndarray().copy()
+        owners = self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0].copy()
+        owner_ids = sorted(int(owner) for owner in np.unique(owners) if owner != 0)
+
+        # Old owners that are not part of the map are ignored
+        old_owners = self.sov_map.get_owner_image()
+        old_owners.as_ndarray()[:] = 987654
+        self.sov_map.load_old_owners(old_owners)
+        self.sov_map.render(3)
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), plain)
+
+        # Every pixel of another owner is hatched on every fifth diagonal
+        self.sov_map.render(1)
+        old_owners = self.sov_map.get_owner_image()
+        old_owners.as_ndarray()[:] = owner_ids[0]
+        self.sov_map.load_old_owners(old_owners)
+        self.sov_map.render(1)
+        single = self.sov_map.get_image().as_ndarray().copy()
+        self.sov_map.render(4)
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), single)
+        self.sov_map.composite(thread_count=3)
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), single)
+        changed = np.argwhere(np.any(single != plain, axis=2))
+        self.assertGreater(len(changed), 0)
+        for y, x in changed:
+            self.assertEqual((y % 5 + x) % 5, 0)
+            self.assertNotEqual(owners[y - 1, x], owner_ids[0])
+
+    def test_render_systems(self):
+        self._create_mock_map(no_colors=True)
+        native = self.sov_map.render_systems(thread_count=1).as_ndarray().copy()
+        # The missing colors are generated like with draw_systems
+        for owner in self.sov_map.owners.values():
+            if not owner.npc and any(system.owner_id == owner.id for system in self.sov_map.systems.values()):
+                self.assertIsNotNone(owner.color)
+        np.testing.assert_array_equal(self.sov_map.render_systems(thread_count=4).as_ndarray(), native)
+        antialiased = self.sov_map.render_systems(antialias=True, thread_count=1).as_ndarray().copy()
+        np.testing.assert_array_equal(
+            self.sov_map.render_systems(antialias=True, thread_count=3).as_ndarray(), antialiased)
+
+        layer = PIL.Image.new("RGBA", (128, 128), (0, 0, 0, 0))
+        self.sov_map.draw_systems(PIL.ImageDraw.Draw(layer))
+        expected = np.asarray(layer)
+        # The markers are opaque and drawn over the jumps, they are identical to PIL
+        for system in self.sov_map.systems.values():
+            for dx in (-1, 0):
+                self.assertEqual(tuple(native[system.y, system.x + dx]), tuple(expected[system.y, system.x + dx]))
+        self.assertGreater(np.count_nonzero(native[:, :, 3] == 0x30), 0)
+        # Away from the markers, the jumps cover the same pixels as with PIL. A pixel of a single jump has the same
+        # color, PIL overwrites where jumps cross instead of blending
+        markers = np.zeros((128, 128), dtype=bool)
+        for system in self.sov_map.systems.values():
+            markers[max(0, system.y - 2):system.y + 3, max(0, system.x - 2):system.x + 3] = True
+        np.testing.assert_array_equal((native[:, :, 3] > 0) & ~markers, (expected[:, :, 3] > 0) & ~markers)
+        single = (native[:, :, 3] == 0x30) & ~markers
+        self.assertGreater(np.count_nonzero(single), 0)
+        np.testing.assert_array_equal(native[single], expected[single])
+        self.assertGreater(np.count_nonzero((antialiased[:, :, 3] > 0) & (antialiased[:, :, 3] < 0x30)), 0)
+
+        # Blended over an opaque image
+        image = np.zeros((128, 128, 4), dtype=np.uint8)
+        image[:, :, 3] = 255
+        self.assertIsNone(self.sov_map.render_systems(out=image))
+        np.testing.assert_array_equal(image[:, :, 3], 255)
+        drawn = native[:, :, 3] == 255
+        np.testing.assert_array_equal(image[drawn], native[drawn])
+        self.assertRaises(ValueError, self.sov_map.render_systems, np.zeros((64, 128, 4), dtype=np.uint8))
+
+    def test_territory_diff(self):
+        self._create_mock_map()
+        self.sov_map.render(2)
+        old = self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0].copy()
+        self.sov_map.save_owner_data("owner.dat")
+        self._create_mock_map(alternate=True)
+        self.assertRaises(RuntimeError, self.sov_map.territory_diff)
+        self.sov_map.load_old_owner_data("owner.dat")
+        self.sov_map.render(2)
+        new = self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0]
+
+        diff = self.sov_map.territory_diff(thread_count=3)
+        owners = diff["owners"]
+        self.assertEqual(owners[0], 0)
+        self.assertEqual(owners, sorted(set(np.unique(old)) | set(np.unique(new))))
+        transfers = diff["transfers"]
+        for i, old_owner in enumerate(owners):
+            for j, new_owner in enumerate(owners):
+                self.assertEqual(transfers[i, j], np.count_nonzero((old == old_owner) & (new == new_owner)))
+            self.assertEqual(diff["gained"][old_owner], np.count_nonzero((new == old_owner) & (old != old_owner)))
+            self.assertEqual(diff["lost"][old_owner], np.count_nonzero((old == old_owner) & (new != old_owner)))
+        self.assertGreater(sum(diff["gained"].values()), 0)
+
+        # Every pixel belongs to exactly one region
+        total = np.zeros_like(transfers)
+        for region_id in {system["region_id"] for system in mock_systems}:
+            region = self.sov_map.territory_diff(region_id, thread_count=2)
+            for i, old_owner in enumerate(region["owners"]):
+                for j, new_owner in enumerate(region["owners"]):
+                    total[owners.index(old_owner), owners.index(new_owner)] += region["transfers"][i, j]
+        np.testing.assert_array_equal(total, transfers)
+        self.assertRaises(RuntimeError, self.sov_map.territory_diff, 123456789)
+
     def test_render_multithreaded(self):
         self._create_mock_map()
         self.sov_map.calculate_influence()
@@ -174,6 +296,310 @@ class TestSovMap(unittest.TestCase):
         self.sov_map.save("test_render_mt_cv2.png", strategy="cv2")
         self.assertRaises(RuntimeError, lambda: self.sov_map.save("test_render_mt_cv2.png", strategy="cv2"))
 
+    def test_composite(self):
+        self._create_mock_map()
+        self.sov_map.calculate_influence()
+        self._render()
+        self.sov_map.calculate_labels()
+        expected = self.sov_map.get_image().as_ndarray()
+        self.sov_map.composite(thread_count=3)
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), expected)
+
+        # Change the styling and compare against a full rendering
+        self.sov_map.save_owner_data("owner.dat")
+        self.sov_map.load_old_owner_data("owner.dat")
+        self.sov_map.border_alpha = 0x80
+        self.sov_map.set_influence_to_alpha_function(lambda influence: min(255.0, influence * 200))
+        next(iter(self.sov_map.owners.values())).color = (12, 34, 56)
+        self.sov_map.composite(thread_count=2)
+        composited = self.sov_map.get_image().as_ndarray()
+        self._render()
+        np.testing.assert_array_equal(composited, self.sov_map.get_image().as_ndarray())
+        self.assertFalse(np.array_equal(composited, expected))
+        self.assertRaises(ValueError, lambda: setattr(self.sov_map, "border_alpha", 256))
+
+    def test_influence_export(self):
+        self._create_mock_map()
+        self.sov_map.calculate_influence()
+        self.assertFalse(self.sov_map.export_influence)
+        self._render()
+        self.assertIsNone(self.sov_map.get_influence_buffer())
+
+        self.sov_map.export_influence = True
+        self.sov_map.render(2)
+        buffer = self.sov_map.get_influence_buffer()
+        self.assertIsNone(self.sov_map.get_influence_buffer())
+        influence = buffer.as_ndarray()
+        self.assertEqual(influence.dtype, np.float32)
+        self.assertEqual(influence.shape, (128, 128, 1))
+        owners = self.sov_map.get_owner_buffer().as_ndarray()
+        self.assertTrue(np.all(influence[owners != 0] >= 0.023))
+        self.assertTrue(np.all(influence[owners == 0] < 0.023))
+        self.assertAlmostEqual(buffer[40, 40], float(influence[40, 40, 0]))
+
+    def test_render_into_buffer(self):
+        self._create_mock_map()
+        self.sov_map.render(2)
+        expected = self.sov_map.get_image().as_ndarray()
+        expected_owners = self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0]
+
+        image = np.full((128, 128, 4), 7, dtype=np.uint8)
+        # Every second column of a bigger array, the owner target does not need to be contiguous
+        owners_base = np.zeros((128, 256), dtype=np.uint64)
+        owners = owners_base[:, ::2]
+        self.sov_map.render(2, out=image, owner_out=owners)
+        np.testing.assert_array_equal(image, expected)
+        np.testing.assert_array_equal(owners, expected_owners)
+        self.assertTrue(np.all(owners_base[:, 1::2] == 0))
+        # The internal image is untouched
+        self.assertIsNone(self.sov_map.get_image())
+
+        image[:] = 0
+        self.sov_map.composite(out=image)
+        np.testing.assert_array_equal(image, expected)
+
+        self.assertRaises(ValueError, lambda: self.sov_map.render(out=np.zeros((128, 127, 4), dtype=np.uint8)))
+        self.assertRaises(ValueError, lambda: self.sov_map.render(out=np.zeros((128, 128, 4), dtype=np.float32)))
+        self.assertRaises(ValueError, lambda: self.sov_map.render(out=np.zeros((128, 256, 4), dtype=np.uint8)[:, ::2]))
+        readonly = np.zeros((128, 128, 4), dtype=np.uint8)
+        readonly.flags.writeable = False
+        self.assertRaises(ValueError, lambda: self.sov_map.render(out=readonly))
+        self.assertRaises(ValueError, lambda: self.sov_map.render(owner_out=np.zeros((128, 128), dtype=np.int32)))
+
+    def test_gil_released(self):
+        import threading
+        self._create_mock_map()
+        self.sov_map.render()
+        phases = {
+            "calculate_influence": lambda: self.sov_map.calculate_influence(),
+            "load_data": lambda: self.sov_map.load_data(
+                owners=mock_owners, systems=mock_systems, connections=mock_connections),
+            "calculate_labels": lambda: self.sov_map.calculate_labels(),
+            "get_owner_buffer": lambda: self.sov_map.get_owner_buffer(),
+            "save": lambda: self.sov_map.save("test_render_gil.png", level=1),
+            "get_image": lambda: self.sov_map.get_image(),
+            "update_size": lambda: self.sov_map.update_size(width=64, height=64),
+        }
+        for name, phase in phases.items():
+            with self.subTest(phase=name):
+                # The callback blocks calculate_influence while it holds the lock of the map, so the phase has to wait
+                # for it. If the phase kept the GIL while waiting, the callback could never return (the test deadlocks).
+                entered = threading.Event()
+                release = threading.Event()
+                errors = []
+
+                def blocking_power(sov_power, has_station, owner_id):
+                    if not entered.is_set():
+                        entered.set()
+                        release.wait()
+                    return 10.0
+
+                def run_phase():
+                    try:
+                        phase()
+                    except Exception as e:
+                        errors.append(e)
+
+                self.sov_map.set_sov_power_function(blocking_power)
+                blocker = threading.Thread(target=self.sov_map.calculate_influence, daemon=True)
+                blocker.start()
+                self.assertTrue(entered.wait(5))
+                worker = threading.Thread(target=run_phase, daemon=True)
+                worker.start()
+                worker.join(0.2)
+                self.assertTrue(worker.is_alive())
+                release.set()
+                blocker.join(5)
+                worker.join(5)
+                self.assertFalse(worker.is_alive())
+                self.assertEqual(errors, [])
+
+    def test_render_async(self):
+        import asyncio
+        import concurrent.futures
+        import time
+        self._create_mock_map()
+        self.sov_map.render()
+        expected = self.sov_map.get_image().as_ndarray()
+
+        future = self.sov_map.render_async(2)
+        self.assertIsNone(future.result(timeout=30))
+        self.assertEqual(future.progress, 1.0)
+        self.assertEqual(self.sov_map.rows_completed, 128)
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), expected)
+
+        async def render():
+            await self.sov_map.render_async(2)
+
+        asyncio.run(render())
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), expected)
+
+        # Slow down the rendering to be able to cancel it
+        def slow_alpha(influence):
+            time.sleep(0.0005)
+            return min(190.0, influence * 100)
+
+        self.sov_map.set_influence_to_alpha_function(slow_alpha)
+        future = self.sov_map.render_async(2)
+        while future.progress == 0.0:
+            time.sleep(0.01)
+        self.assertTrue(future.cancel())
+        # The future completes once the workers have stopped
+        self.assertRaises(concurrent.futures.CancelledError, future.result, timeout=30)
+        self.assertTrue(future.cancelled())
+        self.assertFalse(future.cancel())
+        progress = self.sov_map.render_progress
+        self.assertLess(progress, 1.0)
+        time.sleep(0.1)
+        self.assertEqual(self.sov_map.render_progress, progress)
+
+    def test_render_async_restart(self):
+        import concurrent.futures
+        import time
+        self._create_mock_map()
+
+        def slow_alpha(influence):
+            time.sleep(0.0005)
+            return min(190.0, influence * 100)
+
+        self.sov_map.set_influence_to_alpha_function(slow_alpha)
+        self.sov_map.render()
+        expected = self.sov_map.get_image().as_ndarray()
+
+        future = self.sov_map.render_async(2)
+        while future.progress == 0.0:
+            time.sleep(0.01)
+        # Only one background rendering at a time, also while the cancelled workers are still stopping
+        self.assertRaises(RuntimeError, self.sov_map.render_async, 2)
+        self.assertTrue(future.cancel())
+        self.assertRaises(RuntimeError, self.sov_map.render_async, 2)
+        self.assertRaises(RuntimeError, self.sov_map.render)
+        self.assertRaises(concurrent.futures.CancelledError, future.result, timeout=30)
+
+        # The restarted rendering starts from scratch and produces the full image
+        future = self.sov_map.render_async(2)
+        self.assertIsNone(future.result(timeout=60))
+        self.assertFalse(future.cancelled())
+        self.assertEqual(self.sov_map.rows_completed, 128)
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), expected)
+
+    def test_settings_during_render_async(self):
+        import time
+        self._create_mock_map()
+
+        # The workers hold the lock of the map and need the GIL for the callback, the settings have to wait for the
+        # rendering without holding the GIL (the test deadlocks otherwise)
+        def slow_alpha(influence):
+            time.sleep(0.0002)
+            return min(190.0, influence * 100)
+
+        self.sov_map.set_influence_to_alpha_function(slow_alpha)
+        settings = {
+            "kernel": lambda: self.sov_map.kernel,
+            "set_kernel": lambda: self.sov_map.set_kernel("inverse_square"),
+            "single_precision": lambda: self.sov_map.single_precision,
+            "set_single_precision": lambda: setattr(self.sov_map, "single_precision", False),
+            "engine": lambda: self.sov_map.engine,
+            "set_engine": lambda: setattr(self.sov_map, "engine", "gather"),
+        }
+        for name, setting in settings.items():
+            with self.subTest(setting=name):
+                future = self.sov_map.render_async(2)
+                while future.progress == 0.0:
+                    time.sleep(0.01)
+                self.assertFalse(future.done())
+                setting()
+                self.assertIsNone(future.result(timeout=30))
+
+    def test_stats(self):
+        self._create_mock_map()
+        self.sov_map.reset_stats()
+        stats = self.sov_map.stats
+        self.assertEqual(stats["pixels"], 0)
+        if not stats["enabled"]:
+            self.sov_map.render()
+            self.assertEqual(self.sov_map.stats, stats)
+            self.skipTest("Extension compiled without EVE_MAPPER_STATS")
+        self.sov_map.set_influence_to_alpha_function(lambda influence: min(190.0, influence * 100))
+        self.sov_map.render(2)
+        stats = self.sov_map.stats
+        pixels = self.sov_map.width * self.sov_map.height
+        self.assertEqual(stats["pixels"], pixels)
+        self.assertEqual(len(stats["worker_busy_ms"]), 2)
+        self.assertIn("calculate_influence", stats["phases_ms"])
+        self.assertIn("render", stats["phases_ms"])
+        self.assertGreater(stats["systems_visited"], 0)
+        self.assertGreaterEqual(stats["owner_contributions"], stats["systems_visited"])
+        self.assertGreater(stats["callback_calls"], 0)
+        self.sov_map.reset_stats()
+        self.assertEqual(self.sov_map.stats["phases_ms"], {})
+
+    def test_trace(self):
+        import json
+        self._create_mock_map()
+        self.sov_map.start_trace()
+        self.sov_map.render(2)
+        self.sov_map.composite(2)
+        self.sov_map.stop_trace()
+        self.sov_map.save_trace("test_trace.json")
+        with open("test_trace.json") as f:
+            trace = json.load(f)
+        spans = [e for e in trace["traceEvents"] if e["ph"] == "X"]
+        names = {e["name"] for e in spans}
+        for name in ("calculate_influence", "render_worker", "rows", "wait_map_lock", "paste_cache", "composite"):
+            self.assertIn(name, names)
+        workers = [e for e in spans if e["name"] == "render_worker"]
+        self.assertEqual(len(workers), 2)
+        self.assertEqual(sorted(e["args"]["start"] for e in workers), [0, 64])
+        # The row bands of every worker cover the whole height. A fast worker may finish before the pool starts a
+        # second thread, so the bands are matched by thread and time.
+        for worker in workers:
+            rows = sorted((e["args"]["start"], e["args"]["end"]) for e in spans
+                          if e["name"] == "rows" and e["tid"] == worker["tid"] and
+                          worker["ts"] <= e["ts"] <= worker["ts"] + worker["dur"])
+            self.assertEqual(rows[0][0], 0)
+            self.assertEqual(rows[-1][1], 128)
+            self.assertTrue(all(a[1] == b[0] for a, b in zip(rows, rows[1:])))
+        # Nothing is recorded after stop_trace
+        count = len(trace["traceEvents"])
+        self.sov_map.render(2)
+        self.sov_map.save_trace("test_trace.json")
+        with open("test_trace.json") as f:
+            self.assertEqual(len(json.load(f)["traceEvents"]), count)
+
+    def test_save_native(self):
+        self._create_mock_map()
+        self.sov_map.calculate_influence()
+        self.sov_map.render(2)
+        for level in (0, 1, 4, 9):
+            self.sov_map.save(f"test_render_native_{level}.png", level=level, thread_count=3)
+        self.assertRaises(ValueError, lambda: self.sov_map.save("test_render_native.png", level=10))
+        expected = self.sov_map.get_image().as_ndarray()
+        for level in (0, 1, 4, 9):
+            with PIL.Image.open(f"test_render_native_{level}.png") as img:
+                self.assertEqual(img.mode, "RGBA")
+                np.testing.assert_array_equal(np.array(img), expected)
+        # The image has been retrieved from the map
+        self.assertRaises(RuntimeError, lambda: self.sov_map.save("test_render_native.png"))
+
+    def test_save_intermediate(self):
+        self._create_mock_map()
+        self.sov_map.calculate_influence()
+        self.sov_map.render(2)
+        self.sov_map.save("test_render.qoi")
+        self.sov_map.save("test_render.raw")
+        self.sov_map.save("test_render_qoi.bin", image_format="qoi")
+        self.assertRaises(ValueError, lambda: self.sov_map.save("test_render.qoi", strategy="PIL"))
+        self.assertRaises(ValueError, lambda: self.sov_map.save("test_render.bin", image_format="bmp"))
+        expected = self.sov_map.get_image().as_ndarray()
+        for path in ("test_render.qoi", "test_render.raw", "test_render_qoi.bin"):
+            buffer = load_image(path)
+            self.assertEqual(buffer.size, (128, 128))
+            np.testing.assert_array_equal(buffer.as_ndarray(), expected)
+        with open("test_render_invalid.bin", "wb") as f:
+            f.write(b"\x89PNG\r\n\x1a\n" + bytes(32))
+        self.assertRaises(RuntimeError, lambda: load_image("test_render_invalid.bin"))
+
     def test_influences(self):
         self._create_mock_map()
         self.sov_map.set_sov_power_function(
@@ -194,6 +620,395 @@ class TestSovMap(unittest.TestCase):
                 self.assertAlmostEqual(expected[sys.id][owner_id], influence, delta=0.01,
                                        msg=f"System {sys.id} has wrong influence for owner {owner_id}")
 
+    def test_native_callbacks(self):
+        import ctypes
+        import ctypes.util
+        import math
+        import sys
+        libm_name = ctypes.util.find_library("m")
+        if libm_name is None:
+            self.skipTest("libm not found")
+        libm = ctypes.CDLL(libm_name)
+        native_sqrt = ctypes.CFUNCTYPE(ctypes.c_double, ctypes.c_double)(("sqrt", libm))
+
+        self._create_mock_map()
+        self.sov_map.set_influence_to_alpha_function(lambda influence: math.sqrt(influence))
+        self.sov_map.render(2)
+        expected = self.sov_map.get_image().as_ndarray()
+        self.sov_map.set_influence_to_alpha_function(native_sqrt)
+        self.sov_map.render(2)
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), expected)
+
+        # ctypes callbacks of Python functions work as well, they acquire the GIL on their own
+        power_type = ctypes.CFUNCTYPE(ctypes.c_double, ctypes.c_double, ctypes.c_bool, ctypes.c_uint64)
+        power = power_type(lambda sov_power, _, __: 10.0 * (6 if sov_power >= 6.0 else sov_power / 2.0))
+        self._create_mock_map()
+        self.sov_map.set_sov_power_function(power)
+        self.sov_map.calculate_influence()
+        self.assertAlmostEqual(self.sov_map.systems[100].get_influences()[1], 25.0, delta=0.01)
+
+        self._create_mock_map(no_colors=True)
+        color_type = ctypes.CFUNCTYPE(ctypes.c_uint32, ctypes.c_uint64)
+        self.sov_map.set_generate_owner_color_function(color_type(lambda owner_id: 0x102030))
+        self.sov_map.render()
+        image = self.sov_map.get_image().as_ndarray()
+        colors = {tuple(int(c) for c in pixel[:3]) for pixel in image[image[:, :, 3] > 0]}
+        self.assertEqual(colors, {(0x10, 0x20, 0x30)})
+
+        wrong = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_double)(lambda influence: 0)
+        self.assertRaises(TypeError, self.sov_map.set_influence_to_alpha_function, wrong)
+
+        # Setting a function again replaces the reference the map holds instead of adding another one
+        alpha = ctypes.CFUNCTYPE(ctypes.c_double, ctypes.c_double)(lambda influence: 100.0)
+        self.sov_map.set_influence_to_alpha_function(alpha)
+        references = sys.getrefcount(alpha)
+        self.sov_map.set_influence_to_alpha_function(alpha)
+        self.assertEqual(sys.getrefcount(alpha), references)
+        self.sov_map.set_influence_to_alpha_function(lambda influence: 100.0)
+        self.assertEqual(sys.getrefcount(alpha), references - 1)
+
+    def test_topology_snapshot(self):
+        self._create_mock_map(alternate=True)
+        self.sov_map.render(2)
+        expected_alternate = self.sov_map.get_image().as_ndarray().copy()
+        self._create_mock_map()
+        self.sov_map.render(2)
+        expected = self.sov_map.get_image().as_ndarray().copy()
+        topology = self.sov_map.create_topology()
+        self.assertEqual(len(topology), len(self.sov_map.systems))
+        self.assertEqual((topology.width, topology.height), (128, 128))
+
+        snapshot_map = SovMap(width=128, height=128, offset_x=-32, offset_y=-32)
+        snapshot_map.update_size(width=128, height=128, sample_rate=8)
+        for systems, image in ((mock_systems, expected), (alternative_owners(), expected_alternate)):
+            snapshot_map.load_snapshot(topology, mock_owners, systems)
+            snapshot_map.render(2)
+            np.testing.assert_array_equal(snapshot_map.get_image().as_ndarray(), image)
+        # The original map is not affected by the snapshots
+        self.sov_map.render(2)
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), expected)
+
+        small_map = SovMap(width=64, height=64)
+        self.assertRaises(ValueError, small_map.load_snapshot, topology, mock_owners, mock_systems)
+
+    def test_shared_state(self):
+        from pathlib import Path
+        self._create_mock_map()
+        self.sov_map.render(2)
+        self.sov_map.save_owner_data("owner.dat")
+        self._create_mock_map(alternate=True)
+        self.sov_map.load_old_owner_data("owner.dat")
+        self.sov_map.render(2)
+        expected = self.sov_map.get_image().as_ndarray().copy()
+
+        shm = self.sov_map.export_shared()
+        self.sov_map.save_shared("test_shared_state.bin")
+        try:
+            # A str is a file if it names one, otherwise a shared memory segment
+            for source in (shm.name, Path("test_shared_state.bin"), "test_shared_state.bin"):
+                attached = SovMap(width=128, height=128)
+                attached.attach_shared(source)
+                self.assertTrue(attached.calculated)
+                self.assertEqual(set(attached.owners), set(self.sov_map.owners))
+                attached.render(2)
+                np.testing.assert_array_equal(attached.get_image().as_ndarray(), expected)
+                # The influence can be calculated again from the shared ownership
+                attached.calculate_influence()
+                attached.render(2)
+                np.testing.assert_array_equal(attached.get_image().as_ndarray(), expected)
+                owners = attached.owners
+                del attached
+                # The owners are stored in one block with the map, they stay valid without the map
+                self.assertEqual({owner.id: owner.color for owner in owners.values()},
+                                 {owner.id: owner.color for owner in self.sov_map.owners.values()})
+            self.assertRaises(RuntimeError, SovMap(width=64, height=64).attach_shared, shm.name)
+            self.assertRaises(RuntimeError, SovMap(width=128, height=128).attach_shared, bytes(256))
+            self.assertRaises(FileNotFoundError, SovMap(width=128, height=128).attach_shared, "missing_state_segment")
+            self.assertRaises(FileNotFoundError, SovMap(width=128, height=128).attach_shared, Path("missing.bin"))
+        finally:
+            shm.close()
+            shm.unlink()
+
+        # The render settings are part of the state
+        self.sov_map.set_kernel("linear", cutoff=150)
+        self.sov_map.single_precision = True
+        self.sov_map.engine = "scatter"
+        self.sov_map.save_shared("test_shared_state.bin")
+        attached = SovMap(width=128, height=128)
+        attached.attach_shared(Path("test_shared_state.bin"))
+        self.assertEqual(attached.kernel, self.sov_map.kernel)
+        self.assertTrue(attached.single_precision)
+        self.assertEqual(attached.engine, "scatter")
+
+    def test_owner_history(self):
+        from bluemap import OwnerHistory
+        rasters = []
+        for alternate in (False, True, False):
+            self._create_mock_map(alternate=alternate)
+            self.sov_map.render(2)
+            rasters.append(self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0].copy())
+        history = OwnerHistory(128, 128, keyframe_interval=2)
+        history.append(10, rasters[0])
+        history.append(11, rasters[1])
+        history.append(12, rasters[2])
+        self.assertEqual(history.dates, [10, 11, 12])
+        self.assertRaises(RuntimeError, history.append, 12, rasters[0])
+        self.assertRaises(ValueError, history.append, 13, np.zeros((64, 64), dtype=np.uint64))
+
+        for thread_count in (1, 3):
+            for date, raster in zip((10, 11, 12), rasters):
+                image = history.get(date, thread_count=thread_count)
+                np.testing.assert_array_equal(image.as_ndarray()[:, :, 0], raster)
+        # Dates in between resolve to the newest image before them
+        np.testing.assert_array_equal(history.get(100).as_ndarray()[:, :, 0], rasters[2])
+        self.assertRaises(KeyError, history.get, 9)
+
+        history.save("test_history.bin")
+        loaded = OwnerHistory.load("test_history.bin")
+        self.assertEqual(loaded.dates, history.dates)
+        self.assertEqual(loaded.run_count, history.run_count)
+        np.testing.assert_array_equal(loaded.get(11).as_ndarray()[:, :, 0], rasters[1])
+        # Appending continues from the last image
+        loaded.append(13, rasters[1])
+        np.testing.assert_array_equal(loaded.get(13).as_ndarray()[:, :, 0], rasters[1])
+
+        # The reconstructed image can be used for the old owner overlay
+        self._create_mock_map(alternate=True)
+        self.sov_map.load_old_owners(history.get(10))
+        self.sov_map.render(2)
+
+    def test_owner_history_corrupt(self):
+        import struct
+        from bluemap import OwnerHistory
+        self.addCleanup(os.remove, "test_history_corrupt.bin")
+
+        def write(frames, frame_count=None):
+            # frames: list of (date, keyframe, [(start, length, owner), ...], run_count or None)
+            data = b"SOVHV1.0" + struct.pack(">iiiI", 8, 8, 30, len(frames) if frame_count is None else frame_count)
+            for date, keyframe, runs, run_count in frames:
+                data += struct.pack(">qBI", date, keyframe, len(runs) if run_count is None else run_count)
+                for run in runs:
+                    data += struct.pack(">IIQ", *run)
+            with open("test_history_corrupt.bin", "wb") as f:
+                f.write(data)
+            return "test_history_corrupt.bin"
+
+        valid = [(1, 1, [(0, 4, 7), (10, 2, 8)], None), (2, 0, [(4, 1, 9)], None)]
+        history = OwnerHistory.load(write(valid))
+        self.assertEqual(history.dates, [1, 2])
+        self.assertEqual(history.get(2).as_ndarray()[0, 4, 0], 9)
+
+        # Counts larger than the rest of the file are rejected before anything is allocated
+        self.assertRaises(RuntimeError, OwnerHistory.load, write(valid, frame_count=0xFFFFFFFF))
+        self.assertRaises(RuntimeError, OwnerHistory.load, write([(1, 1, [(0, 4, 7)], 0xFFFFFFFF)]))
+        self.assertRaises(RuntimeError, OwnerHistory.load, write(valid, frame_count=3))
+        # The dates have to be strictly increasing
+        self.assertRaises(RuntimeError, OwnerHistory.load, write([valid[0], (1, 0, [(4, 1, 9)], None)]))
+        self.assertRaises(RuntimeError, OwnerHistory.load, write([(5, 1, [], None), (2, 0, [], None)]))
+        # Runs out of range, overlapping or unsorted
+        self.assertRaises(RuntimeError, OwnerHistory.load, write([(1, 1, [(60, 5, 7)], None)]))
+        self.assertRaises(RuntimeError, OwnerHistory.load, write([(1, 1, [(0, 4, 7), (3, 2, 8)], None)]))
+        self.assertRaises(RuntimeError, OwnerHistory.load, write([(1, 1, [(10, 2, 8), (0, 4, 7)], None)]))
+        # The first frame has to be a keyframe
+        self.assertRaises(RuntimeError, OwnerHistory.load, write([(1, 0, [], None)]))
+        # A truncated file
+        with open(write(valid), "rb") as f:
+            data = f.read()
+        with open("test_history_corrupt.bin", "wb") as f:
+            f.write(data[:-3])
+        self.assertRaises(RuntimeError, OwnerHistory.load, "test_history_corrupt.bin")
+
+    def test_tile_jobs(self):
+        import subprocess
+        import sys
+        from pathlib import Path
+        from bluemap import TileMerger, create_tile_jobs, execute_tile_job
+        from bluemap.tile_worker import read_message, write_message
+        self._create_mock_map()
+        self.sov_map.render(2)
+        self.sov_map.save_owner_data("owner.dat")
+        self._create_mock_map(alternate=True)
+        self.sov_map.load_old_owner_data("owner.dat")
+        self.sov_map.render(2)
+        self.sov_map.calculate_labels()
+        self.sov_map.save_shared("test_shared_state.bin")
+
+        # The tile size is no multiple of the sample rate, so label areas are split between tiles
+        jobs = create_tile_jobs("test_shared_state.bin", 128, 128, tile_size=44)
+        self.assertEqual(len(jobs), 9)
+        env = dict(os.environ, PYTHONPATH=str(Path(__import__("bluemap").__file__).parent.parent))
+        workers = [
+            subprocess.Popen([sys.executable, "-m", "bluemap.tile_worker"], stdin=subprocess.PIPE,
+                             stdout=subprocess.PIPE, env=env)
+            for _ in range(2)
+        ]
+        merger = TileMerger(128, 128)
+        try:
+            for i, job in enumerate(jobs):
+                write_message(workers[i % 2].stdin, job)
+            for i in range(len(jobs)):
+                merger.add(read_message(workers[i % 2].stdout))
+        finally:
+            for worker in workers:
+                worker.stdin.close()
+                worker.wait(timeout=60)
+        self.assertEqual(merger.covered_pixels, 128 * 128)
+        np.testing.assert_array_equal(merger.get_image().as_ndarray(), self.sov_map.get_image().as_ndarray())
+        np.testing.assert_array_equal(merger.get_owner_buffer().as_ndarray(),
+                                      self.sov_map.get_owner_buffer().as_ndarray())
+        self.assertEqual(
+            [(l.owner_id, l.x, l.y, l.count) for l in merger.get_labels()],
+            [(l.owner_id, l.x, l.y, l.count) for l in self.sov_map.get_owner_labels()])
+
+        # Jobs can also be executed in this process
+        self.assertEqual(execute_tile_job(jobs[4]), execute_tile_job(jobs[4]))
+        self.assertRaises(RuntimeError, execute_tile_job, b"invalid")
+        self.assertRaises(RuntimeError, TileMerger(64, 64).add, execute_tile_job(jobs[8]))
+
+        # A rewritten state is loaded again, the kernel and precision are part of it
+        self.sov_map.set_kernel("gaussian", 30, cutoff=120)
+        self.sov_map.single_precision = True
+        self.sov_map.render(2)
+        self.sov_map.save_shared("test_shared_state.bin")
+        merger = TileMerger(128, 128)
+        merger.add(execute_tile_job(jobs[4]))
+        np.testing.assert_array_equal(merger.get_image().as_ndarray()[44:88, 44:88],
+                                      self.sov_map.get_image().as_ndarray()[44:88, 44:88])
+
+    def test_render_viewport(self):
+        self._create_mock_map()
+        self.sov_map.render(2)
+        self.sov_map.save_owner_data("owner.dat")
+        self._create_mock_map(alternate=True)
+        self.sov_map.load_old_owner_data("owner.dat")
+        self.sov_map.render(2)
+        expected = self.sov_map.get_image().as_ndarray()
+        expected_owners = self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0]
+
+        # At zoom 1, the viewport matches the same area of the full image
+        owners = np.zeros((64, 80), dtype=np.uint64)
+        image = self.sov_map.render_viewport(20, 30, 80, 64, thread_count=3, owner_out=owners)
+        self.assertEqual(image.size, (80, 64))
+        np.testing.assert_array_equal(image.as_ndarray(), expected[30:94, 20:100])
+        np.testing.assert_array_equal(owners, expected_owners[30:94, 20:100])
+        # Also at the edges of the map
+        np.testing.assert_array_equal(self.sov_map.render_viewport(0, 0, 128, 128, thread_count=2).as_ndarray(),
+                                      expected)
+        for x, y in ((0, 0), (96, 0), (0, 96), (96, 96)):
+            np.testing.assert_array_equal(self.sov_map.render_viewport(x, y, 32, 32).as_ndarray(),
+                                          expected[y:y + 32, x:x + 32])
+
+        # Zoomed in, every map pixel covers 4x4 output pixels
+        out = np.zeros((256, 320, 4), dtype=np.uint8)
+        self.assertIsNone(self.sov_map.render_viewport(20, 30, 80, 64, 320, 256, thread_count=2, out=out))
+        zoomed_owners = np.zeros((256, 320), dtype=np.uint64)
+        self.sov_map.render_viewport(20, 30, 80, 64, 320, 256, owner_out=zoomed_owners)
+        np.testing.assert_array_equal(zoomed_owners[::4, ::4], owners)
+        self.assertGreater(np.count_nonzero(out[:, :, 3]), 0)
+
+        # Regions far away from all systems are empty
+        empty = self.sov_map.render_viewport(10000, 10000, 16, 16)
+        self.assertEqual(np.count_nonzero(empty.as_ndarray()), 0)
+        self.assertRaises(ValueError, self.sov_map.render_viewport, 0, 0, 0, 10)
+        self.assertRaises(ValueError, self.sov_map.render_viewport, 0, 0, 10, 10, out=np.zeros((5, 5, 4), np.uint8))
+
+    def test_kernels(self):
+        self._create_mock_map()
+        self.assertEqual(self.sov_map.kernel, {"name": "inverse_square", "parameter": 500, "cutoff": 400,
+                                               "threshold": 0.023})
+        self.sov_map.render(2)
+        default = self.sov_map.get_image().as_ndarray().copy()
+        # The defaults of the inverse square kernel are the classic constants
+        self.sov_map.set_kernel("inverse_square")
+        self.sov_map.render(2)
+        np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), default)
+
+        for name, parameter in (("gaussian", 30), ("linear", None)):
+            self.sov_map.set_kernel(name, parameter, cutoff=120)
+            self.assertEqual(self.sov_map.kernel["name"], name)
+            self.sov_map.render(2)
+            image = self.sov_map.get_image().as_ndarray().copy()
+            self.assertGreater(np.count_nonzero(image[:, :, 3]), 0)
+            self.assertFalse(np.array_equal(image, default))
+            # All render paths use the same kernel
+            viewport = self.sov_map.render_viewport(0, 0, 128, 128, thread_count=2)
+            np.testing.assert_array_equal(viewport.as_ndarray(), image)
+
+        # A tiny cutoff leaves the map empty
+        self.sov_map.set_kernel("inverse_square", cutoff=0.5, threshold=10)
+        self.sov_map.render(2)
+        self.assertEqual(np.count_nonzero(self.sov_map.get_image().as_ndarray()), 0)
+        self.assertRaises(ValueError, self.sov_map.set_kernel, "unknown")
+        self.assertRaises(ValueError, self.sov_map.set_kernel, "gaussian", 0)
+        self.assertRaises(ValueError, self.sov_map.set_kernel, "linear", cutoff=-1)
+        # The linear kernel has no parameter, it is not silently dropped
+        self.assertRaises(ValueError, self.sov_map.set_kernel, "linear", 5)
+
+    def test_single_precision(self):
+        self._create_mock_map()
+        self.assertFalse(self.sov_map.single_precision)
+        self.sov_map.render(2)
+        double = self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0].copy()
+        self.sov_map.single_precision = True
+        self.assertTrue(self.sov_map.single_precision)
+        self.sov_map.render(2)
+        single = self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0]
+
+        report = self.sov_map.compare_precision(thread_count=2)
+        self.assertEqual(report["pixels"], 128 * 128)
+        # Only close ties may change their owner
+        self.assertLess(report["owner_differences"], 128 * 128 // 100)
+        self.assertEqual(report["owner_differences"] + report["alpha_differences"], len(report["differences"]))
+        for x, y, double_owner, float_owner, _, _ in report["differences"]:
+            self.assertEqual(double[y, x], double_owner)
+            self.assertEqual(single[y, x], float_owner)
+        self.assertEqual(int(np.count_nonzero(double != single)), report["owner_differences"])
+        self.assertEqual(len(self.sov_map.compare_precision(max_reported=0)["differences"]), 0)
+
+    def test_fft_engine(self):
+        self._create_mock_map()
+        self.assertEqual(self.sov_map.engine, "gather")
+        for name, parameter in (("inverse_square", None), ("gaussian", 30)):
+            self.sov_map.engine = "gather"
+            self.sov_map.set_kernel(name, parameter)
+            self.sov_map.render(2)
+            image = self.sov_map.get_image().as_ndarray().copy()
+            owners = self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0].copy()
+
+            self.sov_map.engine = "fft"
+            self.sov_map.render(2)
+            self.assertAlmostEqual(self.sov_map.render_progress, 1.0)
+            fft_owners = self.sov_map.get_owner_buffer().as_ndarray()[:, :, 0]
+            report = self.sov_map.compare_engine(thread_count=2)
+            self.assertEqual(report["pixels"], 128 * 128)
+            self.assertEqual(int(np.count_nonzero(owners != fft_owners)), report["owner_differences"])
+            self.assertLess(report["owner_differences"], 128 * 128 // 1000)
+            self.assertLess(report["max_influence_error"], 1e-6)
+            fft_image = self.sov_map.get_image().as_ndarray()
+            self.assertLess(np.count_nonzero(np.any(image != fft_image, axis=2)), 128 * 128 // 100)
+        with self.assertRaises(ValueError):
+            self.sov_map.engine = "unknown"
+
+    def test_scatter_engine(self):
+        self._create_mock_map()
+        for single_precision in (False, True):
+            self.sov_map.single_precision = single_precision
+            self.sov_map.engine = "gather"
+            self.sov_map.render(2)
+            image = self.sov_map.get_image().as_ndarray().copy()
+            owners = self.sov_map.get_owner_buffer().as_ndarray().copy()
+
+            self.sov_map.engine = "scatter"
+            self.assertEqual(self.sov_map.engine, "scatter")
+            self.sov_map.render(3)
+            # The systems are summed up in the same order, so the result is identical
+            np.testing.assert_array_equal(self.sov_map.get_image().as_ndarray(), image)
+            np.testing.assert_array_equal(self.sov_map.get_owner_buffer().as_ndarray(), owners)
+            report = self.sov_map.compare_engine(thread_count=2)
+            self.assertEqual(report["owner_differences"], 0)
+            if not single_precision:
+                self.assertEqual(report["max_influence_error"], 0.0)
+
     def test_color_gen(self):
         self._create_mock_map(no_colors=True)
         self.sov_map.calculate_influence()
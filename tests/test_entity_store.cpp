@@ -0,0 +1,119 @@
+// Unit test of the EntityStore (cpp/EntityStore.h), run with ctest. Plain checks instead of assert(), as the tests
+// are built in release mode.
+#include <EntityStore.h>
+
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            ++failures; \
+        } \
+    } while (false)
+
+    struct Entity {
+        unsigned long long id;
+        std::string name;
+
+        Entity(const unsigned long long id, std::string name) : id(id), name(std::move(name)) {
+        }
+
+        [[nodiscard]] unsigned long long get_id() const {
+            return id;
+        }
+    };
+
+    void test_indices() {
+        bluemap::EntityStore<Entity> store;
+        CHECK(store.empty());
+        store.emplace(7, "a");
+        store.emplace(3, "b");
+        store.insert(std::make_shared<Entity>(11, "c"));
+        CHECK(store.size() == 3);
+        // Dense indices in insertion order
+        CHECK(store.index_of(7) == 0);
+        CHECK(store.index_of(3) == 1);
+        CHECK(store.index_of(11) == 2);
+        CHECK(store.index_of(5) == bluemap::EntityStore<Entity>::NO_INDEX);
+        CHECK(store[1]->name == "b");
+        CHECK(store.find(11)->name == "c");
+        CHECK(store.find(5) == nullptr);
+        CHECK(store.get(5) == nullptr);
+        bool thrown = false;
+        try {
+            (void) store.at(5);
+        } catch (const std::out_of_range &) {
+            thrown = true;
+        }
+        CHECK(thrown);
+        thrown = false;
+        try {
+            store.insert(nullptr);
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    void test_replace() {
+        bluemap::EntityStore<Entity> store;
+        const auto old_entity = store.emplace(7, "old");
+        store.emplace(8, "other");
+        const auto new_entity = store.emplace(7, "new");
+        // The replacement keeps the index, the old entity stays valid for its holders
+        CHECK(store.size() == 2);
+        CHECK(store.index_of(7) == 0);
+        CHECK(store.get(7) == new_entity);
+        CHECK(store.find(7)->name == "new");
+        CHECK(old_entity->name == "old");
+        const auto external = std::make_shared<Entity>(8, "external");
+        store.insert(external);
+        CHECK(store.index_of(8) == 1);
+        CHECK(store.get(8) == external);
+    }
+
+    void test_clear_and_lifetime() {
+        std::weak_ptr<Entity> released;
+        std::shared_ptr<Entity> kept;
+        {
+            bluemap::EntityStore<Entity> store;
+            kept = store.emplace(1, "kept");
+            released = store.emplace(2, "released");
+            store.clear();
+            CHECK(store.empty());
+            CHECK(store.find(1) == nullptr);
+            CHECK(store.index_of(1) == bluemap::EntityStore<Entity>::NO_INDEX);
+            // The entities of the old arena live as long as a pointer into it
+            CHECK(kept->name == "kept");
+            CHECK(!released.expired());
+            // New entities go into a new arena and get fresh indices
+            store.emplace(2, "new");
+            CHECK(store.index_of(2) == 0);
+            CHECK(store.find(2)->name == "new");
+            CHECK(released.lock()->name == "released");
+        }
+        CHECK(kept->name == "kept");
+        kept = nullptr;
+        // The last pointer into the arena released it
+        CHECK(released.expired());
+    }
+}
+
+int main() {
+    test_indices();
+    test_replace();
+    test_clear_and_lifetime();
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}